@@ -0,0 +1,49 @@
+/*
+ * IngestQueue.cpp
+ * Description: implementation of the BLE to loop() frame queue
+ * Author: Tom Schwenke
+ * Date: 19/10/2026
+ */
+#include "IngestQueue.h"
+
+IngestQueue::IngestQueue() : head(NULL), tail(NULL), count(0), highWater(0) {
+}
+
+void IngestQueue::push(IngestFrame* frame){
+    frame->next = NULL;
+    std::lock_guard<std::mutex> guard(lock);
+    if(tail == NULL){
+        head = frame;
+    }
+    else{
+        tail->next = frame;
+    }
+    tail = frame;
+    count++;
+    if(count > highWater){
+        highWater = count;
+    }
+}
+
+IngestFrame* IngestQueue::pop(){
+    std::lock_guard<std::mutex> guard(lock);
+    IngestFrame* frame = head;
+    if(frame != NULL){
+        head = frame->next;
+        if(head == NULL){
+            tail = NULL;
+        }
+        count--;
+    }
+    return frame;
+}
+
+uint16_t IngestQueue::depth(){
+    std::lock_guard<std::mutex> guard(lock);
+    return count;
+}
+
+uint16_t IngestQueue::maxDepth(){
+    std::lock_guard<std::mutex> guard(lock);
+    return highWater;
+}
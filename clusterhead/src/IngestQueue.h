@@ -0,0 +1,45 @@
+/*
+ * IngestQueue.h
+ * Description: hands frames received in BLE callbacks over to loop(). Callbacks only copy
+ *              the frame into a pooled IngestFrame and queue it, all decoding, storage and
+ *              fusion then happen on the application thread.
+ * Author: Tom Schwenke
+ * Date: 19/10/2026
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mutex>
+
+//the largest notification Device OS sends, so a full relay batch from a downstream clusterhead fits
+const size_t INGEST_FRAME_DATA = 244;
+
+struct IngestFrame {
+    IngestFrame* next;
+    uint8_t tag;            //INGEST_ tag of the characteristic it arrived on
+    uint8_t length;
+    uint32_t receivedAt;    //millis() at the clusterhead
+    uint8_t data[INGEST_FRAME_DATA];
+};
+
+/* Intrusive FIFO of pooled frames, so queueing never allocates */
+class IngestQueue {
+public:
+    IngestQueue();
+
+    void push(IngestFrame* frame);
+
+    // Oldest frame, or NULL if empty. Ownership passes to the caller
+    IngestFrame* pop();
+
+    uint16_t depth();
+    uint16_t maxDepth();
+
+private:
+    std::mutex lock;
+    IngestFrame* head;
+    IngestFrame* tail;
+    uint16_t count;
+    uint16_t highWater;
+};
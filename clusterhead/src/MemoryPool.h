@@ -0,0 +1,85 @@
+/*
+ * MemoryPool.h
+ * Description: typed fixed-block pool allocator. All blocks are reserved up front, so
+ *              buffers taken and returned at runtime never touch the heap and can't
+ *              fragment it. Allocation and release are O(1) off a free list.
+ *              Does not depend on Particle.h, so it can also be built on a host.
+ * Author: Tom Schwenke
+ * Date: 19/10/2026
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+#include <mutex>
+
+struct MemoryPoolStats {
+    uint16_t capacity;
+    uint16_t inUse;
+    uint16_t highWater;         //most blocks ever in use at once
+    uint32_t allocations;
+    uint32_t failedAllocations; //requests made while the pool was exhausted
+};
+
+template <typename T, size_t N>
+class MemoryPool {
+public:
+    MemoryPool() : freeList(NULL) {
+        stats = { (uint16_t) N, 0, 0, 0, 0 };
+        for(size_t i = 0; i < N; i++){
+            slots[i].next = freeList;
+            freeList = &slots[i];
+        }
+    }
+
+    // Take a block and default construct a T in it. Returns NULL if the pool is exhausted
+    T* allocate(){
+        Slot* slot;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if(freeList == NULL){
+                stats.failedAllocations++;
+                return NULL;
+            }
+            slot = freeList;
+            freeList = slot->next;
+            stats.allocations++;
+            stats.inUse++;
+            if(stats.inUse > stats.highWater){
+                stats.highWater = stats.inUse;
+            }
+        }
+        return new (slot->storage) T();
+    }
+
+    // Destroy a T taken from this pool and return its block. NULL is ignored
+    void release(T* item){
+        if(item == NULL){
+            return;
+        }
+        item->~T();
+        Slot* slot = reinterpret_cast<Slot*>(item);
+        std::lock_guard<std::mutex> guard(lock);
+        slot->next = freeList;
+        freeList = slot;
+        stats.inUse--;
+    }
+
+    MemoryPoolStats getStats(){
+        std::lock_guard<std::mutex> guard(lock);
+        return stats;
+    }
+
+private:
+    //a free block holds the free list link, an allocated one holds the T
+    union Slot {
+        Slot* next;
+        alignas(T) uint8_t storage[sizeof(T)];
+    };
+
+    Slot slots[N];
+    Slot* freeList;
+    MemoryPoolStats stats;
+    std::mutex lock;
+};
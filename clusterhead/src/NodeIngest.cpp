@@ -0,0 +1,231 @@
+/*
+ * NodeIngest.cpp
+ * Description: implementation of the clusterhead's handling of node frames
+ * Author: Tom Schwenke
+ * Date: 19/10/2026
+ */
+#include "NodeIngest.h"
+
+//series of each sensor index in a node's frames, in the order of that node's samplers array
+static const uint8_t STREAM_SERIES_1[STREAM_SENSORS] = { SERIES_TEMPERATURE_1, SERIES_HUMIDITY, SERIES_LIGHT_1, SERIES_DISTANCE };
+static const uint8_t STREAM_SERIES_2[STREAM_SENSORS] = { SERIES_TEMPERATURE_2, SERIES_LIGHT_2, SERIES_SOUND, SERIES_HUMAN_DETECTOR };
+
+//log line for each live reading, by series
+static const char* SERIES_LOG_FORMAT[SERIES_COUNT] = {
+    "Sensor 1 - Temperature: %ld degrees Celsius",
+    "Sensor 1 - Humidity: %ld%%",
+    "Sensor 1 - Light: %ld Lux",
+    "Sensor 1 - Distance: %ld cm",
+    "Sensor 2 - Temperature: %ld degrees Celsius",
+    "Sensor 2 - Light: %ld Lux",
+    "Sensor 2 - Sound: %ld dB",
+    "Sensor 2 - Human detector: %ld",
+    "Occupancy: %ld"
+};
+
+NodeIngest::NodeIngest(NodeKeyring& keyring, SeriesStore& store, QueryServer& queries, PresenceFusion& presence)
+    : keyring(keyring), store(store), queries(queries), presence(presence), lastEventSeries(0) {
+    memset(authFailures, 0, sizeof(authFailures));
+    memset(energyValid, 0, sizeof(energyValid));
+    memset(healthValid, 0, sizeof(healthValid));
+    memset(configs, 0, sizeof(configs));
+    memset(&lastEvent, 0, sizeof(lastEvent));
+}
+
+uint8_t NodeIngest::nodeOf(uint8_t tag){
+    switch(tag){
+        case INGEST_STREAM_1: case INGEST_DIAGNOSTICS_1: case INGEST_EVENT_1: return 1;
+        case INGEST_STREAM_2: case INGEST_DIAGNOSTICS_2: case INGEST_EVENT_2: return 2;
+        default: return 0;
+    }
+}
+
+NodeFrameKind NodeIngest::handle(IngestFrame& frame, uint32_t now){
+    uint8_t node = nodeOf(frame.tag);
+    uint8_t channel = (frame.tag == INGEST_STREAM_1 || frame.tag == INGEST_STREAM_2) ? FRAME_CHANNEL_STREAM
+        : (frame.tag == INGEST_DIAGNOSTICS_1 || frame.tag == INGEST_DIAGNOSTICS_2) ? FRAME_CHANNEL_DIAGNOSTICS
+        : FRAME_CHANNEL_EVENT;
+    if(node == 0){
+        return NODE_FRAME_DROPPED;
+    }
+    if(!open(node, channel, frame)){
+        if(authFailures[node - 1] >= NODE_AUTH_MAX_FAILURES){
+            authFailures[node - 1] = 0;
+            return NODE_FRAME_UNTRUSTED;
+        }
+        return NODE_FRAME_DROPPED;
+    }
+    switch(channel){
+        case FRAME_CHANNEL_STREAM:
+            onStream(node, frame.data, frame.length, now);
+            return NODE_FRAME_STREAM;
+        case FRAME_CHANNEL_DIAGNOSTICS:
+            return onDiagnostics(node, frame.data, frame.length);
+        default:
+            return onEvent(node, frame.data, frame.length);
+    }
+}
+
+void NodeIngest::onConnected(uint8_t node){
+    if(node >= 1 && node <= NODE_CACHE_NODES){
+        authFailures[node - 1] = 0;
+    }
+}
+
+/* Check a frame against the node's key and replace it with the plaintext. Frames from a node
+   we have no key for are dropped without counting against it */
+bool NodeIngest::open(uint8_t node, uint8_t channel, IngestFrame& frame){
+    uint8_t plain[INGEST_FRAME_DATA];
+    size_t len;
+    if(!keyring.provisioned(node)){
+        Log.warn("Sensor node %u - dropped frame of %u bytes, no link key for it", node, frame.length);
+        return false;
+    }
+    if(keyring.open(node, channel, frame.data, frame.length, plain, len)){
+        authFailures[node - 1] = 0;
+        memcpy(frame.data, plain, len);
+        frame.length = len;
+        return true;
+    }
+    Log.warn("Sensor node %u - rejected frame of %u bytes, %lu rejected so far", node, frame.length, keyring.rejected(node));
+    authFailures[node - 1]++;
+    return false;
+}
+
+/* A stream notification: every reading a node takes comes this way, several to a frame. Recent
+   ones are live, older ones are the node catching up on readings it took while we weren't connected */
+void NodeIngest::onStream(uint8_t node, const uint8_t* data, size_t len, uint32_t now){
+    StreamFrameReader reader;
+    if(!reader.begin(data, len)){
+        return;
+    }
+    if(reader.truncated()){
+        Log.warn("Truncated stream frame: %u records in %u bytes", reader.claimedCount(), len);
+    }
+    const uint8_t* seriesOfSensor = node == 1 ? STREAM_SERIES_1 : STREAM_SERIES_2;
+    uint8_t caughtUp = 0;
+    StreamRecord entry;
+    while(reader.next(entry)){
+        uint8_t series = seriesOfSensor[entry.sensor];
+        //temperatures are signed bytes, everything else is unsigned
+        int32_t reading = (series == SERIES_TEMPERATURE_1 || series == SERIES_TEMPERATURE_2) ? (int8_t) entry.value : entry.value;
+        if((int32_t) (now - entry.timestamp) <= STREAM_LIVE_AGE){
+            onLiveReading(series, entry.timestamp, reading);
+        }
+        else{
+            //stored at the time it was taken, but not fed to presence fusion, which only wants current evidence
+            record(series, entry.timestamp, reading);
+            caughtUp++;
+        }
+    }
+    if(caughtUp > 0){
+        Log.info("Caught up on %u backlogged readings", caughtUp);
+    }
+}
+
+void NodeIngest::onLiveReading(uint8_t series, uint32_t timestamp, int32_t value){
+    Log.info(SERIES_LOG_FORMAT[series], (long) value);
+    record(series, timestamp, value);
+    if(series == SERIES_DISTANCE){
+        presence.onDistance(timestamp, value);
+    }
+    else if(series == SERIES_HUMAN_DETECTOR){
+        presence.onHumanDetector(timestamp, value);
+        if(value == 0x00){
+            Log.info("Sensor 2 - Human lost...");
+        }
+        else if (value == 0x01){
+            Log.info("Sensor 2 - Human detected!");
+        }
+        else{
+            Log.info("Sensor 2 - Invalid human detector message. Expected 0 or 1, received %ld", (long) value);
+        }
+    }
+}
+
+void NodeIngest::record(uint8_t series, uint32_t timestamp, int32_t value){
+    store.append(series, timestamp, value);
+    queries.onSample(series, timestamp, value);
+}
+
+/* A diagnostics frame. A bad report leaves the last good one in place. Warns when a node has
+   come back from a watchdog reset, or stalled for longer than it has before */
+NodeFrameKind NodeIngest::onDiagnostics(uint8_t node, const uint8_t* data, size_t len){
+    DiagnosticsFrame frame;
+    bool valid = streamDecodeDiagnostics(data, len, frame);
+    if(len < 1){
+        return NODE_FRAME_DROPPED;
+    }
+    switch(frame.type){
+        case DIAGNOSTICS_ENERGY:
+            if(!valid){
+                Log.warn("Sensor node %u - invalid energy report of %u bytes", node, len);
+                return NODE_FRAME_DROPPED;
+            }
+            energies[node - 1] = frame.energy;
+            energyValid[node - 1] = true;
+            return NODE_FRAME_ENERGY;
+        case DIAGNOSTICS_CONFIG: {
+            if(!valid){
+                Log.warn("Sensor node %u - invalid config status of %u bytes", node, len - 1);
+                return NODE_FRAME_DROPPED;
+            }
+            const ConfigStatusReport& config = frame.config;
+            Log.info("Sensor node %u - config version %u %s, using version %u", node, config.version,
+                configStatusName(config.status), config.inUse);
+            configs[node - 1] = config;
+            return NODE_FRAME_CONFIG;
+        }
+        case DIAGNOSTICS_HEALTH: {
+            if(!valid){
+                Log.warn("Sensor node %u - invalid health report of %u bytes", node, len - 1);
+                return NODE_FRAME_DROPPED;
+            }
+            const HealthReport& report = frame.health;
+            HealthReport& last = healths[node - 1];
+            bool restarted = !healthValid[node - 1] || report.uptimeSeconds < last.uptimeSeconds;
+            if(restarted && report.resetReason == HEALTH_RESET_APP_WATCHDOG){
+                Log.warn("Sensor node %u - reset by its watchdog, stuck in %s", node, HealthMonitor::sectionName(report.resetSection));
+            }
+            if(!restarted && report.longestStallMs > last.longestStallMs){
+                Log.warn("Sensor node %u - new longest stall, %lu ms in %s", node,
+                    report.longestStallMs, HealthMonitor::sectionName(report.longestStallSection));
+            }
+            last = report;
+            healthValid[node - 1] = true;
+            return NODE_FRAME_HEALTH;
+        }
+        default:
+            Log.warn("Sensor node %u - unknown diagnostics type %u", node, frame.type);
+            return NODE_FRAME_DROPPED;
+    }
+}
+
+/* The raw window around an event one of a node's detectors picked up. The node's stream only
+   carries aggregates, so this is the one full resolution look at it */
+NodeFrameKind NodeIngest::onEvent(uint8_t node, const uint8_t* data, size_t len){
+    uint8_t sensor;
+    if(!streamDecodeEvent(data, len, sensor, lastEvent)){
+        Log.warn("Sensor node %u - invalid event frame of %u bytes", node, len);
+        return NODE_FRAME_DROPPED;
+    }
+    lastEventSeries = (node == 1 ? STREAM_SERIES_1 : STREAM_SERIES_2)[sensor];
+    const EventWindow& window = lastEvent;
+    uint16_t low = window.samples[0], high = window.samples[0];
+    for(uint8_t i = 1; i < window.count; i++){
+        low = window.samples[i] < low ? window.samples[i] : low;
+        high = window.samples[i] > high ? window.samples[i] : high;
+    }
+    Log.info("Sensor node %u - event on series %u at %lu, z-score %d.%d, %u samples %u ms apart, %u-%u",
+        node, lastEventSeries, window.triggerTime, window.zScore10 / 10, abs(window.zScore10 % 10),
+        window.count, window.periodMs, low, high);
+    return NODE_FRAME_EVENT;
+}
+
+const EnergyReport* NodeIngest::energy(uint8_t node) const {
+    return node >= 1 && node <= NODE_CACHE_NODES && energyValid[node - 1] ? &energies[node - 1] : NULL;
+}
+
+const HealthReport* NodeIngest::health(uint8_t node) const {
+    return node >= 1 && node <= NODE_CACHE_NODES && healthValid[node - 1] ? &healths[node - 1] : NULL;
+}
@@ -0,0 +1,95 @@
+/*
+ * NodeIngest.h
+ * Description: what the clusterhead does with a frame from one of its sensor nodes, once
+ *              loop() takes it off the ingest queue. Opens it under the node's key, decodes
+ *              it (see StreamFrame.h) and stores what it carries: readings go to the series
+ *              store and query subscribers, live ones to presence fusion as well, and the
+ *              latest energy, health and config reports are kept. Anything that needs the
+ *              radio or the cloud, such as publishing an event window, confirming a config or
+ *              dropping a connection, is left to the caller, going by what handle() returns.
+ *              tools/ingestreplay runs recorded frames through it on a host.
+ * Author: Tom Schwenke
+ * Date: 19/10/2026
+ */
+#pragma once
+
+#include "Particle.h"
+#include "IngestQueue.h"
+#include "NodeKeyring.h"
+#include "PresenceFusion.h"
+#include "QueryServer.h"
+#include "SeriesStore.h"
+#include "StreamFrame.h"
+
+//ingest tags for each node's stream, diagnostics and event characteristics
+const uint8_t INGEST_STREAM_1 = 0x80;
+const uint8_t INGEST_STREAM_2 = 0x81;
+const uint8_t INGEST_DIAGNOSTICS_1 = 0x83;
+const uint8_t INGEST_DIAGNOSTICS_2 = 0x84;
+const uint8_t INGEST_EVENT_1 = 0x85;
+const uint8_t INGEST_EVENT_2 = 0x86;
+//frames in a row that fail to open before the connection should be dropped, since whatever we
+//connected to doesn't have the node's key, e.g. another device advertising its service
+const uint8_t NODE_AUTH_MAX_FAILURES = 3;
+//readings older than this (s) are a node catching up on its backlog, rather than live
+const int32_t STREAM_LIVE_AGE = 5;
+
+/* What handle() made of a frame */
+enum NodeFrameKind : uint8_t {
+    NODE_FRAME_DROPPED,     //not from a node, didn't open, or didn't decode
+    NODE_FRAME_STREAM,
+    NODE_FRAME_ENERGY,
+    NODE_FRAME_CONFIG,      //see configStatus()
+    NODE_FRAME_HEALTH,
+    NODE_FRAME_EVENT,       //see event()
+    NODE_FRAME_UNTRUSTED    //the last of NODE_AUTH_MAX_FAILURES in a row that didn't open, drop the connection
+};
+
+class NodeIngest {
+public:
+    NodeIngest(NodeKeyring& keyring, SeriesStore& store, QueryServer& queries, PresenceFusion& presence);
+
+    // The node a tag belongs to, 0 for none
+    static uint8_t nodeOf(uint8_t tag);
+
+    // Open, decode and store a frame taken off the ingest queue, which is left holding the
+    // plaintext. now is unix time (s), to tell live readings from a catch up
+    NodeFrameKind handle(IngestFrame& frame, uint32_t now);
+
+    // Start counting failures to open afresh, on a new connection to the node
+    void onConnected(uint8_t node);
+
+    // Store a reading at the time it was taken and pass it on to query subscribers
+    void record(uint8_t series, uint32_t timestamp, int32_t value);
+
+    // The latest good report from a node, NULL until it has sent one
+    const EnergyReport* energy(uint8_t node) const;
+    const HealthReport* health(uint8_t node) const;
+    // The latest config status from a node, valid after NODE_FRAME_CONFIG
+    const ConfigStatusReport& configStatus(uint8_t node) const { return configs[node - 1]; }
+
+    // The window from the last NODE_FRAME_EVENT, and the series it is of
+    const EventWindow& event() const { return lastEvent; }
+    uint8_t eventSeries() const { return lastEventSeries; }
+
+private:
+    bool open(uint8_t node, uint8_t channel, IngestFrame& frame);
+    void onStream(uint8_t node, const uint8_t* data, size_t len, uint32_t now);
+    void onLiveReading(uint8_t series, uint32_t timestamp, int32_t value);
+    NodeFrameKind onDiagnostics(uint8_t node, const uint8_t* data, size_t len);
+    NodeFrameKind onEvent(uint8_t node, const uint8_t* data, size_t len);
+
+    NodeKeyring& keyring;
+    SeriesStore& store;
+    QueryServer& queries;
+    PresenceFusion& presence;
+
+    uint8_t authFailures[NODE_CACHE_NODES];
+    EnergyReport energies[NODE_CACHE_NODES];
+    bool energyValid[NODE_CACHE_NODES];
+    HealthReport healths[NODE_CACHE_NODES];
+    bool healthValid[NODE_CACHE_NODES];
+    ConfigStatusReport configs[NODE_CACHE_NODES];
+    EventWindow lastEvent;
+    uint8_t lastEventSeries;
+};
@@ -0,0 +1,147 @@
+/*
+ * NodeKeyring.cpp
+ * Description: implementation of the EEPROM backed per-node keys and sequence state
+ * Author: Tom Schwenke
+ * Date: 19/10/2026
+ */
+#include "NodeKeyring.h"
+
+const uint16_t NODE_KEYRING_MAGIC = 0x5EC2;
+const int NODE_KEYRING_HEADER = 2;
+const int NODE_KEYRING_ENTRY_SIZE = 1 + FRAME_KEY_SIZE + 4 + 4;
+const int NODE_KEYRING_RESERVED_OFFSET = 1 + FRAME_KEY_SIZE;
+const int NODE_KEYRING_FLOOR_OFFSET = NODE_KEYRING_RESERVED_OFFSET + 4;
+
+NodeKeyring::NodeKeyring(){
+    for(uint8_t i = 0; i < NODE_CACHE_NODES; i++){
+        entries[i].savedFloor = 0;
+        entries[i].nextControl = 0;
+        entries[i].controlReservedUpTo = 0;
+        entries[i].rejectedCount = 0;
+    }
+}
+
+void NodeKeyring::begin(){
+    uint16_t magic;
+    EEPROM.get(NODE_KEYRING_EEPROM_START, magic);
+    if(magic != NODE_KEYRING_MAGIC){
+        //blank, no keys yet
+        EEPROM.put(NODE_KEYRING_EEPROM_START, NODE_KEYRING_MAGIC);
+        for(uint8_t node = 1; node <= NODE_CACHE_NODES; node++){
+            EEPROM.write(eepromAddress(node), 0);
+        }
+    }
+    for(uint8_t node = 1; node <= NODE_CACHE_NODES; node++){
+        Entry& entry = entries[node - 1];
+        int address = eepromAddress(node);
+        if(EEPROM.read(address) != 1){
+            Log.warn("No link key for sensor node %u, its frames are dropped until one is provisioned", node);
+            continue;
+        }
+        uint8_t key[FRAME_KEY_SIZE];
+        for(size_t i = 0; i < FRAME_KEY_SIZE; i++){
+            key[i] = EEPROM.read(address + 1 + i);
+        }
+        entry.cipher.setKey(key);
+        //anything below the saved reservation may have been used before the reset
+        EEPROM.get(address + NODE_KEYRING_RESERVED_OFFSET, entry.nextControl);
+        entry.controlReservedUpTo = entry.nextControl;
+        //saved ahead of anything accepted before the reset
+        EEPROM.get(address + NODE_KEYRING_FLOOR_OFFSET, entry.savedFloor);
+        if(entry.savedFloor > 0){
+            entry.window.reset(entry.savedFloor - 1);
+        }
+    }
+}
+
+void NodeKeyring::provision(uint8_t node, const uint8_t* key){
+    if(node < 1 || node > NODE_CACHE_NODES){
+        return;
+    }
+    Entry& entry = entries[node - 1];
+    int address = eepromAddress(node);
+    bool sameKey = entry.cipher.hasKey();
+    for(size_t i = 0; i < FRAME_KEY_SIZE; i++){
+        if(EEPROM.read(address + 1 + i) != key[i]){
+            sameKey = false;
+            EEPROM.write(address + 1 + i, key[i]);
+        }
+    }
+    if(!entry.cipher.hasKey()){
+        //first key for this node, whatever the EEPROM held before means nothing
+        entry.nextControl = 0;
+        entry.controlReservedUpTo = 0;
+        EEPROM.put(address + NODE_KEYRING_RESERVED_OFFSET, entry.controlReservedUpTo);
+    }
+    //otherwise keep counting from the old reservation, nonces must never repeat under a key
+    //that may be the same one again
+    if(!sameKey){
+        entry.savedFloor = 0;
+        EEPROM.put(address + NODE_KEYRING_FLOOR_OFFSET, entry.savedFloor);
+        entry.window = ReplayWindow();
+    }
+    EEPROM.write(address, 1);
+    entry.cipher.setKey(key);
+}
+
+bool NodeKeyring::provisioned(uint8_t node) const {
+    return node >= 1 && node <= NODE_CACHE_NODES && entries[node - 1].cipher.hasKey();
+}
+
+void NodeKeyring::onConnected(uint8_t node){
+    if(node < 1 || node > NODE_CACHE_NODES){
+        return;
+    }
+    Entry& entry = entries[node - 1];
+    entry.nextControl = entry.nextControl > UINT32_MAX - FRAME_FLOOR_STEP ? UINT32_MAX : entry.nextControl + FRAME_FLOOR_STEP;
+}
+
+bool NodeKeyring::open(uint8_t node, uint8_t channel, const uint8_t* in, size_t len, uint8_t* out, size_t& outLen){
+    if(node < 1 || node > NODE_CACHE_NODES){
+        return false;
+    }
+    Entry& entry = entries[node - 1];
+    uint32_t sequence;
+    if(!entry.cipher.open(channel, in, len, out, sequence)){
+        entry.rejectedCount++;
+        return false;
+    }
+    if(sequence >= entry.savedFloor){
+        //save the floor ahead first, a reset after accepting this must not let it through again
+        entry.savedFloor = sequence > UINT32_MAX - FRAME_FLOOR_STEP ? UINT32_MAX : sequence + FRAME_FLOOR_STEP;
+        EEPROM.put(eepromAddress(node) + NODE_KEYRING_FLOOR_OFFSET, entry.savedFloor);
+    }
+    if(!entry.window.accept(sequence)){
+        entry.rejectedCount++;
+        return false;
+    }
+    outLen = len - FRAME_OVERHEAD;
+    return true;
+}
+
+size_t NodeKeyring::seal(uint8_t node, const uint8_t* in, size_t len, uint8_t* out){
+    if(node < 1 || node > NODE_CACHE_NODES){
+        return 0;
+    }
+    Entry& entry = entries[node - 1];
+    if(!entry.cipher.hasKey()){
+        return 0;
+    }
+    if(entry.nextControl >= entry.controlReservedUpTo){
+        if(entry.nextControl > UINT32_MAX - NODE_KEYRING_SEQUENCE_BLOCK){
+            return 0;//never wrap, that would reuse nonces
+        }
+        //onConnected() may have skipped past the end of the last reservation
+        entry.controlReservedUpTo = entry.nextControl + NODE_KEYRING_SEQUENCE_BLOCK;
+        EEPROM.put(eepromAddress(node) + NODE_KEYRING_RESERVED_OFFSET, entry.controlReservedUpTo);
+    }
+    return entry.cipher.seal(FRAME_CHANNEL_CONTROL, entry.nextControl++, in, len, out);
+}
+
+uint32_t NodeKeyring::rejected(uint8_t node) const {
+    return node >= 1 && node <= NODE_CACHE_NODES ? entries[node - 1].rejectedCount : 0;
+}
+
+int NodeKeyring::eepromAddress(uint8_t node) const {
+    return NODE_KEYRING_EEPROM_START + NODE_KEYRING_HEADER + (node - 1) * NODE_KEYRING_ENTRY_SIZE;
+}
@@ -0,0 +1,66 @@
+/*
+ * NodeKeyring.h
+ * Description: the clusterhead's side of each node's authenticated link, see FrameCipher.h.
+ *              Holds each node's key, provisioned at setup, the replay window for frames from
+ *              it, and our own sequence numbers for control frames to it, all backed by EEPROM.
+ *              Frames from a node without a key are dropped, as is anything for it: a
+ *              sealed frame read as plaintext would be garbage, and a plaintext one could
+ *              be from anyone.
+ * Author: Tom Schwenke
+ * Date: 19/10/2026
+ */
+#pragma once
+
+#include "Particle.h"
+#include "FrameCipher.h"
+#include "NodeLinkCache.h"
+
+//after the node link cache. [magic u16], then per node [provisioned u8][key 32 bytes]
+//[control sequence reserved up to u32][replay floor u32, sequence numbers below it are rejected]
+const int NODE_KEYRING_EEPROM_START = 576;
+//control sequence numbers reserved per EEPROM write
+const uint32_t NODE_KEYRING_SEQUENCE_BLOCK = 256;
+
+class NodeKeyring {
+public:
+    NodeKeyring();
+
+    // Load keys and sequence state from EEPROM. Call from setup()
+    void begin();
+
+    // Store a node's key, replacing any old one. Control sequence numbers carry on from where
+    // the old key left them, so provisioning the same key again never reuses a nonce, and the
+    // replay window is only cleared for a different key. The node must be given the same key
+    void provision(uint8_t node, const uint8_t* key);
+
+    bool provisioned(uint8_t node) const;
+
+    // Call when a node connects. Skips FRAME_FLOOR_STEP control sequence numbers, past any
+    // floor the node saved ahead before it reset
+    void onConnected(uint8_t node);
+
+    // Check and decrypt a frame from a node into out, setting outLen. False if it is forged,
+    // replayed or truncated, or if we have no key for the node. The replay floor is saved
+    // FRAME_FLOOR_STEP ahead of what we accept, so nothing accepted before a reset is again
+    bool open(uint8_t node, uint8_t channel, const uint8_t* in, size_t len, uint8_t* out, size_t& outLen);
+
+    // Seal a control frame to a node into out, which takes len + FRAME_OVERHEAD bytes.
+    // Returns the length to send, 0 on failure or if we have no key for the node
+    size_t seal(uint8_t node, const uint8_t* in, size_t len, uint8_t* out);
+
+    uint32_t rejected(uint8_t node) const;
+
+private:
+    struct Entry {
+        FrameCipher cipher;
+        ReplayWindow window;
+        uint32_t savedFloor;        //replay floor in EEPROM, everything accepted is below it
+        uint32_t nextControl;
+        uint32_t controlReservedUpTo;
+        uint32_t rejectedCount;
+    };
+
+    int eepromAddress(uint8_t node) const;
+
+    Entry entries[NODE_CACHE_NODES];
+};
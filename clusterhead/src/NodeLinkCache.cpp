@@ -0,0 +1,86 @@
+/*
+ * NodeLinkCache.cpp
+ * Description: implementation of the EEPROM backed sensor node address cache
+ * Author: Tom Schwenke
+ * Date: 19/10/2026
+ */
+#include "NodeLinkCache.h"
+
+const uint16_t NODE_CACHE_MAGIC = 0xCA5E;
+const int NODE_CACHE_HEADER = 2;
+//[valid u8][address type u8][address 6 bytes]
+const int NODE_CACHE_ENTRY_SIZE = 8;
+
+NodeLinkCache::NodeLinkCache(){
+    memset(entries, 0, sizeof(entries));
+    memset(failures, 0, sizeof(failures));
+}
+
+void NodeLinkCache::begin(){
+    uint16_t magic;
+    EEPROM.get(NODE_CACHE_EEPROM_START, magic);
+    if(magic != NODE_CACHE_MAGIC){
+        //blank, nothing cached yet
+        EEPROM.put(NODE_CACHE_EEPROM_START, NODE_CACHE_MAGIC);
+        for(uint8_t node = 1; node <= NODE_CACHE_NODES; node++){
+            EEPROM.write(eepromAddress(node), 0);
+        }
+        return;
+    }
+    for(uint8_t node = 1; node <= NODE_CACHE_NODES; node++){
+        Entry& entry = entries[node - 1];
+        int address = eepromAddress(node);
+        entry.valid = EEPROM.read(address) == 1;
+        entry.type = EEPROM.read(address + 1);
+        for(int i = 0; i < 6; i++){
+            entry.address[i] = EEPROM.read(address + 2 + i);
+        }
+    }
+}
+
+bool NodeLinkCache::lookup(uint8_t node, BleAddress& out){
+    if(node < 1 || node > NODE_CACHE_NODES){
+        return false;
+    }
+    const Entry& entry = entries[node - 1];
+    if(!entry.valid || failures[node - 1] >= NODE_CACHE_MAX_FAILURES){
+        return false;
+    }
+    out = BleAddress(entry.address, (BleAddressType) entry.type);
+    return true;
+}
+
+void NodeLinkCache::remember(uint8_t node, const BleAddress& address){
+    if(node < 1 || node > NODE_CACHE_NODES){
+        return;
+    }
+    Entry& entry = entries[node - 1];
+    failures[node - 1] = 0;
+
+    Entry updated;
+    updated.valid = true;
+    updated.type = (uint8_t) address.type();
+    for(int i = 0; i < 6; i++){
+        updated.address[i] = address[i];
+    }
+    if(entry.valid && entry.type == updated.type && memcmp(entry.address, updated.address, 6) == 0){
+        return;//already cached, spare the flash a write
+    }
+    entry = updated;
+    int eeprom = eepromAddress(node);
+    EEPROM.write(eeprom, 1);
+    EEPROM.write(eeprom + 1, entry.type);
+    for(int i = 0; i < 6; i++){
+        EEPROM.write(eeprom + 2 + i, entry.address[i]);
+    }
+}
+
+void NodeLinkCache::failed(uint8_t node){
+    if(node >= 1 && node <= NODE_CACHE_NODES && failures[node - 1] < NODE_CACHE_MAX_FAILURES){
+        failures[node - 1]++;
+    }
+}
+
+int NodeLinkCache::eepromAddress(uint8_t node) const {
+    return NODE_CACHE_EEPROM_START + NODE_CACHE_HEADER + (node - 1) * NODE_CACHE_ENTRY_SIZE;
+}
@@ -0,0 +1,48 @@
+/*
+ * NodeLinkCache.h
+ * Description: remembers the BLE address of each sensor node we have connected to, in
+ *              EEPROM so it survives a reset. A reconnect can then go straight to the node,
+ *              skipping the scan and the advertised service matching.
+ * Author: Tom Schwenke
+ * Date: 19/10/2026
+ */
+#pragma once
+
+#include "Particle.h"
+
+//sensor nodes are numbered from 1
+const uint8_t NODE_CACHE_NODES = 2;
+//EEPROM below this is left for config, the cache takes [magic u16] then 8 bytes per node
+const int NODE_CACHE_EEPROM_START = 512;
+//direct reconnects that fail in a row before we fall back to finding the node by scanning
+const uint8_t NODE_CACHE_MAX_FAILURES = 3;
+
+class NodeLinkCache {
+public:
+    NodeLinkCache();
+
+    // Load cached addresses from EEPROM. Call from setup()
+    void begin();
+
+    // The address to reconnect to a node at. Returns false if unknown, or direct reconnects
+    // to it keep failing
+    bool lookup(uint8_t node, BleAddress& out);
+
+    // Record a successful connection, writing to EEPROM only if the address changed
+    void remember(uint8_t node, const BleAddress& address);
+
+    // Record a failed direct reconnect
+    void failed(uint8_t node);
+
+private:
+    struct Entry {
+        bool valid;
+        uint8_t type;       //BleAddressType
+        uint8_t address[6];
+    };
+
+    int eepromAddress(uint8_t node) const;
+
+    Entry entries[NODE_CACHE_NODES];
+    uint8_t failures[NODE_CACHE_NODES];
+};
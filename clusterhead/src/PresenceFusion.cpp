@@ -0,0 +1,137 @@
+/*
+ * PresenceFusion.cpp
+ * Description: implementation of the PIR/distance presence fusion
+ * Author: Tom Schwenke
+ * Date: 19/10/2026
+ */
+#include "PresenceFusion.h"
+
+PresenceFusion::PresenceFusion()
+    : pirActive(false), pirTimestamp(0), distanceNear(false), distanceTimestamp(0),
+      distanceWindow(PRESENCE_DISTANCE_WINDOW), clock(0),
+      state(false), stateConfidence(0), candidatePending(false), candidateSince(0),
+      suppressedCount(0), transitionHead(0), transitionCount(0) {
+}
+
+void PresenceFusion::onDistance(uint32_t timestamp, uint8_t distanceCm){
+    //node 1 doesn't send a reading when no echo came back, so every value is a real distance.
+    //255 is anything from 255 cm out, i.e. nobody in front of the sensor
+    std::lock_guard<std::mutex> guard(lock);
+    if(timestamp < distanceTimestamp){
+        return;//older than what we already have, frames can arrive out of order across nodes
+    }
+    uint32_t gap = timestamp - distanceTimestamp;
+    if(distanceTimestamp != 0 && gap <= PRESENCE_DISTANCE_WINDOW_MAX){
+        uint32_t window = 2 * gap + PRESENCE_DISTANCE_MARGIN;
+        distanceWindow = window < PRESENCE_DISTANCE_WINDOW ? PRESENCE_DISTANCE_WINDOW
+            : window > PRESENCE_DISTANCE_WINDOW_MAX ? PRESENCE_DISTANCE_WINDOW_MAX : window;
+    }
+    distanceNear = distanceCm < PRESENCE_DISTANCE_CM;
+    distanceTimestamp = timestamp;
+    if(timestamp > clock){
+        clock = timestamp;
+    }
+    evaluateLocked(clock);
+}
+
+void PresenceFusion::onHumanDetector(uint32_t timestamp, uint8_t humanSeen){
+    std::lock_guard<std::mutex> guard(lock);
+    if(timestamp < pirTimestamp){
+        return;
+    }
+    pirActive = humanSeen != 0;
+    pirTimestamp = timestamp;
+    if(timestamp > clock){
+        clock = timestamp;
+    }
+    evaluateLocked(clock);
+}
+
+void PresenceFusion::update(uint32_t now){
+    std::lock_guard<std::mutex> guard(lock);
+    if(now > clock){
+        clock = now;
+    }
+    evaluateLocked(clock);
+}
+
+uint8_t PresenceFusion::confidenceAt(uint32_t now) const {
+    uint16_t confidence = 0;
+    //PIR is only sent on change, so its last state holds until told otherwise
+    if(pirActive){
+        confidence += PRESENCE_PIR_CONFIDENCE;
+    }
+    //distance is sampled, so a near reading goes stale once the next one is overdue
+    if(distanceNear && now - distanceTimestamp <= distanceWindow){
+        confidence += PRESENCE_DISTANCE_CONFIDENCE;
+    }
+    return confidence > 100 ? 100 : confidence;
+}
+
+void PresenceFusion::evaluateLocked(uint32_t now){
+    uint8_t confidence = confidenceAt(now);
+    bool desired = confidence >= PRESENCE_THRESHOLD;
+
+    if(desired == state){
+        if(candidatePending){
+            //flipped back before it was confirmed
+            suppressedCount++;
+            candidatePending = false;
+        }
+        stateConfidence = confidence;
+        return;
+    }
+
+    if(!candidatePending){
+        candidatePending = true;
+        candidateSince = now;
+    }
+    //both sensors agreeing someone is there confirms straight away
+    uint32_t hold = desired ? (confidence >= 100 ? 0 : PRESENCE_ENTER_HOLD) : PRESENCE_EXIT_HOLD;
+    if(now - candidateSince < hold){
+        return;
+    }
+
+    state = desired;
+    stateConfidence = confidence;
+    candidatePending = false;
+
+    //queue the transition, dropping the oldest if loop() hasn't taken them
+    uint8_t index = (transitionHead + transitionCount) % TRANSITION_QUEUE;
+    if(transitionCount == TRANSITION_QUEUE){
+        transitionHead = (transitionHead + 1) % TRANSITION_QUEUE;
+    }
+    else{
+        transitionCount++;
+    }
+    transitions[index].occupied = desired;
+    transitions[index].confidence = confidence;
+    transitions[index].timestamp = now;
+    transitions[index].latency = now - candidateSince;
+}
+
+bool PresenceFusion::takeTransition(PresenceTransition& out){
+    std::lock_guard<std::mutex> guard(lock);
+    if(transitionCount == 0){
+        return false;
+    }
+    out = transitions[transitionHead];
+    transitionHead = (transitionHead + 1) % TRANSITION_QUEUE;
+    transitionCount--;
+    return true;
+}
+
+bool PresenceFusion::occupied(){
+    std::lock_guard<std::mutex> guard(lock);
+    return state;
+}
+
+uint8_t PresenceFusion::confidence(){
+    std::lock_guard<std::mutex> guard(lock);
+    return stateConfidence;
+}
+
+uint32_t PresenceFusion::suppressed(){
+    std::lock_guard<std::mutex> guard(lock);
+    return suppressedCount;
+}
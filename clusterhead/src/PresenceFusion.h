@@ -0,0 +1,93 @@
+/*
+ * PresenceFusion.h
+ * Description: combines sensor node 1's ultrasonic distance and sensor node 2's PIR into a
+ *              single debounced occupancy state with a confidence score. Evidence is aligned
+ *              on the timestamps the nodes put in their frames, and a change of state is only
+ *              reported once it is confirmed, either by both sensors agreeing or by one sensor
+ *              holding its view for long enough.
+ *              Does not depend on Particle.h, so it can also be built on a host.
+ * Author: Tom Schwenke
+ * Date: 19/10/2026
+ */
+#pragma once
+
+#include <stdint.h>
+#include <mutex>
+
+//anything closer than this (cm) counts as someone in front of the distance sensor
+const uint8_t PRESENCE_DISTANCE_CM = 120;
+//a near distance reading counts as evidence until the next is overdue: node 1 at most doubles
+//its read delay each time, so that's twice the last gap between readings plus a margin for
+//whole second timestamps and the link. Never shorter than the minimum, never longer than the
+//maximum, and a longer gap is a dropped link rather than the sampler so doesn't count
+const uint32_t PRESENCE_DISTANCE_WINDOW = 5;
+const uint32_t PRESENCE_DISTANCE_MARGIN = 2;
+const uint32_t PRESENCE_DISTANCE_WINDOW_MAX = 30;
+//a single sensor must hold its view this long (s) before a transition is confirmed
+const uint32_t PRESENCE_ENTER_HOLD = 2;
+//leaving needs a longer hold than entering, so a person standing still isn't dropped
+const uint32_t PRESENCE_EXIT_HOLD = 10;
+
+//confidence contributed by each source, both together saturate at 100
+const uint8_t PRESENCE_PIR_CONFIDENCE = 60;
+const uint8_t PRESENCE_DISTANCE_CONFIDENCE = 50;
+//confidence at or above which the area is considered occupied
+const uint8_t PRESENCE_THRESHOLD = 50;
+
+/* A confirmed change in occupancy */
+struct PresenceTransition {
+    bool occupied;
+    uint8_t confidence;     //0-100
+    uint32_t timestamp;     //node time (s) the transition was confirmed at
+    uint32_t latency;       //seconds from first evidence to confirmation
+};
+
+class PresenceFusion {
+public:
+    PresenceFusion();
+
+    // Evidence from sensor node 1, timestamp being when the node took the reading (s).
+    // 255 is anything 255 cm or further
+    void onDistance(uint32_t timestamp, uint8_t distanceCm);
+
+    // Evidence from sensor node 2. The node only sends the PIR when it changes
+    void onHumanDetector(uint32_t timestamp, uint8_t humanSeen);
+
+    // Re-evaluate at time now, so holds can expire without new evidence arriving
+    void update(uint32_t now);
+
+    // Take the oldest confirmed transition not yet taken. Returns false if there are none
+    bool takeTransition(PresenceTransition& out);
+
+    bool occupied();
+    uint8_t confidence();
+
+    // Candidate changes that never confirmed, i.e. false positives kept off the uplink
+    uint32_t suppressed();
+
+private:
+    void evaluateLocked(uint32_t now);
+    uint8_t confidenceAt(uint32_t now) const;
+
+    std::mutex lock;
+
+    bool pirActive;
+    uint32_t pirTimestamp;
+    bool distanceNear;
+    uint32_t distanceTimestamp;
+    uint32_t distanceWindow;    //seconds the newest distance reading holds for
+
+    //newest evidence time seen, node clocks are cloud synced so both share it
+    uint32_t clock;
+
+    bool state;
+    uint8_t stateConfidence;
+    bool candidatePending;
+    uint32_t candidateSince;
+    uint32_t suppressedCount;
+
+    static const uint8_t TRANSITION_QUEUE = 4;
+    PresenceTransition transitions[TRANSITION_QUEUE];
+    uint8_t transitionHead;
+    uint8_t transitionCount;
+};
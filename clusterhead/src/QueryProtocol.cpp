@@ -0,0 +1,117 @@
+/*
+ * QueryProtocol.cpp
+ * Description: framing helpers and parser for the serial query protocol
+ * Author: Tom Schwenke
+ * Date: 19/10/2026
+ */
+#include "QueryProtocol.h"
+#include <string.h>
+
+uint16_t qpCrc16(const uint8_t* data, size_t length, uint16_t crc){
+    for(size_t i = 0; i < length; i++){
+        crc ^= (uint16_t) data[i] << 8;
+        for(uint8_t bit = 0; bit < 8; bit++){
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+void qpPut16(uint8_t* out, uint16_t value){
+    out[0] = value & 0xFF;
+    out[1] = value >> 8;
+}
+
+void qpPut32(uint8_t* out, uint32_t value){
+    out[0] = value & 0xFF;
+    out[1] = (value >> 8) & 0xFF;
+    out[2] = (value >> 16) & 0xFF;
+    out[3] = (value >> 24) & 0xFF;
+}
+
+uint16_t qpGet16(const uint8_t* in){
+    return (uint16_t) in[0] | ((uint16_t) in[1] << 8);
+}
+
+uint32_t qpGet32(const uint8_t* in){
+    return (uint32_t) in[0] | ((uint32_t) in[1] << 8) | ((uint32_t) in[2] << 16) | ((uint32_t) in[3] << 24);
+}
+
+uint16_t qpWriteHeader(uint8_t type, uint16_t payloadLength, uint8_t* header){
+    header[0] = QP_SYNC_1;
+    header[1] = QP_SYNC_2;
+    header[2] = type;
+    qpPut16(header + 3, payloadLength);
+    //sync bytes are not part of the CRC
+    return qpCrc16(header + 2, 3);
+}
+
+size_t qpEncodeFrame(uint8_t type, const uint8_t* payload, uint16_t payloadLength, uint8_t* out){
+    uint16_t crc = qpWriteHeader(type, payloadLength, out);
+    if(payloadLength > 0){
+        memcpy(out + QP_HEADER_SIZE, payload, payloadLength);
+        crc = qpCrc16(payload, payloadLength, crc);
+    }
+    qpPut16(out + QP_HEADER_SIZE + payloadLength, crc);
+    return QP_HEADER_SIZE + payloadLength + QP_CRC_SIZE;
+}
+
+QueryFrameParser::QueryFrameParser()
+    : state(SYNC_1), frameType(0), payloadLength(0), received(0), frameCrc(0), badFrames(0) {
+}
+
+bool QueryFrameParser::feed(uint8_t byte){
+    switch(state){
+        case SYNC_1:
+            if(byte == QP_SYNC_1){
+                state = SYNC_2;
+            }
+            break;
+        case SYNC_2:
+            //a repeated first sync byte could still be the start of a frame
+            state = byte == QP_SYNC_2 ? TYPE : (byte == QP_SYNC_1 ? SYNC_2 : SYNC_1);
+            break;
+        case TYPE:
+            frameType = byte;
+            state = LENGTH_LOW;
+            break;
+        case LENGTH_LOW:
+            payloadLength = byte;
+            state = LENGTH_HIGH;
+            break;
+        case LENGTH_HIGH:
+            payloadLength |= (uint16_t) byte << 8;
+            received = 0;
+            if(payloadLength > QP_MAX_PAYLOAD){
+                //can't be one of ours, most likely log text that happened to contain the sync bytes
+                badFrames++;
+                state = SYNC_1;
+            }
+            else{
+                state = payloadLength > 0 ? PAYLOAD : CRC_LOW;
+            }
+            break;
+        case PAYLOAD:
+            buffer[received++] = byte;
+            if(received == payloadLength){
+                state = CRC_LOW;
+            }
+            break;
+        case CRC_LOW:
+            frameCrc = byte;
+            state = CRC_HIGH;
+            break;
+        case CRC_HIGH: {
+            frameCrc |= (uint16_t) byte << 8;
+            state = SYNC_1;
+            uint8_t header[3] = { frameType, (uint8_t) (payloadLength & 0xFF), (uint8_t) (payloadLength >> 8) };
+            uint16_t crc = qpCrc16(buffer, payloadLength, qpCrc16(header, sizeof(header)));
+            if(crc == frameCrc){
+                return true;
+            }
+            badFrames++;
+            break;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,92 @@
+/*
+ * QueryProtocol.h
+ * Description: binary request/response framing used to pull stored readings off the
+ *              clusterhead over USB serial. Shared by the firmware (QueryServer) and the
+ *              host client in tools/chquery, so it does not depend on Particle.h.
+ * Author: Tom Schwenke
+ * Date: 19/10/2026
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Frame layout (all integers little endian):
+   [0xA5][0x5A][type u8][payload length u16][payload...][crc16 u16]
+   The CRC covers type, length and payload. Frames share the serial port with the
+   text log, so the two sync bytes and the CRC let a reader skip over log lines. */
+const uint8_t QP_SYNC_1 = 0xA5;
+const uint8_t QP_SYNC_2 = 0x5A;
+const size_t QP_HEADER_SIZE = 5;
+const size_t QP_CRC_SIZE = 2;
+const size_t QP_MAX_PAYLOAD = 192;
+
+//sequence number reported for a series' open (not yet sealed) block
+const uint32_t QP_OPEN_BLOCK = 0xFFFFFFFF;
+
+enum QueryMessageType : uint8_t {
+    //requests, host -> clusterhead
+    QP_REQ_RANGE = 0x01,        //[series u8][from u32][to u32]
+    QP_REQ_LATEST = 0x02,       //empty
+    QP_REQ_STATS = 0x03,        //empty
+    QP_REQ_SUBSCRIBE = 0x04,    //[series mask u16], 0 to unsubscribe
+
+    //responses, clusterhead -> host
+    QP_RESP_BLOCK = 0x81,       //[series u8][block sequence u32][TimeSeriesCodec block...]
+    QP_RESP_END = 0x82,         //[request type u8][chunks sent u16]
+    QP_RESP_LATEST = 0x83,      //repeated [series u8][timestamp u32][value i32]
+    QP_RESP_STATS = 0x84,       //repeated [series u8][count u32][min i32][max i32][sum i64]
+    QP_RESP_SAMPLE = 0x85,      //[series u8][timestamp u32][value i32], pushed to subscribers
+    QP_RESP_ERROR = 0xFF        //[request type u8][QueryError u8]
+};
+
+enum QueryError : uint8_t {
+    QP_ERR_UNKNOWN_TYPE = 1,
+    QP_ERR_BAD_LENGTH = 2,
+    QP_ERR_BAD_SERIES = 3,
+    QP_ERR_BUSY = 4             //a range query is still streaming
+};
+
+const size_t QP_LATEST_ENTRY_SIZE = 9;
+const size_t QP_STATS_ENTRY_SIZE = 21;
+const size_t QP_SAMPLE_SIZE = 9;
+
+/* CRC-16/CCITT-FALSE. Pass the previous result as crc to continue over several pieces */
+uint16_t qpCrc16(const uint8_t* data, size_t length, uint16_t crc = 0xFFFF);
+
+// Fill the 5 byte frame header. The CRC is seeded from the header, continue it over the payload
+uint16_t qpWriteHeader(uint8_t type, uint16_t payloadLength, uint8_t* header);
+
+// Encode a whole frame into out, which must hold payloadLength + QP_HEADER_SIZE + QP_CRC_SIZE bytes
+size_t qpEncodeFrame(uint8_t type, const uint8_t* payload, uint16_t payloadLength, uint8_t* out);
+
+void qpPut16(uint8_t* out, uint16_t value);
+void qpPut32(uint8_t* out, uint32_t value);
+uint16_t qpGet16(const uint8_t* in);
+uint32_t qpGet32(const uint8_t* in);
+
+/* Byte-at-a-time frame parser. Anything that isn't a valid frame (e.g. log text) is skipped */
+class QueryFrameParser {
+public:
+    QueryFrameParser();
+
+    // Feed one received byte. Returns true when a complete frame with a valid CRC is ready,
+    // which stays available through type()/payload() until the next call
+    bool feed(uint8_t byte);
+
+    uint8_t type() const { return frameType; }
+    const uint8_t* payload() const { return buffer; }
+    uint16_t length() const { return payloadLength; }
+    uint32_t crcErrors() const { return badFrames; }
+
+private:
+    enum State : uint8_t { SYNC_1, SYNC_2, TYPE, LENGTH_LOW, LENGTH_HIGH, PAYLOAD, CRC_LOW, CRC_HIGH };
+
+    State state;
+    uint8_t frameType;
+    uint16_t payloadLength;
+    uint16_t received;
+    uint16_t frameCrc;
+    uint32_t badFrames;
+    uint8_t buffer[QP_MAX_PAYLOAD];
+};
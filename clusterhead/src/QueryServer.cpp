@@ -0,0 +1,214 @@
+/*
+ * QueryServer.cpp
+ * Description: implementation of the serial query server
+ * Author: Tom Schwenke
+ * Date: 19/10/2026
+ */
+#include "QueryServer.h"
+
+/* Returns true if any sample in the block falls within [from, to]. Samples are in the order
+   they arrived, which isn't time order: a node sends live readings ahead of its backlog, so
+   a later sample can be older. Every sample is checked rather than stopping past to */
+static bool blockOverlaps(const SealedBlock& block, uint32_t from, uint32_t to){
+    TimeSeriesDecoder decoder;
+    uint32_t timestamp;
+    int32_t value;
+    if(!decoder.begin(block.data, block.length)){
+        return false;
+    }
+    while(decoder.next(timestamp, value)){
+        if(timestamp >= from && timestamp <= to){
+            return true;
+        }
+    }
+    return false;
+}
+
+QueryServer::QueryServer(SeriesStore& store, USBSerial& port)
+    : store(store), port(port), rangeActive(false), rangeSeries(0), rangeFrom(0), rangeTo(0),
+      rangeNextSequence(0), rangeChunks(0), subscribedMask(0), sampleHead(0), sampleTail(0),
+      samplesDropped(0) {
+}
+
+void QueryServer::poll(){
+    while(port.available() > 0){
+        if(parser.feed(port.read())){
+            handleRequest(parser.type(), parser.payload(), parser.length());
+        }
+    }
+    if(rangeActive){
+        continueRange();
+    }
+    flushSamples();
+}
+
+void QueryServer::onSample(uint8_t series, uint32_t timestamp, int32_t value){
+    if(series >= SERIES_COUNT || (subscribedMask & (1 << series)) == 0){
+        return;
+    }
+    uint8_t next = (sampleHead + 1) % QUERY_SAMPLE_QUEUE;
+    if(next == sampleTail){
+        samplesDropped++;//host isn't keeping up, drop rather than hold up loop()
+        return;
+    }
+    uint8_t* entry = sampleQueue[sampleHead];
+    entry[0] = series;
+    qpPut32(entry + 1, timestamp);
+    qpPut32(entry + 5, (uint32_t) value);
+    sampleHead = next;
+}
+
+void QueryServer::handleRequest(uint8_t type, const uint8_t* payload, uint16_t length){
+    switch(type){
+        case QP_REQ_RANGE:
+            if(length != 9){
+                sendError(type, QP_ERR_BAD_LENGTH);
+            }
+            else if(payload[0] >= SERIES_COUNT){
+                sendError(type, QP_ERR_BAD_SERIES);
+            }
+            else if(rangeActive){
+                sendError(type, QP_ERR_BUSY);
+            }
+            else{
+                rangeActive = true;
+                rangeSeries = payload[0];
+                rangeFrom = qpGet32(payload + 1);
+                rangeTo = qpGet32(payload + 5);
+                rangeNextSequence = store.oldestSequence();
+                rangeChunks = 0;
+            }
+            break;
+        case QP_REQ_LATEST:
+            sendLatest();
+            break;
+        case QP_REQ_STATS:
+            sendStats();
+            break;
+        case QP_REQ_SUBSCRIBE:
+            if(length != 2){
+                sendError(type, QP_ERR_BAD_LENGTH);
+            }
+            else{
+                subscribedMask = qpGet16(payload) & ((1 << SERIES_COUNT) - 1);
+                sendEnd(type, 0);
+            }
+            break;
+        default:
+            sendError(type, QP_ERR_UNKNOWN_TYPE);
+            break;
+    }
+}
+
+void QueryServer::sendLatest(){
+    uint8_t payload[SERIES_COUNT * QP_LATEST_ENTRY_SIZE];
+    uint16_t length = 0;
+    SeriesStats stats;
+    for(uint8_t series = 0; series < SERIES_COUNT; series++){
+        if(store.copyStats(series, stats)){
+            payload[length] = series;
+            qpPut32(payload + length + 1, stats.lastTimestamp);
+            qpPut32(payload + length + 5, (uint32_t) stats.lastValue);
+            length += QP_LATEST_ENTRY_SIZE;
+        }
+    }
+    sendFrame(QP_RESP_LATEST, payload, length);
+}
+
+void QueryServer::sendStats(){
+    uint8_t payload[SERIES_COUNT * QP_STATS_ENTRY_SIZE];
+    uint16_t length = 0;
+    SeriesStats stats;
+    for(uint8_t series = 0; series < SERIES_COUNT; series++){
+        if(store.copyStats(series, stats)){
+            uint64_t sum = (uint64_t) stats.sum;
+            payload[length] = series;
+            qpPut32(payload + length + 1, stats.count);
+            qpPut32(payload + length + 5, (uint32_t) stats.min);
+            qpPut32(payload + length + 9, (uint32_t) stats.max);
+            qpPut32(payload + length + 13, (uint32_t) sum);
+            qpPut32(payload + length + 17, (uint32_t) (sum >> 32));
+            length += QP_STATS_ENTRY_SIZE;
+        }
+    }
+    sendFrame(QP_RESP_STATS, payload, length);
+}
+
+/* Send the next few matching blocks. Sealed blocks go oldest first, then the open
+   block of the series finishes the response. Each block is copied out of the store
+   one at a time, so only one block of the result is ever held here */
+void QueryServer::continueRange(){
+    SealedBlock block;
+    uint8_t sent = 0;
+
+    //blocks overwritten since the query started are simply skipped
+    uint32_t oldest = store.oldestSequence();
+    if(rangeNextSequence < oldest){
+        rangeNextSequence = oldest;
+    }
+    while(sent < QUERY_CHUNKS_PER_POLL && store.copySealed(rangeNextSequence, block)){
+        uint32_t sequence = rangeNextSequence++;
+        if(block.series == rangeSeries && blockOverlaps(block, rangeFrom, rangeTo)){
+            sendBlock(sequence, block);
+            sent++;
+        }
+    }
+    if(sent == QUERY_CHUNKS_PER_POLL){
+        return;//more to come on the next poll
+    }
+
+    if(store.copyOpen(rangeSeries, block) && blockOverlaps(block, rangeFrom, rangeTo)){
+        sendBlock(QP_OPEN_BLOCK, block);
+    }
+    sendEnd(QP_REQ_RANGE, rangeChunks);
+    rangeActive = false;
+}
+
+void QueryServer::sendBlock(uint32_t sequence, const SealedBlock& block){
+    uint8_t prefix[5];
+    prefix[0] = block.series;
+    qpPut32(prefix + 1, sequence);
+
+    //written in pieces straight from the block, rather than assembling a frame copy
+    uint8_t header[QP_HEADER_SIZE];
+    uint16_t crc = qpWriteHeader(QP_RESP_BLOCK, sizeof(prefix) + block.length, header);
+    crc = qpCrc16(prefix, sizeof(prefix), crc);
+    crc = qpCrc16(block.data, block.length, crc);
+    uint8_t trailer[QP_CRC_SIZE];
+    qpPut16(trailer, crc);
+
+    WITH_LOCK(port){
+        port.write(header, sizeof(header));
+        port.write(prefix, sizeof(prefix));
+        port.write(block.data, block.length);
+        port.write(trailer, sizeof(trailer));
+    }
+    rangeChunks++;
+}
+
+void QueryServer::sendEnd(uint8_t requestType, uint16_t chunks){
+    uint8_t payload[3];
+    payload[0] = requestType;
+    qpPut16(payload + 1, chunks);
+    sendFrame(QP_RESP_END, payload, sizeof(payload));
+}
+
+void QueryServer::sendError(uint8_t requestType, uint8_t error){
+    uint8_t payload[2] = { requestType, error };
+    sendFrame(QP_RESP_ERROR, payload, sizeof(payload));
+}
+
+void QueryServer::sendFrame(uint8_t type, const uint8_t* payload, uint16_t length){
+    uint8_t frame[QP_HEADER_SIZE + QP_MAX_PAYLOAD + QP_CRC_SIZE];
+    size_t frameLength = qpEncodeFrame(type, payload, length, frame);
+    WITH_LOCK(port){
+        port.write(frame, frameLength);
+    }
+}
+
+void QueryServer::flushSamples(){
+    while(sampleTail != sampleHead){
+        sendFrame(QP_RESP_SAMPLE, sampleQueue[sampleTail], QP_SAMPLE_SIZE);
+        sampleTail = (sampleTail + 1) % QUERY_SAMPLE_QUEUE;
+    }
+}
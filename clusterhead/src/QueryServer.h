@@ -0,0 +1,60 @@
+/*
+ * QueryServer.h
+ * Description: answers QueryProtocol requests from a host over USB serial using the
+ *              readings held in a SeriesStore. Range query results are streamed one
+ *              block per frame across several poll() calls, so a large result never
+ *              has to fit in RAM or stall loop().
+ * Author: Tom Schwenke
+ * Date: 19/10/2026
+ */
+#pragma once
+
+#include "Particle.h"
+#include "QueryProtocol.h"
+#include "SeriesStore.h"
+
+//range query chunks sent per poll(), keeps each loop() iteration short
+const uint8_t QUERY_CHUNKS_PER_POLL = 4;
+//samples queued for subscribers between poll() calls
+const size_t QUERY_SAMPLE_QUEUE = 16;
+
+class QueryServer {
+public:
+    QueryServer(SeriesStore& store, USBSerial& port);
+
+    // Handle incoming requests and continue any streaming response. Call from loop()
+    void poll();
+
+    // Offer a new reading to streaming subscribers. Call from loop(), as readings are stored
+    void onSample(uint8_t series, uint32_t timestamp, int32_t value);
+
+private:
+    void handleRequest(uint8_t type, const uint8_t* payload, uint16_t length);
+    void sendLatest();
+    void sendStats();
+    void continueRange();
+    void sendBlock(uint32_t sequence, const SealedBlock& block);
+    void sendEnd(uint8_t requestType, uint16_t chunks);
+    void sendError(uint8_t requestType, uint8_t error);
+    void sendFrame(uint8_t type, const uint8_t* payload, uint16_t length);
+    void flushSamples();
+
+    SeriesStore& store;
+    USBSerial& port;
+    QueryFrameParser parser;
+
+    /* state of the range query currently being streamed */
+    bool rangeActive;
+    uint8_t rangeSeries;
+    uint32_t rangeFrom;
+    uint32_t rangeTo;
+    uint32_t rangeNextSequence;
+    uint16_t rangeChunks;
+
+    /* subscriptions, filled by onSample() and drained in poll() */
+    volatile uint16_t subscribedMask;
+    uint8_t sampleQueue[QUERY_SAMPLE_QUEUE][QP_SAMPLE_SIZE];
+    volatile uint8_t sampleHead;
+    volatile uint8_t sampleTail;
+    uint32_t samplesDropped;
+};
@@ -0,0 +1,324 @@
+/*
+ * RelayRouter.cpp
+ * Description: implementation of relay mode routing, deduplication and batch framing
+ * Author: Tom Schwenke
+ * Date: 19/10/2026
+ */
+#include "RelayRouter.h"
+#include <string.h>
+
+static void put32(uint8_t* out, uint32_t value){
+    out[0] = value & 0xFF;
+    out[1] = (value >> 8) & 0xFF;
+    out[2] = (value >> 16) & 0xFF;
+    out[3] = (value >> 24) & 0xFF;
+}
+
+static void put16(uint8_t* out, uint16_t value){
+    out[0] = value & 0xFF;
+    out[1] = value >> 8;
+}
+
+static uint16_t get16(const uint8_t* in){
+    return in[0] | (in[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* in){
+    return (uint32_t) in[0] | ((uint32_t) in[1] << 8) | ((uint32_t) in[2] << 16) | ((uint32_t) in[3] << 24);
+}
+
+size_t relayEncodeBeacon(const RelayBeacon& beacon, uint8_t* out){
+    //0xFFFF is the company id reserved for testing
+    out[0] = 0xFF;
+    out[1] = 0xFF;
+    out[2] = RELAY_BEACON_MAGIC;
+    put32(out + 3, beacon.clusterId);
+    out[7] = beacon.hops;
+    put32(out + 8, beacon.parentId);
+    out[12] = beacon.openSlots;
+    return RELAY_BEACON_SIZE;
+}
+
+bool relayDecodeBeacon(const uint8_t* data, size_t length, RelayBeacon& out){
+    if(length < RELAY_BEACON_SIZE || data[0] != 0xFF || data[1] != 0xFF || data[2] != RELAY_BEACON_MAGIC){
+        return false;
+    }
+    out.clusterId = get32(data + 3);
+    out.hops = data[7];
+    out.parentId = get32(data + 8);
+    out.openSlots = data[12];
+    return out.clusterId != 0;
+}
+
+size_t relayEncodeAttach(const RelayAttach& attach, uint8_t* out){
+    put32(out, attach.parentId);
+    out[4] = attach.grant;
+    return RELAY_ATTACH_SIZE;
+}
+
+bool relayDecodeAttach(const uint8_t* data, size_t length, RelayAttach& out){
+    if(length < RELAY_ATTACH_SIZE){
+        return false;
+    }
+    out.parentId = get32(data);
+    out.grant = data[4];
+    return out.parentId != 0;
+}
+
+void RelayBatchWriter::begin(uint8_t* buffer, size_t capacity){
+    this->buffer = buffer;
+    this->capacity = capacity;
+    used = 0;
+    if(buffer != NULL && capacity > 0){
+        buffer[0] = 0;
+        used = 1;
+    }
+}
+
+bool RelayBatchWriter::add(uint32_t origin, uint16_t epoch, uint32_t sequence, uint8_t series, const uint8_t* block, uint8_t length){
+    if(buffer == NULL || buffer[0] == 0xFF || used + RELAY_ENTRY_HEADER + length > capacity){
+        return false;
+    }
+    uint8_t* entry = buffer + used;
+    put32(entry, origin);
+    put16(entry + 4, epoch);
+    put32(entry + 6, sequence);
+    entry[10] = series;
+    entry[11] = length;
+    memcpy(entry + RELAY_ENTRY_HEADER, block, length);
+    used += RELAY_ENTRY_HEADER + length;
+    buffer[0]++;
+    return true;
+}
+
+void RelayBatchReader::begin(const uint8_t* batch, size_t length){
+    this->batch = batch;
+    this->length = length;
+    offset = 1;
+    remaining = length > 0 ? batch[0] : 0;
+}
+
+bool RelayBatchReader::next(RelayEntry& out){
+    if(remaining == 0 || offset + RELAY_ENTRY_HEADER > length){
+        return false;
+    }
+    const uint8_t* entry = batch + offset;
+    if(offset + RELAY_ENTRY_HEADER + entry[11] > length){
+        remaining = 0;
+        return false;
+    }
+    out.origin = get32(entry);
+    out.epoch = get16(entry + 4);
+    out.sequence = get32(entry + 6);
+    out.series = entry[10];
+    out.length = entry[11];
+    out.block = entry + RELAY_ENTRY_HEADER;
+    offset += RELAY_ENTRY_HEADER + out.length;
+    remaining--;
+    return true;
+}
+
+RelayRouter::RelayRouter(){
+    begin(0);
+}
+
+void RelayRouter::begin(uint32_t selfId, uint16_t epoch){
+    this->selfId = selfId;
+    bootEpoch = epoch;
+    root = false;
+    parentId = 0;
+    parentHops = RELAY_NO_ROUTE;
+    parentSince = 0;
+    attached = false;
+    candidateCount = 0;
+    memset(children, 0, sizeof(children));
+    dedupNext = 0;
+    dedupCount = 0;
+    duplicateCount = 0;
+}
+
+void RelayRouter::setRoot(bool root){
+    this->root = root;
+}
+
+uint8_t RelayRouter::hops() const {
+    if(root){
+        return 0;
+    }
+    return parentId != 0 ? parentHops + 1 : RELAY_NO_ROUTE;
+}
+
+RelayBeacon RelayRouter::beacon() const {
+    RelayBeacon beacon;
+    beacon.clusterId = selfId;
+    beacon.hops = hops();
+    beacon.parentId = root ? 0 : parentId;
+    beacon.openSlots = RELAY_MAX_CHILDREN - childCount();
+    return beacon;
+}
+
+uint8_t RelayRouter::childCount() const {
+    uint8_t count = 0;
+    for(uint8_t slot = 0; slot < RELAY_MAX_CHILDREN; slot++){
+        if(children[slot].clusterId != 0){
+            count++;
+        }
+    }
+    return count;
+}
+
+int RelayRouter::childSlot(uint32_t clusterId) const {
+    for(uint8_t slot = 0; slot < RELAY_MAX_CHILDREN; slot++){
+        if(clusterId != 0 && children[slot].clusterId == clusterId){
+            return slot;
+        }
+    }
+    return -1;
+}
+
+int RelayRouter::nextChild(int after) const {
+    for(uint8_t i = 1; i <= RELAY_MAX_CHILDREN; i++){
+        int slot = after < 0 ? i - 1 : (after + i) % RELAY_MAX_CHILDREN;
+        if(children[slot].clusterId != 0){
+            return slot;
+        }
+    }
+    return -1;
+}
+
+void RelayRouter::dropChild(uint32_t clusterId){
+    int slot = childSlot(clusterId);
+    if(slot >= 0){
+        children[slot].clusterId = 0;
+    }
+}
+
+uint16_t RelayRouter::cost(const Candidate& candidate){
+    uint16_t linkCost = candidate.rssi < RELAY_GOOD_RSSI ? RELAY_GOOD_RSSI - candidate.rssi : 0;
+    return (candidate.hops + 1) * RELAY_HOP_COST + linkCost;
+}
+
+void RelayRouter::onBeacon(const RelayBeacon& beacon, int8_t rssi, uint32_t now){
+    if(beacon.clusterId == selfId){
+        return;
+    }
+    Candidate heard;
+    heard.clusterId = beacon.clusterId;
+    //a clusterhead routing through us can't be our parent, treat it as having no route
+    heard.hops = beacon.parentId == selfId ? RELAY_NO_ROUTE : beacon.hops;
+    heard.rssi = rssi;
+    heard.openSlots = beacon.openSlots;
+    heard.lastSeen = now;
+
+    //take on clusterheads that pick us while there's room, and let go of those that pick another
+    int slot = childSlot(beacon.clusterId);
+    if(beacon.parentId == selfId){
+        if(slot < 0){
+            for(uint8_t free = 0; free < RELAY_MAX_CHILDREN && slot < 0; free++){
+                if(children[free].clusterId == 0){
+                    slot = free;
+                    children[slot].clusterId = beacon.clusterId;
+                }
+            }
+        }
+        if(slot >= 0){
+            children[slot].lastSeen = now;
+        }
+    }
+    else if(slot >= 0){
+        children[slot].clusterId = 0;
+    }
+
+    for(uint8_t i = 0; i < candidateCount; i++){
+        if(candidates[i].clusterId == beacon.clusterId){
+            //average out fading, so a single strong or weak beacon doesn't move us
+            heard.rssi = (candidates[i].rssi * (RELAY_RSSI_SMOOTHING - 1) + rssi) / RELAY_RSSI_SMOOTHING;
+            candidates[i] = heard;
+            return;
+        }
+    }
+    if(candidateCount < RELAY_MAX_CANDIDATES){
+        candidates[candidateCount++] = heard;
+        return;
+    }
+    //table is full, in a dense site only the cheapest routes are worth remembering
+    uint8_t worst = 0;
+    for(uint8_t i = 1; i < candidateCount; i++){
+        if(cost(candidates[i]) > cost(candidates[worst])){
+            worst = i;
+        }
+    }
+    if(cost(heard) < cost(candidates[worst]) && candidates[worst].clusterId != parentId){
+        candidates[worst] = heard;
+    }
+}
+
+bool RelayRouter::update(uint32_t now){
+    //drop candidates we haven't heard from in a while
+    for(uint8_t i = 0; i < candidateCount; ){
+        if(now - candidates[i].lastSeen > RELAY_CANDIDATE_TIMEOUT){
+            candidates[i] = candidates[--candidateCount];
+        }
+        else{
+            i++;
+        }
+    }
+    for(uint8_t slot = 0; slot < RELAY_MAX_CHILDREN; slot++){
+        if(children[slot].clusterId != 0 && now - children[slot].lastSeen > RELAY_CANDIDATE_TIMEOUT){
+            children[slot].clusterId = 0;
+        }
+    }
+
+    uint32_t previous = parentId;
+    if(root){
+        parentId = 0;
+        parentHops = RELAY_NO_ROUTE;
+        return previous != 0;
+    }
+
+    const Candidate* best = NULL;
+    const Candidate* current = NULL;
+    for(uint8_t i = 0; i < candidateCount; i++){
+        const Candidate& candidate = candidates[i];
+        //one that is full can't take us, unless it has us already or may be about to
+        bool holdsUs = candidate.clusterId == parentId && (attached || now - parentSince < RELAY_ADOPT_TIMEOUT);
+        if(candidate.hops >= RELAY_MAX_HOPS || candidate.rssi < RELAY_MIN_RSSI || (candidate.openSlots == 0 && !holdsUs)){
+            continue;
+        }
+        if(candidate.clusterId == parentId){
+            current = &candidate;
+        }
+        if(best == NULL || cost(candidate) < cost(*best)){
+            best = &candidate;
+        }
+    }
+
+    //stick with the current parent unless the best is clearly better
+    if(current != NULL && best != current && cost(*current) <= cost(*best) + RELAY_SWITCH_MARGIN){
+        best = current;
+    }
+    parentId = best != NULL ? best->clusterId : 0;
+    parentHops = best != NULL ? best->hops : RELAY_NO_ROUTE;
+    if(parentId != previous){
+        parentSince = now;
+        attached = false;
+    }
+    return parentId != previous;
+}
+
+bool RelayRouter::seen(uint32_t origin, uint16_t epoch, uint32_t sequence){
+    for(uint8_t i = 0; i < dedupCount; i++){
+        if(dedupOrigin[i] == origin && dedupEpoch[i] == epoch && dedupSequence[i] == sequence){
+            duplicateCount++;
+            return true;
+        }
+    }
+    dedupOrigin[dedupNext] = origin;
+    dedupEpoch[dedupNext] = epoch;
+    dedupSequence[dedupNext] = sequence;
+    dedupNext = (dedupNext + 1) % RELAY_DEDUP_ENTRIES;
+    if(dedupCount < RELAY_DEDUP_ENTRIES){
+        dedupCount++;
+    }
+    return false;
+}
@@ -0,0 +1,206 @@
+/*
+ * RelayRouter.h
+ * Description: routing and framing for relay mode, where clusterheads form a tree and pass
+ *              compressed series blocks up it towards a cloud connected root.
+ *              Every clusterhead advertises its cluster id, hop count to the root, chosen
+ *              parent and how many more children it can take. A clusterhead picks the parent
+ *              with the lowest cost, counting hops and link quality (RSSI), among those with a
+ *              child slot free or already holding us, then acts as a BLE peripheral to it.
+ *              A parent takes the first RELAY_MAX_CHILDREN clusterheads to pick it, and they
+ *              take turns on its one spare central link: it connects to each in turn and
+ *              says how many blocks it has room for. Blocks from all of them are batched
+ *              together on the way up, and deduplicated on (origin cluster, boot epoch,
+ *              block sequence).
+ *              Does not depend on Particle.h, so tools/relaysim can run the same logic.
+ * Author: Tom Schwenke
+ * Date: 19/10/2026
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+//hop count advertised while no route to the root is known
+const uint8_t RELAY_NO_ROUTE = 0xFF;
+//trees deeper than this are refused, also stops count-to-infinity after a root goes away
+const uint8_t RELAY_MAX_HOPS = 8;
+//clusterheads heard from recently enough to be parent candidates
+const uint8_t RELAY_MAX_CANDIDATES = 8;
+//seconds without hearing a candidate or child before it is forgotten
+const uint32_t RELAY_CANDIDATE_TIMEOUT = 90;
+//children a clusterhead takes. The sensor nodes hold two of the argon's three central links,
+//so the children share the third, one at a time
+const uint8_t RELAY_MAX_CHILDREN = 4;
+//seconds we wait to be taken on by a parent that has no free slot before looking elsewhere.
+//It may already hold one for us, as it learns its children from scans
+const uint32_t RELAY_ADOPT_TIMEOUT = 90;
+
+/* Route cost = hops * RELAY_HOP_COST + 1 per dB the link is below RELAY_GOOD_RSSI,
+   so a weak link counts against a route like extra hops do */
+const uint16_t RELAY_HOP_COST = 10;
+const int8_t RELAY_GOOD_RSSI = -70;
+//links weaker than this are never used
+const int8_t RELAY_MIN_RSSI = -92;
+//a candidate's RSSI is a running average, each beacon counting for 1 / RELAY_RSSI_SMOOTHING
+const int RELAY_RSSI_SMOOTHING = 4;
+//a new parent has to be this much cheaper than the current one, stops flapping between similar routes
+const uint16_t RELAY_SWITCH_MARGIN = 5;
+
+//(origin, epoch, sequence) entries remembered for deduplication
+const uint8_t RELAY_DEDUP_ENTRIES = 64;
+
+/* Advertised relay beacon, carried as manufacturer specific data:
+   [company id 0xFFFF u16][magic 'R'][cluster id u32][hops u8][parent id u32][free child slots u8] */
+const size_t RELAY_BEACON_SIZE = 13;
+const uint8_t RELAY_BEACON_MAGIC = 'R';
+
+/* Written by a parent to the child whose turn it is: [parent cluster id u32][blocks it has room for u8] */
+const size_t RELAY_ATTACH_SIZE = 5;
+
+/* A relay batch is [entry count u8] followed by entries of
+   [origin cluster u32][boot epoch u16][block sequence u32][series u8][block length u8][block...]
+   Block sequences start again when a clusterhead restarts, and the epoch it picks at random
+   each boot keeps the new blocks from looking like duplicates of the old ones */
+const size_t RELAY_ENTRY_HEADER = 12;
+
+struct RelayBeacon {
+    uint32_t clusterId;
+    uint8_t hops;
+    uint32_t parentId;
+    uint8_t openSlots;      //children it can still take
+};
+
+struct RelayAttach {
+    uint32_t parentId;
+    uint8_t grant;
+};
+
+struct RelayEntry {
+    uint32_t origin;
+    uint16_t epoch;
+    uint32_t sequence;
+    uint8_t series;
+    uint8_t length;
+    const uint8_t* block;   //points into the batch it was read from
+};
+
+size_t relayEncodeBeacon(const RelayBeacon& beacon, uint8_t* out);
+bool relayDecodeBeacon(const uint8_t* data, size_t length, RelayBeacon& out);
+size_t relayEncodeAttach(const RelayAttach& attach, uint8_t* out);
+bool relayDecodeAttach(const uint8_t* data, size_t length, RelayAttach& out);
+
+/* Builds a batch in a caller owned buffer, typically one notification's worth */
+class RelayBatchWriter {
+public:
+    void begin(uint8_t* buffer, size_t capacity);
+
+    // Returns false if the entry doesn't fit, the batch is left as it was
+    bool add(uint32_t origin, uint16_t epoch, uint32_t sequence, uint8_t series, const uint8_t* block, uint8_t length);
+
+    uint8_t count() const { return buffer != NULL ? buffer[0] : 0; }
+    size_t length() const { return used; }
+
+private:
+    uint8_t* buffer = NULL;
+    size_t capacity = 0;
+    size_t used = 0;
+};
+
+/* Reads entries back out of a received batch, stopping at the first truncated one */
+class RelayBatchReader {
+public:
+    void begin(const uint8_t* batch, size_t length);
+    bool next(RelayEntry& out);
+
+private:
+    const uint8_t* batch = NULL;
+    size_t length = 0;
+    size_t offset = 0;
+    uint8_t remaining = 0;
+};
+
+class RelayRouter {
+public:
+    RelayRouter();
+
+    // Set this clusterhead's id, e.g. from its BLE address, and its boot epoch, random each
+    // boot, and forget all routing state
+    void begin(uint32_t selfId, uint16_t epoch = 0);
+
+    // A root has a route to the cloud of its own, and so is hop 0
+    void setRoot(bool root);
+
+    // Feed every relay beacon heard while scanning. now is in seconds. A clusterhead naming
+    // us as its parent is taken on as a child if there's a slot, one naming another is let go
+    void onBeacon(const RelayBeacon& beacon, int8_t rssi, uint32_t now);
+
+    // Forget stale candidates and children, and re-pick the parent. Returns true if the
+    // parent changed
+    bool update(uint32_t now);
+
+    // Whether our parent has taken us on, i.e. has connected and granted us room lately.
+    // A parent with no free slot stays a candidate while it has us
+    void setAttached(bool attached){ this->attached = attached; }
+
+    uint32_t self() const { return selfId; }
+    uint16_t epoch() const { return bootEpoch; }
+    bool isRoot() const { return root; }
+    uint32_t parent() const { return parentId; }   //0 when there is none
+    uint8_t hops() const;
+
+    /* Children keep the same slot, 0 to RELAY_MAX_CHILDREN - 1, for as long as they stay,
+       so callers can keep per child state (an address, a connection) alongside */
+    uint32_t child(uint8_t slot) const { return children[slot].clusterId; }   //0 when free
+    uint8_t childCount() const;
+    int childSlot(uint32_t clusterId) const;    //-1 if it isn't our child
+
+    // The slot whose turn on the link comes after the given one, -1 to start from the first.
+    // -1 when there are no children
+    int nextChild(int after) const;
+
+    // Let a child go, e.g. one we keep failing to connect to. It is taken back on if its
+    // beacon still names us
+    void dropChild(uint32_t clusterId);
+
+    // The beacon this clusterhead should be advertising
+    RelayBeacon beacon() const;
+
+    // True if this (origin, epoch, sequence) has been seen before. Records it if not
+    bool seen(uint32_t origin, uint16_t epoch, uint32_t sequence);
+    uint32_t duplicates() const { return duplicateCount; }
+
+private:
+    struct Candidate {
+        uint32_t clusterId;
+        uint8_t hops;
+        int8_t rssi;
+        uint8_t openSlots;
+        uint32_t lastSeen;
+    };
+
+    struct Child {
+        uint32_t clusterId;     //0 while the slot is free
+        uint32_t lastSeen;
+    };
+
+    static uint16_t cost(const Candidate& candidate);
+
+    uint32_t selfId;
+    uint16_t bootEpoch;
+    bool root;
+    uint32_t parentId;
+    uint8_t parentHops;
+    uint32_t parentSince;
+    bool attached;
+
+    Candidate candidates[RELAY_MAX_CANDIDATES];
+    uint8_t candidateCount;
+    Child children[RELAY_MAX_CHILDREN];
+
+    uint32_t dedupOrigin[RELAY_DEDUP_ENTRIES];
+    uint16_t dedupEpoch[RELAY_DEDUP_ENTRIES];
+    uint32_t dedupSequence[RELAY_DEDUP_ENTRIES];
+    uint8_t dedupNext;
+    uint8_t dedupCount;
+    uint32_t duplicateCount;
+};
@@ -0,0 +1,148 @@
+/*
+ * SeriesStore.cpp
+ * Description: implementation of the clusterhead's compressed series store
+ * Author: Tom Schwenke
+ * Date: 19/10/2026
+ */
+#include "SeriesStore.h"
+
+SeriesStore::SeriesStore()
+    : sealedTotal(0), samplesEncoded(0), encodeMicros(0),
+      rawBytesSealed(0), encodedBytesSealed(0) {
+    memset(stats, 0, sizeof(stats));
+    for(uint8_t i = 0; i < SERIES_COUNT; i++){
+        encoders[i].begin(openBlocks[i], SERIES_BLOCK_SIZE);
+    }
+}
+
+void SeriesStore::append(uint8_t series, uint32_t timestamp, int32_t value){
+    if(series >= SERIES_COUNT){
+        return;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+
+    unsigned long start = micros();
+    if(!encoders[series].append(timestamp, value)){
+        //block is full, so move it into the log and start a fresh one
+        sealLocked(series);
+        encoders[series].append(timestamp, value);
+    }
+    encodeMicros += micros() - start;
+    samplesEncoded++;
+
+    SeriesStats& s = stats[series];
+    if(s.count == 0 || value < s.min){
+        s.min = value;
+    }
+    if(s.count == 0 || value > s.max){
+        s.max = value;
+    }
+    //backlogged readings arrive after newer live ones, latest means newest taken
+    if(s.count == 0 || timestamp >= s.lastTimestamp){
+        s.lastTimestamp = timestamp;
+        s.lastValue = value;
+    }
+    s.count++;
+    s.sum += value;
+}
+
+void SeriesStore::seal(uint8_t series){
+    if(series >= SERIES_COUNT){
+        return;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    sealLocked(series);
+}
+
+void SeriesStore::sealLocked(uint8_t series){
+    TimeSeriesEncoder& encoder = encoders[series];
+    if(encoder.count() == 0){
+        return;
+    }
+    size_t length = encoder.finish();
+    rawBytesSealed += encoder.rawSize();
+    encodedBytesSealed += length;
+
+    SealedBlock& block = log[sealedTotal % SERIES_LOG_BLOCKS];
+    block.series = series;
+    block.length = length;
+    memcpy(block.data, openBlocks[series], length);
+    sealedTotal++;
+
+    Log.trace("Sealed block for series %u: %u samples in %u bytes", series, encoder.count(), length);
+    encoder.begin(openBlocks[series], SERIES_BLOCK_SIZE);
+}
+
+uint32_t SeriesStore::oldestSequence(){
+    std::lock_guard<std::mutex> guard(lock);
+    return sealedTotal > SERIES_LOG_BLOCKS ? sealedTotal - SERIES_LOG_BLOCKS : 0;
+}
+
+uint32_t SeriesStore::nextSequence(){
+    std::lock_guard<std::mutex> guard(lock);
+    return sealedTotal;
+}
+
+bool SeriesStore::copySealed(uint32_t sequence, SealedBlock& out){
+    std::lock_guard<std::mutex> guard(lock);
+    if(sequence >= sealedTotal || sealedTotal - sequence > SERIES_LOG_BLOCKS){
+        return false;
+    }
+    const SealedBlock& block = log[sequence % SERIES_LOG_BLOCKS];
+    out.series = block.series;
+    out.length = block.length;
+    memcpy(out.data, block.data, block.length);
+    return true;
+}
+
+bool SeriesStore::copyOpen(uint8_t series, SealedBlock& out){
+    if(series >= SERIES_COUNT){
+        return false;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    if(encoders[series].count() == 0){
+        return false;
+    }
+    //finish() only patches the header count, so appending can carry on afterwards
+    out.series = series;
+    out.length = encoders[series].finish();
+    memcpy(out.data, openBlocks[series], out.length);
+    return true;
+}
+
+bool SeriesStore::copyStats(uint8_t series, SeriesStats& out){
+    if(series >= SERIES_COUNT){
+        return false;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    out = stats[series];
+    return out.count > 0;
+}
+
+void SeriesStore::logReport(){
+    //decode everything held to time the decoder against the same data
+    uint32_t samplesDecoded = 0;
+    uint32_t blocksDecoded = 0;
+    uint32_t decodeMicros = 0;
+    SealedBlock block;
+    for(uint32_t sequence = oldestSequence(); copySealed(sequence, block); sequence++){
+        TimeSeriesDecoder decoder;
+        uint32_t timestamp;
+        int32_t value;
+        unsigned long start = micros();
+        decoder.begin(block.data, block.length);
+        while(decoder.next(timestamp, value)){
+            samplesDecoded++;
+        }
+        decodeMicros += micros() - start;
+        blocksDecoded++;
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    Log.info("Codec: %lu samples encoded in %lu us", samplesEncoded, encodeMicros);
+    Log.info("Codec: %lu samples decoded from %lu sealed blocks in %lu us", samplesDecoded, blocksDecoded, decodeMicros);
+    if(encodedBytesSealed > 0){
+        Log.info("Codec: %lu raw bytes sealed into %lu bytes, ratio %.2f",
+            rawBytesSealed, encodedBytesSealed, (double) rawBytesSealed / encodedBytesSealed);
+    }
+}
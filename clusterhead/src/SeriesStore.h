@@ -0,0 +1,98 @@
+/*
+ * SeriesStore.h
+ * Description: keeps every sensor series received by the clusterhead as compressed
+ *              TimeSeriesCodec blocks. Each series has one open block being appended to,
+ *              full blocks are sealed into a shared ring (the block log) which the
+ *              cloud uplink and local queries read from.
+ *              Readings are appended and queries answered from loop(), BLE callbacks only
+ *              queue frames for it. Access still goes through an internal mutex, and readers
+ *              get copies so none of them holds it while sending.
+ * Author: Tom Schwenke
+ * Date: 19/10/2026
+ */
+#pragma once
+
+#include "Particle.h"
+#include "TimeSeriesCodec.h"
+#include <mutex>
+
+/* Every series the clusterhead keeps, one per characteristic it subscribes to plus derived ones */
+enum SeriesId : uint8_t {
+    SERIES_TEMPERATURE_1 = 0,
+    SERIES_HUMIDITY,
+    SERIES_LIGHT_1,
+    SERIES_DISTANCE,
+    SERIES_TEMPERATURE_2,
+    SERIES_LIGHT_2,
+    SERIES_SOUND,
+    SERIES_HUMAN_DETECTOR,
+    SERIES_OCCUPANCY,       //fused presence confidence, 0 while unoccupied
+    SERIES_COUNT
+};
+
+//bytes per compressed block. ~100 slowly changing samples fit in one
+const size_t SERIES_BLOCK_SIZE = 128;
+//number of sealed blocks kept before the oldest is overwritten
+const size_t SERIES_LOG_BLOCKS = 24;
+
+struct SealedBlock {
+    uint8_t series;
+    uint16_t length;
+    uint8_t data[SERIES_BLOCK_SIZE];
+};
+
+/* Running summary of a series since boot */
+struct SeriesStats {
+    uint32_t count;
+    int32_t min;
+    int32_t max;
+    int64_t sum;
+    uint32_t lastTimestamp;    //of the newest reading, which needn't be the last to arrive
+    int32_t lastValue;
+};
+
+class SeriesStore {
+public:
+    SeriesStore();
+
+    // Add a reading to a series, sealing its open block into the log if it is full
+    void append(uint8_t series, uint32_t timestamp, int32_t value);
+
+    // Seal the open block of a series early, e.g. before an uplink. No-op if it is empty
+    void seal(uint8_t series);
+
+    /* Sealed blocks are numbered in the order they were sealed. Sequences from
+       oldestSequence() up to (but not including) nextSequence() are still held */
+    uint32_t oldestSequence();
+    uint32_t nextSequence();
+
+    // Copy out a sealed block. Returns false if it has been overwritten or not sealed yet
+    bool copySealed(uint32_t sequence, SealedBlock& out);
+
+    // Copy out the block currently being appended to. Returns false if it is empty
+    bool copyOpen(uint8_t series, SealedBlock& out);
+
+    // Copy out the summary of a series. Returns false if nothing has been received for it
+    bool copyStats(uint8_t series, SeriesStats& out);
+
+    // Log compression ratio and encode/decode throughput over everything held
+    void logReport();
+
+private:
+    void sealLocked(uint8_t series);
+
+    std::mutex lock;
+
+    TimeSeriesEncoder encoders[SERIES_COUNT];
+    uint8_t openBlocks[SERIES_COUNT][SERIES_BLOCK_SIZE];
+    SeriesStats stats[SERIES_COUNT];
+
+    SealedBlock log[SERIES_LOG_BLOCKS];
+    uint32_t sealedTotal;  //sequence number the next sealed block gets
+
+    //running totals for the compression report
+    uint32_t samplesEncoded;
+    uint32_t encodeMicros;
+    uint32_t rawBytesSealed;
+    uint32_t encodedBytesSealed;
+};
@@ -0,0 +1,59 @@
+/*
+ * StreamFrame.cpp
+ * Description: implementation of the node frame decoders
+ * Author: Tom Schwenke
+ * Date: 19/10/2026
+ */
+#include "StreamFrame.h"
+
+bool StreamFrameReader::begin(const uint8_t* data, size_t len){
+    this->data = data;
+    index = 0;
+    skippedCount = 0;
+    if(len < 1){
+        count = claimed = 0;
+        return false;
+    }
+    claimed = data[0];
+    size_t present = (len - 1) / STREAM_RECORD_SIZE;
+    count = claimed < present ? claimed : present;
+    return true;
+}
+
+bool StreamFrameReader::next(StreamRecord& out){
+    while(index < count){
+        const uint8_t* record = &data[1 + index * STREAM_RECORD_SIZE];
+        index++;
+        if(record[0] >= STREAM_SENSORS){
+            skippedCount++;
+            continue;
+        }
+        out.sensor = record[0];
+        out.value = record[1] | (record[2] << 8);
+        out.timestamp = (uint32_t) record[3] | ((uint32_t) record[4] << 8)
+            | ((uint32_t) record[5] << 16) | ((uint32_t) record[6] << 24);
+        return true;
+    }
+    return false;
+}
+
+bool streamDecodeDiagnostics(const uint8_t* data, size_t len, DiagnosticsFrame& out){
+    if(len < 1){
+        return false;
+    }
+    out.type = data[0];
+    switch(out.type){
+        case DIAGNOSTICS_ENERGY: return EnergyMeter::decode(&data[1], len - 1, out.energy);
+        case DIAGNOSTICS_HEALTH: return HealthMonitor::decode(&data[1], len - 1, out.health);
+        case DIAGNOSTICS_CONFIG: return configStatusDecode(&data[1], len - 1, out.config);
+        default: return false;
+    }
+}
+
+bool streamDecodeEvent(const uint8_t* data, size_t len, uint8_t& sensor, EventWindow& window){
+    if(len < 1 || data[0] >= STREAM_SENSORS){
+        return false;
+    }
+    sensor = data[0];
+    return EventDetector::decode(&data[1], len - 1, window);
+}
@@ -0,0 +1,73 @@
+/*
+ * StreamFrame.h
+ * Description: decoding of the frames a node sends once they are opened, see NodeIngest.h:
+ *              stream notifications of readings, diagnostics reports and event windows.
+ *              Does not depend on Particle.h, so tools/decodefuzz can fuzz the same code.
+ * Author: Tom Schwenke
+ * Date: 19/10/2026
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "EnergyMeter.h"
+#include "EventDetector.h"
+#include "HealthMonitor.h"
+#include "NodeConfig.h"
+
+/* A stream notification is [record count u8][records...], each record
+   [sensor index u8][value u16][timestamp u32], little endian, as FrameBacklog stores them */
+const size_t STREAM_RECORD_SIZE = 7;
+//sensors on each node, the indices its records and event windows use
+const uint8_t STREAM_SENSORS = 4;
+
+/* A diagnostics frame is [type u8][payload...] */
+const uint8_t DIAGNOSTICS_ENERGY = 0x01;    //EnergyMeter report
+const uint8_t DIAGNOSTICS_CONFIG = 0x02;    //config status, see CONFIG_STATUS_SIZE in NodeConfig.h
+const uint8_t DIAGNOSTICS_HEALTH = 0x03;    //HealthMonitor report
+
+struct StreamRecord {
+    uint8_t sensor;     //below STREAM_SENSORS
+    uint16_t value;     //raw bits, the node's sensor decides the type
+    uint32_t timestamp;
+};
+
+/* Walks the records of a stream notification. A count running past the end of the frame is
+   cut to the records that are there, and records for a sensor index out of range are skipped */
+class StreamFrameReader {
+public:
+    StreamFrameReader() : data(NULL), count(0), index(0), claimed(0), skippedCount(0) {}
+
+    // False if the frame is empty
+    bool begin(const uint8_t* data, size_t len);
+
+    bool next(StreamRecord& out);
+
+    // The count the frame claimed, and whether it was more than the frame holds
+    uint8_t claimedCount() const { return claimed; }
+    bool truncated() const { return count < claimed; }
+    uint8_t skipped() const { return skippedCount; }
+
+private:
+    const uint8_t* data;
+    uint8_t count;
+    uint8_t index;
+    uint8_t claimed;
+    uint8_t skippedCount;
+};
+
+/* A diagnostics frame, decoded by its type */
+struct DiagnosticsFrame {
+    uint8_t type;
+    EnergyReport energy;
+    HealthReport health;
+    ConfigStatusReport config;
+};
+
+// False if it is empty, of an unknown type or its payload doesn't decode. type is set whenever
+// the frame isn't empty, so the caller can say which it was
+bool streamDecodeDiagnostics(const uint8_t* data, size_t len, DiagnosticsFrame& out);
+
+// An event frame, [sensor index u8][EventDetector window]. False if it doesn't decode or the
+// sensor is out of range
+bool streamDecodeEvent(const uint8_t* data, size_t len, uint8_t& sensor, EventWindow& window);
@@ -0,0 +1,252 @@
+/*
+ * TimeSeriesCodec.cpp
+ * Description: implementation of the Gorilla-style time series block codec
+ * Author: Tom Schwenke
+ * Date: 19/10/2026
+ */
+#include "TimeSeriesCodec.h"
+
+/* Zig-zag maps signed deltas onto unsigned ints so small magnitudes of either sign
+   get small codes: 0 -> 0, -1 -> 1, 1 -> 2, -2 -> 3 ... */
+static inline uint32_t zigzagEncode(int32_t n){
+    return ((uint32_t) n << 1) ^ (uint32_t) (n >> 31);
+}
+
+static inline int32_t zigzagDecode(uint32_t n){
+    return (int32_t) (n >> 1) ^ -(int32_t) (n & 1);
+}
+
+//all arithmetic on deltas is done modulo 2^32 so the encoder and decoder agree even on wrap
+static inline int32_t wrappingDelta(uint32_t current, uint32_t previous){
+    return (int32_t) (current - previous);
+}
+
+TimeSeriesEncoder::TimeSeriesEncoder()
+    : buffer(NULL), capacityBits(0), bitPos(0), sampleCount(0),
+      lastTimestamp(0), lastDelta(0), lastValue(0) {
+}
+
+void TimeSeriesEncoder::begin(uint8_t* buffer, size_t capacity){
+    //too small for even the header, so every append() fails
+    this->buffer = capacity >= TSC_HEADER_SIZE ? buffer : NULL;
+    //bit positions are tracked in 16 bits, which caps a block at ~8KB
+    size_t streamBytes = capacity > TSC_HEADER_SIZE ? capacity - TSC_HEADER_SIZE : 0;
+    if(streamBytes > 8000){
+        streamBytes = 8000;
+    }
+    capacityBits = streamBytes * 8;
+    bitPos = 0;
+    sampleCount = 0;
+    lastTimestamp = 0;
+    lastDelta = 0;
+    lastValue = 0;
+}
+
+/* Timestamp delta-of-delta buckets:
+   '0'                  dod == 0
+   '10'   + 7 bits      zig-zag dod < 2^7
+   '110'  + 9 bits      zig-zag dod < 2^9
+   '1110' + 12 bits     zig-zag dod < 2^12
+   '1111' + 32 bits     anything else */
+uint8_t TimeSeriesEncoder::timestampBits(int32_t deltaOfDelta){
+    uint32_t zz = zigzagEncode(deltaOfDelta);
+    if(zz == 0) return 1;
+    if(zz < (1UL << 7)) return 2 + 7;
+    if(zz < (1UL << 9)) return 3 + 9;
+    if(zz < (1UL << 12)) return 4 + 12;
+    return 4 + 32;
+}
+
+/* Value delta buckets:
+   '0'                  value unchanged
+   '10'  + 6 bits       zig-zag delta < 2^6
+   '110' + 12 bits      zig-zag delta < 2^12
+   '111' + 32 bits      anything else */
+uint8_t TimeSeriesEncoder::valueBits(uint32_t zigzagDelta){
+    if(zigzagDelta == 0) return 1;
+    if(zigzagDelta < (1UL << 6)) return 2 + 6;
+    if(zigzagDelta < (1UL << 12)) return 3 + 12;
+    return 3 + 32;
+}
+
+bool TimeSeriesEncoder::append(uint32_t timestamp, int32_t value){
+    if(buffer == NULL){
+        return false;
+    }
+
+    //first sample goes into the header uncompressed
+    if(sampleCount == 0){
+        buffer[2] = timestamp & 0xFF;
+        buffer[3] = (timestamp >> 8) & 0xFF;
+        buffer[4] = (timestamp >> 16) & 0xFF;
+        buffer[5] = (timestamp >> 24) & 0xFF;
+        uint32_t rawValue = (uint32_t) value;
+        buffer[6] = rawValue & 0xFF;
+        buffer[7] = (rawValue >> 8) & 0xFF;
+        buffer[8] = (rawValue >> 16) & 0xFF;
+        buffer[9] = (rawValue >> 24) & 0xFF;
+        lastTimestamp = timestamp;
+        lastDelta = 0;
+        lastValue = value;
+        sampleCount = 1;
+        return true;
+    }
+    if(sampleCount == UINT16_MAX){
+        return false;
+    }
+
+    int32_t delta = wrappingDelta(timestamp, lastTimestamp);
+    int32_t deltaOfDelta = wrappingDelta((uint32_t) delta, (uint32_t) lastDelta);
+    uint32_t valueDelta = zigzagEncode(wrappingDelta((uint32_t) value, (uint32_t) lastValue));
+
+    //check the whole sample fits before writing any of it, so a full block stays valid
+    uint8_t tsBits = timestampBits(deltaOfDelta);
+    uint8_t valBits = valueBits(valueDelta);
+    if((uint32_t) bitPos + tsBits + valBits > capacityBits){
+        return false;
+    }
+
+    uint32_t zz = zigzagEncode(deltaOfDelta);
+    switch(tsBits){
+        case 1:         writeBits(0x0, 1); break;
+        case 2 + 7:     writeBits(0x2, 2); writeBits(zz, 7); break;
+        case 3 + 9:     writeBits(0x6, 3); writeBits(zz, 9); break;
+        case 4 + 12:    writeBits(0xE, 4); writeBits(zz, 12); break;
+        default:        writeBits(0xF, 4); writeBits(zz, 32); break;
+    }
+    switch(valBits){
+        case 1:         writeBits(0x0, 1); break;
+        case 2 + 6:     writeBits(0x2, 2); writeBits(valueDelta, 6); break;
+        case 3 + 12:    writeBits(0x6, 3); writeBits(valueDelta, 12); break;
+        default:        writeBits(0x7, 3); writeBits(valueDelta, 32); break;
+    }
+
+    lastTimestamp = timestamp;
+    lastDelta = delta;
+    lastValue = value;
+    sampleCount++;
+    return true;
+}
+
+size_t TimeSeriesEncoder::finish(){
+    if(buffer == NULL){
+        return 0;
+    }
+    buffer[0] = sampleCount & 0xFF;
+    buffer[1] = (sampleCount >> 8) & 0xFF;
+    return encodedSize();
+}
+
+/* Writes the lowest <width> bits of <bits>, most significant first */
+void TimeSeriesEncoder::writeBits(uint32_t bits, uint8_t width){
+    uint8_t* stream = buffer + TSC_HEADER_SIZE;
+    while(width > 0){
+        size_t byteIndex = bitPos >> 3;
+        uint8_t bitOffset = bitPos & 7;
+        //clear fresh bytes as we reach them, since the buffer is reused between blocks
+        if(bitOffset == 0){
+            stream[byteIndex] = 0;
+        }
+        uint8_t freeBits = 8 - bitOffset;
+        uint8_t chunk = width < freeBits ? width : freeBits;
+        uint8_t part = (bits >> (width - chunk)) & ((1U << chunk) - 1);
+        stream[byteIndex] |= part << (freeBits - chunk);
+        bitPos += chunk;
+        width -= chunk;
+    }
+}
+
+bool TimeSeriesDecoder::begin(const uint8_t* block, size_t length){
+    this->block = block;
+    samplesRead = 0;
+    bitPos = 0;
+    if(block == NULL || length < TSC_HEADER_SIZE){
+        sampleCount = 0;
+        lengthBits = 0;
+        return false;
+    }
+    sampleCount = block[0] | (block[1] << 8);
+    firstTimestamp = (uint32_t) block[2] | ((uint32_t) block[3] << 8)
+        | ((uint32_t) block[4] << 16) | ((uint32_t) block[5] << 24);
+    firstValue = (int32_t) ((uint32_t) block[6] | ((uint32_t) block[7] << 8)
+        | ((uint32_t) block[8] << 16) | ((uint32_t) block[9] << 24));
+    lengthBits = (length - TSC_HEADER_SIZE) * 8;
+    lastTimestamp = 0;
+    lastDelta = 0;
+    lastValue = 0;
+    return true;
+}
+
+bool TimeSeriesDecoder::next(uint32_t& timestamp, int32_t& value){
+    if(samplesRead >= sampleCount){
+        return false;
+    }
+    if(samplesRead == 0){
+        lastTimestamp = firstTimestamp;
+        lastValue = firstValue;
+        lastDelta = 0;
+        timestamp = firstTimestamp;
+        value = firstValue;
+        samplesRead++;
+        return true;
+    }
+
+    //count the leading 1s of the timestamp bucket prefix (at most 4)
+    uint32_t bit;
+    uint8_t ones = 0;
+    while(ones < 4){
+        if(!readBits(1, bit)) return false;
+        if(bit == 0) break;
+        ones++;
+    }
+    uint32_t zz = 0;
+    switch(ones){
+        case 0: zz = 0; break;
+        case 1: if(!readBits(7, zz)) return false; break;
+        case 2: if(!readBits(9, zz)) return false; break;
+        case 3: if(!readBits(12, zz)) return false; break;
+        default: if(!readBits(32, zz)) return false; break;
+    }
+    int32_t delta = (int32_t) ((uint32_t) lastDelta + (uint32_t) zigzagDecode(zz));
+
+    //value bucket prefix has at most 3 leading 1s
+    ones = 0;
+    while(ones < 3){
+        if(!readBits(1, bit)) return false;
+        if(bit == 0) break;
+        ones++;
+    }
+    uint32_t valueDelta = 0;
+    switch(ones){
+        case 0: valueDelta = 0; break;
+        case 1: if(!readBits(6, valueDelta)) return false; break;
+        case 2: if(!readBits(12, valueDelta)) return false; break;
+        default: if(!readBits(32, valueDelta)) return false; break;
+    }
+
+    lastTimestamp += (uint32_t) delta;
+    lastDelta = delta;
+    lastValue = (int32_t) ((uint32_t) lastValue + (uint32_t) zigzagDecode(valueDelta));
+    timestamp = lastTimestamp;
+    value = lastValue;
+    samplesRead++;
+    return true;
+}
+
+bool TimeSeriesDecoder::readBits(uint8_t width, uint32_t& bits){
+    if(bitPos + width > lengthBits){
+        return false;
+    }
+    const uint8_t* stream = block + TSC_HEADER_SIZE;
+    bits = 0;
+    while(width > 0){
+        uint8_t bitOffset = bitPos & 7;
+        uint8_t availBits = 8 - bitOffset;
+        uint8_t chunk = width < availBits ? width : availBits;
+        uint8_t part = (stream[bitPos >> 3] >> (availBits - chunk)) & ((1U << chunk) - 1);
+        bits = (bits << chunk) | part;
+        bitPos += chunk;
+        width -= chunk;
+    }
+    return true;
+}
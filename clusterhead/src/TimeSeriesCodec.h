@@ -0,0 +1,88 @@
+/*
+ * TimeSeriesCodec.h
+ * Description: Gorilla-style block codec for slowly changing sensor series.
+ *              Timestamps are stored as delta-of-deltas and values as zig-zag
+ *              encoded deltas, both packed into variable length bit buckets.
+ *              Does not depend on Particle.h, so it can also be built on a host.
+ * Author: Tom Schwenke
+ * Date: 19/10/2026
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Block layout:
+   [uint16 sample count][uint32 first timestamp][int32 first value][bit stream...]
+   The first sample is stored raw in the header, every later sample is appended
+   to the bit stream as a timestamp delta-of-delta followed by a value delta. */
+const size_t TSC_HEADER_SIZE = 10;
+
+//worst case bits one sample can take in the bit stream (36 timestamp + 35 value)
+const size_t TSC_MAX_SAMPLE_BITS = 71;
+
+//size of one sample before compression (uint32 timestamp + int32 value), used for ratios
+const size_t TSC_RAW_SAMPLE_SIZE = 8;
+
+/* Streaming encoder writing into a caller owned block buffer.
+   Holds no buffer of its own, so one instance per series only costs 24 bytes on the Argon
+   (32 on a 64 bit host) */
+class TimeSeriesEncoder {
+public:
+    TimeSeriesEncoder();
+
+    // Start a new block in the given buffer. With a capacity below TSC_HEADER_SIZE nothing
+    // can be appended
+    void begin(uint8_t* buffer, size_t capacity);
+
+    // Append a sample. Returns false (and writes nothing) if the block is full,
+    // in which case the caller should finish() the block and begin() a new one
+    bool append(uint32_t timestamp, int32_t value);
+
+    // Patch the header and return the number of bytes used by the block
+    size_t finish();
+
+    uint16_t count() const { return sampleCount; }
+    size_t encodedSize() const { return TSC_HEADER_SIZE + (bitPos + 7) / 8; }
+    size_t rawSize() const { return (size_t) sampleCount * TSC_RAW_SAMPLE_SIZE; }
+
+private:
+    void writeBits(uint32_t bits, uint8_t width);
+    static uint8_t timestampBits(int32_t deltaOfDelta);
+    static uint8_t valueBits(uint32_t zigzagDelta);
+
+    uint8_t* buffer;
+    uint16_t capacityBits;
+    uint16_t bitPos;
+    uint16_t sampleCount;
+    uint32_t lastTimestamp;
+    int32_t lastDelta;
+    int32_t lastValue;
+};
+
+/* Streaming decoder reading samples back out of a finished block */
+class TimeSeriesDecoder {
+public:
+    // Returns false if the block is too short to hold a header
+    bool begin(const uint8_t* block, size_t length);
+
+    // Read the next sample. Returns false once all samples have been read,
+    // or if the block is truncated
+    bool next(uint32_t& timestamp, int32_t& value);
+
+    uint16_t count() const { return sampleCount; }
+
+private:
+    bool readBits(uint8_t width, uint32_t& bits);
+
+    const uint8_t* block;
+    size_t lengthBits;
+    size_t bitPos;
+    uint16_t sampleCount;
+    uint16_t samplesRead;
+    uint32_t firstTimestamp;
+    int32_t firstValue;
+    uint32_t lastTimestamp;
+    int32_t lastDelta;
+    int32_t lastValue;
+};
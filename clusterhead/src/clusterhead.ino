@@ -1,5 +1,18 @@
 #include "Particle.h"
 #include "dct.h"
+#include "SeriesStore.h"
+#include "QueryServer.h"
+#include "PresenceFusion.h"
+#include "MemoryPool.h"
+#include "IngestQueue.h"
+#include "RelayRouter.h"
+#include "NodeLinkCache.h"
+#include "NodeKeyring.h"
+#include "EnergyMeter.h"
+#include "EventDetector.h"
+#include "NodeConfig.h"
+#include "HealthMonitor.h"
+#include "NodeIngest.h"
 #include <chrono>
 /*
  * clusterhead.ino
@@ -11,6 +24,7 @@
 // This example does not require the cloud so you can run it in manual mode or
 // normal cloud-connected mode
 SYSTEM_MODE(AUTOMATIC);
+STARTUP(System.enableFeature(FEATURE_RESET_INFO)); //keep why we reset, for the health report
 
 SerialLogHandler logHandler(LOG_LEVEL_TRACE);
 
@@ -20,79 +34,301 @@ BlePeerDevice sensorNode2;
 BleUuid sensorNode1ServiceUuid("754ebf5e-ce31-4300-9fd5-a8fb4ee4a811");
 BleUuid sensorNode2ServiceUuid("97728ad9-a998-4629-b855-ee2658ca01f7");
 
-//characteristics we want to track
-//for sensor node 1
-BleCharacteristic temperatureSensorCharacteristic1;
-BleCharacteristic humiditySensorCharacteristic;
-BleCharacteristic lightSensorCharacteristic1;
-BleCharacteristic distanceSensorCharacteristic;
+/* Each node streams every sensor's readings on one characteristic, and takes commands
+   (see sendRateHint()) on another. Both nodes use the same UUIDs within their own service */
+BleCharacteristic streamCharacteristic1;
+BleCharacteristic controlCharacteristic1;
+BleCharacteristic streamCharacteristic2;
+BleCharacteristic controlCharacteristic2;
+//periodic reports on how a node is doing, [type u8][payload...]
+BleCharacteristic diagnosticsCharacteristic1;
+BleCharacteristic diagnosticsCharacteristic2;
+//raw windows around events a node's detectors picked up, [sensor index u8][window]
+BleCharacteristic eventCharacteristic1;
+BleCharacteristic eventCharacteristic2;
+//parsed once here, rather than from strings on every connect
+BleUuid streamUuid("5a1c3e7d-2f4b-4a8e-b6d9-0c7e1f2a3b44");
+BleUuid controlUuid("5a1c3e7d-2f4b-4a8e-b6d9-0c7e1f2a3b45");
+BleUuid diagnosticsUuid("5a1c3e7d-2f4b-4a8e-b6d9-0c7e1f2a3b46");
+BleUuid eventUuid("5a1c3e7d-2f4b-4a8e-b6d9-0c7e1f2a3b47");
+const uint8_t CONTROL_RATE_HINT = 0x01;
+const uint8_t CONTROL_CONFIG = 0x02;
+const uint8_t CONTROL_CONFIG_CONFIRM = 0x03;
+const uint8_t CONTROL_CONFIG_ROLLBACK = 0x04;
+//where the nodes were last seen, so reconnects can skip scanning
+NodeLinkCache nodeLinkCache;
+//each node's link key. Frames from a node are only trusted if they open under it, and dropped if it has none
+NodeKeyring nodeKeyring;
+//how often to try reconnecting straight to a cached node
+const uint32_t NODE_RECONNECT_INTERVAL = 2000;
+uint32_t lastNodeReconnect = 0;
+//millis() when we started connecting to each node, until its first stream frame arrives
+uint32_t nodeConnectStartedAt[NODE_CACHE_NODES] = { 0, 0 };
+bool nodeAwaitingFirstData[NODE_CACHE_NODES] = { false, false };
+/* Our own loop timing, stalls, ingest queue depth, heap and stack, see HealthMonitor.h. Logged by
+   healthReport() and published as "health" along with the latest report from each node, which
+   nodeIngest keeps */
+HealthMonitor healthMonitor;
+const uint32_t HEALTH_PUBLISH_INTERVAL = 900000;
+uint32_t lastHealthPublish = 0;
+/* Resets us if loop() doesn't come back for this long, noting what it was stuck in, see
+   onWatchdog(). Well over a BLE scan or connect. Device OS checks in for us after every loop()
+   and while it runs the cloud connection */
+const uint32_t WATCHDOG_TIMEOUT = 30000;
+ApplicationWatchdog watchdog(WATCHDOG_TIMEOUT, onWatchdog, 1536);
+/* The config last pushed to the nodes, see pushConfig(). Resent to each node it is pending for
+   until the node reports back on it, so one that was away or missed the write still gets it */
+uint8_t pushedConfig[CONFIG_MAX_SIZE];
+size_t pushedConfigLength = 0;
+bool nodeConfigPending[NODE_CACHE_NODES] = { false, false };
+const uint32_t CONFIG_RESEND_INTERVAL = 10000;
+uint32_t lastConfigSend = 0;
+/* A node with the pushed config on trial is only confirmed once its data or health reports have
+   kept arriving under it for this long, see checkConfigTrial(). Well inside the node's own trial
+   timeout of two minutes */
+const uint32_t CONFIG_CONFIRM_DWELL = 30000;
+bool nodeConfigOnTrial[NODE_CACHE_NODES] = { false, false };
+//when the node first reported the pushed config on trial, or we last sent it a confirm
+uint32_t nodeConfigTrialSince[NODE_CACHE_NODES] = { 0, 0 };
 
-//for sensor node 2
-BleCharacteristic temperatureSensorCharacteristic2;
-BleCharacteristic lightSensorCharacteristic2;
-BleCharacteristic soundSensorCharacteristic;
-BleCharacteristic humanDetectorCharacteristic;
+/* Relay mode, for sites bigger than one radio cell. Clusterheads form a tree rooted at
+   whichever are cloud connected, see RelayRouter.h. We advertise a relay beacon, pick
+   our parent from the beacons we hear, and the parent connects to us as a central and
+   subscribes to relayBatchCharacteristic. We take up to RELAY_MAX_CHILDREN children
+   ourselves. The two sensor nodes already hold two of the argon's three central links, so
+   the children take turns on the third: for each turn we connect, write how many blocks we
+   have room for, take what the child sends and move on to the next */
+const char* relayBatchUuid = "c3d5e2a2-7b4f-4e69-8d2a-5f1e9b7c3a40";
+const char* relayAttachUuid = "c3d5e2a3-7b4f-4e69-8d2a-5f1e9b7c3a40";
+BleUuid relayServiceUuid("c3d5e2a1-7b4f-4e69-8d2a-5f1e9b7c3a40");
+//our batches going up to our parent
+BleCharacteristic relayBatchCharacteristic("relayBatch", BleCharacteristicProperty::NOTIFY, relayBatchUuid, relayServiceUuid);
+//written by our parent at the start of each of our turns, see onRelayAttach()
+BleCharacteristic relayAttachCharacteristic("relayAttach", BleCharacteristicProperty::WRITE_WO_RSP, relayAttachUuid, relayServiceUuid, onRelayAttach, NULL);
+//the child whose turn it is on our spare central link, and its characteristics
+BlePeerDevice relayChild;
+uint32_t relayChildId = 0;
+int relayChildSlot = -1;
+BleCharacteristic relayChildBatchCharacteristic;
+BleCharacteristic relayChildAttachCharacteristic;
+//where each of our children was last heard, by their slot in relayRouter
+uint32_t relayChildIds[RELAY_MAX_CHILDREN];
+BleAddress relayChildAddresses[RELAY_MAX_CHILDREN];
+uint8_t relayChildFailures[RELAY_MAX_CHILDREN];
+const uint8_t INGEST_RELAY = 0x82;
+
+RelayRouter relayRouter;
+RelayBeacon advertisedBeacon;
+//relay mode is off unless turned on with relayMode(), when we neither advertise nor scan for
+//other clusterheads. The choice is kept in EEPROM, after the node keyring
+const int RELAY_MODE_EEPROM = 672;
+const uint8_t RELAY_MODE_ON = 'R';
+bool relayEnabled = false;
+//how often to scan for relay beacons when the sensor nodes are both connected
+const uint32_t RELAY_SCAN_INTERVAL = 30000;
+//a child's turn lasts at most this long, and ends early once it has gone quiet for RELAY_CHILD_IDLE
+//or sent all we had room for. It stops sending RELAY_TURN_GUARD before the end, so nothing goes
+//out as we disconnect
+const uint32_t RELAY_CHILD_TURN = 5000;
+const uint32_t RELAY_CHILD_IDLE = 1000;
+const uint32_t RELAY_TURN_GUARD = 500;
+//turns are only started with room for at least this many blocks
+const uint8_t RELAY_MIN_GRANT = 4;
+//failed connections to a child before its slot is freed for another
+const uint8_t RELAY_CHILD_MAX_FAILURES = 3;
+//no turn for this long and we treat our parent as gone. Covers a full round of its children
+const uint32_t RELAY_ATTACH_TIMEOUT = 60000;
+//open blocks are sealed this often while we have a parent, bounding how stale relayed data gets
+const uint32_t RELAY_SEAL_INTERVAL = 60000;
+//the largest notification Device OS sends
+const size_t RELAY_BATCH_SIZE = 244;
+const uint8_t RELAY_BATCHES_PER_LOOP = 4;
+//the root publishes relayed blocks no faster than Particle's rate limit
+const uint32_t RELAY_PUBLISH_INTERVAL = 1000;
+uint32_t lastRelayScan = 0;
+uint32_t lastRelaySeal = 0;
+uint32_t lastRelayPublish = 0;
+//the turn we are giving a child: when it started, blocks granted and received, last batch
+uint32_t relayTurnStartedAt = 0;
+uint8_t relayTurnGranted = 0;
+uint8_t relayTurnReceived = 0;
+uint32_t relayTurnLastBatch = 0;
+//our own turn, set on the BLE thread when our parent starts it
+volatile uint32_t relayAttachedAt = 0;
+volatile uint32_t relayAttachedTo = 0;
+volatile uint8_t relayGrant = 0;        //blocks our parent still has room for this turn
+
+/* Blocks received from our children, waiting to go up to our parent (or the cloud if we are
+   root). Only touched from loop(). Children are only granted the room left, so it doesn't
+   overflow, but if it did the oldest would be dropped. Sized for a few turns' worth from each */
+struct RelayPending {
+    uint32_t origin;
+    uint16_t epoch;
+    uint32_t sequence;
+    uint8_t series;
+    uint8_t length;
+    uint8_t block[SERIES_BLOCK_SIZE];
+};
+const size_t RELAY_PENDING_BLOCKS = RELAY_MAX_CHILDREN * 12;
+RelayPending relayPending[RELAY_PENDING_BLOCKS];
+size_t relayPendingHead = 0;
+size_t relayPendingCount = 0;
+//next of our own sealed blocks to send up
+uint32_t relayOwnSequence = 0;
+uint32_t relayForwarded = 0;
+uint32_t relayDropped = 0;
 
 // void onDataReceived(const uint8_t* data, size_t len, const BlePeerDevice& peer, void* context);
 const size_t SCAN_RESULT_MAX = 30;
 BleScanResult scanResults[SCAN_RESULT_MAX];
+//how long each scan blocks loop() for, in 10 ms units. Nodes and clusterheads advertise every
+//100 ms, so this hears each of them a few times
+const uint16_t SCAN_TIMEOUT = 50;
+
+//compressed history of every reading received, one series per characteristic
+SeriesStore seriesStore;
+//answers history queries from the host over USB serial, see tools/chquery
+QueryServer queryServer(seriesStore, Serial);
+//single occupancy signal fused from node 1's distance sensor and node 2's PIR
+PresenceFusion presenceFusion;
+/* Opens, decodes and stores what the nodes send, and keeps their latest energy, health and
+   config reports, see NodeIngest.h. What it hands back is acted on in onNodeFrame() */
+NodeIngest nodeIngest(nodeKeyring, seriesStore, queryServer, presenceFusion);
+
+/* Everything buffered at runtime comes from fixed pools reserved here, so nothing is
+   malloc'd after setup() and the heap can't fragment however long we run */
+//frames copied out of BLE callbacks, waiting in ingestQueue for loop()
+const size_t INGEST_POOL_SIZE = 32;
+MemoryPool<IngestFrame, INGEST_POOL_SIZE> ingestPool;
+IngestQueue ingestQueue;
+//payloads being put together for the cloud
+const size_t UPLINK_BATCH_SIZE = 320;//Particle.publish's data limit on 1.5.0 is 622, keep well under. Fits a hex relayed block
+struct UplinkBatch {
+    char data[UPLINK_BATCH_SIZE];
+};
+MemoryPool<UplinkBatch, 2> uplinkPool;
+uint32_t freeMemoryAfterSetup = 0;//to check the heap stays put after setup()
 
 void setup() {
+    //before anything else runs deep, see HealthMonitor.h
+    healthMonitor.paintStack(HEALTH_STACK_PAINT_SIZE);
+    healthMonitor.setResetReason(System.resetReason(), System.resetReasonData());
+    if(healthMonitor.lastReset() == HEALTH_RESET_APP_WATCHDOG){
+        Log.warn("Reset by the watchdog, loop() was stuck in %s", HealthMonitor::sectionName(healthMonitor.lastResetSection()));
+    }
+
     const uint8_t val = 0x01;
     dct_write_app_data(&val, DCT_SETUP_DONE_OFFSET, 1);
     (void)logHandler; // Does nothing, just to eliminate the unused variable warning
 
     BLE.on();
+    BLE.setScanTimeout(SCAN_TIMEOUT);
     
-    //map functions to be called whenever new data is received for a characteristic
-    temperatureSensorCharacteristic1.onDataReceived(onTemperatureReceived1, NULL);
-    humiditySensorCharacteristic.onDataReceived(onHumidityReceived, NULL);
-    lightSensorCharacteristic1.onDataReceived(onLightReceived1, NULL);
-    distanceSensorCharacteristic.onDataReceived(onDistanceReceived, NULL);
-    temperatureSensorCharacteristic2.onDataReceived(onTemperatureReceived2, NULL);
-    lightSensorCharacteristic2.onDataReceived(onLightReceived2, NULL);
-    soundSensorCharacteristic.onDataReceived(onSoundReceived, NULL);
-    humanDetectorCharacteristic.onDataReceived(onHumanDetectorReceived, NULL);
+    //queue data received on each characteristic, tagged with where it came from, to be handled in loop()
+    //by the matching "on<X>Received" function
+    streamCharacteristic1.onDataReceived(onFrameReceived, (void*) INGEST_STREAM_1);
+    streamCharacteristic2.onDataReceived(onFrameReceived, (void*) INGEST_STREAM_2);
+    diagnosticsCharacteristic1.onDataReceived(onFrameReceived, (void*) INGEST_DIAGNOSTICS_1);
+    diagnosticsCharacteristic2.onDataReceived(onFrameReceived, (void*) INGEST_DIAGNOSTICS_2);
+    eventCharacteristic1.onDataReceived(onFrameReceived, (void*) INGEST_EVENT_1);
+    eventCharacteristic2.onDataReceived(onFrameReceived, (void*) INGEST_EVENT_2);
+    relayChildBatchCharacteristic.onDataReceived(onFrameReceived, (void*) INGEST_RELAY);
+
+    //relay mode, our cluster id is the low 4 bytes of our BLE address
+    BLE.addCharacteristic(relayBatchCharacteristic);
+    BLE.addCharacteristic(relayAttachCharacteristic);
+    BleAddress address = BLE.address();
+    //and our block sequences start again, so they are told apart from the last boot's by a random epoch
+    relayRouter.begin((uint32_t) address[0] | ((uint32_t) address[1] << 8) | ((uint32_t) address[2] << 16) | ((uint32_t) address[3] << 24),
+        HAL_RNG_GetRandomNumber() & 0xFFFF);
+    relayEnabled = EEPROM.read(RELAY_MODE_EEPROM) == RELAY_MODE_ON;
+    if(relayEnabled){
+        advertiseRelayBeacon();
+    }
+
+    nodeLinkCache.begin();
+    nodeKeyring.begin();
+
+    //debug function to log the codec's compression ratio and throughput
+    Particle.function("codecReport", codecReport);
+    //push sampling rate bounds to a node, see rateHint()
+    Particle.function("rateHint", rateHint);
+    //debug function to log memory pool usage and heap drift
+    Particle.function("poolReport", poolReport);
+    //debug function to log relay routing and forwarding state
+    Particle.function("relayReport", relayReport);
+    //turn relay mode on or off, see relayMode()
+    Particle.function("relayMode", relayMode);
+    //debug function to log each node's energy use and projected battery life
+    Particle.function("energyReport", energyReport);
+    //debug function to log loop timing, stalls and memory headroom across the cluster
+    Particle.function("healthReport", healthReport);
+    //store a node's link key, see provisionKey()
+    Particle.function("provisionKey", provisionKey);
+    //push a config to one node or all of them, and undo it, see pushConfig()
+    Particle.function("pushConfig", pushConfig);
+    Particle.function("rollbackConfig", rollbackConfig);
+
+    freeMemoryAfterSetup = System.freeMemory();
 }
 
 void loop() { 
-    //do stuff if both sensors have been connected
-    if (sensorNode1.connected() && sensorNode2.connected()) {
+    healthMonitor.beginLoop(micros());
+    //what BLE callbacks queued since the last loop
+    healthMonitor.setQueueDepth(ingestQueue.depth(), ingestQueue.maxDepth());
+    healthMonitor.enter(HEALTH_SECTION_INGEST, micros());
+    handleReceivedFrames();
+    healthMonitor.leave(micros());
+    queryServer.poll();
+    checkPresence();
+    healthMonitor.enter(HEALTH_SECTION_RADIO, micros());
+    updateRelay();
+    sendPendingConfig();
+    healthMonitor.leave(micros());
+    //go straight back to nodes we know, scanning is only needed to find them the first time
+    reconnectCachedNodes();
+    publishHealth();
+
+    //do stuff if both sensors have been connected, and we aren't due to look for other clusterheads
+    if (sensorNode1.connected() && sensorNode2.connected() && (!relayEnabled || millis() - lastRelayScan < RELAY_SCAN_INTERVAL)) {
         //do stuff here
     }
     //if we haven't connected both, then scan for them
     else {
         Log.info("About to scan...");
+        lastRelayScan = millis();
+        healthMonitor.enter(HEALTH_SECTION_BLE_SCAN, micros());
         int count = BLE.scan(scanResults, SCAN_RESULT_MAX);
+        healthMonitor.leave(micros());
         for (int i = 0; i < count; i++) {
+            //other clusterheads advertise a relay beacon rather than a service
+            if(checkRelayBeacon(scanResults[i])){
+                continue;
+            }
+
             BleUuid foundService;
             size_t len;
 
             //Read the service UUID of this BT device
             len = scanResults[i].advertisingData.serviceUUID(&foundService, 1);
 
+            //format into stack buffers rather than concatenating Strings on the heap
+            char text[40];
             Log.info("Found a bluetooth device.");
-            Log.info("Address: " + scanResults[i].address.toString());
-            Log.info("Found UUID: " + foundService.toString());
-            Log.info("SensorNode1 UUID: " + sensorNode1ServiceUuid.toString());
-            Log.info("SensorNode2 UUID: " + sensorNode2ServiceUuid.toString());
+            scanResults[i].address.toString(text, sizeof(text));
+            Log.info("Address: %s", text);
+            foundService.toString(text, sizeof(text));
+            Log.info("Found UUID: %s", text);
+            sensorNode1ServiceUuid.toString(text, sizeof(text));
+            Log.info("SensorNode1 UUID: %s", text);
+            sensorNode2ServiceUuid.toString(text, sizeof(text));
+            Log.info("SensorNode2 UUID: %s", text);
 
             //Check if it matches UUID for sensor node 1
             if (len > 0 && foundService == sensorNode1ServiceUuid){
                 Log.info("Found sensor node 1.");
                 if(sensorNode1.connected() == false){
-                    sensorNode1 = BLE.connect(scanResults[i].address);
-                    if(sensorNode1.connected()){
-                        Log.info("Successfully connected to sensor node 1!");
-                        //map characteristics from this service to the variables in this program, so they're handled by our "on<X>Received" functions
-                        sensorNode1.getCharacteristicByUUID(lightSensorCharacteristic1, "ea5248a4-43cc-4198-a4aa-79200a750835");
-                        sensorNode1.getCharacteristicByUUID(temperatureSensorCharacteristic1, "bc7f18d9-2c43-408e-be25-62f40645987c");
-                        sensorNode1.getCharacteristicByUUID(humiditySensorCharacteristic, "99a0d2f9-1cfa-42b3-b5ba-1b4d4341392f");
-                        sensorNode1.getCharacteristicByUUID(distanceSensorCharacteristic, "45be4a56-48f5-483c-8bb1-d3fee433c23c");
-                    }
-                    else{
-                        Log.info("Failed to connect to sensor node 1.");
-                    }
+                    connectNode(1, scanResults[i].address);
                 }
                 else{
                     Log.info("Sensor node 1 already connected.");
@@ -103,18 +339,7 @@ void loop() {
             else if (len > 0 && foundService == sensorNode2ServiceUuid){
                 Log.info("Found sensor node 2.");
                 if(sensorNode2.connected() == false){
-                    sensorNode2 = BLE.connect(scanResults[i].address);
-                    if(sensorNode2.connected()){
-                        Log.info("Successfully connected to sensor node 2!");
-                        //map characteristics from this service to the variables in this program, so they're handled by our "on<X>Received" functions
-                        sensorNode2.getCharacteristicByUUID(temperatureSensorCharacteristic2, "bc7f18d9-2c43-408e-be25-62f40645987c");
-                        sensorNode2.getCharacteristicByUUID(lightSensorCharacteristic2, "ea5248a4-43cc-4198-a4aa-79200a750835");
-                        sensorNode2.getCharacteristicByUUID(soundSensorCharacteristic, "88ba2f5d-1e98-49af-8697-d0516df03be9");
-                        sensorNode2.getCharacteristicByUUID(humanDetectorCharacteristic, "b482d551-c3ae-4dde-b125-ce244d7896b0");
-                    }
-                    else{
-                        Log.info("Failed to connect to sensor node 2.");
-                    }
+                    connectNode(2, scanResults[i].address);
                 }
                 else{
                     Log.info("Sensor node 2 already connected.");
@@ -126,113 +351,760 @@ void loop() {
             Log.info("%d devices found", count);
         }
     }
+    healthMonitor.sampleHeap(System.freeMemory());
+    healthMonitor.endLoop(micros());
+}
+
+/* Runs on the watchdog's thread once loop() has been stuck for WATCHDOG_TIMEOUT. The section it
+   was stuck in goes in the reset data, for the health report after we come back */
+void onWatchdog(){
+    System.reset(HEALTH_WATCHDOG_RESET_DATA | healthMonitor.section());
+}
+
+/* Connect to a sensor node and map its stream and control characteristics to the variables
+   in this program. Remembers the address, so the next reconnect can skip scanning */
+bool connectNode(uint8_t node, const BleAddress& address){
+    BlePeerDevice& peer = node == 1 ? sensorNode1 : sensorNode2;
+    nodeConnectStartedAt[node - 1] = millis();
+    healthMonitor.enter(HEALTH_SECTION_BLE_CONNECT, micros());
+    peer = BLE.connect(address);
+    healthMonitor.leave(micros());
+    if(!peer.connected()){
+        Log.info("Failed to connect to sensor node %u.", node);
+        return false;
+    }
+    Log.info("Successfully connected to sensor node %u!", node);
+    //lookups against the table Device OS discovered while connecting
+    peer.getCharacteristicByUUID(node == 1 ? streamCharacteristic1 : streamCharacteristic2, streamUuid);
+    peer.getCharacteristicByUUID(node == 1 ? controlCharacteristic1 : controlCharacteristic2, controlUuid);
+    peer.getCharacteristicByUUID(node == 1 ? diagnosticsCharacteristic1 : diagnosticsCharacteristic2, diagnosticsUuid);
+    peer.getCharacteristicByUUID(node == 1 ? eventCharacteristic1 : eventCharacteristic2, eventUuid);
+    nodeLinkCache.remember(node, address);
+    nodeAwaitingFirstData[node - 1] = true;
+    nodeIngest.onConnected(node);
+    nodeKeyring.onConnected(node);
+    return true;
+}
+
+/* Try disconnected nodes at their cached addresses, without scanning. A node that keeps
+   failing is left to the scan, which will find it if it has moved to a new address */
+void reconnectCachedNodes(){
+    if(millis() - lastNodeReconnect < NODE_RECONNECT_INTERVAL){
+        return;
+    }
+    lastNodeReconnect = millis();
+    for(uint8_t node = 1; node <= NODE_CACHE_NODES; node++){
+        BlePeerDevice& peer = node == 1 ? sensorNode1 : sensorNode2;
+        BleAddress address;
+        if(!peer.connected() && nodeLinkCache.lookup(node, address)){
+            Log.info("Reconnecting to sensor node %u at its cached address", node);
+            if(!connectNode(node, address)){
+                nodeLinkCache.failed(node);
+            }
+        }
+    }
+}
+
+/* Called on the BLE thread for every notification. Only copies the frame into a pooled
+   buffer and queues it, so the BLE thread is never held up by storage or logging */
+void onFrameReceived(const uint8_t* data, size_t len, const BlePeerDevice& peer, void* context){
+    IngestFrame* frame = ingestPool.allocate();
+    if(frame == NULL){
+        return;//pool exhausted, loop() has fallen behind. Counted in the pool's failed allocations
+    }
+    frame->tag = (uint8_t) (uintptr_t) context;
+    frame->length = len < INGEST_FRAME_DATA ? len : INGEST_FRAME_DATA;
+    frame->receivedAt = millis();
+    memcpy(frame->data, data, frame->length);
+    ingestQueue.push(frame);
+}
+
+/* Hand every queued frame to its characteristic's handler, then return it to the pool */
+void handleReceivedFrames(){
+    IngestFrame* frame;
+    while((frame = ingestQueue.pop()) != NULL){
+        if(frame->tag == INGEST_RELAY){
+            onRelayBatchReceived(frame->data, frame->length);
+        }
+        else{
+            onNodeFrame(*frame);
+        }
+        ingestPool.release(frame);
+    }
 }
 
 /* These functions are where we do something with the data (in bytes) we've received via bluetooth */
 
-void onTemperatureReceived1(const uint8_t* data, size_t len, const BlePeerDevice& peer, void* context){
-    int8_t receivedTemp;
-    uint64_t sentTime;
+/* A frame from one of the nodes. nodeIngest checks, decodes and stores it, the rest is what
+   needs the radio or the cloud: confirming a config on trial, publishing an event window and
+   dropping a connection that keeps sending frames that don't open under the node's key */
+void onNodeFrame(IngestFrame& frame){
+    uint8_t node = NodeIngest::nodeOf(frame.tag);
+    switch(nodeIngest.handle(frame, Time.now())){
+        case NODE_FRAME_STREAM:
+            if(nodeAwaitingFirstData[node - 1]){
+                nodeAwaitingFirstData[node - 1] = false;
+                Log.info("Sensor node %u - first data %lu ms after starting to connect", node, millis() - nodeConnectStartedAt[node - 1]);
+            }
+            checkConfigTrial(node);
+            break;
+        case NODE_FRAME_HEALTH:
+            checkConfigTrial(node);
+            break;
+        case NODE_FRAME_CONFIG:
+            onConfigStatusReceived(node, nodeIngest.configStatus(node));
+            break;
+        case NODE_FRAME_EVENT:
+            publishEventWindow(node, nodeIngest.eventSeries(), nodeIngest.event());
+            break;
+        case NODE_FRAME_UNTRUSTED: {
+            BlePeerDevice& peer = node == 1 ? sensorNode1 : sensorNode2;
+            Log.warn("Sensor node %u - disconnecting, it isn't using the node's key", node);
+            peer.disconnect();
+            nodeLinkCache.failed(node);
+            break;
+        }
+        default:
+            break;
+    }
+}
 
-    //read the time of sending, to calculate transmission delay
-    memcpy(&sentTime, &data[0] + sizeof(receivedTemp), sizeof(sentTime));
-    //read the temp
-    memcpy(&receivedTemp, &data[0], sizeof(receivedTemp));
-    
-    Log.info("Sensor 1 - Temperature: %u degrees Celsius", receivedTemp);
-    // Log.info("Temp/humidity transmission delay: %llu seconds", calculateTransmissionDelay(sentTime));
+/* Publish the raw window around an event as
+   "<series>,<trigger time>,<period ms>,<pre samples>,<z-score x10>,<samples as hex u16>" */
+void publishEventWindow(uint8_t node, uint8_t series, const EventWindow& window){
+    UplinkBatch* batch = uplinkPool.allocate();
+    if(batch == NULL){
+        return;
+    }
+    int written = snprintf(batch->data, sizeof(batch->data), "%u,%lu,%u,%u,%d,", series, window.triggerTime,
+        window.periodMs, window.preSamples, window.zScore10);
+    for(uint8_t i = 0; i < window.count && written + 5 <= (int) sizeof(batch->data); i++){
+        written += snprintf(&batch->data[written], sizeof(batch->data) - written, "%04x", window.samples[i]);
+    }
+    if(!Particle.publish("rawWindow", batch->data, PRIVATE)){
+        Log.warn("Sensor node %u - event window not published", node);
+    }
+    uplinkPool.release(batch);
+}
+
+uint64_t calculateTransmissionDelay(uint64_t sentTime){
+    return Time.now() - sentTime;
+    // return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count() - sentTime;
+}
+
+/* Let the presence fusion confirm holds that have expired, and report confirmed transitions.
+   Only these go to the cloud, rather than every PIR and distance reading */
+void checkPresence(){
+    presenceFusion.update(Time.now());
+    PresenceTransition transition;
+    while(presenceFusion.takeTransition(transition)){
+        Log.info("Presence - %s (confidence %u%%, confirmed after %lu s)",
+            transition.occupied ? "occupied" : "vacant", transition.confidence, transition.latency);
+        nodeIngest.record(SERIES_OCCUPANCY, transition.timestamp, transition.occupied ? transition.confidence : 0);
+        UplinkBatch* batch = uplinkPool.allocate();
+        if(batch != NULL){
+            snprintf(batch->data, sizeof(batch->data), "%u,%u", transition.occupied, transition.confidence);
+            Particle.publish("occupancy", batch->data, PRIVATE);
+            uplinkPool.release(batch);
+        }
+    }
+}
+
+/* Advertise who we are, how far we are from the root and who our parent is.
+   Called again whenever any of that changes */
+void advertiseRelayBeacon(){
+    advertisedBeacon = relayRouter.beacon();
+    uint8_t beacon[RELAY_BEACON_SIZE];
+    relayEncodeBeacon(advertisedBeacon, beacon);
+    BleAdvertisingData data;
+    data.appendCustomData(beacon, sizeof(beacon));
+    BLE.advertise(&data);
+}
+
+/* Look at a scan result for a relay beacon. Feeds it to the router, and notes where a
+   child of ours can be found for its next turn. Returns false if it isn't a clusterhead */
+bool checkRelayBeacon(const BleScanResult& result){
+    uint8_t custom[RELAY_BEACON_SIZE];
+    RelayBeacon beacon;
+    size_t len = result.advertisingData.customData(custom, sizeof(custom));
+    if(!relayDecodeBeacon(custom, len, beacon)){
+        return false;
+    }
+    if(!relayEnabled){
+        return true;
+    }
+    relayRouter.onBeacon(beacon, result.rssi, Time.now());
+    int slot = relayRouter.childSlot(beacon.clusterId);
+    if(slot >= 0){
+        if(relayChildIds[slot] != beacon.clusterId){
+            Log.info("Relay - cluster %08lx attached as our child", beacon.clusterId);
+            relayChildIds[slot] = beacon.clusterId;
+            relayChildFailures[slot] = 0;
+        }
+        relayChildAddresses[slot] = result.address;
+    }
+    return true;
 }
 
-void onHumidityReceived(const uint8_t* data, size_t len, const BlePeerDevice& peer, void* context){
-    uint8_t receivedHumidity;
-    memcpy(&receivedHumidity, &data[0], sizeof(receivedHumidity));
-    Log.info("Sensor 1 - Humidity: %u%%", receivedHumidity);
+/* Written by our parent on the BLE thread at the start of our turn, see RelayAttach */
+void onRelayAttach(const uint8_t* data, size_t len, const BlePeerDevice& peer, void* context){
+    RelayAttach attach;
+    if(relayDecodeAttach(data, len, attach)){
+        relayAttachedTo = attach.parentId;
+        relayGrant = attach.grant;
+        relayAttachedAt = millis();
+    }
 }
 
-void onLightReceived1(const uint8_t* data, size_t len, const BlePeerDevice& peer, void* context){
-    //read the light sensor reading
-    uint16_t twoByteValue;
-    uint64_t sentTime;
+/* Whether our parent has given us a turn lately, i.e. still has us as a child */
+bool relayUpstreamAttached(){
+    return relayRouter.parent() != 0 && relayAttachedTo == relayRouter.parent()
+        && millis() - relayAttachedAt < RELAY_ATTACH_TIMEOUT;
+}
 
-    memcpy(&twoByteValue, &data[0], sizeof(uint16_t));
+/* Whether we are in a turn and may still send. We stop short of its end, so nothing is
+   sent as our parent disconnects */
+bool relayTurnOpen(){
+    return relayUpstreamAttached() && relayGrant > 0
+        && millis() - relayAttachedAt < RELAY_CHILD_TURN - RELAY_TURN_GUARD;
+}
 
-    //read the time of sending, to calculate transmission delay
-    memcpy(&sentTime, &data[0] + sizeof(twoByteValue), sizeof(sentTime));
-    
-    Log.info("Sensor 1 - Light: %u Lux", twoByteValue);
-    // Log.info("Transmission delay: %llu seconds", calculateTransmissionDelay(sentTime));
+/* Tell the child on our spare link its turn has started, and how many blocks we have room for */
+bool grantRelayTurn(){
+    size_t room = RELAY_PENDING_BLOCKS - relayPendingCount;
+    RelayAttach attach = { relayRouter.self(), (uint8_t) (room > 255 ? 255 : room) };
+    uint8_t frame[RELAY_ATTACH_SIZE];
+    if(relayChildAttachCharacteristic.setValue(frame, relayEncodeAttach(attach, frame)) <= 0){
+        return false;
+    }
+    relayTurnStartedAt = millis();
+    relayTurnLastBatch = relayTurnStartedAt;
+    relayTurnGranted = attach.grant;
+    relayTurnReceived = 0;
+    return true;
+}
+
+/* Give our children turns on the spare central link. A turn ends when its time is up, the
+   child has sent all we had room for or has gone quiet. An only child keeps the connection
+   and just gets another grant, otherwise we move on to the next. Turns only start when we
+   have room for at least RELAY_MIN_GRANT blocks, so a full queue holds the children back
+   rather than being overrun */
+void serveRelayChildren(){
+    if(relayChild.connected()){
+        bool stillOurs = relayRouter.childSlot(relayChildId) == relayChildSlot;
+        uint32_t elapsed = millis() - relayTurnStartedAt;
+        if(stillOurs && elapsed < RELAY_CHILD_TURN && relayTurnReceived < relayTurnGranted
+            && millis() - relayTurnLastBatch < RELAY_CHILD_IDLE){
+            return;
+        }
+        if(stillOurs && relayRouter.childCount() == 1){
+            if(RELAY_PENDING_BLOCKS - relayPendingCount >= RELAY_MIN_GRANT){
+                grantRelayTurn();
+            }
+            return;
+        }
+        relayChild.disconnect();
+    }
+    if(RELAY_PENDING_BLOCKS - relayPendingCount < RELAY_MIN_GRANT){
+        return;
+    }
+    int slot = relayRouter.nextChild(relayChildSlot);
+    if(slot < 0 || relayChildIds[slot] != relayRouter.child(slot)){
+        //no children, or we haven't heard where this one is yet
+        relayChildSlot = slot;
+        return;
+    }
+    relayChildSlot = slot;
+    relayChildId = relayChildIds[slot];
+    healthMonitor.enter(HEALTH_SECTION_BLE_CONNECT, micros());
+    relayChild = BLE.connect(relayChildAddresses[slot]);
+    healthMonitor.leave(micros());
+    if(relayChild.connected()
+        && relayChild.getCharacteristicByUUID(relayChildBatchCharacteristic, relayBatchUuid)
+        && relayChild.getCharacteristicByUUID(relayChildAttachCharacteristic, relayAttachUuid)
+        && grantRelayTurn()){
+        relayChildFailures[slot] = 0;
+        return;
+    }
+    relayChild.disconnect();
+    if(++relayChildFailures[slot] >= RELAY_CHILD_MAX_FAILURES){
+        Log.warn("Relay - can't reach child %08lx, freeing its slot", relayChildId);
+        relayRouter.dropChild(relayChildId);
+        relayChildIds[slot] = 0;
+        relayChildFailures[slot] = 0;
+    }
+}
+
+/* Re-pick our parent, keep our beacon current and move relayed blocks on a hop */
+void updateRelay(){
+    if(!relayEnabled){
+        return;
+    }
+    relayRouter.setRoot(Particle.connected());
+    relayRouter.setAttached(relayUpstreamAttached());
+    if(relayRouter.update(Time.now())){
+        Log.info("Relay - parent is now %08lx, %u hops from the root", relayRouter.parent(), relayRouter.hops());
+    }
+    RelayBeacon beacon = relayRouter.beacon();
+    if(beacon.hops != advertisedBeacon.hops || beacon.parentId != advertisedBeacon.parentId
+        || beacon.openSlots != advertisedBeacon.openSlots){
+        advertiseRelayBeacon();
+    }
+
+    serveRelayChildren();
+
+    if(relayRouter.isRoot()){
+        publishRelayed();
+    }
+    else if(relayUpstreamAttached()){
+        //seal regularly so our own readings don't wait for a block to fill before going up
+        if(millis() - lastRelaySeal >= RELAY_SEAL_INTERVAL){
+            for(uint8_t series = 0; series < SERIES_COUNT; series++){
+                seriesStore.seal(series);
+            }
+            lastRelaySeal = millis();
+        }
+        forwardRelayed();
+    }
+}
+
+/* Pack pending blocks, then our own sealed ones, into batches for our parent, during our turn
+   and no more than it has room for. Blocks from several clusters share a notification, and
+   only leave the queue once it has been sent */
+void forwardRelayed(){
+    if(relayOwnSequence < seriesStore.oldestSequence()){
+        relayOwnSequence = seriesStore.oldestSequence();//overwritten before we could send them
+    }
+    for(uint8_t sent = 0; sent < RELAY_BATCHES_PER_LOOP && relayTurnOpen(); sent++){
+        uint8_t batch[RELAY_BATCH_SIZE];
+        RelayBatchWriter writer;
+        writer.begin(batch, sizeof(batch));
+        uint8_t grant = relayGrant;
+
+        size_t pendingTaken = 0;
+        while(pendingTaken < relayPendingCount && writer.count() < grant){
+            const RelayPending& pending = relayPending[(relayPendingHead + pendingTaken) % RELAY_PENDING_BLOCKS];
+            if(!writer.add(pending.origin, pending.epoch, pending.sequence, pending.series, pending.block, pending.length)){
+                break;
+            }
+            pendingTaken++;
+        }
+        uint32_t ownSequence = relayOwnSequence;
+        SealedBlock block;
+        while(writer.count() < grant && ownSequence < seriesStore.nextSequence() && seriesStore.copySealed(ownSequence, block)){
+            if(!writer.add(relayRouter.self(), relayRouter.epoch(), ownSequence, block.series, block.data, block.length)){
+                break;
+            }
+            ownSequence++;
+        }
+
+        if(writer.count() == 0 || relayBatchCharacteristic.setValue(batch, writer.length()) <= 0){
+            return;
+        }
+        relayPendingHead = (relayPendingHead + pendingTaken) % RELAY_PENDING_BLOCKS;
+        relayPendingCount -= pendingTaken;
+        relayOwnSequence = ownSequence;
+        relayForwarded += writer.count();
+        relayGrant = grant - writer.count();
+    }
 }
 
-void onDistanceReceived(const uint8_t* data, size_t len, const BlePeerDevice& peer, void* context){
-    uint8_t byteValue;
-    uint64_t sentTime;
+/* As the root, publish relayed blocks one at a time as
+   "<origin cluster>,<boot epoch>,<sequence>,<series>,<hex encoded block>" */
+void publishRelayed(){
+    if(relayPendingCount == 0 || millis() - lastRelayPublish < RELAY_PUBLISH_INTERVAL){
+        return;
+    }
+    UplinkBatch* batch = uplinkPool.allocate();
+    if(batch == NULL){
+        return;
+    }
+    const RelayPending& pending = relayPending[relayPendingHead];
+    int used = snprintf(batch->data, sizeof(batch->data), "%08lx,%04x,%lu,%u,", pending.origin, pending.epoch, pending.sequence, pending.series);
+    for(uint8_t i = 0; i < pending.length && used + 3 <= (int) sizeof(batch->data); i++){
+        used += snprintf(batch->data + used, sizeof(batch->data) - used, "%02x", pending.block[i]);
+    }
+    if(Particle.publish("relayBlock", batch->data, PRIVATE)){
+        relayPendingHead = (relayPendingHead + 1) % RELAY_PENDING_BLOCKS;
+        relayPendingCount--;
+        relayForwarded++;
+    }
+    lastRelayPublish = millis();
+    uplinkPool.release(batch);
+}
 
-    //read the time of sending, to calculate transmission delay
-    memcpy(&sentTime, &data[0] + sizeof(byteValue), sizeof(sentTime));
+/* A batch from the child whose turn it is. Blocks we have already passed on (e.g. resent
+   after a turn ended before they were sent, or reaching us over a second path) are dropped
+   here, the rest are queued. All of them count against the turn's grant */
+void onRelayBatchReceived(const uint8_t* data, size_t len){
+    RelayBatchReader reader;
+    RelayEntry entry;
+    reader.begin(data, len);
+    relayTurnLastBatch = millis();
+    while(reader.next(entry)){
+        if(relayTurnReceived < 255){
+            relayTurnReceived++;
+        }
+        if(entry.length > SERIES_BLOCK_SIZE || entry.series >= SERIES_COUNT || relayRouter.seen(entry.origin, entry.epoch, entry.sequence)){
+            continue;
+        }
+        if(relayPendingCount == RELAY_PENDING_BLOCKS){
+            relayPendingHead = (relayPendingHead + 1) % RELAY_PENDING_BLOCKS;
+            relayPendingCount--;
+            relayDropped++;
+        }
+        RelayPending& pending = relayPending[(relayPendingHead + relayPendingCount) % RELAY_PENDING_BLOCKS];
+        pending.origin = entry.origin;
+        pending.epoch = entry.epoch;
+        pending.sequence = entry.sequence;
+        pending.series = entry.series;
+        pending.length = entry.length;
+        memcpy(pending.block, entry.block, entry.length);
+        relayPendingCount++;
+    }
+}
 
-    memcpy(&byteValue, &data[0], sizeof(uint8_t));
-    Log.info("Sensor 1 - Distance: %u cm", byteValue);
-    // Log.info("Transmission delay: %llu seconds", calculateTransmissionDelay(sentTime));
+/* Particle function logging the latest energy report from each node, overall and by
+   subsystem state. Returns how many nodes have reported */
+int energyReport(String arg){
+    int reported = 0;
+    char line[160];
+    for(uint8_t node = 1; node <= NODE_CACHE_NODES; node++){
+        const EnergyReport* report = nodeIngest.energy(node);
+        if(report == NULL){
+            Log.info("Sensor node %u - no energy report yet", node);
+            continue;
+        }
+        reported++;
+        EnergyMeter::formatSummary(*report, line, sizeof(line));
+        Log.info("Sensor node %u - %s", node, line);
+        for(int state = 0; state < ENERGY_STATE_COUNT; state++){
+            EnergyMeter::formatState(*report, (EnergyState) state, line, sizeof(line));
+            Log.info("%s", line);
+        }
+    }
+    return reported;
 }
 
-void onTemperatureReceived2(const uint8_t* data, size_t len, const BlePeerDevice& peer, void* context){
-    int8_t temperature;
-    uint64_t sentTime;
+/* Particle function logging our own health and the latest from each node, then the worst
+   of them across the cluster. Returns how many devices have a report */
+int healthReport(String arg){
+    HealthReport reports[1 + NODE_CACHE_NODES];
+    const char* names[1 + NODE_CACHE_NODES] = { "Clusterhead", "Sensor node 1", "Sensor node 2" };
+    healthMonitor.report(reports[0], millis() / 1000);
+    int reported = 1;
+    for(uint8_t node = 1; node <= NODE_CACHE_NODES; node++){
+        if(nodeIngest.health(node) != NULL){
+            reports[reported] = *nodeIngest.health(node);
+            names[reported] = names[node];
+            reported++;
+        }
+        else{
+            Log.info("Sensor node %u - no health report yet", node);
+        }
+    }
+    char line[320];
+    int worst = 0;
+    uint32_t stalls = 0;
+    uint32_t minFreeHeap = reports[0].minFreeHeap;
+    for(int i = 0; i < reported; i++){
+        HealthMonitor::formatSummary(reports[i], line, sizeof(line));
+        Log.info("%s - %s", names[i], line);
+        HealthMonitor::formatSections(reports[i], line, sizeof(line));
+        Log.info("%s", line);
+        if(reports[i].longestStallMs > reports[worst].longestStallMs){
+            worst = i;
+        }
+        stalls += reports[i].stalls;
+        if(reports[i].minFreeHeap < minFreeHeap){
+            minFreeHeap = reports[i].minFreeHeap;
+        }
+    }
+    Log.info("Cluster - %lu stalls, longest %lu ms on %s in %s, lowest free heap %lu", stalls,
+        reports[worst].longestStallMs, names[worst], HealthMonitor::sectionName(reports[worst].longestStallSection), minFreeHeap);
+    return reported;
+}
+
+/* Publish a line of health per device every HEALTH_PUBLISH_INTERVAL, so regressions in the field
+   show up in the cloud rather than only on the bench. Each line is
+   "<device>,<uptime s>,<loops>,<stalls>,<longest stall ms>,<section>,<p99 ms>,<queue high water>,
+   <min free heap>,<stack untouched>,<reset reason>", separated by ';', the clusterhead's as device 0 */
+void publishHealth(){
+    if(millis() - lastHealthPublish < HEALTH_PUBLISH_INTERVAL || !Particle.connected()){
+        return;
+    }
+    lastHealthPublish = millis();
+    UplinkBatch* batch = uplinkPool.allocate();
+    if(batch == NULL){
+        return;
+    }
+    size_t used = 0;
+    for(uint8_t device = 0; device <= NODE_CACHE_NODES; device++){
+        HealthReport report;
+        if(device == 0){
+            healthMonitor.report(report, millis() / 1000);
+        }
+        else if(nodeIngest.health(device) != NULL){
+            report = *nodeIngest.health(device);
+        }
+        else{
+            continue;
+        }
+        int written = snprintf(batch->data + used, sizeof(batch->data) - used, "%s%u,%lu,%lu,%lu,%lu,%s,%lu,%u,%lu,%u,%s",
+            used > 0 ? ";" : "", device, report.uptimeSeconds, report.loops, report.stalls, report.longestStallMs,
+            HealthMonitor::sectionName(report.longestStallSection), HealthMonitor::percentileMs(report, 0.99),
+            report.queueHighWater, report.minFreeHeap, report.stackUntouched, HealthMonitor::resetName(report.resetReason));
+        if(written < 0 || used + written >= sizeof(batch->data)){
+            batch->data[used] = '\0';//no room for this device's line, send the others
+            break;
+        }
+        used += written;
+    }
+    if(!Particle.publish("health", batch->data, PRIVATE)){
+        Log.warn("Health not published");
+    }
+    uplinkPool.release(batch);
+}
+
+/* Particle function logging our place in the relay tree and what has passed through us */
+int relayReport(String arg){
+    Log.info("Relay - %s, cluster %08lx, %s, parent %08lx (%s), %u hops", relayEnabled ? "on" : "off",
+        relayRouter.self(), relayRouter.isRoot() ? "root" : "not root", relayRouter.parent(),
+        relayUpstreamAttached() ? "attached" : "not attached", relayRouter.hops());
+    Log.info("Relay - %u children, turn with %08lx, %u blocks pending, %lu forwarded, %lu dropped, %lu duplicates",
+        relayRouter.childCount(), relayChild.connected() ? relayChildId : 0, relayPendingCount, relayForwarded, relayDropped, relayRouter.duplicates());
+    return relayRouter.hops();
+}
+
+/* Particle function turning relay mode "on" or "off", kept across resets. Off, we stop
+   advertising our beacon, let any child go and only scan while a sensor node is missing.
+   Returns 1 if relay mode is now on, 0 if off */
+int relayMode(String arg){
+    if(arg != "on" && arg != "off"){
+        return -1;
+    }
+    bool enable = arg == "on";
+    if(enable != relayEnabled){
+        relayEnabled = enable;
+        EEPROM.write(RELAY_MODE_EEPROM, enable ? RELAY_MODE_ON : 0);
+        if(enable){
+            advertiseRelayBeacon();
+            lastRelayScan = millis() - RELAY_SCAN_INTERVAL;//look for other clusterheads straight away
+        }
+        else{
+            BLE.stopAdvertising();
+            if(relayChild.connected()){
+                relayChild.disconnect();
+            }
+        }
+        Log.info("Relay - mode %s", arg.c_str());
+    }
+    return relayEnabled ? 1 : 0;
+}
 
-    //read the time of sending, to calculate transmission delay
-    memcpy(&sentTime, &data[0] + sizeof(temperature), sizeof(sentTime));
+/* Particle function logging how well the stored series are compressing */
+int codecReport(String arg){
+    seriesStore.logReport();
+    return seriesStore.nextSequence();
+}
 
-    memcpy(&temperature, &data[0], sizeof(temperature));
-    Log.info("Sensor 2 - Temperature: %d degrees Celsius", temperature);
-    // Log.info("Transmission delay: %llu seconds", calculateTransmissionDelay(sentTime));
+/* Seal a control frame, [opcode u8][payload...], and write it to a node. False if the node
+   isn't connected or the write didn't go */
+bool sendControl(uint8_t node, const uint8_t* frame, size_t len){
+    BlePeerDevice& peer = node == 1 ? sensorNode1 : sensorNode2;
+    BleCharacteristic& control = node == 1 ? controlCharacteristic1 : controlCharacteristic2;
+    uint8_t sealed[FRAME_MAX_SIZE];
+    if(!peer.connected() || len + FRAME_OVERHEAD > sizeof(sealed)){
+        return false;
+    }
+    size_t sealedLen = nodeKeyring.seal(node, frame, len, sealed);
+    return sealedLen > 0 && control.setValue(sealed, sealedLen) == (ssize_t) sealedLen;
 }
 
-void onLightReceived2(const uint8_t* data, size_t len, const BlePeerDevice& peer, void* context){
-    uint16_t twoByteValue;
-    uint64_t sentTime;
+/* Write new read delay bounds (millis, 0 to leave unchanged) for one sensor on a node.
+   Sensor indices are the order of the samplers array in that node's firmware */
+bool sendRateHint(uint8_t node, uint8_t sensor, uint32_t minDelay, uint32_t maxDelay){
+    uint8_t hint[10];
+    hint[0] = CONTROL_RATE_HINT;
+    hint[1] = sensor;
+    memcpy(&hint[2], &minDelay, sizeof(minDelay));
+    memcpy(&hint[6], &maxDelay, sizeof(maxDelay));
+    return sendControl(node, hint, sizeof(hint));
+}
 
-    //read the time of sending, to calculate transmission delay
-    memcpy(&sentTime, &data[0] + sizeof(twoByteValue), sizeof(sentTime));
+/* Particle function pushing a rate hint. Argument is "<node>,<sensor>,<min ms>,<max ms>",
+   e.g. "1,3,200,1000" to keep node 1's distance sensor between 0.2 and 1 second */
+int rateHint(String arg){
+    int node, sensor;
+    unsigned long minDelay, maxDelay;
+    if(sscanf(arg.c_str(), "%d,%d,%lu,%lu", &node, &sensor, &minDelay, &maxDelay) != 4 || sensor < 0){
+        return -1;
+    }
+    if(node == 1 && sensorNode1.connected()){
+        return sendRateHint(1, sensor, minDelay, maxDelay) ? 0 : -2;
+    }
+    if(node == 2 && sensorNode2.connected()){
+        return sendRateHint(2, sensor, minDelay, maxDelay) ? 0 : -2;
+    }
+    return -1;
+}
 
-    memcpy(&twoByteValue, &data[0], sizeof(uint16_t));
-    Log.info("Sensor 2 - Light: %u Lux", twoByteValue);
-    // Log.info("Transmission delay: %llu seconds", calculateTransmissionDelay(sentTime));
+/* Write the pushed config to one node */
+bool sendConfig(uint8_t node){
+    uint8_t frame[1 + CONFIG_MAX_SIZE];
+    frame[0] = CONTROL_CONFIG;
+    memcpy(&frame[1], pushedConfig, pushedConfigLength);
+    return sendControl(node, frame, 1 + pushedConfigLength);
 }
 
-void onSoundReceived(const uint8_t* data, size_t len, const BlePeerDevice& peer, void* context){
-    uint16_t twoByteValue;
-    uint64_t sentTime;
+/* Resend the pushed config to connected nodes that haven't reported back on it */
+void sendPendingConfig(){
+    if(millis() - lastConfigSend < CONFIG_RESEND_INTERVAL){
+        return;
+    }
+    lastConfigSend = millis();
+    for(uint8_t node = 1; node <= NODE_CACHE_NODES; node++){
+        if(nodeConfigPending[node - 1]){
+            sendConfig(node);
+        }
+    }
+}
 
-    //read the time of sending, to calculate transmission delay
-    memcpy(&sentTime, &data[0] + sizeof(twoByteValue), sizeof(sentTime));
+/* A node's report on a config, already logged by nodeIngest. Moves the pushed config on a step
+   if it is about that one */
+void onConfigStatusReceived(uint8_t node, const ConfigStatusReport& report){
+    if(pushedConfigLength == 0 || report.version != configVersion(pushedConfig, pushedConfigLength)){
+        return;
+    }
+    if(report.status == CONFIG_STATUS_TRIAL){
+        //we've heard back from the node since it applied the config, so the link still works
+        //under it. Confirmed once its data has kept coming too, see checkConfigTrial()
+        if(!nodeConfigOnTrial[node - 1]){
+            nodeConfigOnTrial[node - 1] = true;
+            nodeConfigTrialSince[node - 1] = millis();
+        }
+        return;
+    }
+    nodeConfigOnTrial[node - 1] = false;
+    nodeConfigPending[node - 1] = false;
+}
 
-    memcpy(&twoByteValue, &data[0], sizeof(uint16_t));
-    Log.info("Sensor 2 - Sound: %u dB", twoByteValue);
-    // Log.info("Transmission delay: %llu seconds", calculateTransmissionDelay(sentTime));
+/* Confirm the pushed config to a node that has had it on trial for CONFIG_CONFIRM_DWELL, now
+   that a data or health frame has come in under it */
+void checkConfigTrial(uint8_t node){
+    if(!nodeConfigOnTrial[node - 1] || millis() - nodeConfigTrialSince[node - 1] < CONFIG_CONFIRM_DWELL){
+        return;
+    }
+    uint16_t version = configVersion(pushedConfig, pushedConfigLength);
+    uint8_t confirm[3] = { CONTROL_CONFIG_CONFIRM, (uint8_t) (version & 0xFF), (uint8_t) (version >> 8) };
+    if(sendControl(node, confirm, sizeof(confirm))){
+        Log.info("Sensor node %u - confirming config version %u", node, version);
+    }
+    //stays on trial until the node reports it confirmed, so a lost confirm goes again a dwell later
+    nodeConfigTrialSince[node - 1] = millis();
 }
 
-void onHumanDetectorReceived(const uint8_t* data, size_t len, const BlePeerDevice& peer, void* context){
-    uint8_t humanSeen;
-    uint64_t sentTime;
+/* Particle function pushing a config to the nodes, see NodeConfig.h. Argument is
+   "<node or all>,<version>,<settings>", e.g. "all,3,light.min=2000,light.max=30000,records=8",
+   settings as in ConfigWriter::addText(). Anything left out goes back to a node's default.
+   The config is built once and written to every target node in one go, then resent to any
+   that haven't reported back on it. Returns how many nodes it was written to straight away */
+int pushConfig(String arg){
+    const char* text = arg.c_str();
+    char target[8];
+    unsigned int version;
+    int settingsStart = 0;
+    if(sscanf(text, "%7[^,],%u%n", target, &version, &settingsStart) != 2 || version == 0 || version > 0xFFFF){
+        return -1;
+    }
+    int node = 0;
+    if(strcmp(target, "all") != 0){
+        node = atoi(target);
+        if(node < 1 || node > NODE_CACHE_NODES){
+            return -1;
+        }
+    }
+    const char* settings = text + settingsStart;
+    if(*settings == ','){
+        settings++;
+    }
+    else if(*settings != '\0'){
+        return -1;
+    }
+    ConfigWriter writer;
+    writer.begin(pushedConfig, sizeof(pushedConfig), version);
+    if(!writer.addText(settings)){
+        pushedConfigLength = 0;
+        return -1;
+    }
+    pushedConfigLength = writer.length();
 
-    //read the time of sending, to calculate transmission delay
-    memcpy(&sentTime, &data[0] + sizeof(uint8_t), sizeof(sentTime));
+    int sent = 0;
+    for(uint8_t n = 1; n <= NODE_CACHE_NODES; n++){
+        nodeConfigPending[n - 1] = node == 0 || node == n;
+        if(nodeConfigPending[n - 1]){
+            nodeConfigOnTrial[n - 1] = false;
+        }
+        if(nodeConfigPending[n - 1] && sendConfig(n)){
+            sent++;
+        }
+    }
+    lastConfigSend = millis();
+    Log.info("Config version %u, %u bytes, pushed to %d nodes now", version, pushedConfigLength, sent);
+    return sent;
+}
 
-    memcpy(&humanSeen, &data[0], sizeof(uint8_t));
-    Log.info("Sensor 2 - Human detector: %u", humanSeen);
-    if(humanSeen == 0x00){
-        Log.info("Sensor 2 - Human lost...");
+/* Particle function rolling one node or all of them back to the config before their latest.
+   Argument is "<node or all>". Returns how many nodes it was written to */
+int rollbackConfig(String arg){
+    int node = 0;
+    if(arg != "all"){
+        node = arg.toInt();
+        if(node < 1 || node > NODE_CACHE_NODES){
+            return -1;
+        }
     }
-    else if (humanSeen == 0x01){
-        Log.info("Sensor 2 - Human detected!");
+    uint8_t frame[1] = { CONTROL_CONFIG_ROLLBACK };
+    int sent = 0;
+    for(uint8_t n = 1; n <= NODE_CACHE_NODES; n++){
+        if(node == 0 || node == n){
+            //or it would be pushed straight back, or confirmed
+            nodeConfigPending[n - 1] = false;
+            nodeConfigOnTrial[n - 1] = false;
+            if(sendControl(n, frame, sizeof(frame))){
+                sent++;
+            }
+        }
     }
-    else{
-        Log.info("Sensor 2 - Invalid human detector message. Expected 0 or 1, received %u", humanSeen);
+    return sent;
+}
+
+/* Particle function storing the key a node shares with us. Argument is "<node>,<64 hex digits>".
+   Give the node the same key with its own provisionKey function */
+int provisionKey(String arg){
+    int node;
+    char hex[2 * FRAME_KEY_SIZE + 1];
+    uint8_t key[FRAME_KEY_SIZE];
+    if(sscanf(arg.c_str(), "%d,%64s", &node, hex) != 2 || node < 1 || node > NODE_CACHE_NODES
+        || !FrameCipher::parseKey(hex, key)){
+        return -1;
     }
-    // Log.info("Transmission delay: %llu seconds", calculateTransmissionDelay(sentTime));
+    nodeKeyring.provision(node, key);
+    Log.info("Link key provisioned for sensor node %u", node);
+    return 0;
 }
 
-uint64_t calculateTransmissionDelay(uint64_t sentTime){
-    return Time.now() - sentTime;
-    // return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count() - sentTime;
-}
\ No newline at end of file
+void logPoolStats(const char* name, const MemoryPoolStats& stats){
+    Log.info("Pool %s: %u/%u in use, high water %u, %lu allocations, %lu failed",
+        name, stats.inUse, stats.capacity, stats.highWater, stats.allocations, stats.failedAllocations);
+}
+
+/* Particle function logging pool usage, and how far free heap has moved since setup() */
+int poolReport(String arg){
+    logPoolStats("ingest", ingestPool.getStats());
+    logPoolStats("uplink", uplinkPool.getStats());
+    Log.info("Ingest queue depth %u, max %u", ingestQueue.depth(), ingestQueue.maxDepth());
+    int32_t drift = (int32_t) System.freeMemory() - (int32_t) freeMemoryAfterSetup;
+    Log.info("Free heap %lu bytes, %ld since setup()", System.freeMemory(), drift);
+    return drift;
+}
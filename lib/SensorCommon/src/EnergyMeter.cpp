@@ -0,0 +1,149 @@
+/*
+ * EnergyMeter.cpp
+ * Description: implementation of the per-state energy accounting
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#include "EnergyMeter.h"
+#include <stdio.h>
+#include <string.h>
+
+const char* const ENERGY_STATE_NAMES[ENERGY_STATE_COUNT] = {
+    "cpuActive", "cpuIdle", "radioTx", "radioRx", "radioIdle", "adc", "dht", "rangefinder", "pir"
+};
+
+const uint32_t ENERGY_DEFAULT_CURRENT_UA[ENERGY_STATE_COUNT] = {
+    3300,   //CPU running from flash at 64 MHz
+    1500,   //CPU idle in delay(), with the board's regulators and peripherals still up
+    4800,   //radio TX at 0 dBm
+    4600,   //radio RX
+    2,      //radio off between events
+    500,    //SAADC conversion
+    1500,   //DHT measuring (datasheet 0.5-2.5 mA)
+    15000,  //HC-SR04 ranging
+    65      //PIR module quiescent
+};
+
+//bytes on air around a notification's payload: link layer, L2CAP and ATT headers, and the empty ack
+const uint32_t PACKET_OVERHEAD_BYTES = 17;
+const uint32_t EMPTY_PACKET_BYTES = 10;
+const uint32_t BYTE_MICROS = 8;     //1M PHY
+//an advertising event is a ~30 byte packet on each of 3 channels, with a short listen after each
+const uint32_t ADVERTISING_TX_MICROS = 3 * 30 * BYTE_MICROS;
+const uint32_t ADVERTISING_RX_MICROS = 3 * 150;
+
+static void put32(uint8_t* out, uint32_t value){
+    for(int i = 0; i < 4; i++){
+        out[i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+static uint32_t get32(const uint8_t* in){
+    return (uint32_t) in[0] | ((uint32_t) in[1] << 8) | ((uint32_t) in[2] << 16) | ((uint32_t) in[3] << 24);
+}
+
+EnergyMeter::EnergyMeter()
+    : readings(0), batteryMah(ENERGY_DEFAULT_BATTERY_MAH), batteryMv(ENERGY_DEFAULT_BATTERY_MV) {
+    memset(microsIn, 0, sizeof(microsIn));
+    memcpy(currentUa, ENERGY_DEFAULT_CURRENT_UA, sizeof(currentUa));
+}
+
+void EnergyMeter::setCurrent(EnergyState state, uint32_t microamps){
+    currentUa[state] = microamps;
+}
+
+void EnergyMeter::setBattery(uint16_t capacityMah, uint16_t millivolts){
+    batteryMah = capacityMah;
+    batteryMv = millivolts;
+}
+
+void EnergyMeter::add(EnergyState state, uint32_t micros){
+    microsIn[state] += micros;
+}
+
+void EnergyMeter::addNotification(size_t payload){
+    microsIn[ENERGY_RADIO_TX] += (PACKET_OVERHEAD_BYTES + payload) * BYTE_MICROS;
+    microsIn[ENERGY_RADIO_RX] += EMPTY_PACKET_BYTES * BYTE_MICROS;
+}
+
+void EnergyMeter::addLinkTime(uint32_t millis, bool connected){
+    uint64_t tx, rx;
+    if(connected){
+        //every connection event is at least an empty packet each way
+        uint64_t events = millis / ENERGY_CONNECTION_INTERVAL_MS;
+        tx = events * EMPTY_PACKET_BYTES * BYTE_MICROS;
+        rx = events * EMPTY_PACKET_BYTES * BYTE_MICROS;
+    }
+    else{
+        uint64_t events = millis / ENERGY_ADVERTISING_INTERVAL_MS;
+        tx = events * ADVERTISING_TX_MICROS;
+        rx = events * ADVERTISING_RX_MICROS;
+    }
+    microsIn[ENERGY_RADIO_TX] += tx;
+    microsIn[ENERGY_RADIO_RX] += rx;
+    uint64_t total = (uint64_t) millis * 1000;
+    microsIn[ENERGY_RADIO_IDLE] += total > tx + rx ? total - tx - rx : 0;
+}
+
+void EnergyMeter::report(EnergyReport& out) const {
+    //the CPU is always either active or idle, so between them they cover the whole run
+    out.elapsedSeconds = (microsIn[ENERGY_CPU_ACTIVE] + microsIn[ENERGY_CPU_IDLE]) / 1000000;
+    out.readings = readings;
+    out.batteryMah = batteryMah;
+    out.batteryMv = batteryMv;
+    for(int i = 0; i < ENERGY_STATE_COUNT; i++){
+        out.charge[i] = microsIn[i] * currentUa[i] / 1000000;
+    }
+}
+
+void EnergyMeter::encode(const EnergyReport& report, uint8_t* out){
+    put32(out, report.elapsedSeconds);
+    put32(out + 4, report.readings);
+    out[8] = report.batteryMah & 0xFF;
+    out[9] = report.batteryMah >> 8;
+    out[10] = report.batteryMv & 0xFF;
+    out[11] = report.batteryMv >> 8;
+    for(int i = 0; i < ENERGY_STATE_COUNT; i++){
+        put32(out + 12 + 8 * i, (uint32_t) report.charge[i]);
+        put32(out + 16 + 8 * i, (uint32_t) (report.charge[i] >> 32));
+    }
+}
+
+bool EnergyMeter::decode(const uint8_t* data, size_t length, EnergyReport& out){
+    if(length < ENERGY_REPORT_SIZE){
+        return false;
+    }
+    out.elapsedSeconds = get32(data);
+    out.readings = get32(data + 4);
+    out.batteryMah = data[8] | (data[9] << 8);
+    out.batteryMv = data[10] | (data[11] << 8);
+    for(int i = 0; i < ENERGY_STATE_COUNT; i++){
+        out.charge[i] = get32(data + 12 + 8 * i) | ((uint64_t) get32(data + 16 + 8 * i) << 32);
+    }
+    return true;
+}
+
+static uint64_t totalCharge(const EnergyReport& report){
+    uint64_t total = 0;
+    for(int i = 0; i < ENERGY_STATE_COUNT; i++){
+        total += report.charge[i];
+    }
+    return total;
+}
+
+int EnergyMeter::formatSummary(const EnergyReport& report, char* out, size_t size){
+    uint64_t charge = totalCharge(report);
+    double joules = charge * (double) report.batteryMv / 1e9;
+    double perReading = report.readings > 0 ? joules * 1000 / report.readings : 0;
+    double averageMa = report.elapsedSeconds > 0 ? charge / 1000.0 / report.elapsedSeconds : 0;
+    double lifeDays = averageMa > 0 ? report.batteryMah / averageMa / 24 : 0;
+    return snprintf(out, size, "Energy over %lu s, %lu readings: %.3f J, %.3f mJ per reading, average %.2f mA, battery life %.1f days",
+        (unsigned long) report.elapsedSeconds, (unsigned long) report.readings, joules, perReading, averageMa, lifeDays);
+}
+
+int EnergyMeter::formatState(const EnergyReport& report, EnergyState state, char* out, size_t size){
+    uint64_t charge = totalCharge(report);
+    double millijoules = report.charge[state] * (double) report.batteryMv / 1e6;
+    double share = charge > 0 ? 100.0 * report.charge[state] / charge : 0;
+    return snprintf(out, size, "  %s: %.3f mJ (%.1f%%)", ENERGY_STATE_NAMES[state], millijoules, share);
+}
@@ -0,0 +1,88 @@
+/*
+ * EnergyMeter.h
+ * Description: energy accounting for a node. Counts the time spent in each state of each
+ *              subsystem (CPU, radio, sensor conversions) and multiplies it by a per-state
+ *              current table, giving charge, joules per reading and projected battery life.
+ *              Radio time can't be measured directly, so it is estimated from the
+ *              notifications sent and the time spent connected or advertising.
+ *              Does not depend on Particle.h, so tools/energysim builds the same report.
+ *              Every firmware builds it from lib/SensorCommon, the clusterhead only decodes.
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum EnergyState {
+    ENERGY_CPU_ACTIVE,
+    ENERGY_CPU_IDLE,        //delay() between loops
+    ENERGY_RADIO_TX,
+    ENERGY_RADIO_RX,
+    ENERGY_RADIO_IDLE,
+    ENERGY_ADC,             //analogRead conversions
+    ENERGY_DHT,             //DHT bus transactions
+    ENERGY_RANGEFINDER,     //HC-SR04 trigger and echo
+    ENERGY_PIR,             //always powered, so counted for the whole run
+    ENERGY_STATE_COUNT
+};
+
+extern const char* const ENERGY_STATE_NAMES[ENERGY_STATE_COUNT];
+
+/* Default draw of each state in microamps. nRF52840 figures for the CPU and radio (0 dBm),
+   sensor figures from their datasheets. Override per board with setCurrent() */
+extern const uint32_t ENERGY_DEFAULT_CURRENT_UA[ENERGY_STATE_COUNT];
+
+const uint16_t ENERGY_DEFAULT_BATTERY_MAH = 2000;
+const uint16_t ENERGY_DEFAULT_BATTERY_MV = 3700;
+
+/* Link timing used to estimate radio time, matching what Device OS negotiates */
+const uint32_t ENERGY_CONNECTION_INTERVAL_MS = 30;
+const uint32_t ENERGY_ADVERTISING_INTERVAL_MS = 100;
+
+struct EnergyReport {
+    uint32_t elapsedSeconds;
+    uint32_t readings;
+    uint16_t batteryMah;
+    uint16_t batteryMv;
+    uint64_t charge[ENERGY_STATE_COUNT];   //microcoulombs (microamp seconds)
+};
+//[elapsed u32][readings u32][battery mAh u16][battery mV u16][charge u64 per state], little endian
+const size_t ENERGY_REPORT_SIZE = 12 + 8 * ENERGY_STATE_COUNT;
+
+class EnergyMeter {
+public:
+    EnergyMeter();
+
+    void setCurrent(EnergyState state, uint32_t microamps);
+    void setBattery(uint16_t capacityMah, uint16_t millivolts);
+
+    // Time spent in a state
+    void add(EnergyState state, uint32_t micros);
+
+    // A notification with this much payload was sent, plus the acknowledgement received
+    void addNotification(size_t payload);
+
+    // Radio upkeep over a stretch of time: connection events while connected, advertising
+    // otherwise. The rest of the time is radio idle
+    void addLinkTime(uint32_t millis, bool connected);
+
+    void addReading(){ readings++; }
+
+    void report(EnergyReport& out) const;
+
+    static void encode(const EnergyReport& report, uint8_t* out);
+    static bool decode(const uint8_t* data, size_t length, EnergyReport& out);
+
+    // Human readable summary, and one line per state, shared by firmware logs and host tools
+    static int formatSummary(const EnergyReport& report, char* out, size_t size);
+    static int formatState(const EnergyReport& report, EnergyState state, char* out, size_t size);
+
+private:
+    uint64_t microsIn[ENERGY_STATE_COUNT];
+    uint32_t currentUa[ENERGY_STATE_COUNT];
+    uint32_t readings;
+    uint16_t batteryMah;
+    uint16_t batteryMv;
+};
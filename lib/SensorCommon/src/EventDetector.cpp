@@ -0,0 +1,122 @@
+/*
+ * EventDetector.cpp
+ * Description: implementation of the EWMA z-score event detector and its raw window
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#include "EventDetector.h"
+#include <math.h>
+#include <string.h>
+
+//samples of baseline needed before anything can fire, as a multiple of 1/alpha
+const float EVENT_WARM_UP = 2;
+
+EventDetector::EventDetector(uint16_t periodMs, float alpha, float zThreshold, float minDeviation)
+    : periodMs(periodMs), alpha(alpha), zThreshold(zThreshold), minDeviation(minDeviation),
+      mean(0), variance(0), added(0), ringHead(0), aggregateSum(0), aggregateCount(0),
+      postRemaining(0), holdoff(0), triggerTime(0), triggerZ10(0), windowReady(false), eventCount(0) {
+    memset(ring, 0, sizeof(ring));
+    memset(&window, 0, sizeof(window));
+}
+
+void EventDetector::add(uint32_t timestamp, uint16_t value){
+    ring[ringHead] = value;
+    ringHead = (ringHead + 1) % EVENT_WINDOW_SAMPLES;
+    aggregateSum += value;
+    aggregateCount++;
+
+    //check against the baseline before this sample moves it
+    float deviation = value - mean;
+    if(added == 0){
+        mean = value;
+        deviation = 0;
+    }
+    bool warm = added >= EVENT_WARM_UP / alpha;
+    if(warm && postRemaining == 0 && holdoff == 0 && fabsf(deviation) >= minDeviation
+        && deviation * deviation > zThreshold * zThreshold * variance){
+        //sample after sample of this is what the window is for, so wait for the rest of it
+        postRemaining = EVENT_POST_SAMPLES + 1;
+        triggerTime = timestamp;
+        float z = variance > 0 ? fabsf(deviation) / sqrtf(variance) : 999;
+        triggerZ10 = (int16_t) (z > 3276 ? 32767 : z * 10) * (deviation < 0 ? -1 : 1);
+        eventCount++;
+    }
+    //the baseline follows a step change, so it stops firing once the new level is normal
+    mean += alpha * deviation;
+    variance = (1 - alpha) * (variance + alpha * deviation * deviation);
+    added++;
+
+    if(holdoff > 0){
+        holdoff--;
+    }
+    if(postRemaining > 0 && --postRemaining == 0){
+        //the sample that fired is EVENT_POST_SAMPLES back from the newest
+        uint8_t count = added < EVENT_WINDOW_SAMPLES ? added : EVENT_WINDOW_SAMPLES;
+        window.triggerTime = triggerTime;
+        window.periodMs = periodMs;
+        window.count = count;
+        window.preSamples = count - EVENT_POST_SAMPLES - 1;
+        window.zScore10 = triggerZ10;
+        for(uint8_t i = 0; i < count; i++){
+            window.samples[i] = ring[(ringHead + EVENT_WINDOW_SAMPLES - count + i) % EVENT_WINDOW_SAMPLES];
+        }
+        windowReady = true;
+        //give the baseline a window's worth of samples to settle
+        holdoff = EVENT_WINDOW_SAMPLES;
+    }
+}
+
+bool EventDetector::aggregate(uint16_t& out){
+    if(aggregateCount == 0){
+        return false;
+    }
+    out = (aggregateSum + aggregateCount / 2) / aggregateCount;
+    aggregateSum = 0;
+    aggregateCount = 0;
+    return true;
+}
+
+bool EventDetector::takeWindow(EventWindow& out){
+    if(!windowReady){
+        return false;
+    }
+    out = window;
+    windowReady = false;
+    return true;
+}
+
+size_t EventDetector::encode(const EventWindow& window, uint8_t* out){
+    for(int i = 0; i < 4; i++){
+        out[i] = (window.triggerTime >> (8 * i)) & 0xFF;
+    }
+    out[4] = window.periodMs & 0xFF;
+    out[5] = window.periodMs >> 8;
+    out[6] = window.preSamples;
+    out[7] = window.count;
+    out[8] = (uint16_t) window.zScore10 & 0xFF;
+    out[9] = (uint16_t) window.zScore10 >> 8;
+    for(uint8_t i = 0; i < window.count; i++){
+        out[EVENT_HEADER_SIZE + 2 * i] = window.samples[i] & 0xFF;
+        out[EVENT_HEADER_SIZE + 2 * i + 1] = window.samples[i] >> 8;
+    }
+    return EVENT_HEADER_SIZE + 2 * window.count;
+}
+
+bool EventDetector::decode(const uint8_t* data, size_t length, EventWindow& out){
+    if(length < EVENT_HEADER_SIZE){
+        return false;
+    }
+    out.triggerTime = (uint32_t) data[0] | ((uint32_t) data[1] << 8) | ((uint32_t) data[2] << 16) | ((uint32_t) data[3] << 24);
+    out.periodMs = data[4] | (data[5] << 8);
+    out.preSamples = data[6];
+    out.count = data[7];
+    out.zScore10 = (int16_t) (data[8] | (data[9] << 8));
+    if(out.count > EVENT_WINDOW_SAMPLES || out.preSamples >= out.count
+        || length < EVENT_HEADER_SIZE + 2 * (size_t) out.count){
+        return false;
+    }
+    for(uint8_t i = 0; i < out.count; i++){
+        out.samples[i] = data[EVENT_HEADER_SIZE + 2 * i] | (data[EVENT_HEADER_SIZE + 2 * i + 1] << 8);
+    }
+    return true;
+}
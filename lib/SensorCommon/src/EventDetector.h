@@ -0,0 +1,83 @@
+/*
+ * EventDetector.h
+ * Description: online event detection on one sensor's raw samples, keeping the raw window
+ *              around each event for a burst upload. Tracks an EWMA baseline of the mean and
+ *              variance, and fires when a sample's z-score against it passes a threshold.
+ *              The last EVENT_WINDOW_SAMPLES samples are kept in a ring, so a window holds
+ *              what led up to the event as well as what followed it. Between events the
+ *              node only sends aggregate(), the mean since the last reading.
+ *              Does not depend on Particle.h. Every firmware builds it from
+ *              lib/SensorCommon, the clusterhead only decodes.
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+//samples in a window, and how many of them come after the one that fired
+const uint8_t EVENT_WINDOW_SAMPLES = 64;
+const uint8_t EVENT_POST_SAMPLES = 16;
+
+struct EventWindow {
+    uint32_t triggerTime;   //unix time (s) of the sample that fired
+    uint16_t periodMs;      //time between samples
+    uint8_t preSamples;     //samples before the one that fired, which is samples[preSamples]
+    uint8_t count;
+    int16_t zScore10;       //z-score of the sample that fired, x10
+    uint16_t samples[EVENT_WINDOW_SAMPLES];
+};
+//[trigger time u32][period ms u16][pre samples u8][count u8][z-score x10 i16][samples u16...], little endian
+const size_t EVENT_HEADER_SIZE = 10;
+const size_t EVENT_WINDOW_MAX_SIZE = EVENT_HEADER_SIZE + 2 * EVENT_WINDOW_SAMPLES;
+
+class EventDetector {
+public:
+    // periodMs is how often add() is called. alpha is the baseline's weight on each new
+    // sample, zThreshold how many standard deviations from it counts as an event, and
+    // minDeviation the smallest jump (in the sensor's units) that does, so a very flat
+    // signal doesn't fire on a count of noise
+    EventDetector(uint16_t periodMs, float alpha, float zThreshold, float minDeviation);
+
+    // Add a raw sample taken at timestamp (unix s)
+    void add(uint32_t timestamp, uint16_t value);
+
+    // Mean of the samples added since the last call. False if there were none
+    bool aggregate(uint16_t& out);
+
+    // Take the window around the latest event, once it has its post-trigger samples.
+    // A window not taken before the next one completes is replaced by it
+    bool takeWindow(EventWindow& out);
+
+    uint32_t events() const { return eventCount; }
+    float baseline() const { return mean; }
+
+    // Returns the encoded length
+    static size_t encode(const EventWindow& window, uint8_t* out);
+    static bool decode(const uint8_t* data, size_t length, EventWindow& out);
+
+private:
+    uint16_t periodMs;
+    float alpha;
+    float zThreshold;
+    float minDeviation;
+
+    float mean;
+    float variance;
+    uint32_t added;             //samples seen, for the warm up and the ring's fill
+
+    uint16_t ring[EVENT_WINDOW_SAMPLES];
+    uint8_t ringHead;           //where the next sample goes
+    uint32_t aggregateSum;
+    uint16_t aggregateCount;
+
+    uint8_t postRemaining;      //samples still to come for the open window, 0 if none is open
+    uint8_t holdoff;            //samples before another event can fire
+    uint32_t triggerTime;
+    int16_t triggerZ10;
+
+    EventWindow window;
+    bool windowReady;
+    uint32_t eventCount;
+};
@@ -0,0 +1,295 @@
+/*
+ * FrameCipher.cpp
+ * Description: implementation of ChaCha20-Poly1305 framing and the replay window.
+ *              Poly1305 uses 26 bit limbs, so it only needs 32x32->64 bit multiplies,
+ *              which the Cortex-M4 does in one instruction
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#include "FrameCipher.h"
+#include <string.h>
+
+static uint32_t load32(const uint8_t* in){
+    return (uint32_t) in[0] | ((uint32_t) in[1] << 8) | ((uint32_t) in[2] << 16) | ((uint32_t) in[3] << 24);
+}
+
+static void store32(uint8_t* out, uint32_t value){
+    for(int i = 0; i < 4; i++){
+        out[i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+static inline uint32_t rotl(uint32_t value, int bits){
+    return (value << bits) | (value >> (32 - bits));
+}
+
+#define QUARTER_ROUND(a, b, c, d) \
+    a += b; d ^= a; d = rotl(d, 16); \
+    c += d; b ^= c; b = rotl(b, 12); \
+    a += b; d ^= a; d = rotl(d, 8); \
+    c += d; b ^= c; b = rotl(b, 7);
+
+static void chachaBlock(const uint32_t* input, uint8_t* out){
+    uint32_t x[16];
+    memcpy(x, input, sizeof(x));
+    for(int round = 0; round < 10; round++){
+        QUARTER_ROUND(x[0], x[4], x[8], x[12]);
+        QUARTER_ROUND(x[1], x[5], x[9], x[13]);
+        QUARTER_ROUND(x[2], x[6], x[10], x[14]);
+        QUARTER_ROUND(x[3], x[7], x[11], x[15]);
+        QUARTER_ROUND(x[0], x[5], x[10], x[15]);
+        QUARTER_ROUND(x[1], x[6], x[11], x[12]);
+        QUARTER_ROUND(x[2], x[7], x[8], x[13]);
+        QUARTER_ROUND(x[3], x[4], x[9], x[14]);
+    }
+    for(int i = 0; i < 16; i++){
+        store32(out + 4 * i, x[i] + input[i]);
+    }
+}
+
+void FrameCipher::chacha20(const uint8_t* key, const uint8_t* nonce, uint32_t counter,
+    const uint8_t* in, size_t len, uint8_t* out){
+    uint32_t state[16] = { 0x61707865, 0x3320646e, 0x79622d32, 0x6b206574 };
+    for(int i = 0; i < 8; i++){
+        state[4 + i] = load32(key + 4 * i);
+    }
+    state[12] = counter;
+    for(int i = 0; i < 3; i++){
+        state[13 + i] = load32(nonce + 4 * i);
+    }
+    uint8_t block[64];
+    while(len > 0){
+        chachaBlock(state, block);
+        size_t chunk = len < 64 ? len : 64;
+        for(size_t i = 0; i < chunk; i++){
+            out[i] = in[i] ^ block[i];
+        }
+        state[12]++;
+        in += chunk;
+        out += chunk;
+        len -= chunk;
+    }
+}
+
+/* Poly1305 over 16 byte blocks, as five 26 bit limbs */
+struct Poly1305 {
+    uint32_t r[5];
+    uint32_t h[5];
+    uint32_t pad[4];
+
+    void begin(const uint8_t* key){
+        //clamp r as the spec requires
+        r[0] = load32(key) & 0x3ffffff;
+        r[1] = (load32(key + 3) >> 2) & 0x3ffff03;
+        r[2] = (load32(key + 6) >> 4) & 0x3ffc0ff;
+        r[3] = (load32(key + 9) >> 6) & 0x3f03fff;
+        r[4] = (load32(key + 12) >> 8) & 0x00fffff;
+        memset(h, 0, sizeof(h));
+        for(int i = 0; i < 4; i++){
+            pad[i] = load32(key + 16 + 4 * i);
+        }
+    }
+
+    //padded is the high bit for a full block, 0 when the final partial block carries its own 0x01
+    void block(const uint8_t* m, uint32_t padded){
+        uint32_t s1 = r[1] * 5, s2 = r[2] * 5, s3 = r[3] * 5, s4 = r[4] * 5;
+        h[0] += load32(m) & 0x3ffffff;
+        h[1] += (load32(m + 3) >> 2) & 0x3ffffff;
+        h[2] += (load32(m + 6) >> 4) & 0x3ffffff;
+        h[3] += (load32(m + 9) >> 6) & 0x3ffffff;
+        h[4] += (load32(m + 12) >> 8) | padded;
+
+        uint64_t d0 = (uint64_t) h[0] * r[0] + (uint64_t) h[1] * s4 + (uint64_t) h[2] * s3 + (uint64_t) h[3] * s2 + (uint64_t) h[4] * s1;
+        uint64_t d1 = (uint64_t) h[0] * r[1] + (uint64_t) h[1] * r[0] + (uint64_t) h[2] * s4 + (uint64_t) h[3] * s3 + (uint64_t) h[4] * s2;
+        uint64_t d2 = (uint64_t) h[0] * r[2] + (uint64_t) h[1] * r[1] + (uint64_t) h[2] * r[0] + (uint64_t) h[3] * s4 + (uint64_t) h[4] * s3;
+        uint64_t d3 = (uint64_t) h[0] * r[3] + (uint64_t) h[1] * r[2] + (uint64_t) h[2] * r[1] + (uint64_t) h[3] * r[0] + (uint64_t) h[4] * s4;
+        uint64_t d4 = (uint64_t) h[0] * r[4] + (uint64_t) h[1] * r[3] + (uint64_t) h[2] * r[2] + (uint64_t) h[3] * r[1] + (uint64_t) h[4] * r[0];
+
+        uint32_t carry = (uint32_t) (d0 >> 26); h[0] = (uint32_t) d0 & 0x3ffffff;
+        d1 += carry; carry = (uint32_t) (d1 >> 26); h[1] = (uint32_t) d1 & 0x3ffffff;
+        d2 += carry; carry = (uint32_t) (d2 >> 26); h[2] = (uint32_t) d2 & 0x3ffffff;
+        d3 += carry; carry = (uint32_t) (d3 >> 26); h[3] = (uint32_t) d3 & 0x3ffffff;
+        d4 += carry; carry = (uint32_t) (d4 >> 26); h[4] = (uint32_t) d4 & 0x3ffffff;
+        h[0] += carry * 5; carry = h[0] >> 26; h[0] &= 0x3ffffff;
+        h[1] += carry;
+    }
+
+    //whole message, zero padded to a block boundary as the AEAD construction wants
+    void update(const uint8_t* m, size_t len){
+        while(len >= 16){
+            block(m, 1 << 24);
+            m += 16;
+            len -= 16;
+        }
+        if(len > 0){
+            uint8_t last[16] = { 0 };
+            memcpy(last, m, len);
+            block(last, 1 << 24);
+        }
+    }
+
+    void finish(uint8_t* tag){
+        //fully carry h
+        uint32_t carry = h[1] >> 26; h[1] &= 0x3ffffff;
+        h[2] += carry; carry = h[2] >> 26; h[2] &= 0x3ffffff;
+        h[3] += carry; carry = h[3] >> 26; h[3] &= 0x3ffffff;
+        h[4] += carry; carry = h[4] >> 26; h[4] &= 0x3ffffff;
+        h[0] += carry * 5; carry = h[0] >> 26; h[0] &= 0x3ffffff;
+        h[1] += carry;
+
+        //h - p, kept only if h >= p
+        uint32_t g[5];
+        g[0] = h[0] + 5; carry = g[0] >> 26; g[0] &= 0x3ffffff;
+        g[1] = h[1] + carry; carry = g[1] >> 26; g[1] &= 0x3ffffff;
+        g[2] = h[2] + carry; carry = g[2] >> 26; g[2] &= 0x3ffffff;
+        g[3] = h[3] + carry; carry = g[3] >> 26; g[3] &= 0x3ffffff;
+        g[4] = h[4] + carry - (1 << 26);
+        uint32_t mask = (g[4] >> 31) - 1;  //all ones if h >= p
+        for(int i = 0; i < 5; i++){
+            h[i] = (h[i] & ~mask) | (g[i] & mask);
+        }
+
+        //to 4 words, then add the pad mod 2^128
+        uint32_t w0 = h[0] | (h[1] << 26);
+        uint32_t w1 = (h[1] >> 6) | (h[2] << 20);
+        uint32_t w2 = (h[2] >> 12) | (h[3] << 14);
+        uint32_t w3 = (h[3] >> 18) | (h[4] << 8);
+        uint64_t f = (uint64_t) w0 + pad[0]; store32(tag, (uint32_t) f);
+        f = (uint64_t) w1 + pad[1] + (f >> 32); store32(tag + 4, (uint32_t) f);
+        f = (uint64_t) w2 + pad[2] + (f >> 32); store32(tag + 8, (uint32_t) f);
+        f = (uint64_t) w3 + pad[3] + (f >> 32); store32(tag + 12, (uint32_t) f);
+    }
+};
+
+void FrameCipher::aeadTag(const uint8_t* key, const uint8_t* nonce, const uint8_t* aad, size_t aadLen,
+    const uint8_t* ciphertext, size_t len, uint8_t* tag){
+    //the one time Poly1305 key is the first half of keystream block 0
+    uint8_t polyKey[64] = { 0 };
+    chacha20(key, nonce, 0, polyKey, sizeof(polyKey), polyKey);
+    Poly1305 poly;
+    poly.begin(polyKey);
+    poly.update(aad, aadLen);
+    poly.update(ciphertext, len);
+    uint8_t lengths[16];
+    store32(lengths, (uint32_t) aadLen);
+    store32(lengths + 4, 0);
+    store32(lengths + 8, (uint32_t) len);
+    store32(lengths + 12, 0);
+    poly.block(lengths, 1 << 24);
+    poly.finish(tag);
+}
+
+void FrameCipher::aeadEncrypt(const uint8_t* key, const uint8_t* nonce, const uint8_t* aad, size_t aadLen,
+    const uint8_t* in, size_t len, uint8_t* out, uint8_t* tag){
+    chacha20(key, nonce, 1, in, len, out);
+    aeadTag(key, nonce, aad, aadLen, out, len, tag);
+}
+
+FrameCipher::FrameCipher() : keyed(false) {
+    memset(key, 0, sizeof(key));
+}
+
+void FrameCipher::setKey(const uint8_t* key){
+    memcpy(this->key, key, FRAME_KEY_SIZE);
+    keyed = true;
+}
+
+void FrameCipher::clearKey(){
+    memset(key, 0, sizeof(key));
+    keyed = false;
+}
+
+void FrameCipher::makeNonce(uint8_t channel, uint32_t sequence, uint8_t* nonce){
+    //[channel u8][0 u8 x3][sequence u32][0 u8 x4]
+    memset(nonce, 0, 12);
+    nonce[0] = channel;
+    store32(nonce + 4, sequence);
+}
+
+size_t FrameCipher::seal(uint8_t channel, uint32_t sequence, const uint8_t* in, size_t len, uint8_t* out) const {
+    if(!keyed){
+        return 0;
+    }
+    uint8_t nonce[12];
+    uint8_t tag[16];
+    makeNonce(channel, sequence, nonce);
+    store32(out, sequence);
+    aeadEncrypt(key, nonce, NULL, 0, in, len, out + FRAME_SEQUENCE_SIZE, tag);
+    memcpy(out + FRAME_SEQUENCE_SIZE + len, tag, FRAME_TAG_SIZE);
+    return len + FRAME_OVERHEAD;
+}
+
+bool FrameCipher::open(uint8_t channel, const uint8_t* in, size_t len, uint8_t* out, uint32_t& sequence) const {
+    if(!keyed || len < FRAME_OVERHEAD){
+        return false;
+    }
+    size_t payload = len - FRAME_OVERHEAD;
+    uint32_t claimed = load32(in);
+    uint8_t nonce[12];
+    uint8_t tag[16];
+    makeNonce(channel, claimed, nonce);
+    aeadTag(key, nonce, NULL, 0, in + FRAME_SEQUENCE_SIZE, payload, tag);
+    //compare in constant time, so the tag can't be guessed a byte at a time
+    uint8_t difference = 0;
+    for(size_t i = 0; i < FRAME_TAG_SIZE; i++){
+        difference |= tag[i] ^ in[FRAME_SEQUENCE_SIZE + payload + i];
+    }
+    if(difference != 0){
+        return false;
+    }
+    chacha20(key, nonce, 1, in + FRAME_SEQUENCE_SIZE, payload, out);
+    sequence = claimed;
+    return true;
+}
+
+bool FrameCipher::parseKey(const char* hex, uint8_t* key){
+    if(hex == NULL || strlen(hex) != 2 * FRAME_KEY_SIZE){
+        return false;
+    }
+    for(size_t i = 0; i < 2 * FRAME_KEY_SIZE; i++){
+        char c = hex[i];
+        uint8_t nibble;
+        if(c >= '0' && c <= '9'){
+            nibble = c - '0';
+        }
+        else if(c >= 'a' && c <= 'f'){
+            nibble = c - 'a' + 10;
+        }
+        else if(c >= 'A' && c <= 'F'){
+            nibble = c - 'A' + 10;
+        }
+        else{
+            return false;
+        }
+        key[i / 2] = i % 2 == 0 ? nibble << 4 : key[i / 2] | nibble;
+    }
+    return true;
+}
+
+void ReplayWindow::reset(uint32_t floor){
+    highest = floor;
+    //everything at or below the floor counts as seen
+    seen = 0xFFFFFFFF;
+    started = true;
+}
+
+bool ReplayWindow::accept(uint32_t sequence){
+    if(!started){
+        highest = sequence;
+        seen = 1;
+        started = true;
+        return true;
+    }
+    if(sequence > highest){
+        uint32_t shift = sequence - highest;
+        seen = shift >= 32 ? 1 : (seen << shift) | 1;
+        highest = sequence;
+        return true;
+    }
+    uint32_t age = highest - sequence;
+    if(age >= 32 || (seen & (1UL << age))){
+        return false;
+    }
+    seen |= 1UL << age;
+    return true;
+}
@@ -0,0 +1,94 @@
+/*
+ * FrameCipher.h
+ * Description: authenticated framing for everything sent between a node and the clusterhead,
+ *              using ChaCha20-Poly1305 (RFC 8439) with a per-node key.
+ *              A sealed frame is [sequence u32][ciphertext][tag], 12 bytes more than the plain
+ *              payload. The nonce is built from the channel and the sequence number, so a frame
+ *              can't be moved to another characteristic or direction. The sender never reuses
+ *              a sequence number under a key, and the receiver's ReplayWindow rejects any it
+ *              has already accepted. The Poly1305 tag is truncated to 8 bytes, as BLE's own
+ *              link layer MIC is, to keep the overhead down on small notifications.
+ *              Does not depend on Particle.h, so tools/cryptobench times the same code.
+ *              Every firmware builds it from lib/SensorCommon.
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+const size_t FRAME_KEY_SIZE = 32;
+const size_t FRAME_SEQUENCE_SIZE = 4;
+const size_t FRAME_TAG_SIZE = 8;
+const size_t FRAME_OVERHEAD = FRAME_SEQUENCE_SIZE + FRAME_TAG_SIZE;
+//the largest notification or write Device OS sends, sealed
+const size_t FRAME_MAX_SIZE = 244;
+
+/* What a frame is for, bound into its nonce. Node to clusterhead channels share the node's
+   sequence numbers, control frames use the clusterhead's */
+const uint8_t FRAME_CHANNEL_STREAM = 0x01;
+const uint8_t FRAME_CHANNEL_DIAGNOSTICS = 0x02;
+const uint8_t FRAME_CHANNEL_EVENT = 0x03;
+const uint8_t FRAME_CHANNEL_CONTROL = 0x04;
+
+/* Receivers save their replay floor this far ahead of the sequence numbers they accept, before
+   accepting any past the saved one, so a reset never lowers it. Senders skip this many whenever
+   a connection starts, which takes them past a floor saved before the other side reset */
+const uint32_t FRAME_FLOOR_STEP = 256;
+
+class FrameCipher {
+public:
+    FrameCipher();
+
+    void setKey(const uint8_t* key);
+    void clearKey();
+    bool hasKey() const { return keyed; }
+
+    // Seal len bytes of in for channel under sequence into out, which takes len + FRAME_OVERHEAD
+    // bytes and must not overlap in. Returns the sealed length, 0 if there is no key
+    size_t seal(uint8_t channel, uint32_t sequence, const uint8_t* in, size_t len, uint8_t* out) const;
+
+    // Check and decrypt a sealed frame for channel into out, which takes len - FRAME_OVERHEAD
+    // bytes. False if there is no key, it is too short or the tag doesn't match, in which
+    // case out is left untouched. Checking sequence for replays is up to the caller
+    bool open(uint8_t channel, const uint8_t* in, size_t len, uint8_t* out, uint32_t& sequence) const;
+
+    // Parse a key written as 64 hex digits
+    static bool parseKey(const char* hex, uint8_t* key);
+
+    // The RFC 8439 AEAD, with the full 16 byte tag. Exposed for the test vectors in tools/cryptobench
+    static void aeadEncrypt(const uint8_t* key, const uint8_t* nonce, const uint8_t* aad, size_t aadLen,
+        const uint8_t* in, size_t len, uint8_t* out, uint8_t* tag);
+    static void aeadTag(const uint8_t* key, const uint8_t* nonce, const uint8_t* aad, size_t aadLen,
+        const uint8_t* ciphertext, size_t len, uint8_t* tag);
+    static void chacha20(const uint8_t* key, const uint8_t* nonce, uint32_t counter,
+        const uint8_t* in, size_t len, uint8_t* out);
+
+private:
+    static void makeNonce(uint8_t channel, uint32_t sequence, uint8_t* nonce);
+
+    uint8_t key[FRAME_KEY_SIZE];
+    bool keyed;
+};
+
+/* Sequence numbers accepted from one sender. Anything at or below the highest seen is
+   rejected unless it is within the last 32 and hasn't been seen, which allows for frames
+   on different characteristics arriving out of order with each other */
+class ReplayWindow {
+public:
+    ReplayWindow() : highest(0), seen(0), started(false) {}
+
+    // Start again with nothing accepted at or below floor, e.g. from a value saved before a reset
+    void reset(uint32_t floor);
+
+    // Record sequence if it is new. False if it is a replay, or too old to tell
+    bool accept(uint32_t sequence);
+
+    uint32_t latest() const { return highest; }
+
+private:
+    uint32_t highest;
+    uint32_t seen;      //bit n set if highest - n has been accepted
+    bool started;
+};
@@ -0,0 +1,282 @@
+/*
+ * HealthMonitor.cpp
+ * Description: implementation of the loop timing and runtime health tracking
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#include "HealthMonitor.h"
+#include <stdio.h>
+#include <string.h>
+
+const char* const HEALTH_SECTION_NAMES[HEALTH_SECTION_COUNT] = {
+    "loop", "dht", "rangefinder", "adc", "radio", "storage", "bleScan", "bleConnect", "ingest"
+};
+
+//left below setup()'s frame unpainted, for paintStack()'s own
+const size_t STACK_MARGIN = 256;
+const uint8_t STACK_PAINT = 0xA5;
+
+static void put16(uint8_t* out, uint16_t value){
+    out[0] = value & 0xFF;
+    out[1] = value >> 8;
+}
+
+static void put32(uint8_t* out, uint32_t value){
+    for(int i = 0; i < 4; i++){
+        out[i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+static uint16_t get16(const uint8_t* in){
+    return in[0] | (in[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* in){
+    return (uint32_t) in[0] | ((uint32_t) in[1] << 8) | ((uint32_t) in[2] << 16) | ((uint32_t) in[3] << 24);
+}
+
+static uint16_t clamp16(uint32_t value){
+    return value > 0xFFFF ? 0xFFFF : value;
+}
+
+HealthMonitor::HealthMonitor(uint32_t stallMs)
+    : stallMicros(stallMs * 1000), loopStart(0), loops(0), stalls(0), longestLoop(0),
+      longestLoopSection(HEALTH_SECTION_LOOP), currentSection(HEALTH_SECTION_LOOP), sectionStart(0),
+      sectionedMicros(0), slowestSection(HEALTH_SECTION_LOOP), slowestSectionMicros(0),
+      queueDepth(0), queueHighWater(0), freeHeap(0), minFreeHeap(0), stackBottom(NULL), stackPainted(0),
+      resetReason(0), resetSection(HEALTH_NO_SECTION) {
+    memset(latency, 0, sizeof(latency));
+    memset(sectionMax, 0, sizeof(sectionMax));
+}
+
+void HealthMonitor::beginLoop(uint32_t nowMicros){
+    loopStart = nowMicros;
+    currentSection = HEALTH_SECTION_LOOP;
+    sectionedMicros = 0;
+    slowestSectionMicros = 0;
+}
+
+void HealthMonitor::endLoop(uint32_t nowMicros){
+    uint32_t busy = nowMicros - loopStart;
+    //time outside any section counts to the loop itself
+    uint32_t unsectioned = busy - sectionedMicros;
+    if(unsectioned >= slowestSectionMicros){
+        slowestSection = HEALTH_SECTION_LOOP;
+        slowestSectionMicros = unsectioned;
+    }
+    if(unsectioned > sectionMax[HEALTH_SECTION_LOOP]){
+        sectionMax[HEALTH_SECTION_LOOP] = unsectioned;
+    }
+    uint32_t ms = busy / 1000;
+    int bucket = 0;
+    while(bucket < HEALTH_LATENCY_BUCKETS - 1 && ms >= (1u << bucket)){
+        bucket++;
+    }
+    latency[bucket]++;
+    loops++;
+    if(busy > stallMicros){
+        stalls++;
+    }
+    if(busy > longestLoop){
+        longestLoop = busy;
+        longestLoopSection = slowestSection;
+    }
+}
+
+void HealthMonitor::enter(HealthSection section, uint32_t nowMicros){
+    sectionStart = nowMicros;
+    currentSection = section;
+}
+
+void HealthMonitor::leave(uint32_t nowMicros){
+    uint32_t elapsed = nowMicros - sectionStart;
+    uint8_t section = currentSection;
+    currentSection = HEALTH_SECTION_LOOP;
+    sectionedMicros += elapsed;
+    if(elapsed > sectionMax[section]){
+        sectionMax[section] = elapsed;
+    }
+    if(elapsed > slowestSectionMicros){
+        slowestSection = section;
+        slowestSectionMicros = elapsed;
+    }
+}
+
+void HealthMonitor::setQueueDepth(uint16_t depth, uint16_t highWater){
+    queueDepth = depth;
+    if(highWater > queueHighWater){
+        queueHighWater = highWater;
+    }
+}
+
+void HealthMonitor::sampleHeap(uint32_t freeBytes){
+    freeHeap = freeBytes;
+    if(minFreeHeap == 0 || freeBytes < minFreeHeap){
+        minFreeHeap = freeBytes;
+    }
+}
+
+void HealthMonitor::paintStack(size_t bytes){
+    //the stack grows down, so everything below our own frame is unused so far
+    volatile uint8_t here = 0;
+    volatile uint8_t* top = (volatile uint8_t*) ((uintptr_t) &here - STACK_MARGIN);
+    stackBottom = top - bytes;
+    stackPainted = bytes;
+    //a plain loop rather than memset, which would put its frame in the middle of what it paints
+    for(volatile uint8_t* p = stackBottom; p < top; p++){
+        *p = STACK_PAINT;
+    }
+}
+
+uint16_t HealthMonitor::stackUntouched() const {
+    if(stackBottom == NULL){
+        return 0;
+    }
+    size_t untouched = 0;
+    while(untouched < stackPainted && stackBottom[untouched] == STACK_PAINT){
+        untouched++;
+    }
+    return clamp16(untouched);
+}
+
+void HealthMonitor::setResetReason(int reason, uint32_t data){
+    if(reason == HEALTH_RESET_REASON_USER && (data & 0xFFFFFF00) == HEALTH_WATCHDOG_RESET_DATA){
+        resetReason = HEALTH_RESET_APP_WATCHDOG;
+        resetSection = data & 0xFF;
+    }
+    else{
+        resetReason = reason;
+        resetSection = HEALTH_NO_SECTION;
+    }
+}
+
+void HealthMonitor::report(HealthReport& out, uint32_t uptimeSeconds) const {
+    out.uptimeSeconds = uptimeSeconds;
+    out.loops = loops;
+    out.stalls = stalls;
+    out.longestStallMs = longestLoop / 1000;
+    out.longestStallSection = longestLoopSection;
+    memcpy(out.latency, latency, sizeof(latency));
+    for(int i = 0; i < HEALTH_SECTION_COUNT; i++){
+        out.sectionMaxMs[i] = clamp16(sectionMax[i] / 1000);
+    }
+    out.queueDepth = queueDepth;
+    out.queueHighWater = queueHighWater;
+    out.freeHeap = freeHeap;
+    out.minFreeHeap = minFreeHeap;
+    out.stackUntouched = stackUntouched();
+    out.resetReason = resetReason;
+    out.resetSection = resetSection;
+}
+
+void HealthMonitor::encode(const HealthReport& report, uint8_t* out){
+    put32(out, report.uptimeSeconds);
+    put32(out + 4, report.loops);
+    put32(out + 8, report.stalls);
+    put32(out + 12, report.longestStallMs);
+    out[16] = report.longestStallSection;
+    out += 17;
+    for(int i = 0; i < HEALTH_LATENCY_BUCKETS; i++, out += 4){
+        put32(out, report.latency[i]);
+    }
+    for(int i = 0; i < HEALTH_SECTION_COUNT; i++, out += 2){
+        put16(out, report.sectionMaxMs[i]);
+    }
+    put16(out, report.queueDepth);
+    put16(out + 2, report.queueHighWater);
+    put32(out + 4, report.freeHeap);
+    put32(out + 8, report.minFreeHeap);
+    put16(out + 12, report.stackUntouched);
+    out[14] = report.resetReason;
+    out[15] = report.resetSection;
+}
+
+bool HealthMonitor::decode(const uint8_t* data, size_t length, HealthReport& out){
+    if(length < HEALTH_REPORT_SIZE){
+        return false;
+    }
+    out.uptimeSeconds = get32(data);
+    out.loops = get32(data + 4);
+    out.stalls = get32(data + 8);
+    out.longestStallMs = get32(data + 12);
+    out.longestStallSection = data[16];
+    data += 17;
+    for(int i = 0; i < HEALTH_LATENCY_BUCKETS; i++, data += 4){
+        out.latency[i] = get32(data);
+    }
+    for(int i = 0; i < HEALTH_SECTION_COUNT; i++, data += 2){
+        out.sectionMaxMs[i] = get16(data);
+    }
+    out.queueDepth = get16(data);
+    out.queueHighWater = get16(data + 2);
+    out.freeHeap = get32(data + 4);
+    out.minFreeHeap = get32(data + 8);
+    out.stackUntouched = get16(data + 12);
+    out.resetReason = data[14];
+    out.resetSection = data[15];
+    return true;
+}
+
+uint32_t HealthMonitor::percentileMs(const HealthReport& report, double fraction){
+    uint64_t target = (uint64_t) (fraction * report.loops);
+    uint64_t seen = 0;
+    for(int i = 0; i < HEALTH_LATENCY_BUCKETS - 1; i++){
+        seen += report.latency[i];
+        if(seen > target){
+            return 1u << i;
+        }
+    }
+    return report.longestStallMs;
+}
+
+const char* HealthMonitor::resetName(uint8_t reason){
+    switch(reason){
+        case 0: return "none";
+        case HEALTH_RESET_APP_WATCHDOG: return "appWatchdog";
+        case 20: return "pin";
+        case 30: return "powerManagement";
+        case 40: return "powerDown";
+        case 50: return "brownout";
+        case 60: return "watchdog";
+        case 70: return "update";
+        case 80: return "updateError";
+        case 90: return "updateTimeout";
+        case 100: return "factoryReset";
+        case 110: return "safeMode";
+        case 120: return "dfuMode";
+        case 130: return "panic";
+        case HEALTH_RESET_REASON_USER: return "user";
+        default: return "unknown";
+    }
+}
+
+const char* HealthMonitor::sectionName(uint8_t section){
+    return section < HEALTH_SECTION_COUNT ? HEALTH_SECTION_NAMES[section] : "unknown";
+}
+
+int HealthMonitor::formatSummary(const HealthReport& report, char* out, size_t size){
+    char reset[48];
+    if(report.resetSection != HEALTH_NO_SECTION){
+        snprintf(reset, sizeof(reset), "%s in %s", resetName(report.resetReason), sectionName(report.resetSection));
+    }
+    else{
+        snprintf(reset, sizeof(reset), "%s", resetName(report.resetReason));
+    }
+    return snprintf(out, size, "Up %lu s, %lu loops, p50 < %lu ms, p99 < %lu ms, %lu stalls, longest %lu ms in %s, "
+        "queue %u (max %u), heap %lu free (min %lu), stack %u untouched, reset %s",
+        (unsigned long) report.uptimeSeconds, (unsigned long) report.loops,
+        (unsigned long) percentileMs(report, 0.5), (unsigned long) percentileMs(report, 0.99),
+        (unsigned long) report.stalls, (unsigned long) report.longestStallMs, sectionName(report.longestStallSection),
+        report.queueDepth, report.queueHighWater, (unsigned long) report.freeHeap, (unsigned long) report.minFreeHeap,
+        report.stackUntouched, reset);
+}
+
+int HealthMonitor::formatSections(const HealthReport& report, char* out, size_t size){
+    int written = snprintf(out, size, "  longest in section:");
+    for(int i = 0; i < HEALTH_SECTION_COUNT && written < (int) size; i++){
+        if(report.sectionMaxMs[i] > 0){
+            written += snprintf(out + written, size - written, " %s %u ms", HEALTH_SECTION_NAMES[i], report.sectionMaxMs[i]);
+        }
+    }
+    return written;
+}
@@ -0,0 +1,143 @@
+/*
+ * HealthMonitor.h
+ * Description: runtime health of a device. Times every loop() into a histogram, counts the
+ *              loops that stall, and notes which section of the loop (a sensor read, a BLE
+ *              scan...) held up the longest one. Also tracks the depth of the queue handing work
+ *              to loop(), the free heap and how much of the application thread's stack has ever
+ *              been used, and why the device last reset, including resets by our watchdog.
+ *              Does not depend on Particle.h, so the same report can be decoded anywhere.
+ *              Every firmware builds it from lib/SensorCommon, the clusterhead also aggregates.
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* What loop() is doing, for attributing stalls. Anything not in a section is HEALTH_SECTION_LOOP */
+enum HealthSection {
+    HEALTH_SECTION_LOOP,
+    HEALTH_SECTION_DHT,             //DHT bus transactions, including the library's delays
+    HEALTH_SECTION_RANGEFINDER,     //HC-SR04 trigger and echo, with interrupts off
+    HEALTH_SECTION_ADC,             //analogRead conversions
+    HEALTH_SECTION_RADIO,           //sending notifications and control writes
+    HEALTH_SECTION_STORAGE,         //EEPROM writes
+    HEALTH_SECTION_BLE_SCAN,
+    HEALTH_SECTION_BLE_CONNECT,
+    HEALTH_SECTION_INGEST,          //handling frames queued by BLE callbacks
+    HEALTH_SECTION_COUNT
+};
+
+extern const char* const HEALTH_SECTION_NAMES[HEALTH_SECTION_COUNT];
+
+/* Loop times in ms: bucket 0 is under 1 ms, bucket i is [2^(i-1), 2^i) ms, the last is 1024 ms up */
+const int HEALTH_LATENCY_BUCKETS = 12;
+
+//a loop busy for longer than this (ms) counts as a stall
+const uint32_t HEALTH_DEFAULT_STALL_MS = 100;
+
+/* Reset reasons are Device OS's RESET_REASON_ codes, except HEALTH_RESET_APP_WATCHDOG. The
+   watchdog resets through System.reset(HEALTH_WATCHDOG_RESET_DATA | section), which comes back
+   as RESET_REASON_USER with that data, see setResetReason() */
+const uint8_t HEALTH_RESET_APP_WATCHDOG = 1;
+const int HEALTH_RESET_REASON_USER = 140;
+const uint32_t HEALTH_WATCHDOG_RESET_DATA = 0x57440000;
+const uint8_t HEALTH_NO_SECTION = 0xFF;
+
+/* Bytes painted below setup()'s frame to find the stack high water mark. Device OS doesn't tell
+   the application where its thread's stack ends, so this stays well inside it: the Gen3
+   application thread has 6 KB, and even if setup() started 2 KB in, the paint plus the margin
+   paintStack() leaves would end under 3.5 KB. A report of 0 untouched then means loop() has gone
+   at least this deep, not that the stack overflowed */
+const size_t HEALTH_STACK_PAINT_SIZE = 1024;
+
+struct HealthReport {
+    uint32_t uptimeSeconds;
+    uint32_t loops;
+    uint32_t stalls;
+    uint32_t longestStallMs;
+    uint8_t longestStallSection;    //the section that took longest in the longest loop, as sent
+    uint32_t latency[HEALTH_LATENCY_BUCKETS];
+    uint16_t sectionMaxMs[HEALTH_SECTION_COUNT];
+    uint16_t queueDepth;
+    uint16_t queueHighWater;
+    uint32_t freeHeap;
+    uint32_t minFreeHeap;
+    uint16_t stackUntouched;        //painted stack bytes never used, 0 if not painted
+    uint8_t resetReason;
+    uint8_t resetSection;           //where loop() was when the watchdog reset us, or HEALTH_NO_SECTION, as sent
+};
+//[uptime u32][loops u32][stalls u32][longest stall ms u32][section u8][latency u32 per bucket]
+//[max ms u16 per section][queue depth u16][queue high water u16][free heap u32][min free heap u32]
+//[stack untouched u16][reset reason u8][reset section u8], little endian
+const size_t HEALTH_REPORT_SIZE = 17 + 4 * HEALTH_LATENCY_BUCKETS + 2 * HEALTH_SECTION_COUNT + 16;
+
+class HealthMonitor {
+public:
+    explicit HealthMonitor(uint32_t stallMs = HEALTH_DEFAULT_STALL_MS);
+
+    // Bracket the work of each loop(), before any delay() at the end
+    void beginLoop(uint32_t nowMicros);
+    void endLoop(uint32_t nowMicros);
+
+    // Bracket a section within the loop. Sections don't nest
+    void enter(HealthSection section, uint32_t nowMicros);
+    void leave(uint32_t nowMicros);
+
+    // The section loop() is in now. Safe to read from the watchdog's thread
+    uint8_t section() const { return currentSection; }
+
+    void setQueueDepth(uint16_t depth, uint16_t highWater);
+    void sampleHeap(uint32_t freeBytes);
+
+    // Fill bytes of the unused stack below the caller with a pattern, so stackUntouched() can
+    // tell how deep it has since been used. Call once, early in setup(). Nothing checks bytes
+    // against the real end of the stack, see HEALTH_STACK_PAINT_SIZE
+    void paintStack(size_t bytes);
+    uint16_t stackUntouched() const;
+
+    // Record why we last reset, from System.resetReason() and System.resetReasonData()
+    void setResetReason(int reason, uint32_t data);
+    uint8_t lastReset() const { return resetReason; }
+    uint8_t lastResetSection() const { return resetSection; }
+
+    void report(HealthReport& out, uint32_t uptimeSeconds) const;
+
+    static void encode(const HealthReport& report, uint8_t* out);
+    static bool decode(const uint8_t* data, size_t length, HealthReport& out);
+
+    // Upper bound in ms of the loop time the given fraction of loops came in under
+    static uint32_t percentileMs(const HealthReport& report, double fraction);
+    static const char* resetName(uint8_t reason);
+    // Name of a section, "unknown" for anything out of range, as a decoded report may hold
+    static const char* sectionName(uint8_t section);
+
+    // Human readable summary, and the longest stretch in each section, shared by firmware logs and host tools
+    static int formatSummary(const HealthReport& report, char* out, size_t size);
+    static int formatSections(const HealthReport& report, char* out, size_t size);
+
+private:
+    uint32_t stallMicros;
+    uint32_t loopStart;
+    uint32_t loops;
+    uint32_t stalls;
+    uint32_t longestLoop;
+    uint8_t longestLoopSection;
+    uint32_t latency[HEALTH_LATENCY_BUCKETS];
+    uint32_t sectionMax[HEALTH_SECTION_COUNT];
+    volatile uint8_t currentSection;
+    uint32_t sectionStart;
+    uint32_t sectionedMicros;   //spent in sections so far in this loop
+    //the section that took longest so far in this loop
+    uint8_t slowestSection;
+    uint32_t slowestSectionMicros;
+    uint16_t queueDepth;
+    uint16_t queueHighWater;
+    uint32_t freeHeap;
+    uint32_t minFreeHeap;
+    volatile uint8_t* stackBottom;
+    size_t stackPainted;
+    uint8_t resetReason;
+    uint8_t resetSection;
+};
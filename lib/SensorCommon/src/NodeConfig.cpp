@@ -0,0 +1,411 @@
+/*
+ * NodeConfig.cpp
+ * Description: implementation of the config blob's parser and writer
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#include "NodeConfig.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+const char* const CONFIG_SENSOR_NAMES[CONFIG_SENSOR_COUNT] = {
+    "temperature", "humidity", "light", "distance", "sound", "human"
+};
+
+static uint32_t readU32(const uint8_t* data){
+    return (uint32_t) data[0] | ((uint32_t) data[1] << 8) | ((uint32_t) data[2] << 16) | ((uint32_t) data[3] << 24);
+}
+
+static void writeU32(uint8_t* out, uint32_t value){
+    for(int i = 0; i < 4; i++){
+        out[i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+static float readF32(const uint8_t* data){
+    uint32_t bits = readU32(data);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static void writeF32(uint8_t* out, float value){
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    writeU32(out, bits);
+}
+
+bool configParse(const uint8_t* blob, size_t length, const NodeSettings& defaults, NodeSettings& out){
+    out = defaults;
+    if(length == 0){
+        return true;
+    }
+    if(length < CONFIG_HEADER_SIZE || length > CONFIG_MAX_SIZE){
+        return false;
+    }
+    out.version = blob[0] | (blob[1] << 8);
+    size_t i = CONFIG_HEADER_SIZE;
+    while(i < length){
+        if(length - i < 2 || length - i - 2 < blob[i + 1]){
+            return false;
+        }
+        uint8_t type = blob[i];
+        uint8_t fieldLength = blob[i + 1];
+        const uint8_t* value = blob + i + 2;
+        i += 2 + fieldLength;
+
+        //every per-sensor value starts with the sensor
+        SensorSettings* sensor = NULL;
+        if(type >= CONFIG_READ_DELAY && type <= CONFIG_CALIBRATION){
+            if(fieldLength < 1 || value[0] >= CONFIG_SENSOR_COUNT){
+                return false;
+            }
+            sensor = &out.sensors[value[0]];
+        }
+        switch(type){
+            case CONFIG_READ_DELAY: {
+                if(fieldLength != 9){
+                    return false;
+                }
+                uint32_t minDelay = readU32(value + 1);
+                uint32_t maxDelay = readU32(value + 5);
+                if(minDelay == 0 || minDelay > maxDelay){
+                    return false;
+                }
+                sensor->minDelay = minDelay;
+                sensor->maxDelay = maxDelay;
+                break;
+            }
+            case CONFIG_THRESHOLD: {
+                if(fieldLength != 5){
+                    return false;
+                }
+                int32_t threshold = (int32_t) readU32(value + 1);
+                if(threshold < 0){
+                    return false;
+                }
+                sensor->threshold = threshold;
+                break;
+            }
+            case CONFIG_PIN:
+                //which pins are usable is up to the node
+                if(fieldLength != 3){
+                    return false;
+                }
+                sensor->pin = value[1] | (value[2] << 8);
+                break;
+            case CONFIG_CALIBRATION: {
+                if(fieldLength != 9){
+                    return false;
+                }
+                float scale = readF32(value + 1);
+                float offset = readF32(value + 5);
+                if(!isfinite(scale) || !isfinite(offset)){
+                    return false;
+                }
+                sensor->scale = scale;
+                sensor->offset = offset;
+                break;
+            }
+            case CONFIG_BATCHING:
+                if(fieldLength != 2 || value[0] == 0 || value[0] > CONFIG_MAX_RECORDS_PER_NOTIFICATION
+                    || value[1] == 0 || value[1] > CONFIG_MAX_NOTIFICATIONS_PER_LOOP){
+                    return false;
+                }
+                out.recordsPerNotification = value[0];
+                out.notificationsPerLoop = value[1];
+                break;
+            case CONFIG_LOOP_DELAY: {
+                if(fieldLength != 2){
+                    return false;
+                }
+                uint16_t delay = value[0] | (value[1] << 8);
+                if(delay < CONFIG_MIN_LOOP_DELAY || delay > CONFIG_MAX_LOOP_DELAY){
+                    return false;
+                }
+                out.loopDelay = delay;
+                break;
+            }
+            case CONFIG_DIAGNOSTICS_INTERVAL: {
+                if(fieldLength != 4){
+                    return false;
+                }
+                uint32_t interval = readU32(value);
+                if(interval < CONFIG_MIN_DIAGNOSTICS_INTERVAL){
+                    return false;
+                }
+                out.diagnosticsInterval = interval;
+                break;
+            }
+            default:
+                //a node can't honour part of a config, so one it doesn't understand is refused whole
+                return false;
+        }
+    }
+    return true;
+}
+
+uint16_t configVersion(const uint8_t* blob, size_t length){
+    if(length < CONFIG_HEADER_SIZE){
+        return 0;
+    }
+    return blob[0] | (blob[1] << 8);
+}
+
+const char* configStatusName(uint8_t status){
+    switch(status){
+        case CONFIG_STATUS_TRIAL: return "trial";
+        case CONFIG_STATUS_CONFIRMED: return "confirmed";
+        case CONFIG_STATUS_ROLLED_BACK: return "rolled back";
+        case CONFIG_STATUS_INVALID: return "invalid";
+        case CONFIG_STATUS_STALE: return "stale";
+        case CONFIG_STATUS_UNSUPPORTED: return "unsupported";
+        default: return "unknown";
+    }
+}
+
+void configStatusEncode(const ConfigStatusReport& report, uint8_t* out){
+    out[0] = report.version & 0xFF;
+    out[1] = report.version >> 8;
+    out[2] = report.status;
+    out[3] = report.inUse & 0xFF;
+    out[4] = report.inUse >> 8;
+}
+
+bool configStatusDecode(const uint8_t* data, size_t length, ConfigStatusReport& out){
+    if(length < CONFIG_STATUS_SIZE){
+        return false;
+    }
+    out.version = data[0] | (data[1] << 8);
+    out.status = data[2];
+    out.inUse = data[3] | (data[4] << 8);
+    return true;
+}
+
+void ConfigWriter::begin(uint8_t* out, size_t capacity, uint16_t version){
+    this->out = out;
+    this->capacity = capacity < CONFIG_MAX_SIZE ? capacity : CONFIG_MAX_SIZE;
+    used = 0;
+    overflowed = this->capacity < CONFIG_HEADER_SIZE;
+    if(!overflowed){
+        out[0] = version & 0xFF;
+        out[1] = version >> 8;
+        used = CONFIG_HEADER_SIZE;
+    }
+}
+
+uint8_t* ConfigWriter::field(uint8_t type, uint8_t length){
+    if(overflowed || capacity - used < 2 + (size_t) length){
+        overflowed = true;
+        return NULL;
+    }
+    uint8_t* value = out + used + 2;
+    out[used] = type;
+    out[used + 1] = length;
+    used += 2 + length;
+    return value;
+}
+
+void ConfigWriter::readDelay(uint8_t sensor, uint32_t minDelay, uint32_t maxDelay){
+    uint8_t* value = field(CONFIG_READ_DELAY, 9);
+    if(value){
+        value[0] = sensor;
+        writeU32(value + 1, minDelay);
+        writeU32(value + 5, maxDelay);
+    }
+}
+
+void ConfigWriter::threshold(uint8_t sensor, int32_t threshold){
+    uint8_t* value = field(CONFIG_THRESHOLD, 5);
+    if(value){
+        value[0] = sensor;
+        writeU32(value + 1, (uint32_t) threshold);
+    }
+}
+
+void ConfigWriter::pin(uint8_t sensor, uint16_t pin){
+    uint8_t* value = field(CONFIG_PIN, 3);
+    if(value){
+        value[0] = sensor;
+        value[1] = pin & 0xFF;
+        value[2] = pin >> 8;
+    }
+}
+
+void ConfigWriter::calibration(uint8_t sensor, float scale, float offset){
+    uint8_t* value = field(CONFIG_CALIBRATION, 9);
+    if(value){
+        value[0] = sensor;
+        writeF32(value + 1, scale);
+        writeF32(value + 5, offset);
+    }
+}
+
+void ConfigWriter::batching(uint8_t recordsPerNotification, uint8_t notificationsPerLoop){
+    uint8_t* value = field(CONFIG_BATCHING, 2);
+    if(value){
+        value[0] = recordsPerNotification;
+        value[1] = notificationsPerLoop;
+    }
+}
+
+void ConfigWriter::loopDelay(uint16_t delay){
+    uint8_t* value = field(CONFIG_LOOP_DELAY, 2);
+    if(value){
+        value[0] = delay & 0xFF;
+        value[1] = delay >> 8;
+    }
+}
+
+void ConfigWriter::diagnosticsInterval(uint32_t interval){
+    uint8_t* value = field(CONFIG_DIAGNOSTICS_INTERVAL, 4);
+    if(value){
+        writeU32(value, interval);
+    }
+}
+
+//which of a sensor's values the text set
+const uint8_t TEXT_MIN = 0x01;
+const uint8_t TEXT_MAX = 0x02;
+const uint8_t TEXT_THRESHOLD = 0x04;
+const uint8_t TEXT_PIN = 0x08;
+const uint8_t TEXT_SCALE = 0x10;
+const uint8_t TEXT_OFFSET = 0x20;
+
+bool ConfigWriter::addText(const char* text){
+    //collect everything first, so e.g. light.min and light.max end up in one field
+    NodeSettings settings;
+    memset(&settings, 0, sizeof(settings));
+    uint8_t sensorFields[CONFIG_SENSOR_COUNT] = {0};
+    bool recordsSet = false;
+    bool notificationsSet = false;
+    bool loopDelaySet = false;
+    bool diagnosticsSet = false;
+
+    const char* p = text;
+    while(*p){
+        const char* end = strchr(p, ',');
+        size_t pairLength = end ? (size_t) (end - p) : strlen(p);
+        char pair[40];
+        if(pairLength == 0 || pairLength >= sizeof(pair)){
+            return false;
+        }
+        memcpy(pair, p, pairLength);
+        pair[pairLength] = '\0';
+        p += pairLength + (end ? 1 : 0);
+
+        char* equals = strchr(pair, '=');
+        if(!equals || equals[1] == '\0'){
+            return false;
+        }
+        *equals = '\0';
+        const char* key = pair;
+        const char* valueText = equals + 1;
+        char* valueEnd;
+        double number = strtod(valueText, &valueEnd);
+        if(*valueEnd != '\0'){
+            return false;
+        }
+
+        const char* dot = strchr(key, '.');
+        if(dot){
+            int sensor = -1;
+            for(int s = 0; s < CONFIG_SENSOR_COUNT; s++){
+                if(strlen(CONFIG_SENSOR_NAMES[s]) == (size_t) (dot - key)
+                    && strncmp(key, CONFIG_SENSOR_NAMES[s], dot - key) == 0){
+                    sensor = s;
+                }
+            }
+            if(sensor < 0){
+                return false;
+            }
+            const char* field = dot + 1;
+            SensorSettings& s = settings.sensors[sensor];
+            if(strcmp(field, "scale") == 0){
+                s.scale = (float) number;
+                sensorFields[sensor] |= TEXT_SCALE;
+                continue;
+            }
+            if(strcmp(field, "offset") == 0){
+                s.offset = (float) number;
+                sensorFields[sensor] |= TEXT_OFFSET;
+                continue;
+            }
+            //the rest are whole and not negative
+            if(number < 0 || number != floor(number) || number > 0xFFFFFFFFu){
+                return false;
+            }
+            if(strcmp(field, "min") == 0){
+                s.minDelay = (uint32_t) number;
+                sensorFields[sensor] |= TEXT_MIN;
+            } else if(strcmp(field, "max") == 0){
+                s.maxDelay = (uint32_t) number;
+                sensorFields[sensor] |= TEXT_MAX;
+            } else if(strcmp(field, "threshold") == 0 && number <= 0x7FFFFFFF){
+                s.threshold = (int32_t) number;
+                sensorFields[sensor] |= TEXT_THRESHOLD;
+            } else if(strcmp(field, "pin") == 0 && number <= 0xFFFF){
+                s.pin = (uint16_t) number;
+                sensorFields[sensor] |= TEXT_PIN;
+            } else {
+                return false;
+            }
+            continue;
+        }
+
+        if(number < 0 || number != floor(number) || number > 0xFFFFFFFFu){
+            return false;
+        }
+        if(strcmp(key, "records") == 0 && number <= 0xFF){
+            settings.recordsPerNotification = (uint8_t) number;
+            recordsSet = true;
+        } else if(strcmp(key, "notifications") == 0 && number <= 0xFF){
+            settings.notificationsPerLoop = (uint8_t) number;
+            notificationsSet = true;
+        } else if(strcmp(key, "loop") == 0 && number <= 0xFFFF){
+            settings.loopDelay = (uint16_t) number;
+            loopDelaySet = true;
+        } else if(strcmp(key, "diagnostics") == 0){
+            settings.diagnosticsInterval = (uint32_t) number;
+            diagnosticsSet = true;
+        } else {
+            return false;
+        }
+    }
+
+    for(uint8_t s = 0; s < CONFIG_SENSOR_COUNT; s++){
+        const SensorSettings& sensor = settings.sensors[s];
+        uint8_t delayFields = sensorFields[s] & (TEXT_MIN | TEXT_MAX);
+        uint8_t calibrationFields = sensorFields[s] & (TEXT_SCALE | TEXT_OFFSET);
+        if((delayFields && delayFields != (TEXT_MIN | TEXT_MAX))
+            || (calibrationFields && calibrationFields != (TEXT_SCALE | TEXT_OFFSET))){
+            return false;
+        }
+        if(delayFields){
+            readDelay(s, sensor.minDelay, sensor.maxDelay);
+        }
+        if(sensorFields[s] & TEXT_THRESHOLD){
+            threshold(s, sensor.threshold);
+        }
+        if(sensorFields[s] & TEXT_PIN){
+            pin(s, sensor.pin);
+        }
+        if(calibrationFields){
+            calibration(s, sensor.scale, sensor.offset);
+        }
+    }
+    if(recordsSet != notificationsSet){
+        return false;
+    }
+    if(recordsSet){
+        batching(settings.recordsPerNotification, settings.notificationsPerLoop);
+    }
+    if(loopDelaySet){
+        loopDelay(settings.loopDelay);
+    }
+    if(diagnosticsSet){
+        diagnosticsInterval(settings.diagnosticsInterval);
+    }
+    return ok();
+}
@@ -0,0 +1,132 @@
+/*
+ * NodeConfig.h
+ * Description: the runtime configuration the clusterhead pushes to nodes over the control
+ *              characteristic, as a versioned TLV blob: [version u16][type u8][length u8][value]...
+ *              Sensors are named by kind rather than by a node's sensor index, so the same blob
+ *              means the same thing to every node, and a node skips kinds it doesn't have.
+ *              Anything a blob leaves out is the node's compiled-in default.
+ *              Does not depend on Particle.h. Every firmware builds it from
+ *              lib/SensorCommon, the clusterhead builds blobs and the nodes parse them.
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum ConfigSensor {
+    CONFIG_SENSOR_TEMPERATURE,
+    CONFIG_SENSOR_HUMIDITY,
+    CONFIG_SENSOR_LIGHT,
+    CONFIG_SENSOR_DISTANCE,
+    CONFIG_SENSOR_SOUND,
+    CONFIG_SENSOR_HUMAN_DETECTOR,
+    CONFIG_SENSOR_COUNT
+};
+
+extern const char* const CONFIG_SENSOR_NAMES[CONFIG_SENSOR_COUNT];
+
+/* TLV types, values little endian */
+const uint8_t CONFIG_READ_DELAY = 0x01;             //[sensor u8][min ms u32][max ms u32]
+const uint8_t CONFIG_THRESHOLD = 0x02;              //[sensor u8][change threshold i32]
+const uint8_t CONFIG_PIN = 0x03;                    //[sensor u8][pin u16]
+const uint8_t CONFIG_CALIBRATION = 0x04;            //[sensor u8][scale f32][offset f32], reading = raw * scale + offset
+const uint8_t CONFIG_BATCHING = 0x05;               //[records per notification u8][notifications per loop u8]
+const uint8_t CONFIG_LOOP_DELAY = 0x06;             //[ms u16]
+const uint8_t CONFIG_DIAGNOSTICS_INTERVAL = 0x07;   //[ms u32]
+
+//a blob fits one sealed control write, after its opcode
+const size_t CONFIG_MAX_SIZE = 231;
+const size_t CONFIG_HEADER_SIZE = 2;
+
+/* Limits every node checks a blob against */
+const uint8_t CONFIG_MAX_RECORDS_PER_NOTIFICATION = 16;    //the nodes' notification buffers
+const uint8_t CONFIG_MAX_NOTIFICATIONS_PER_LOOP = 32;
+const uint16_t CONFIG_MIN_LOOP_DELAY = 10;
+const uint16_t CONFIG_MAX_LOOP_DELAY = 10000;
+const uint32_t CONFIG_MIN_DIAGNOSTICS_INTERVAL = 5000;
+
+/* What a node reports after a config operation, on its diagnostics characteristic as
+   [DIAGNOSTICS_CONFIG][version u16][status u8][version in use u16], version being
+   the one the status is about */
+const size_t CONFIG_STATUS_SIZE = 5;
+const uint8_t CONFIG_STATUS_TRIAL = 0;          //applied, rolls back unless confirmed in time
+const uint8_t CONFIG_STATUS_CONFIRMED = 1;
+const uint8_t CONFIG_STATUS_ROLLED_BACK = 2;    //won't be taken again, push a newer version
+const uint8_t CONFIG_STATUS_INVALID = 3;        //malformed, or a value out of range
+const uint8_t CONFIG_STATUS_STALE = 4;          //older than the one in use
+const uint8_t CONFIG_STATUS_UNSUPPORTED = 5;    //valid, but this node can't apply it at runtime
+
+struct ConfigStatusReport {
+    uint16_t version;
+    uint8_t status;
+    uint16_t inUse;
+};
+
+struct SensorSettings {
+    uint32_t minDelay;
+    uint32_t maxDelay;
+    int32_t threshold;
+    uint16_t pin;
+    float scale;
+    float offset;
+};
+
+struct NodeSettings {
+    uint16_t version;       //0 for the compiled-in defaults
+    SensorSettings sensors[CONFIG_SENSOR_COUNT];
+    uint8_t recordsPerNotification;
+    uint8_t notificationsPerLoop;
+    uint16_t loopDelay;
+    uint32_t diagnosticsInterval;
+};
+
+// Settings from defaults with blob laid over them. False if the blob is malformed or any
+// value is out of range, in which case out is undefined. An empty blob gives the defaults
+bool configParse(const uint8_t* blob, size_t length, const NodeSettings& defaults, NodeSettings& out);
+
+// The version of a blob, 0 if it is empty or too short to have one
+uint16_t configVersion(const uint8_t* blob, size_t length);
+
+const char* configStatusName(uint8_t status);
+
+// A status report, without the diagnostics type byte, into CONFIG_STATUS_SIZE bytes of out
+void configStatusEncode(const ConfigStatusReport& report, uint8_t* out);
+// False if it is too short. Anything past CONFIG_STATUS_SIZE is ignored
+bool configStatusDecode(const uint8_t* data, size_t length, ConfigStatusReport& out);
+
+/* Builds a blob */
+class ConfigWriter {
+public:
+    ConfigWriter() : out(NULL), capacity(0), used(0), overflowed(false) {}
+
+    void begin(uint8_t* out, size_t capacity, uint16_t version);
+
+    void readDelay(uint8_t sensor, uint32_t minDelay, uint32_t maxDelay);
+    void threshold(uint8_t sensor, int32_t threshold);
+    void pin(uint8_t sensor, uint16_t pin);
+    void calibration(uint8_t sensor, float scale, float offset);
+    void batching(uint8_t recordsPerNotification, uint8_t notificationsPerLoop);
+    void loopDelay(uint16_t delay);
+    void diagnosticsInterval(uint32_t interval);
+
+    // Add settings written as comma separated key=value pairs, e.g.
+    // "light.min=2000,light.max=30000,records=8,loop=200". Keys are <sensor>.min, .max,
+    // .threshold, .pin, .scale and .offset, then records, notifications, loop and diagnostics.
+    // A sensor's min and max, its scale and offset, and records and notifications each go in
+    // one field, so have to be given together. False on an unknown key, a bad value or a
+    // missing half of a pair
+    bool addText(const char* text);
+
+    size_t length() const { return used; }
+    bool ok() const { return !overflowed; }
+
+private:
+    uint8_t* field(uint8_t type, uint8_t length);
+
+    uint8_t* out;
+    size_t capacity;
+    size_t used;
+    bool overflowed;
+};
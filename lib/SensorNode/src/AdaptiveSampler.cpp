@@ -0,0 +1,69 @@
+/*
+ * AdaptiveSampler.cpp
+ * Description: implementation of the activity driven sampling rate controller
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#include "AdaptiveSampler.h"
+
+AdaptiveSampler::AdaptiveSampler(uint32_t minInterval, uint32_t maxInterval, int32_t threshold)
+    : minInterval(minInterval), maxInterval(maxInterval), threshold(threshold),
+      currentInterval(minInterval), lastSampleTime(0), lastValue(0), sampleCount(0), skipCount(0), retrying(false) {
+}
+
+bool AdaptiveSampler::due(uint32_t now) const {
+    //always take the first reading straight away, unless it has just failed
+    if(sampleCount == 0 && skipCount == 0){
+        return true;
+    }
+    return now - lastSampleTime >= (retrying ? minInterval : currentInterval);
+}
+
+void AdaptiveSampler::update(uint32_t now, int32_t value){
+    int32_t change = value - lastValue;
+    if(change < 0){
+        change = -change;
+    }
+
+    if(sampleCount > 0 && change >= threshold){
+        //signal is moving, sample as fast as we're allowed
+        currentInterval = minInterval;
+    }
+    else if(sampleCount > 0){
+        //signal is flat, back off exponentially
+        currentInterval = currentInterval >= maxInterval / 2 ? maxInterval : currentInterval * 2;
+    }
+
+    lastSampleTime = now;
+    lastValue = value;
+    sampleCount++;
+    retrying = false;
+}
+
+void AdaptiveSampler::skip(uint32_t now){
+    //the last good value and the interval are kept, so a failed read neither looks like
+    //a change nor undoes the back off
+    retrying = true;
+    lastSampleTime = now;
+    skipCount++;
+}
+
+void AdaptiveSampler::setBounds(uint32_t minInterval, uint32_t maxInterval){
+    if(minInterval > 0){
+        this->minInterval = minInterval;
+    }
+    if(maxInterval > 0){
+        this->maxInterval = maxInterval;
+    }
+    if(this->maxInterval < this->minInterval){
+        this->maxInterval = this->minInterval;
+    }
+
+    //apply straight away rather than waiting out the old interval
+    if(currentInterval < this->minInterval){
+        currentInterval = this->minInterval;
+    }
+    else if(currentInterval > this->maxInterval){
+        currentInterval = this->maxInterval;
+    }
+}
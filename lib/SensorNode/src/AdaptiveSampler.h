@@ -0,0 +1,50 @@
+/*
+ * AdaptiveSampler.h
+ * Description: decides when a sensor is next due to be read. Snaps to the minimum interval
+ *              whenever a reading moves by more than a threshold, and doubles the interval
+ *              (up to the maximum) every time the signal stays flat.
+ *              Does not depend on Particle.h, so tools/samplerbench can replay traces through it.
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#pragma once
+
+#include <stdint.h>
+
+class AdaptiveSampler {
+public:
+    // minInterval/maxInterval in millis, threshold in the sensor's own units
+    AdaptiveSampler(uint32_t minInterval, uint32_t maxInterval, int32_t threshold);
+
+    // True if a reading should be taken at time now (millis)
+    bool due(uint32_t now) const;
+
+    // Record a reading taken at time now and work out the next interval
+    void update(uint32_t now, int32_t value);
+
+    // A read attempted at time now failed. Try again after the minimum interval,
+    // without it counting as a reading or changing the interval after that
+    void skip(uint32_t now);
+
+    // Change the interval bounds, e.g. from a clusterhead rate hint.
+    // Zero leaves that bound unchanged
+    void setBounds(uint32_t minInterval, uint32_t maxInterval);
+
+    // Change how far a reading has to move to count as a change, from the next reading
+    void setThreshold(int32_t threshold) { this->threshold = threshold; }
+
+    uint32_t interval() const { return currentInterval; }
+    uint32_t samples() const { return sampleCount; }
+    uint32_t skips() const { return skipCount; }
+
+private:
+    uint32_t minInterval;
+    uint32_t maxInterval;
+    int32_t threshold;
+    uint32_t currentInterval;
+    uint32_t lastSampleTime;
+    int32_t lastValue;
+    uint32_t sampleCount;
+    uint32_t skipCount;
+    bool retrying;      //the last read failed, the next is due after minInterval
+};
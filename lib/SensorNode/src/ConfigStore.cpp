@@ -0,0 +1,110 @@
+/*
+ * ConfigStore.cpp
+ * Description: implementation of the node's two slot config store
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#include "ConfigStore.h"
+
+const uint16_t CONFIG_STORE_MAGIC = 0xC0F1;
+const int CONFIG_SLOTS_OFFSET = 6;
+//header flags. A store from before there were flags only ever holds CONFIG_FLAG_TRIAL
+const uint8_t CONFIG_FLAG_TRIAL = 0x01;
+const uint8_t CONFIG_FLAG_PREVIOUS = 0x02;
+
+ConfigStore::ConfigStore() : activeSlot(0), onTrial(false), hasPrevious(false), rolledBackVersion(0), blobLength(0) {
+}
+
+bool ConfigStore::begin(){
+    uint16_t magic;
+    EEPROM.get(CONFIG_STORE_EEPROM_START, magic);
+    if(magic != CONFIG_STORE_MAGIC){
+        //nothing stored yet, both slots are the defaults
+        EEPROM.write(slotAddress(0), 0);
+        EEPROM.write(slotAddress(1), 0);
+        activeSlot = 0;
+        onTrial = false;
+        hasPrevious = false;
+        rolledBackVersion = 0;
+        saveHeader();
+        EEPROM.put(CONFIG_STORE_EEPROM_START, CONFIG_STORE_MAGIC);
+        blobLength = 0;
+        return false;
+    }
+    activeSlot = EEPROM.read(CONFIG_STORE_EEPROM_START + 2) & 1;
+    uint8_t flags = EEPROM.read(CONFIG_STORE_EEPROM_START + 3);
+    onTrial = (flags & CONFIG_FLAG_TRIAL) != 0;
+    hasPrevious = (flags & CONFIG_FLAG_PREVIOUS) != 0;
+    EEPROM.get(CONFIG_STORE_EEPROM_START + 4, rolledBackVersion);
+    load();
+    if(onTrial){
+        rollback();
+        return true;
+    }
+    return false;
+}
+
+void ConfigStore::apply(const uint8_t* config, size_t len){
+    if(len > CONFIG_MAX_SIZE){
+        return;
+    }
+    //over the confirmed config's other slot, which on trial means replacing the trial
+    uint8_t slot = confirmedSlot() ^ 1;
+    int address = slotAddress(slot);
+    for(size_t i = 0; i < len; i++){
+        EEPROM.write(address + 1 + i, config[i]);
+    }
+    //the length goes last, so a slot is never read back half written
+    EEPROM.write(address, len);
+    activeSlot = slot;
+    onTrial = true;
+    hasPrevious = false;
+    saveHeader();
+    memcpy(blob, config, len);
+    blobLength = len;
+}
+
+bool ConfigStore::confirm(uint16_t version){
+    if(!onTrial || version != this->version()){
+        return false;
+    }
+    onTrial = false;
+    hasPrevious = true;
+    saveHeader();
+    return true;
+}
+
+bool ConfigStore::rollback(){
+    if(!onTrial && !hasPrevious){
+        return false;
+    }
+    rolledBackVersion = version();
+    activeSlot ^= 1;
+    onTrial = false;
+    //the slot left holds the config rolled back from, never one to go back to
+    hasPrevious = false;
+    saveHeader();
+    load();
+    return true;
+}
+
+int ConfigStore::slotAddress(uint8_t slot) const {
+    return CONFIG_STORE_EEPROM_START + CONFIG_SLOTS_OFFSET + slot * (1 + CONFIG_MAX_SIZE);
+}
+
+void ConfigStore::load(){
+    int address = slotAddress(activeSlot);
+    blobLength = EEPROM.read(address);
+    if(blobLength > CONFIG_MAX_SIZE){
+        blobLength = 0;
+    }
+    for(size_t i = 0; i < blobLength; i++){
+        blob[i] = EEPROM.read(address + 1 + i);
+    }
+}
+
+void ConfigStore::saveHeader(){
+    EEPROM.write(CONFIG_STORE_EEPROM_START + 2, activeSlot);
+    EEPROM.write(CONFIG_STORE_EEPROM_START + 3, (onTrial ? CONFIG_FLAG_TRIAL : 0) | (hasPrevious ? CONFIG_FLAG_PREVIOUS : 0));
+    EEPROM.put(CONFIG_STORE_EEPROM_START + 4, rolledBackVersion);
+}
@@ -0,0 +1,64 @@
+/*
+ * ConfigStore.h
+ * Description: the node's runtime configuration pushed by the clusterhead, see NodeConfig.h,
+ *              kept in EEPROM in two slots. A new config goes into the slot not holding the
+ *              last confirmed one and is applied on trial, so rolling back always returns to a
+ *              config that worked, however many were pushed over the trial. It is only kept
+ *              for good once the clusterhead confirms it, which it does when it hears back from
+ *              the node over the new config, so a config that cuts the node off undoes itself.
+ *              A reset during a trial rolls back too, in case the config is what caused it.
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#pragma once
+
+#include "Particle.h"
+#include "NodeConfig.h"
+
+//EEPROM from here holds [magic u16][active slot u8][flags u8][rolled back version u16], then
+//two slots of [length u8][blob], a length of 0 meaning the compiled-in defaults. Follows LinkSecurity's
+const int CONFIG_STORE_EEPROM_START = 64;
+const int CONFIG_STORE_EEPROM_SIZE = 6 + 2 * (1 + CONFIG_MAX_SIZE);
+
+class ConfigStore {
+public:
+    ConfigStore();
+
+    // Load the config in use. Returns true if a trial was in progress at the reset and has
+    // been rolled back. Call from setup()
+    bool begin();
+
+    // The config in use, length 0 for the defaults
+    const uint8_t* active() const { return blob; }
+    size_t length() const { return blobLength; }
+    uint16_t version() const { return configVersion(blob, blobLength); }
+    bool trial() const { return onTrial; }
+
+    // The version last rolled back from, which the node won't take again, so a config the
+    // clusterhead keeps resending can't cut the node off over and over. 0 for none
+    uint16_t rolledBack() const { return rolledBackVersion; }
+
+    // Store a config and make it the one in use, on trial. The caller checks it first
+    void apply(const uint8_t* config, size_t len);
+
+    // Keep the config on trial for good. False if version isn't the one on trial
+    bool confirm(uint16_t version);
+
+    // Go back to the last confirmed config if one is on trial, otherwise to the one confirmed
+    // before it. False if there is none to go back to, see rolledBack() for the version left
+    bool rollback();
+
+private:
+    int slotAddress(uint8_t slot) const;
+    void load();
+    void saveHeader();
+
+    uint8_t confirmedSlot() const { return onTrial ? activeSlot ^ 1 : activeSlot; }
+
+    uint8_t activeSlot;
+    bool onTrial;
+    bool hasPrevious;   //the slot not in use holds the config confirmed before the active one
+    uint16_t rolledBackVersion;
+    uint8_t blob[CONFIG_MAX_SIZE];
+    size_t blobLength;
+};
@@ -0,0 +1,209 @@
+/*
+ * FrameBacklog.cpp
+ * Description: implementation of the RAM and EEPROM backed reading backlog
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#include "FrameBacklog.h"
+
+/* EEPROM ring header, at BACKLOG_EEPROM_START: [magic u16][head u16][count u16][lap u8]
+   followed by the slots, each [lap u8][record]. A slot's lap is the ring's lap when it was
+   written, and the ring's lap goes up each time writing wraps round to slot 0, so the slots
+   written since the header was saved are the run after its tail carrying the expected lap */
+const uint16_t BACKLOG_EEPROM_MAGIC = 0xB10D;
+const int BACKLOG_EEPROM_HEADER = 7;
+const size_t BACKLOG_SLOT_SIZE = BACKLOG_RECORD_SIZE + 1;
+
+FrameBacklog::FrameBacklog()
+    : ramHead(0), ramCount(0), eepromCapacity(0), eepromHead(0), eepromCount(0), eepromLap(0),
+      unsavedChanges(0), droppedCount(0) {
+}
+
+void FrameBacklog::begin(){
+    eepromCapacity = (EEPROM.length() - BACKLOG_EEPROM_START - BACKLOG_EEPROM_HEADER) / BACKLOG_SLOT_SIZE;
+    if(eepromCapacity == 0){
+        return;
+    }
+
+    uint16_t magic;
+    EEPROM.get(BACKLOG_EEPROM_START, magic);
+    EEPROM.get(BACKLOG_EEPROM_START + 2, eepromHead);
+    EEPROM.get(BACKLOG_EEPROM_START + 4, eepromCount);
+    eepromLap = EEPROM.read(BACKLOG_EEPROM_START + 6);
+    if(magic != BACKLOG_EEPROM_MAGIC || eepromHead >= eepromCapacity || eepromCount > eepromCapacity){
+        //blank or from an older layout, start empty. Mark every slot as from the lap before,
+        //so whatever was there can't pass for a record
+        eepromHead = 0;
+        eepromCount = 0;
+        eepromLap = 1;
+        for(size_t slot = 0; slot < eepromCapacity; slot++){
+            EEPROM.write(eepromAddress(slot), 0);
+        }
+        writeEepromHeader();
+        return;
+    }
+
+    //pick up records spilled after the header was last saved. Fewer than a ring's worth can
+    //have been, and if the ring filled meanwhile the oldest were dropped to make room
+    size_t recovered = 0;
+    size_t tail = (eepromHead + eepromCount) % eepromCapacity;
+    while(recovered < eepromCapacity && EEPROM.read(eepromAddress(tail)) == eepromLap){
+        if(eepromCount == eepromCapacity){
+            eepromHead = (eepromHead + 1) % eepromCapacity;
+        }
+        else{
+            eepromCount++;
+        }
+        recovered++;
+        tail = (tail + 1) % eepromCapacity;
+        if(tail == 0){
+            eepromLap++;
+        }
+    }
+    if(recovered > 0){
+        writeEepromHeader();
+    }
+    if(eepromCount > 0){
+        Log.info("Recovered %u backlogged readings from EEPROM", eepromCount);
+    }
+}
+
+void FrameBacklog::push(uint8_t sensor, uint16_t value, uint32_t timestamp){
+    if(ramCount == BACKLOG_RAM_FRAMES){
+        //RAM is full, move its oldest reading out to EEPROM to make room
+        if(eepromCapacity == 0){
+            droppedCount++;
+        }
+        else{
+            if(eepromCount == eepromCapacity){
+                //EEPROM is full too, give up the very oldest reading
+                eepromHead = (eepromHead + 1) % eepromCapacity;
+                eepromCount--;
+                droppedCount++;
+            }
+            uint8_t slot[BACKLOG_SLOT_SIZE];
+            slot[0] = eepromLap;
+            encode(ram[ramHead], slot + 1);
+            size_t tail = (eepromHead + eepromCount) % eepromCapacity;
+            int address = eepromAddress(tail);
+            for(size_t i = 0; i < BACKLOG_SLOT_SIZE; i++){
+                EEPROM.write(address + i, slot[i]);
+            }
+            eepromCount++;
+            if(tail == eepromCapacity - 1){
+                eepromLap++;
+            }
+            headerChanged(1);
+        }
+        ramHead = (ramHead + 1) % BACKLOG_RAM_FRAMES;
+        ramCount--;
+    }
+
+    BacklogFrame& frame = ram[(ramHead + ramCount) % BACKLOG_RAM_FRAMES];
+    frame.sensor = sensor;
+    frame.value = value;
+    frame.timestamp = timestamp;
+    ramCount++;
+}
+
+void FrameBacklog::peek(size_t index, BacklogFrame& out){
+    //EEPROM always holds the oldest readings, RAM the newer ones
+    if(index < eepromCount){
+        uint8_t record[BACKLOG_RECORD_SIZE];
+        int address = eepromAddress((eepromHead + index) % eepromCapacity) + 1;
+        for(size_t i = 0; i < BACKLOG_RECORD_SIZE; i++){
+            record[i] = EEPROM.read(address + i);
+        }
+        out.sensor = record[0];
+        out.value = record[1] | (record[2] << 8);
+        out.timestamp = (uint32_t) record[3] | ((uint32_t) record[4] << 8)
+            | ((uint32_t) record[5] << 16) | ((uint32_t) record[6] << 24);
+    }
+    else{
+        out = ram[(ramHead + index - eepromCount) % BACKLOG_RAM_FRAMES];
+    }
+}
+
+void FrameBacklog::pop(size_t count){
+    if(count > size()){
+        count = size();
+    }
+    size_t fromEeprom = count < eepromCount ? count : eepromCount;
+    if(fromEeprom > 0){
+        eepromHead = (eepromHead + fromEeprom) % eepromCapacity;
+        eepromCount -= fromEeprom;
+        if(eepromCount == 0){
+            //caught up, don't send any of it again after a reset
+            writeEepromHeader();
+        }
+        else{
+            headerChanged(fromEeprom);
+        }
+    }
+    size_t fromRam = count - fromEeprom;
+    ramHead = (ramHead + fromRam) % BACKLOG_RAM_FRAMES;
+    ramCount -= fromRam;
+}
+
+void FrameBacklog::peekNewest(size_t index, BacklogFrame& out){
+    peek(size() - 1 - index, out);
+}
+
+void FrameBacklog::popNewest(size_t count){
+    if(count > size()){
+        count = size();
+    }
+    //the newest readings are in RAM, unless RAM has been emptied from the front
+    size_t fromRam = count < ramCount ? count : ramCount;
+    ramCount -= fromRam;
+    size_t fromEeprom = count - fromRam;
+    if(fromEeprom > 0){
+        //step the tail back over them, spoiling each one's lap so begin() can't scan them back in
+        size_t tail = (eepromHead + eepromCount) % eepromCapacity;
+        for(size_t i = 0; i < fromEeprom; i++){
+            if(tail == 0){
+                eepromLap--;
+                tail = eepromCapacity;
+            }
+            tail--;
+            EEPROM.write(eepromAddress(tail), (uint8_t) (eepromLap - 1));
+        }
+        eepromCount -= fromEeprom;
+        writeEepromHeader();
+    }
+}
+
+void FrameBacklog::flush(){
+    if(unsavedChanges > 0){
+        writeEepromHeader();
+    }
+}
+
+void FrameBacklog::encode(const BacklogFrame& frame, uint8_t* out){
+    out[0] = frame.sensor;
+    out[1] = frame.value & 0xFF;
+    out[2] = frame.value >> 8;
+    out[3] = frame.timestamp & 0xFF;
+    out[4] = (frame.timestamp >> 8) & 0xFF;
+    out[5] = (frame.timestamp >> 16) & 0xFF;
+    out[6] = (frame.timestamp >> 24) & 0xFF;
+}
+
+int FrameBacklog::eepromAddress(size_t slot) const {
+    return BACKLOG_EEPROM_START + BACKLOG_EEPROM_HEADER + slot * BACKLOG_SLOT_SIZE;
+}
+
+void FrameBacklog::headerChanged(size_t records){
+    unsavedChanges += records;
+    if(unsavedChanges >= BACKLOG_HEADER_INTERVAL){
+        writeEepromHeader();
+    }
+}
+
+void FrameBacklog::writeEepromHeader(){
+    EEPROM.put(BACKLOG_EEPROM_START, BACKLOG_EEPROM_MAGIC);
+    EEPROM.put(BACKLOG_EEPROM_START + 2, eepromHead);
+    EEPROM.put(BACKLOG_EEPROM_START + 4, eepromCount);
+    EEPROM.write(BACKLOG_EEPROM_START + 6, eepromLap);
+    unsavedChanges = 0;
+}
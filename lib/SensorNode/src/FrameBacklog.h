@@ -0,0 +1,78 @@
+/*
+ * FrameBacklog.h
+ * Description: bounded queue of readings waiting to be sent to the clusterhead, which
+ *              grows while the clusterhead is not connected.
+ *              New readings go into a RAM ring. Once that fills, the oldest spill into a
+ *              ring in the emulated EEPROM, which also survives a reset. Readings come back
+ *              out oldest first, so they can be sent on in bulk after reconnecting, or
+ *              newest first, so live readings can go ahead of a long catch up.
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#pragma once
+
+#include "Particle.h"
+
+/* One stored reading, encoded on the air and in EEPROM as
+   [sensor index u8][value u16][timestamp u32], little endian */
+struct BacklogFrame {
+    uint8_t sensor;
+    uint16_t value;     //raw bits of the reading, the clusterhead knows each sensor's type
+    uint32_t timestamp; //unix time (s) the reading was taken
+};
+const size_t BACKLOG_RECORD_SIZE = 7;
+
+//readings held in RAM before spilling to EEPROM
+const size_t BACKLOG_RAM_FRAMES = 256;
+//EEPROM below this is left for other uses, the backlog ring takes the rest
+const int BACKLOG_EEPROM_START = 1024;
+//records spilled or popped between saves of the EEPROM ring's head and count, see flush()
+const uint16_t BACKLOG_HEADER_INTERVAL = 16;
+
+class FrameBacklog {
+public:
+    FrameBacklog();
+
+    // Pick up anything left in EEPROM from before a reset. Call from setup()
+    void begin();
+
+    // Store a reading. If both rings are full the oldest reading is dropped
+    void push(uint8_t sensor, uint16_t value, uint32_t timestamp);
+
+    // Read the index'th oldest reading without removing it. index must be < size()
+    void peek(size_t index, BacklogFrame& out);
+
+    // Remove the count oldest readings, e.g. once they have been sent
+    void pop(size_t count);
+
+    // As peek() and pop(), from the newest end
+    void peekNewest(size_t index, BacklogFrame& out);
+    void popNewest(size_t count);
+
+    // Save the EEPROM ring's head and count now. They are otherwise saved every
+    // BACKLOG_HEADER_INTERVAL records, and after a reset begin() finds any spilled since by
+    // scanning, but up to that many already popped come back. Call when the link comes or goes
+    void flush();
+
+    size_t size() const { return eepromCount + ramCount; }
+    uint32_t dropped() const { return droppedCount; }
+
+    static void encode(const BacklogFrame& frame, uint8_t* out);
+
+private:
+    int eepromAddress(size_t slot) const;
+    void writeEepromHeader();
+    void headerChanged(size_t records);
+
+    BacklogFrame ram[BACKLOG_RAM_FRAMES];
+    size_t ramHead;     //oldest reading in RAM
+    size_t ramCount;
+
+    size_t eepromCapacity;
+    uint16_t eepromHead;
+    uint16_t eepromCount;
+    uint8_t eepromLap;          //marks the records written on this pass round the ring
+    uint16_t unsavedChanges;    //records spilled or popped since the header was saved
+
+    uint32_t droppedCount;
+};
@@ -0,0 +1,104 @@
+/*
+ * LinkSecurity.cpp
+ * Description: implementation of the node's key and sequence number store
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#include "LinkSecurity.h"
+
+const uint16_t LINK_SECURITY_MAGIC = 0x5EC1;
+const int LINK_KEY_OFFSET = 2;
+const int LINK_RESERVED_OFFSET = 2 + FRAME_KEY_SIZE;
+const int LINK_CONTROL_OFFSET = LINK_RESERVED_OFFSET + 4;
+
+LinkSecurity::LinkSecurity() : nextSequence(0), reservedUpTo(0), savedControl(0), rejectedCount(0) {
+}
+
+void LinkSecurity::begin(){
+    uint16_t magic;
+    EEPROM.get(LINK_SECURITY_EEPROM_START, magic);
+    if(magic != LINK_SECURITY_MAGIC){
+        Log.warn("No link key provisioned, nothing is sent until one is");
+        return;
+    }
+    uint8_t key[FRAME_KEY_SIZE];
+    for(size_t i = 0; i < FRAME_KEY_SIZE; i++){
+        key[i] = EEPROM.read(LINK_SECURITY_EEPROM_START + LINK_KEY_OFFSET + i);
+    }
+    cipher.setKey(key);
+    //anything below the saved reservation may have been used before the reset
+    EEPROM.get(LINK_SECURITY_EEPROM_START + LINK_RESERVED_OFFSET, nextSequence);
+    reservedUpTo = nextSequence;
+    //saved ahead of anything accepted before the reset
+    EEPROM.get(LINK_SECURITY_EEPROM_START + LINK_CONTROL_OFFSET, savedControl);
+    if(savedControl > 0){
+        controlWindow.reset(savedControl - 1);
+    }
+}
+
+void LinkSecurity::provision(const uint8_t* key){
+    bool sameKey = cipher.hasKey();
+    for(size_t i = 0; i < FRAME_KEY_SIZE; i++){
+        int address = LINK_SECURITY_EEPROM_START + LINK_KEY_OFFSET + i;
+        if(EEPROM.read(address) != key[i]){
+            sameKey = false;
+            EEPROM.write(address, key[i]);
+        }
+    }
+    if(!cipher.hasKey()){
+        //first key, whatever the EEPROM held before means nothing
+        nextSequence = 0;
+        reserve(0);
+    }
+    //otherwise keep counting from the old reservation, nonces must never repeat under a key
+    //that may be the same one again
+    if(!sameKey){
+        savedControl = 0;
+        EEPROM.put(LINK_SECURITY_EEPROM_START + LINK_CONTROL_OFFSET, savedControl);
+        controlWindow = ReplayWindow();
+    }
+    EEPROM.put(LINK_SECURITY_EEPROM_START, LINK_SECURITY_MAGIC);
+    cipher.setKey(key);
+}
+
+void LinkSecurity::reserve(uint32_t upTo){
+    reservedUpTo = upTo;
+    EEPROM.put(LINK_SECURITY_EEPROM_START + LINK_RESERVED_OFFSET, reservedUpTo);
+}
+
+void LinkSecurity::onConnected(){
+    nextSequence = nextSequence > UINT32_MAX - FRAME_FLOOR_STEP ? UINT32_MAX : nextSequence + FRAME_FLOOR_STEP;
+}
+
+size_t LinkSecurity::seal(uint8_t channel, const uint8_t* in, size_t len, uint8_t* out){
+    if(!cipher.hasKey()){
+        return 0;
+    }
+    if(nextSequence >= reservedUpTo){
+        if(nextSequence > UINT32_MAX - LINK_SEQUENCE_BLOCK){
+            return 0;//never wrap, that would reuse nonces
+        }
+        //onConnected() may have skipped past the end of the last reservation
+        reserve(nextSequence + LINK_SEQUENCE_BLOCK);
+    }
+    return cipher.seal(channel, nextSequence++, in, len, out);
+}
+
+bool LinkSecurity::open(uint8_t channel, const uint8_t* in, size_t len, uint8_t* out, size_t& outLen){
+    uint32_t sequence;
+    if(!cipher.open(channel, in, len, out, sequence)){
+        rejectedCount++;
+        return false;
+    }
+    if(sequence >= savedControl){
+        //save the floor ahead first, a reset after accepting this must not let it through again
+        savedControl = sequence > UINT32_MAX - FRAME_FLOOR_STEP ? UINT32_MAX : sequence + FRAME_FLOOR_STEP;
+        EEPROM.put(LINK_SECURITY_EEPROM_START + LINK_CONTROL_OFFSET, savedControl);
+    }
+    if(!controlWindow.accept(sequence)){
+        rejectedCount++;
+        return false;
+    }
+    outLen = len - FRAME_OVERHEAD;
+    return true;
+}
@@ -0,0 +1,63 @@
+/*
+ * LinkSecurity.h
+ * Description: a node's side of the authenticated link to the clusterhead, see FrameCipher.h.
+ *              Holds the node's key, provisioned once at setup, and its sequence numbers,
+ *              both in EEPROM. Sequence numbers are reserved in blocks, so a reset skips the
+ *              rest of the block rather than ever reusing one under the same key.
+ *              Until a key is provisioned nothing is sent or accepted, so readings wait in
+ *              the backlog rather than going out in plaintext.
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#pragma once
+
+#include "Particle.h"
+#include "FrameCipher.h"
+
+//EEPROM from here holds [magic u16][key 32 bytes][sequence reserved up to u32]
+//[control replay floor u32, control sequence numbers below it are rejected]
+const int LINK_SECURITY_EEPROM_START = 0;
+const int LINK_SECURITY_EEPROM_SIZE = 42;
+//sequence numbers reserved per EEPROM write
+const uint32_t LINK_SEQUENCE_BLOCK = 1024;
+
+class LinkSecurity {
+public:
+    LinkSecurity();
+
+    // Load the key and the next sequence block from EEPROM. Call from setup()
+    void begin();
+
+    // Store a new key, replacing any old one. Sequence numbers carry on from where the old
+    // key left them, so provisioning the same key again never reuses a nonce. The control
+    // replay window is only cleared for a different key, under which old frames can't open
+    void provision(const uint8_t* key);
+
+    bool provisioned() const { return cipher.hasKey(); }
+
+    // Call when the clusterhead connects. Skips FRAME_FLOOR_STEP sequence numbers, past any
+    // floor it saved ahead before it reset
+    void onConnected();
+
+    // Seal a frame for channel into out, which takes len + FRAME_OVERHEAD bytes. Returns the
+    // length to send, or 0 if there is no key or sequence numbers have run out and the node
+    // needs a new one
+    size_t seal(uint8_t channel, const uint8_t* in, size_t len, uint8_t* out);
+
+    // Check and decrypt a frame from the clusterhead into out, setting outLen. False if it
+    // is forged, replayed or truncated, or there is no key. The replay floor is saved
+    // FRAME_FLOOR_STEP ahead of what we accept, so nothing accepted before a reset is again
+    bool open(uint8_t channel, const uint8_t* in, size_t len, uint8_t* out, size_t& outLen);
+
+    uint32_t rejected() const { return rejectedCount; }
+
+private:
+    void reserve(uint32_t upTo);
+
+    FrameCipher cipher;
+    uint32_t nextSequence;
+    uint32_t reservedUpTo;  //sequence numbers below this are ours to use without a write
+    ReplayWindow controlWindow;
+    uint32_t savedControl;  //control replay floor in EEPROM, everything accepted is below it
+    uint32_t rejectedCount;
+};
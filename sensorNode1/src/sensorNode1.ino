@@ -3,6 +3,13 @@
 #include "dct.h"
 #include <HC-SR04.h>
 #include <Grove_Temperature_And_Humidity_Sensor.h>
+#include "AdaptiveSampler.h"
+#include "FrameBacklog.h"
+#include "EnergyMeter.h"
+#include "EventDetector.h"
+#include "LinkSecurity.h"
+#include "ConfigStore.h"
+#include "HealthMonitor.h"
 #include <chrono>
 /*
  * sensorNode1.ino
@@ -11,58 +18,168 @@
  * Date: 07/05/2020
  */
 
-DHT dht(D0);        //DHT for temperature/humidity 
+const int dhtPin = D0;
+DHT dht(dhtPin);        //DHT for temperature/humidity 
 
 SYSTEM_MODE(AUTOMATIC); //Put into Automatic mode so the argon can connect to the cloud
+STARTUP(System.enableFeature(FEATURE_RESET_INFO)); //keep why we reset, for the health report
 
 SerialLogHandler logHandler(LOG_LEVEL_TRACE);
 
-/* Service UUID for sensor node 1. It is advertised as one service, 
-   with 4 characteristics for each of its 4 sensors */
+/* Service UUID for sensor node 1. It is advertised as one service, with one
+   streaming characteristic carrying every sensor's readings and one control characteristic */
 const char* sensorNode1ServiceUuid("754ebf5e-ce31-4300-9fd5-a8fb4ee4a811");
 
 
 /*Temperature sensor variables */
-//duration in millis to wait between reads
-const uint16_t TEMPERATURE_READ_DELAY = 30000;
-unsigned long lastTemperatureUpdate = 0;//last absolute time a recording was taken
-//advertised bluetooth characteristic
-const char* temperatureSensorUuid("bc7f18d9-2c43-408e-be25-62f40645987c");
-BleCharacteristic temperatureSensorCharacteristic("temp",
-BleCharacteristicProperty::NOTIFY, temperatureSensorUuid, sensorNode1ServiceUuid);
+//bounds in millis on the wait between reads, which adapts to how fast the reading is changing
+const uint32_t TEMPERATURE_MIN_READ_DELAY = 10000;
+const uint32_t TEMPERATURE_MAX_READ_DELAY = 120000;
+const int32_t TEMPERATURE_CHANGE_THRESHOLD = 1;//degrees
+AdaptiveSampler temperatureSampler(TEMPERATURE_MIN_READ_DELAY, TEMPERATURE_MAX_READ_DELAY, TEMPERATURE_CHANGE_THRESHOLD);
 
 /*Humidity sensor variables */
 // const int temperaturePin = A0; //pin reading output of temp sensor
-//duration in millis to wait between reads
-const uint16_t HUMIDITY_READ_DELAY = 30000;
-unsigned long lastHumidityUpdate = 0;//last absolute time a recording was taken
-//advertised bluetooth characteristic
-const char* humiditySensorUuid("99a0d2f9-1cfa-42b3-b5ba-1b4d4341392f");
-BleCharacteristic humiditySensorCharacteristic("humid",
-BleCharacteristicProperty::NOTIFY, humiditySensorUuid, sensorNode1ServiceUuid);
+//bounds in millis on the wait between reads
+const uint32_t HUMIDITY_MIN_READ_DELAY = 10000;
+const uint32_t HUMIDITY_MAX_READ_DELAY = 120000;
+const int32_t HUMIDITY_CHANGE_THRESHOLD = 2;//percent
+AdaptiveSampler humiditySampler(HUMIDITY_MIN_READ_DELAY, HUMIDITY_MAX_READ_DELAY, HUMIDITY_CHANGE_THRESHOLD);
 
 /* Light sensor variables */
-const int lightPin = A1; //pin reading output of sensor
-//duration in millis to wait between reads
-const uint16_t LIGHT_READ_DELAY = 5000;
-unsigned long lastLightUpdate = 0;//last absolute time a recording was taken
-//advertised bluetooth characteristic
-const char* lightSensorUuid("ea5248a4-43cc-4198-a4aa-79200a750835");
-BleCharacteristic lightSensorCharacteristic("light",
-BleCharacteristicProperty::NOTIFY, lightSensorUuid, sensorNode1ServiceUuid);
+int lightPin = A1; //pin reading output of sensor
+//lux = raw * scale + offset
+const float LIGHT_SCALE = 1 / 3.793103448f;
+const float LIGHT_OFFSET = -1382.758621f / 3.793103448f;
+float lightScale = LIGHT_SCALE;
+float lightOffset = LIGHT_OFFSET;
+//bounds in millis on the wait between reads
+const uint32_t LIGHT_MIN_READ_DELAY = 1000;
+const uint32_t LIGHT_MAX_READ_DELAY = 40000;
+const int32_t LIGHT_CHANGE_THRESHOLD = 20;//lux
+AdaptiveSampler lightSampler(LIGHT_MIN_READ_DELAY, LIGHT_MAX_READ_DELAY, LIGHT_CHANGE_THRESHOLD);
 
 /* Distance sensor variables */
 const int distanceTriggerPin = D2;  //pin reading input of sensor
 const int distanceEchoPin = D3;     //pin reading output of sensor
 HC_SR04 rangefinder = HC_SR04(distanceTriggerPin, distanceEchoPin);
-//duration in millis to wait between reads
-const uint16_t DISTANCE_READ_DELAY = 1000;
-unsigned long lastDistanceUpdate = 0;//last absolute time a recording was taken
-//advertised bluetooth characteristic
-const char* distanceSensorUuid("45be4a56-48f5-483c-8bb1-d3fee433c23c");
-BleCharacteristic distanceSensorCharacteristic("distance",
-BleCharacteristicProperty::NOTIFY, distanceSensorUuid, sensorNode1ServiceUuid);
-uint8_t lastRecordedDistance = 255;
+//bounds in millis on the wait between reads. Fast minimum so approaching objects are tracked closely
+const uint32_t DISTANCE_MIN_READ_DELAY = 200;
+const uint32_t DISTANCE_MAX_READ_DELAY = 6400;
+const int32_t DISTANCE_CHANGE_THRESHOLD = 5;//cm
+AdaptiveSampler distanceSampler(DISTANCE_MIN_READ_DELAY, DISTANCE_MAX_READ_DELAY, DISTANCE_CHANGE_THRESHOLD);
+//raw samples are taken at the fastest read delay for the event detector, and each reading sent is
+//their mean since the last. A distance collapse sends the raw window around it, see sendEventWindow()
+const uint16_t DISTANCE_SAMPLE_PERIOD = DISTANCE_MIN_READ_DELAY;
+EventDetector distanceDetector(DISTANCE_SAMPLE_PERIOD, 0.05f, 4.0f, 20);
+unsigned long lastDistanceSample = 0;
+
+//DHT and rangefinder reads that returned no value, see the read functions
+int readFailures = 0;
+
+/* Commands written by the clusterhead, [opcode u8][payload...]. See onControlReceived() */
+const char* controlUuid("5a1c3e7d-2f4b-4a8e-b6d9-0c7e1f2a3b45");
+BleCharacteristic controlCharacteristic("control",
+BleCharacteristicProperty::WRITE_WO_RSP, controlUuid, sensorNode1ServiceUuid, onControlReceived, NULL);
+//payload [sensor index u8][min delay millis u32][max delay millis u32], 0 keeps a bound
+const uint8_t CONTROL_RATE_HINT = 0x01;
+//payload a config blob, see NodeConfig.h
+const uint8_t CONTROL_CONFIG = 0x02;
+//payload [version u16], keeps the config on trial
+const uint8_t CONTROL_CONFIG_CONFIRM = 0x03;
+//no payload, goes back to the config before the latest
+const uint8_t CONTROL_CONFIG_ROLLBACK = 0x04;
+//indexed by the sensor index in a rate hint
+AdaptiveSampler* samplers[] = { &temperatureSampler, &humiditySampler, &lightSampler, &distanceSampler };
+const uint8_t SAMPLER_COUNT = sizeof(samplers) / sizeof(samplers[0]);
+
+/* Sensor indices, used in rate hints and stream records. Match the samplers array */
+const uint8_t SENSOR_TEMPERATURE = 0;
+const uint8_t SENSOR_HUMIDITY = 1;
+const uint8_t SENSOR_LIGHT = 2;
+const uint8_t SENSOR_DISTANCE = 3;
+//each sensor's kind in a config, see NodeConfig.h. Match the samplers array
+const uint8_t SENSOR_KINDS[] = { CONFIG_SENSOR_TEMPERATURE, CONFIG_SENSOR_HUMIDITY, CONFIG_SENSOR_LIGHT, CONFIG_SENSOR_DISTANCE };
+
+/* Every reading is queued in the backlog and sent from there on the stream characteristic,
+   several readings per notification, see drainBacklog(). While the clusterhead isn't
+   connected they stay queued and are caught up on once it is back */
+FrameBacklog backlog;
+//readings queued while connected and not sent yet, at the newest end of the backlog. They go
+//out ahead of anything older, so a catch up doesn't hold up live data
+size_t liveReadings = 0;
+//whether the clusterhead was connected last loop, the backlog is flushed as that changes
+bool wasConnected = false;
+const char* streamUuid("5a1c3e7d-2f4b-4a8e-b6d9-0c7e1f2a3b44");
+BleCharacteristic streamCharacteristic("stream",
+BleCharacteristicProperty::NOTIFY, streamUuid, sensorNode1ServiceUuid);
+//records per notification, needs the 247 byte ATT MTU Device OS negotiates with the clusterhead
+const uint8_t BACKLOG_RECORDS_PER_NOTIFICATION = 16;
+//cap on notifications per loop, so a long backlog can't hold up sampling
+const uint8_t BACKLOG_NOTIFICATIONS_PER_LOOP = 8;
+uint8_t recordsPerNotification = BACKLOG_RECORDS_PER_NOTIFICATION;
+uint8_t notificationsPerLoop = BACKLOG_NOTIFICATIONS_PER_LOOP;
+unsigned long lastNotConnectedLog = 0;
+
+/* Raw windows around detected events, [sensor index u8][window], see EventDetector.h */
+const char* eventUuid("5a1c3e7d-2f4b-4a8e-b6d9-0c7e1f2a3b47");
+BleCharacteristic eventCharacteristic("event",
+BleCharacteristicProperty::NOTIFY, eventUuid, sensorNode1ServiceUuid);
+
+/* Every frame to and from the clusterhead is sealed with this node's key, see LinkSecurity.h */
+LinkSecurity linkSecurity;
+
+/* Energy accounting, see EnergyMeter.h. A report goes to the clusterhead on the
+   diagnostics characteristic every DIAGNOSTICS_INTERVAL while connected */
+EnergyMeter energyMeter;
+const char* diagnosticsUuid("5a1c3e7d-2f4b-4a8e-b6d9-0c7e1f2a3b46");
+BleCharacteristic diagnosticsCharacteristic("diag",
+BleCharacteristicProperty::NOTIFY, diagnosticsUuid, sensorNode1ServiceUuid);
+//diagnostics frames are [type u8][payload...]
+const uint8_t DIAGNOSTICS_ENERGY = 0x01;
+//payload see CONFIG_STATUS_SIZE in NodeConfig.h
+const uint8_t DIAGNOSTICS_CONFIG = 0x02;
+//payload see HEALTH_REPORT_SIZE in HealthMonitor.h
+const uint8_t DIAGNOSTICS_HEALTH = 0x03;
+const uint32_t DIAGNOSTICS_INTERVAL = 60000;
+uint32_t diagnosticsInterval = DIAGNOSTICS_INTERVAL;
+unsigned long lastDiagnostics = 0;
+const uint32_t LOOP_DELAY = 100;
+uint32_t loopDelay = LOOP_DELAY;
+
+/* Loop timing, stalls, backlog depth, heap and stack, see HealthMonitor.h. Reported to the
+   clusterhead alongside the energy report */
+HealthMonitor healthMonitor;
+/* Resets us if loop() doesn't come back for this long, noting what it was stuck in, see
+   onWatchdog(). Device OS checks in for us after every loop() and while it runs the cloud connection */
+const uint32_t WATCHDOG_TIMEOUT = 30000;
+ApplicationWatchdog watchdog(WATCHDOG_TIMEOUT, onWatchdog, 1536);
+
+/* Runtime configuration from the clusterhead, see ConfigStore.h. Everything it can change
+   starts from the constants above, see defaultSettings() */
+ConfigStore configStore;
+//a config on trial is rolled back unless the clusterhead confirms it within this long
+const uint32_t CONFIG_TRIAL_TIMEOUT = 120000;
+unsigned long configTrialStart = 0;
+//config writes arrive on the BLE thread and are handled in loop(), one at a time
+uint8_t configRequest[FRAME_MAX_SIZE];
+size_t configRequestLength = 0;
+volatile bool configRequested = false;
+//rate hints arrive on the BLE thread too. Each sensor has a slot for one, applied in loop()
+uint32_t rateHintMin[SAMPLER_COUNT];
+uint32_t rateHintMax[SAMPLER_COUNT];
+volatile bool rateHintWaiting[SAMPLER_COUNT];
+
+/* Readings are also published to the cloud. Device OS allows about one publish a second and the
+   samplers can read much faster, so a read only leaves its latest value here for
+   publishReadings(), which publishes one sensor's at a time, in turn */
+const uint32_t PUBLISH_INTERVAL = 1000;
+//each sensor's event name. Match the samplers array
+const char* const PUBLISH_EVENTS[] = { "temperature", "humidity", "light", "distance" };
+char publishValues[SAMPLER_COUNT][12];
+bool publishWaiting[SAMPLER_COUNT];
+uint8_t nextPublish = 0;
+unsigned long lastPublish = 0;
 
 
 /*debug variables */
@@ -74,6 +191,13 @@ double distanceCloud = 0;
 
 /* Initial setup */
 void setup() {
+    //before anything else runs deep, see HealthMonitor.h
+    healthMonitor.paintStack(HEALTH_STACK_PAINT_SIZE);
+    healthMonitor.setResetReason(System.resetReason(), System.resetReasonData());
+    if(healthMonitor.lastReset() == HEALTH_RESET_APP_WATCHDOG){
+        Log.warn("Reset by the watchdog, loop() was stuck in %s", HealthMonitor::sectionName(healthMonitor.lastResetSection()));
+    }
+
     const uint8_t val = 0x01;
     dct_write_app_data(&val, DCT_SETUP_DONE_OFFSET, 1);
     
@@ -85,16 +209,17 @@ void setup() {
     Particle.variable("light", lightCloud);
     Particle.variable("humidity", humidityCloud);
     Particle.variable("distance", distanceCloud);
+    Particle.variable("readFailures", readFailures);
 
     
     /* Setup bluetooth characteristics and advertise sensorNode1Service to be connected to by the clusterhead */
     BLE.on();//activate BT
 
     //add characteristics
-    BLE.addCharacteristic(temperatureSensorCharacteristic);
-    BLE.addCharacteristic(humiditySensorCharacteristic);
-    BLE.addCharacteristic(lightSensorCharacteristic);
-    BLE.addCharacteristic(distanceSensorCharacteristic);
+    BLE.addCharacteristic(streamCharacteristic);
+    BLE.addCharacteristic(controlCharacteristic);
+    BLE.addCharacteristic(diagnosticsCharacteristic);
+    BLE.addCharacteristic(eventCharacteristic);
 
     //data to be advertised
     BleAdvertisingData advData;
@@ -106,114 +231,536 @@ void setup() {
 
     //Initialises rangefinder
     rangefinder.init();
+
+    //pick up any readings backlogged before a reset
+    backlog.begin();
+
+    //load the link key, and take the key shared with the clusterhead, see provisionKey()
+    linkSecurity.begin();
+    Particle.function("provisionKey", provisionKey);
+
+    //apply the config the clusterhead last pushed
+    if(configStore.begin()){
+        Log.warn("Reset while config version %u was on trial, rolled back", configStore.rolledBack());
+    }
+    NodeSettings settings;
+    if(checkSettings(configStore.active(), configStore.length(), settings) != CONFIG_STATUS_TRIAL){
+        Log.warn("Stored config version %u can't be applied, using defaults", configStore.version());
+        settings = defaultSettings();
+    }
+    applySettings(settings);
 }
 
 void loop() {
-    //only begin using sensors when this node has connected to a cluster head
-    if(BLE.connected()){
-        long currentTime = millis();//record current time
-        /* Check if it's time to take another reading for each sensor 
-           If it is, update "lastUpdate" time, then read and update the appropriate characteristic
-           A change in the characteristic will notify the connected cluster head
-        */
-        //temperature and humidity
-        if(currentTime - lastTemperatureUpdate >= TEMPERATURE_READ_DELAY){
-            //reset read delay timer
-            lastTemperatureUpdate = currentTime;
-            //read temp
-            int8_t temp = readTemperature();
-            
+    //sample whether or not the clusterhead is connected. Readings taken while it's away are
+    //backlogged and caught up on once it's back
+    long currentTime = millis();//record current time
+    uint32_t loopStart = micros();
+    healthMonitor.beginLoop(loopStart);
+    bool connected = BLE.connected();
+    healthMonitor.enter(HEALTH_SECTION_STORAGE, micros());
+    if(connected != wasConnected){
+        wasConnected = connected;
+        backlog.flush();
+        if(connected){
+            linkSecurity.onConnected();
+        }
+    }
+    handleConfigRequest();
+    healthMonitor.leave(micros());
+    handleRateHints();
+    if(configStore.trial() && currentTime - configTrialStart >= CONFIG_TRIAL_TIMEOUT){
+        Log.warn("Config version %u not confirmed in time", configStore.version());
+        rollbackConfig();
+    }
+    /* Check if it's time to take another reading for each sensor 
+       If it is, read and queue it, letting the sampler pick the next read delay
+       Everything queued goes out together on the stream characteristic at the end of the loop
+    */
+    //temperature and humidity
+    if(temperatureSampler.due(currentTime)){
+        //read temp, and let the sampler pick the next read delay
+        int8_t temp;
+        if(readTemperature(temp)){
+            temperatureSampler.update(currentTime, temp);
+
             //update cloud variables if we're doing this
             temperatureCloud = temp;
 
-            //package together with send time in a buffer
-            uint8_t* transmission[9];
-            memcpy(transmission, &temp, sizeof(temp));
-
-            //record and append the sending time
-            uint64_t sendTime = getCurrentTime();
-            memcpy(transmission + sizeof(temp), &sendTime, sizeof(sendTime));
-
             //send bluetooth transmission
-            temperatureSensorCharacteristic.setValue(transmission);
+            sendReading(SENSOR_TEMPERATURE, (uint8_t) temp);
         }
-        //humidity
-        if(currentTime - lastHumidityUpdate >= HUMIDITY_READ_DELAY){
-           lastHumidityUpdate = currentTime;
-           uint8_t humidity = readHumidity();
-           
+        else{
+            //nothing is sent, the sampler retries at its minimum read delay
+            temperatureSampler.skip(currentTime);
+            Log.warn("Temperature read failed");
+        }
+    }
+    //humidity
+    if(humiditySampler.due(currentTime)){
+       uint8_t humidity;
+       if(readHumidity(humidity)){
+           humiditySampler.update(currentTime, humidity);
+
            //update cloud variables if we're doing this
            humidityCloud = humidity;
-           
+
            //send bluetooth transmission
-           humiditySensorCharacteristic.setValue(humidity);
+           sendReading(SENSOR_HUMIDITY, humidity);
+       }
+       else{
+           humiditySampler.skip(currentTime);
+           Log.warn("Humidity read failed");
+       }
+    }
+    //light
+    if(lightSampler.due(currentTime)){
+        uint16_t getValue = readLight();
+        lightSampler.update(currentTime, getValue);
+        lightCloud = getValue;
+        Log.info("Light: %u", getValue);
+
+        //send bluetooth transmission
+        sendReading(SENSOR_LIGHT, getValue);
+    }
+    //raw distance sample for the event detector
+    if(currentTime - lastDistanceSample >= DISTANCE_SAMPLE_PERIOD){
+        lastDistanceSample = currentTime;
+        uint8_t cms;
+        if(sampleDistance(cms)){
+            distanceDetector.add((uint32_t) getCurrentTime(), cms);
         }
-        //light
-        if(currentTime - lastLightUpdate >= LIGHT_READ_DELAY){
-            lastLightUpdate = currentTime;
-            uint16_t getValue = readLight();
-            lightCloud = getValue;
-            Log.info("Light: " + getValue);
-
-            //store data in buffer
-            uint8_t* transmission[10];
-            memcpy(transmission, &getValue, sizeof(getValue));
-            //record and append the sending time
-            uint64_t sendTime = getCurrentTime();
-            memcpy(transmission + sizeof(getValue), &sendTime, sizeof(sendTime));
+    }
+    //distance
+    if(distanceSampler.due(currentTime)){
+        uint8_t getValue;
+        if(readDistance(getValue)){
+            distanceSampler.update(currentTime, getValue);
 
-            //send bluetooth transmission
-            lightSensorCharacteristic.setValue(transmission);
+            //every reading is sent, even a repeated 0 cm, as the clusterhead's presence fusion
+            //lets distance evidence lapse once the next reading is overdue. The sampler has
+            //already slowed down while it holds still
+            sendReading(SENSOR_DISTANCE, getValue);
+            distanceCloud = getValue;
+            Log.info("Distance: %u", getValue);
         }
-        //distance
-        if(currentTime - lastDistanceUpdate >= DISTANCE_READ_DELAY){
-            lastDistanceUpdate = currentTime;
-            uint8_t getValue = readDistance();
-
-            //if distance remains 0 for multiple cycles, only send first 0 over bluetooth
-            //this helps save power
-            if(!(getValue == 0 && lastRecordedDistance == 0)){
-                //store data in buffer
-                uint8_t* transmission[9];
-                memcpy(transmission, &getValue, sizeof(getValue));
-                //record and append the sending time
-                uint64_t sendTime = getCurrentTime();
-                memcpy(transmission + sizeof(getValue), &sendTime, sizeof(sendTime));
-
-                //send bluetooth transmission
-                distanceSensorCharacteristic.setValue(transmission);
-                lastRecordedDistance = getValue;//update last recorded distance
-                Log.info("Distance transmitted.");
+        else{
+            //no echo has come back since the last reading, which is not the same as nothing in range
+            distanceSampler.skip(currentTime);
+            Log.warn("Distance read failed");
+        }
+    }
+
+    publishReadings(currentTime);
+
+    uint16_t backlogDepth = backlog.size() < 0xFFFF ? backlog.size() : 0xFFFF;
+    healthMonitor.setQueueDepth(backlogDepth, backlogDepth);
+    healthMonitor.sampleHeap(System.freeMemory());
+    if(connected){
+        //send this loop's readings, then any backlog, see drainBacklog()
+        healthMonitor.enter(HEALTH_SECTION_RADIO, micros());
+        drainBacklog();
+        sendEventWindow(SENSOR_DISTANCE, distanceDetector);
+        if(currentTime - lastDiagnostics >= diagnosticsInterval){
+            lastDiagnostics = currentTime;
+            sendEnergyReport();
+            sendHealthReport();
+        }
+        healthMonitor.leave(micros());
+    }
+    else if(currentTime - lastNotConnectedLog >= 5000){
+        lastNotConnectedLog = currentTime;
+        Log.info("not connected yet... %u readings backlogged", backlog.size());
+    }
+    
+    //everything up to here was the CPU running, the delay is it idling
+    uint32_t loopEnd = micros();
+    healthMonitor.endLoop(loopEnd);
+    uint32_t busy = loopEnd - loopStart;
+    energyMeter.add(ENERGY_CPU_ACTIVE, busy);
+    energyMeter.add(ENERGY_CPU_IDLE, loopDelay * 1000);
+    energyMeter.addLinkTime(busy / 1000 + loopDelay, connected);
+    delay(loopDelay);
+}
+
+/* Queue a reading, stamped with the time it was taken, to go out with the next stream notification */
+void sendReading(uint8_t sensor, uint16_t value){
+    backlog.push(sensor, value, (uint32_t) getCurrentTime());
+    //taken while disconnected, it and any unsent live readings before it are backlog now
+    liveReadings = BLE.connected() ? liveReadings + 1 : 0;
+    energyMeter.addReading();
+}
+
+/* Send live readings, newest first, then the backlog oldest first, many per notification.
+   Stops early once the BLE stack stops accepting notifications, so a catch up runs as fast
+   as the link allows while sampling carries on, and never holds up the latest readings */
+void drainBacklog(){
+    if(liveReadings > backlog.size()){
+        liveReadings = backlog.size();//dropped from a full backlog
+    }
+    for(uint8_t n = 0; n < notificationsPerLoop && backlog.size() > 0; n++){
+        bool live = liveReadings > 0;
+        size_t available = live ? liveReadings : backlog.size();
+        //[record count u8][records...]
+        uint8_t payload[1 + CONFIG_MAX_RECORDS_PER_NOTIFICATION * BACKLOG_RECORD_SIZE];
+        uint8_t count = available < recordsPerNotification ? available : recordsPerNotification;
+        payload[0] = count;
+        for(uint8_t i = 0; i < count; i++){
+            //within a notification records still go oldest first
+            BacklogFrame frame;
+            if(live){
+                backlog.peekNewest(count - 1 - i, frame);
             }
-            distanceCloud = getValue;
-            Log.info("Distance: " + getValue);
+            else{
+                backlog.peek(i, frame);
+            }
+            FrameBacklog::encode(frame, &payload[1 + i * BACKLOG_RECORD_SIZE]);
+        }
+        uint8_t sealed[sizeof(payload) + FRAME_OVERHEAD];
+        size_t len = linkSecurity.seal(FRAME_CHANNEL_STREAM, payload, 1 + count * BACKLOG_RECORD_SIZE, sealed);
+        if(len == 0 || streamCharacteristic.setValue(sealed, len) <= 0){
+            break;//link is saturated, carry on next loop
+        }
+        energyMeter.addNotification(len);
+        if(live){
+            backlog.popNewest(count);
+            liveReadings -= count;
         }
-        
-        delay(100);
+        else{
+            backlog.pop(count);
+        }
+    }
+}
+
+/* Burst upload the raw window around the detector's latest event, once it has one. While
+   we aren't connected it stays with the detector, so the latest event still goes on reconnect */
+void sendEventWindow(uint8_t sensor, EventDetector& detector){
+    EventWindow window;
+    if(!detector.takeWindow(window)){
+        return;
+    }
+    uint8_t payload[1 + EVENT_WINDOW_MAX_SIZE];
+    payload[0] = sensor;
+    uint8_t sealed[sizeof(payload) + FRAME_OVERHEAD];
+    size_t len = linkSecurity.seal(FRAME_CHANNEL_EVENT, payload, 1 + EventDetector::encode(window, &payload[1]), sealed);
+    if(len == 0 || eventCharacteristic.setValue(sealed, len) <= 0){
+        Log.warn("Event window for sensor %u not sent", sensor);
+        return;
+    }
+    energyMeter.addNotification(len);
+    Log.info("Event on sensor %u (z-score %d.%d), sent %u raw samples", sensor,
+        window.zScore10 / 10, abs(window.zScore10 % 10), window.count);
+}
+
+/* Send the energy used so far, by subsystem state, to the clusterhead */
+void sendEnergyReport(){
+    EnergyReport report;
+    energyMeter.report(report);
+    uint8_t payload[1 + ENERGY_REPORT_SIZE];
+    payload[0] = DIAGNOSTICS_ENERGY;
+    EnergyMeter::encode(report, &payload[1]);
+    uint8_t sealed[sizeof(payload) + FRAME_OVERHEAD];
+    size_t len = linkSecurity.seal(FRAME_CHANNEL_DIAGNOSTICS, payload, sizeof(payload), sealed);
+    if(len > 0 && diagnosticsCharacteristic.setValue(sealed, len) > 0){
+        energyMeter.addNotification(len);
+    }
+}
+
+/* Send loop timing and the rest of our health so far to the clusterhead */
+void sendHealthReport(){
+    HealthReport report;
+    healthMonitor.report(report, millis() / 1000);
+    uint8_t payload[1 + HEALTH_REPORT_SIZE];
+    payload[0] = DIAGNOSTICS_HEALTH;
+    HealthMonitor::encode(report, &payload[1]);
+    uint8_t sealed[sizeof(payload) + FRAME_OVERHEAD];
+    size_t len = linkSecurity.seal(FRAME_CHANNEL_DIAGNOSTICS, payload, sizeof(payload), sealed);
+    if(len > 0 && diagnosticsCharacteristic.setValue(sealed, len) > 0){
+        energyMeter.addNotification(len);
+    }
+}
+
+/* Runs on the watchdog's thread once loop() has been stuck for WATCHDOG_TIMEOUT. The section it
+   was stuck in goes in the reset data, for the health report after we come back */
+void onWatchdog(){
+    System.reset(HEALTH_WATCHDOG_RESET_DATA | healthMonitor.section());
+}
+
+/* Called when the clusterhead writes to the control characteristic */
+void onControlReceived(const uint8_t* sealed, size_t sealedLen, const BlePeerDevice& peer, void* context){
+    uint8_t data[FRAME_MAX_SIZE];
+    size_t len;
+    if(sealedLen > sizeof(data) || !linkSecurity.open(FRAME_CHANNEL_CONTROL, sealed, sealedLen, data, len)){
+        Log.warn("Rejected control frame of %u bytes, %lu rejected so far", sealedLen, linkSecurity.rejected());
+        return;
+    }
+    if(len < 1){
+        return;
+    }
+    switch(data[0]){
+        case CONTROL_RATE_HINT: onRateHintReceived(&data[1], len - 1); break;
+        case CONTROL_CONFIG:
+        case CONTROL_CONFIG_CONFIRM:
+        case CONTROL_CONFIG_ROLLBACK:
+            //applying touches EEPROM and the samplers, so leave it to loop()
+            if(configRequested){
+                Log.warn("Config request dropped, one is already waiting");
+                return;
+            }
+            memcpy(configRequest, data, len);
+            configRequestLength = len;
+            configRequested = true;
+            break;
+        default: Log.warn("Ignoring unknown control opcode %u", data[0]); break;
+    }
+}
+
+/* Handle a config write from the clusterhead, if one is waiting */
+void handleConfigRequest(){
+    if(!configRequested){
+        return;
+    }
+    const uint8_t* payload = &configRequest[1];
+    size_t len = configRequestLength - 1;
+    switch(configRequest[0]){
+        case CONTROL_CONFIG: onConfigReceived(payload, len); break;
+        case CONTROL_CONFIG_CONFIRM:
+            if(len >= 2){
+                uint16_t version = payload[0] | (payload[1] << 8);
+                if(configStore.confirm(version)){
+                    Log.info("Config version %u confirmed", version);
+                }
+                if(version == configStore.version() && !configStore.trial()){
+                    sendConfigStatus(version, CONFIG_STATUS_CONFIRMED);
+                }
+            }
+            break;
+        case CONTROL_CONFIG_ROLLBACK: rollbackConfig(); break;
+    }
+    configRequested = false;
+}
+
+/* Check a pushed config and apply it on trial, reporting how that went */
+void onConfigReceived(const uint8_t* blob, size_t len){
+    uint16_t version = configVersion(blob, len);
+    uint8_t status;
+    NodeSettings settings;
+    if(version == 0){
+        status = CONFIG_STATUS_INVALID;
+    }
+    else if(version == configStore.version()){
+        //already in use, e.g. pushed again on reconnect
+        status = configStore.trial() ? CONFIG_STATUS_TRIAL : CONFIG_STATUS_CONFIRMED;
+    }
+    else if(version == configStore.rolledBack()){
+        status = CONFIG_STATUS_ROLLED_BACK;
+    }
+    else if(version < configStore.version()){
+        status = CONFIG_STATUS_STALE;
     }
     else{
-        Log.info("not connected yet... ");
+        status = checkSettings(blob, len, settings);
+        if(status == CONFIG_STATUS_TRIAL){
+            configStore.apply(blob, len);
+            applySettings(settings);
+            configTrialStart = millis();
+        }
     }
+    Log.info("Config version %u: %s", version, configStatusName(status));
+    sendConfigStatus(version, status);
 }
 
-/** Returns the current temperature in microseconds */
+/* Go back to the last confirmed config, see ConfigStore::rollback() */
+void rollbackConfig(){
+    if(!configStore.rollback()){
+        Log.warn("No config to roll back to from version %u", configStore.version());
+        return;
+    }
+    uint16_t from = configStore.rolledBack();
+    NodeSettings settings;
+    if(checkSettings(configStore.active(), configStore.length(), settings) != CONFIG_STATUS_TRIAL){
+        settings = defaultSettings();
+    }
+    applySettings(settings);
+    Log.info("Config version %u rolled back to %u", from, configStore.version());
+    sendConfigStatus(from, CONFIG_STATUS_ROLLED_BACK);
+}
+
+/* Report a config's status to the clusterhead */
+void sendConfigStatus(uint16_t version, uint8_t status){
+    uint8_t payload[1 + CONFIG_STATUS_SIZE];
+    ConfigStatusReport report = { version, status, configStore.version() };
+    payload[0] = DIAGNOSTICS_CONFIG;
+    configStatusEncode(report, &payload[1]);
+    uint8_t sealed[sizeof(payload) + FRAME_OVERHEAD];
+    size_t len = linkSecurity.seal(FRAME_CHANNEL_DIAGNOSTICS, payload, sizeof(payload), sealed);
+    if(len > 0 && diagnosticsCharacteristic.setValue(sealed, len) > 0){
+        energyMeter.addNotification(len);
+    }
+}
+
+/* The settings this node was built with */
+NodeSettings defaultSettings(){
+    NodeSettings settings;
+    memset(&settings, 0, sizeof(settings));
+    settings.sensors[CONFIG_SENSOR_TEMPERATURE] = { TEMPERATURE_MIN_READ_DELAY, TEMPERATURE_MAX_READ_DELAY, TEMPERATURE_CHANGE_THRESHOLD, (uint16_t) dhtPin, 1, 0 };
+    settings.sensors[CONFIG_SENSOR_HUMIDITY] = { HUMIDITY_MIN_READ_DELAY, HUMIDITY_MAX_READ_DELAY, HUMIDITY_CHANGE_THRESHOLD, (uint16_t) dhtPin, 1, 0 };
+    settings.sensors[CONFIG_SENSOR_LIGHT] = { LIGHT_MIN_READ_DELAY, LIGHT_MAX_READ_DELAY, LIGHT_CHANGE_THRESHOLD, (uint16_t) A1, LIGHT_SCALE, LIGHT_OFFSET };
+    settings.sensors[CONFIG_SENSOR_DISTANCE] = { DISTANCE_MIN_READ_DELAY, DISTANCE_MAX_READ_DELAY, DISTANCE_CHANGE_THRESHOLD, (uint16_t) distanceTriggerPin, 1, 0 };
+    settings.recordsPerNotification = BACKLOG_RECORDS_PER_NOTIFICATION;
+    settings.notificationsPerLoop = BACKLOG_NOTIFICATIONS_PER_LOOP;
+    settings.loopDelay = LOOP_DELAY;
+    settings.diagnosticsInterval = DIAGNOSTICS_INTERVAL;
+    return settings;
+}
+
+/* Parse a config over this node's defaults into settings, and check this node can apply it.
+   Returns CONFIG_STATUS_TRIAL if it can, or why not */
+uint8_t checkSettings(const uint8_t* blob, size_t len, NodeSettings& settings){
+    NodeSettings defaults = defaultSettings();
+    if(!configParse(blob, len, defaults, settings)){
+        return CONFIG_STATUS_INVALID;
+    }
+    //the DHT and rangefinder are built with their pins, and only the light reading is calibrated
+    for(uint8_t i = 0; i < SAMPLER_COUNT; i++){
+        uint8_t kind = SENSOR_KINDS[i];
+        const SensorSettings& sensor = settings.sensors[kind];
+        const SensorSettings& fixed = defaults.sensors[kind];
+        if(kind != CONFIG_SENSOR_LIGHT && (sensor.pin != fixed.pin || sensor.scale != fixed.scale || sensor.offset != fixed.offset)){
+            return CONFIG_STATUS_UNSUPPORTED;
+        }
+    }
+    //a longer loop would sample distance slower than the event detector assumes
+    if(settings.loopDelay > DISTANCE_SAMPLE_PERIOD){
+        return CONFIG_STATUS_UNSUPPORTED;
+    }
+    if(!isAnalogPin(settings.sensors[CONFIG_SENSOR_LIGHT].pin)){
+        return CONFIG_STATUS_INVALID;
+    }
+    return CONFIG_STATUS_TRIAL;
+}
+
+/* Start using settings */
+void applySettings(const NodeSettings& settings){
+    for(uint8_t i = 0; i < SAMPLER_COUNT; i++){
+        const SensorSettings& sensor = settings.sensors[SENSOR_KINDS[i]];
+        samplers[i]->setBounds(sensor.minDelay, sensor.maxDelay);
+        samplers[i]->setThreshold(sensor.threshold);
+    }
+    const SensorSettings& light = settings.sensors[CONFIG_SENSOR_LIGHT];
+    lightPin = light.pin;
+    lightScale = light.scale;
+    lightOffset = light.offset;
+    recordsPerNotification = settings.recordsPerNotification;
+    notificationsPerLoop = settings.notificationsPerLoop;
+    loopDelay = settings.loopDelay;
+    diagnosticsInterval = settings.diagnosticsInterval;
+}
+
+bool isAnalogPin(uint16_t pin){
+    const uint16_t analogPins[] = { A0, A1, A2, A3, A4, A5 };
+    for(uint16_t analogPin : analogPins){
+        if(pin == analogPin){
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Particle function storing the key this node shares with the clusterhead, as 64 hex digits.
+   The clusterhead needs the same key for this node, see its provisionKey function */
+int provisionKey(String arg){
+    uint8_t key[FRAME_KEY_SIZE];
+    if(!FrameCipher::parseKey(arg.c_str(), key)){
+        return -1;
+    }
+    linkSecurity.provision(key);
+    Log.info("Link key provisioned");
+    return 0;
+}
+
+/* Adjusts the bounds of one sensor's read delay */
+void onRateHintReceived(const uint8_t* data, size_t len){
+    if(len < 9 || data[0] >= SAMPLER_COUNT){
+        Log.warn("Ignoring invalid rate hint of %u bytes", len);
+        return;
+    }
+    uint32_t minDelay;
+    uint32_t maxDelay;
+    memcpy(&minDelay, &data[1], sizeof(minDelay));
+    memcpy(&maxDelay, &data[5], sizeof(maxDelay));
+    uint8_t sensor = data[0];
+    //the sampler belongs to loop(), leave the hint for handleRateHints()
+    if(rateHintWaiting[sensor]){
+        Log.warn("Rate hint for sensor %u dropped, one is already waiting", sensor);
+        return;
+    }
+    rateHintMin[sensor] = minDelay;
+    rateHintMax[sensor] = maxDelay;
+    rateHintWaiting[sensor] = true;
+}
+
+/* Apply the rate hints that arrived since the last loop */
+void handleRateHints(){
+    for(uint8_t i = 0; i < SAMPLER_COUNT; i++){
+        if(rateHintWaiting[i]){
+            samplers[i]->setBounds(rateHintMin[i], rateHintMax[i]);
+            Log.info("Rate hint for sensor %u: %lu-%lu ms", i, rateHintMin[i], rateHintMax[i]);
+            rateHintWaiting[i] = false;
+        }
+    }
+}
+
+/* Leave a reading's latest value to be published by publishReadings() */
+void queuePublish(uint8_t sensor, const char* value){
+    snprintf(publishValues[sensor], sizeof(publishValues[sensor]), "%s", value);
+    publishWaiting[sensor] = true;
+}
+
+/* Publish the next sensor with a value waiting, at most once every PUBLISH_INTERVAL */
+void publishReadings(unsigned long now){
+    if(now - lastPublish < PUBLISH_INTERVAL){
+        return;
+    }
+    for(uint8_t i = 0; i < SAMPLER_COUNT; i++){
+        uint8_t sensor = (nextPublish + i) % SAMPLER_COUNT;
+        if(publishWaiting[sensor]){
+            Particle.publish(PUBLISH_EVENTS[sensor], publishValues[sensor], PUBLIC);
+            publishWaiting[sensor] = false;
+            nextPublish = (sensor + 1) % SAMPLER_COUNT;
+            lastPublish = now;
+            return;
+        }
+    }
+}
+
+/** Returns the current unix time in seconds, stamped on every frame so the clusterhead can align them */
 uint64_t getCurrentTime(){
     return Time.now();
     // return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
 }
 
-/* Read the value on the temperature sensor pin 
-Analogue pin generates 12 bits of data, so store as a 2-byte uint
+/* Read the temperature in Celsius from the DHT into t
+Returns false if the read failed, e.g. a checksum error, which the library reports as NAN
 */
-int8_t readTemperature(){
+bool readTemperature(int8_t& t){
     // Read temperature as Celsius
-	int8_t t = (int8_t) dht.getTempCelcius();   //Normally returns float
+	uint32_t start = micros();
+	healthMonitor.enter(HEALTH_SECTION_DHT, start);
+	float celsius = dht.getTempCelcius();
+	healthMonitor.leave(micros());
+	energyMeter.add(ENERGY_DHT, micros() - start);
+	if(isnan(celsius)){
+	    readFailures++;
+	    return false;
+	}
+	t = (int8_t) celsius;
 	//May be able to change this to 8bit int - check when able.
-	char str[2];
-	sprintf(str, "%u", t);
-	Particle.publish("temperature", str, PUBLIC);
+	char str[12];
+	snprintf(str, sizeof(str), "%d", t);
+	queuePublish(SENSOR_TEMPERATURE, str);
 	
-	return t;
+	return true;
 }
 
 /* Read the value on the light sensor pin 
@@ -221,36 +768,73 @@ Analogue pin generates 12 bits of data, so store as a 2-byte uint
 */
 uint16_t readLight(){
     //do any transformation logic we might want
+    uint32_t start = micros();
+    healthMonitor.enter(HEALTH_SECTION_ADC, start);
     uint16_t getL = analogRead(lightPin);
-	char str[2];
-	sprintf(str, "%u", getL);
-	Particle.publish("light", str, PUBLIC);
+    healthMonitor.leave(micros());
+    energyMeter.add(ENERGY_ADC, micros() - start);
+	char str[12];
+	snprintf(str, sizeof(str), "%u", getL);
+	queuePublish(SENSOR_LIGHT, str);
     
-	uint16_t getLasLux =  (uint16_t) (getL - 1382.758621)/3.793103448;
-    return getLasLux;
+	//below the sensor's floor reads as 0 lux rather than wrapping around
+	float lux = getL * lightScale + lightOffset;
+    return (uint16_t) constrain(lux, 0.0f, 65535.0f);
 }
 
-/* Read the value on the humidity sensor pin 
-Analogue pin generates 12 bits of data, so store as a 2-byte uint
+/* Read the relative humidity in percent from the DHT into h
+Returns false if the read failed, which the library reports as NAN
 */
-uint8_t readHumidity(){
+bool readHumidity(uint8_t& h){
     //Read Humidity
-	uint8_t h = (uint8_t) dht.getHumidity(); //normally returns float, casted to uint16_t
+	uint32_t start = micros();
+	healthMonitor.enter(HEALTH_SECTION_DHT, start);
+	float percent = dht.getHumidity();
+	healthMonitor.leave(micros());
+	energyMeter.add(ENERGY_DHT, micros() - start);
+	if(isnan(percent)){
+	    readFailures++;
+	    return false;
+	}
+	h = (uint8_t) constrain(percent, 0.0f, 100.0f);
 	//May be able to change this to 8bit int - check when able.
-	char str[2];
-	sprintf(str, "%u", h);
-	Particle.publish("humidity", str, PUBLIC);
+	char str[12];
+	snprintf(str, sizeof(str), "%u", h);
+	queuePublish(SENSOR_HUMIDITY, str);
     //do any transformation logic we might want
-    return  h;
+    return true;
+}
+
+/* Take one raw distance sample in cm into cms, clamped to 255
+Returns false if no echo came back in time, which the library reports as NO_SIGNAL
+*/
+bool sampleDistance(uint8_t& cms){
+    uint32_t start = micros();
+    healthMonitor.enter(HEALTH_SECTION_RANGEFINDER, start);
+    float distance = rangefinder.distCM();
+    healthMonitor.leave(micros());
+    energyMeter.add(ENERGY_RANGEFINDER, micros() - start);
+    if(distance == rangefinder.NO_SIGNAL || distance < 0){
+        readFailures++;
+        return false;
+    }
+    cms = distance > 255 ? 255 : (uint8_t) distance;
+    return true;
 }
 
-/* Read the distance */
-uint8_t readDistance(){
+/* The distance in cm since the last reading, the mean of the raw samples
+Returns false if none of them got an echo back
+*/
+bool readDistance(uint8_t& cms){
     //do any transformation logic we might want
-    uint8_t cms = (uint8_t) rangefinder.distCM();
-	char str[2];
-	sprintf(str, "%u", cms);
-	Particle.publish("distance", str, PUBLIC);
+    uint16_t mean;
+    if(!distanceDetector.aggregate(mean)){
+        return false;
+    }
+    cms = (uint8_t) mean;
+	char str[12];
+	snprintf(str, sizeof(str), "%u", cms);
+	queuePublish(SENSOR_DISTANCE, str);
     
-    return cms;//placeholder output value to use if sensor isnt connected
-}
\ No newline at end of file
+    return true;
+}
@@ -0,0 +1,75 @@
+/*
+ * WorkStealingPool.cpp
+ * Description: implementation of the work stealing thread pool
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#include "WorkStealingPool.h"
+
+#include <thread>
+
+//the worker a thread is running as, for submit() from inside a task
+static thread_local int currentWorker = -1;
+
+WorkStealingPool::WorkStealingPool(unsigned threads)
+    : queues(threads > 0 ? threads : 1), pending(0), stealCount(0), nextQueue(0) {
+}
+
+void WorkStealingPool::submit(Task task){
+    unsigned worker = currentWorker >= 0 ? (unsigned) currentWorker : nextQueue++ % queues.size();
+    pending++;
+    std::lock_guard<std::mutex> guard(queues[worker].lock);
+    queues[worker].tasks.push_back(std::move(task));
+}
+
+void WorkStealingPool::run(){
+    std::vector<std::thread> threads;
+    for(unsigned worker = 1; worker < queues.size(); worker++){
+        threads.emplace_back(&WorkStealingPool::work, this, worker);
+    }
+    work(0);
+    for(std::thread& thread : threads){
+        thread.join();
+    }
+}
+
+void WorkStealingPool::work(unsigned worker){
+    currentWorker = worker;
+    Task task;
+    while(pending > 0){
+        if(!take(worker, task)){
+            //everything left is running elsewhere, and may still submit more
+            std::this_thread::yield();
+            continue;
+        }
+        task(worker);
+        task = nullptr;
+        pending--;
+    }
+    currentWorker = -1;
+}
+
+bool WorkStealingPool::take(unsigned worker, Task& task){
+    {
+        //newest first from our own, it is the most likely to still be in cache
+        Queue& own = queues[worker];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if(!own.tasks.empty()){
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    //oldest first from the others, which for split up work is the biggest piece left
+    for(unsigned i = 1; i < queues.size(); i++){
+        Queue& victim = queues[(worker + i) % queues.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if(!victim.tasks.empty()){
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            stealCount++;
+            return true;
+        }
+    }
+    return false;
+}
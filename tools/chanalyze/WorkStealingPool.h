@@ -0,0 +1,50 @@
+/*
+ * WorkStealingPool.h
+ * Description: fixed set of worker threads, each with its own deque of tasks. A worker takes
+ *              from the back of its own deque and, once that is empty, steals from the front
+ *              of another's, so uneven tasks (one site's export much bigger than the rest, one
+ *              series much denser) still keep every core busy. Tasks are told which worker runs
+ *              them, so they can write into per-worker results without locking.
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+class WorkStealingPool {
+public:
+    typedef std::function<void(unsigned worker)> Task;
+
+    explicit WorkStealingPool(unsigned threads);
+
+    // Queue a task. Before run() tasks are dealt round robin, from inside a task they go
+    // on the calling worker's own deque
+    void submit(Task task);
+
+    // Run every queued task, and any they submit, on the workers. Returns once all are done
+    void run();
+
+    unsigned size() const { return (unsigned) queues.size(); }
+    uint64_t steals() const { return stealCount; }
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    void work(unsigned worker);
+    bool take(unsigned worker, Task& task);
+
+    std::vector<Queue> queues;
+    std::atomic<size_t> pending;    //queued or running
+    std::atomic<uint64_t> stealCount;
+    unsigned nextQueue;
+};
@@ -0,0 +1,694 @@
+/*
+ * chanalyze.cpp
+ * Description: offline analysis of clusterhead exports (see chquery export), across every
+ *              core. Memory maps each export, finds its frames with the firmware's own
+ *              QueryFrameParser and decodes the blocks in them with its TimeSeriesDecoder, so
+ *              the numbers can't drift from what the clusterhead stored.
+ *              Prints per-series rollups, sample interval distributions and gap reports.
+ *              See README.md
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#include "QueryProtocol.h"
+#include "TimeSeriesCodec.h"
+#include "WorkStealingPool.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+//must match the SeriesId order in clusterhead/src/SeriesStore.h
+static const char* SERIES_NAMES[] = {
+    "temperature1", "humidity", "light1", "distance",
+    "temperature2", "light2", "sound", "humanDetector",
+    "occupancy"
+};
+static const int SERIES_COUNT = sizeof(SERIES_NAMES) / sizeof(SERIES_NAMES[0]);
+
+//bytes of export each scan task covers. Frames are found from any offset, so chunks can split them
+static const size_t SCAN_CHUNK = 8 << 20;
+//blocks each decode task covers, so one dense series still spreads across cores
+static const size_t DECODE_RUN_BLOCKS = 2048;
+//[series u8][block sequence u32] ahead of the block in a QP_RESP_BLOCK payload
+static const size_t BLOCK_PREFIX = 5;
+//gap between samples of a series (s) reported as missing data, unless -g says otherwise
+static const uint32_t DEFAULT_GAP = 600;
+
+/* Sample intervals in seconds, exact up to INTERVAL_EXACT then in powers of two */
+static const uint32_t INTERVAL_EXACT = 1024;
+static const int INTERVAL_BUCKETS = INTERVAL_EXACT + 22;
+
+struct ExportFile {
+    const char* path;
+    const uint8_t* data;
+    size_t size;
+};
+
+/* Where one block is in an export, and enough of it to order and dedupe by */
+struct BlockRef {
+    uint64_t offset;            //of the block, after the QP_RESP_BLOCK prefix
+    uint32_t firstTimestamp;
+    uint16_t count;
+    uint8_t length;
+};
+
+struct ScanTotals {
+    uint64_t frames;
+    uint64_t blocks;
+    uint64_t badBlocks;         //QP_RESP_BLOCK frames with an unknown series or no samples
+};
+
+struct Rollup {
+    uint64_t samples;
+    int64_t sum;
+    int32_t min;
+    int32_t max;
+    uint32_t first;
+    uint32_t last;
+
+    void add(uint32_t timestamp, int32_t value){
+        if(samples == 0){
+            min = max = value;
+            first = timestamp;
+        }
+        min = std::min(min, value);
+        max = std::max(max, value);
+        sum += value;
+        last = timestamp;
+        samples++;
+    }
+    void merge(const Rollup& other){
+        if(other.samples == 0){
+            return;
+        }
+        if(samples == 0){
+            *this = other;
+            return;
+        }
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+        sum += other.sum;
+        first = std::min(first, other.first);
+        last = std::max(last, other.last);
+        samples += other.samples;
+    }
+};
+
+struct IntervalHistogram {
+    std::vector<uint64_t> buckets;
+    uint64_t count;
+    uint64_t sum;
+    uint32_t max;
+
+    IntervalHistogram() : buckets(INTERVAL_BUCKETS, 0), count(0), sum(0), max(0) {}
+
+    void add(uint32_t interval){
+        int bucket;
+        if(interval < INTERVAL_EXACT){
+            bucket = interval;
+        }
+        else{
+            bucket = INTERVAL_EXACT + (31 - __builtin_clz(interval)) - 10;
+        }
+        buckets[bucket]++;
+        count++;
+        sum += interval;
+        max = std::max(max, interval);
+    }
+    void merge(const IntervalHistogram& other){
+        for(int i = 0; i < INTERVAL_BUCKETS; i++){
+            buckets[i] += other.buckets[i];
+        }
+        count += other.count;
+        sum += other.sum;
+        max = std::max(max, other.max);
+    }
+    // Lower bound of the bucket holding the given fraction of intervals
+    uint32_t percentile(double fraction) const {
+        uint64_t target = (uint64_t) (fraction * count);
+        uint64_t seen = 0;
+        for(int i = 0; i < INTERVAL_BUCKETS; i++){
+            seen += buckets[i];
+            if(seen > target){
+                return i < (int) INTERVAL_EXACT ? i : 1u << (i - INTERVAL_EXACT + 10);
+            }
+        }
+        return max;
+    }
+};
+
+struct Gap {
+    uint32_t from;
+    uint32_t to;
+};
+
+/* What one decode task found in its run of blocks */
+struct RunResult {
+    Rollup rollup;
+    IntervalHistogram intervals;
+    std::vector<Gap> gaps;
+    uint64_t backwards;         //samples older than the one before, which shouldn't happen
+};
+
+/* One series of one export */
+struct SeriesGroup {
+    std::vector<BlockRef> blocks;
+    uint64_t duplicates;
+    std::vector<RunResult> runs;
+    //combined from the runs
+    Rollup rollup;
+    IntervalHistogram intervals;
+    std::vector<Gap> gaps;
+    uint64_t backwards;
+};
+
+struct Analysis {
+    std::vector<ExportFile> files;
+    unsigned threads;
+    uint32_t gapSeconds;
+    std::vector<SeriesGroup> groups;    //file * SERIES_COUNT + series
+    ScanTotals totals;
+    uint64_t steals;
+    double scanSeconds;
+    double decodeSeconds;
+};
+
+static void usage(){
+    fprintf(stderr,
+        "usage: chanalyze [-j threads] [-g gap seconds] rollup|intervals|gaps <export>...\n"
+        "       chanalyze [-j threads] bench <export>...\n"
+        "       chanalyze synth <export> <megabytes> [seed]\n");
+}
+
+static void formatTime(uint32_t timestamp, char* text, size_t size){
+    time_t t = timestamp;
+    strftime(text, size, "%Y-%m-%d %H:%M:%S", gmtime(&t));
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool mapFile(const char* path, ExportFile& out){
+    int fd = open(path, O_RDONLY);
+    if(fd < 0){
+        fprintf(stderr, "chanalyze: can't open %s\n", path);
+        return false;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    out.path = path;
+    out.size = st.st_size;
+    out.data = NULL;
+    if(out.size > 0){
+        void* map = mmap(NULL, out.size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(map == MAP_FAILED){
+            fprintf(stderr, "chanalyze: can't map %s\n", path);
+            close(fd);
+            return false;
+        }
+        madvise(map, out.size, MADV_WILLNEED);
+        out.data = (const uint8_t*) map;
+    }
+    close(fd);
+    return true;
+}
+
+/* If a valid frame starts at data, return its length, otherwise 0. The bytes go through the
+   firmware's parser, so what counts as a frame is exactly what the clusterhead's host tools accept */
+static size_t frameAt(const uint8_t* data, size_t available, QueryFrameParser& parser){
+    if(available < QP_HEADER_SIZE + QP_CRC_SIZE){
+        return 0;
+    }
+    uint16_t payloadLength = qpGet16(data + 3);
+    size_t frameLength = QP_HEADER_SIZE + payloadLength + QP_CRC_SIZE;
+    if(payloadLength > QP_MAX_PAYLOAD || frameLength > available){
+        return 0;
+    }
+    parser = QueryFrameParser();
+    for(size_t i = 0; i < frameLength; i++){
+        if(parser.feed(data[i])){
+            return i + 1 == frameLength ? frameLength : 0;
+        }
+    }
+    return 0;
+}
+
+/* Find every frame starting in [begin, end) of an export, and note each block in them */
+static void scanChunk(const ExportFile& file, size_t begin, size_t end,
+    std::vector<std::vector<BlockRef> >& blocks, ScanTotals& totals){
+    QueryFrameParser parser;
+    size_t offset = begin;
+    while(offset < end){
+        const uint8_t* sync = (const uint8_t*) memchr(file.data + offset, QP_SYNC_1, end - offset);
+        if(sync == NULL){
+            break;
+        }
+        offset = sync - file.data;
+        size_t frameLength = frameAt(sync, file.size - offset, parser);
+        if(frameLength == 0){
+            offset++;
+            continue;
+        }
+        offset += frameLength;
+        totals.frames++;
+        if(parser.type() != QP_RESP_BLOCK || parser.length() < BLOCK_PREFIX){
+            continue;
+        }
+        const uint8_t* payload = parser.payload();
+        TimeSeriesDecoder decoder;
+        uint32_t timestamp;
+        int32_t value;
+        size_t length = parser.length() - BLOCK_PREFIX;
+        if(payload[0] >= SERIES_COUNT || !decoder.begin(payload + BLOCK_PREFIX, length) || !decoder.next(timestamp, value)){
+            totals.badBlocks++;
+            continue;
+        }
+        BlockRef ref;
+        ref.offset = sync - file.data + QP_HEADER_SIZE + BLOCK_PREFIX;
+        ref.firstTimestamp = timestamp;
+        ref.count = decoder.count();
+        ref.length = length;
+        blocks[payload[0]].push_back(ref);
+        totals.blocks++;
+    }
+}
+
+/* Decode a run of one series' blocks, in time order */
+static void decodeRun(const ExportFile& file, const BlockRef* blocks, size_t count, uint32_t gapSeconds, RunResult& result){
+    result.backwards = 0;
+    bool started = false;
+    uint32_t previous = 0;
+    for(size_t i = 0; i < count; i++){
+        TimeSeriesDecoder decoder;
+        uint32_t timestamp;
+        int32_t value;
+        decoder.begin(file.data + blocks[i].offset, blocks[i].length);
+        while(decoder.next(timestamp, value)){
+            result.rollup.add(timestamp, value);
+            if(started){
+                if(timestamp < previous){
+                    result.backwards++;
+                }
+                else{
+                    result.intervals.add(timestamp - previous);
+                    if(timestamp - previous > gapSeconds){
+                        result.gaps.push_back(Gap{ previous, timestamp });
+                    }
+                }
+            }
+            started = true;
+            previous = timestamp;
+        }
+    }
+}
+
+/* Sort one series' blocks into time order, drop any the export holds twice, e.g. from
+   overlapping range dumps or an open block exported again once sealed, then queue its decode */
+static void prepareGroup(Analysis& analysis, size_t index, WorkStealingPool& pool){
+    SeriesGroup& group = analysis.groups[index];
+    std::vector<BlockRef>& blocks = group.blocks;
+    //the fullest copy of a block first, so it is the one kept
+    std::sort(blocks.begin(), blocks.end(), [](const BlockRef& a, const BlockRef& b){
+        return a.firstTimestamp != b.firstTimestamp ? a.firstTimestamp < b.firstTimestamp : a.count > b.count;
+    });
+    size_t kept = 0;
+    for(size_t i = 0; i < blocks.size(); i++){
+        if(kept > 0 && blocks[kept - 1].firstTimestamp == blocks[i].firstTimestamp){
+            group.duplicates++;
+            continue;
+        }
+        blocks[kept++] = blocks[i];
+    }
+    blocks.resize(kept);
+
+    const ExportFile& file = analysis.files[index / SERIES_COUNT];
+    uint32_t gapSeconds = analysis.gapSeconds;
+    group.runs.resize((blocks.size() + DECODE_RUN_BLOCKS - 1) / DECODE_RUN_BLOCKS);
+    for(size_t run = 0; run < group.runs.size(); run++){
+        size_t first = run * DECODE_RUN_BLOCKS;
+        size_t count = std::min(DECODE_RUN_BLOCKS, blocks.size() - first);
+        RunResult* result = &group.runs[run];
+        const BlockRef* start = &blocks[first];
+        pool.submit([&file, start, count, gapSeconds, result](unsigned){
+            decodeRun(file, start, count, gapSeconds, *result);
+        });
+    }
+}
+
+/* Join a group's runs back up, counting the interval across each boundary between them */
+static void combineRuns(SeriesGroup& group, uint32_t gapSeconds){
+    group.backwards = 0;
+    const RunResult* previous = NULL;
+    for(const RunResult& run : group.runs){
+        if(run.rollup.samples == 0){
+            continue;
+        }
+        if(previous != NULL){
+            uint32_t from = previous->rollup.last;
+            uint32_t to = run.rollup.first;
+            if(to < from){
+                group.backwards++;
+            }
+            else{
+                group.intervals.add(to - from);
+                if(to - from > gapSeconds){
+                    group.gaps.push_back(Gap{ from, to });
+                }
+            }
+        }
+        group.rollup.merge(run.rollup);
+        group.intervals.merge(run.intervals);
+        group.gaps.insert(group.gaps.end(), run.gaps.begin(), run.gaps.end());
+        group.backwards += run.backwards;
+        previous = &run;
+    }
+    std::sort(group.gaps.begin(), group.gaps.end(), [](const Gap& a, const Gap& b){ return a.from < b.from; });
+    group.runs.clear();
+}
+
+static void analyse(Analysis& analysis){
+    unsigned threads = analysis.threads;
+    size_t groupCount = analysis.files.size() * SERIES_COUNT;
+    analysis.groups.clear();
+    analysis.groups.resize(groupCount);
+    analysis.steals = 0;
+    memset(&analysis.totals, 0, sizeof(analysis.totals));
+
+    //scan: every worker collects the blocks it finds by group, so nothing is shared
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::vector<std::vector<BlockRef> > > found(threads, std::vector<std::vector<BlockRef> >(groupCount));
+    std::vector<ScanTotals> totals(threads);
+    memset(totals.data(), 0, threads * sizeof(ScanTotals));
+    WorkStealingPool scanPool(threads);
+    for(size_t f = 0; f < analysis.files.size(); f++){
+        const ExportFile* file = &analysis.files[f];
+        for(size_t begin = 0; begin < file->size; begin += SCAN_CHUNK){
+            size_t end = std::min(file->size, begin + SCAN_CHUNK);
+            scanPool.submit([file, f, begin, end, &found, &totals](unsigned worker){
+                std::vector<std::vector<BlockRef> >& mine = found[worker];
+                //this file's groups, by series
+                std::vector<std::vector<BlockRef> > series(SERIES_COUNT);
+                for(int s = 0; s < SERIES_COUNT; s++){
+                    series[s].swap(mine[f * SERIES_COUNT + s]);
+                }
+                scanChunk(*file, begin, end, series, totals[worker]);
+                for(int s = 0; s < SERIES_COUNT; s++){
+                    series[s].swap(mine[f * SERIES_COUNT + s]);
+                }
+            });
+        }
+    }
+    scanPool.run();
+    analysis.scanSeconds = secondsSince(start);
+    analysis.steals += scanPool.steals();
+    for(const ScanTotals& worker : totals){
+        analysis.totals.frames += worker.frames;
+        analysis.totals.blocks += worker.blocks;
+        analysis.totals.badBlocks += worker.badBlocks;
+    }
+
+    //decode: each group gathers its blocks, orders and dedupes them, then splits into runs
+    start = std::chrono::steady_clock::now();
+    WorkStealingPool decodePool(threads);
+    for(size_t g = 0; g < groupCount; g++){
+        decodePool.submit([&analysis, &found, &decodePool, g, threads](unsigned){
+            SeriesGroup& group = analysis.groups[g];
+            size_t total = 0;
+            for(unsigned w = 0; w < threads; w++){
+                total += found[w][g].size();
+            }
+            group.blocks.reserve(total);
+            for(unsigned w = 0; w < threads; w++){
+                group.blocks.insert(group.blocks.end(), found[w][g].begin(), found[w][g].end());
+                std::vector<BlockRef>().swap(found[w][g]);
+            }
+            prepareGroup(analysis, g, decodePool);
+        });
+    }
+    decodePool.run();
+    for(SeriesGroup& group : analysis.groups){
+        combineRuns(group, analysis.gapSeconds);
+    }
+    analysis.decodeSeconds = secondsSince(start);
+    analysis.steals += decodePool.steals();
+}
+
+static uint64_t totalBytes(const Analysis& analysis){
+    uint64_t bytes = 0;
+    for(const ExportFile& file : analysis.files){
+        bytes += file.size;
+    }
+    return bytes;
+}
+
+static void printSummary(const Analysis& analysis){
+    uint64_t samples = 0;
+    uint64_t duplicates = 0;
+    for(const SeriesGroup& group : analysis.groups){
+        samples += group.rollup.samples;
+        duplicates += group.duplicates;
+    }
+    double megabytes = totalBytes(analysis) / 1e6;
+    double seconds = analysis.scanSeconds + analysis.decodeSeconds;
+    fprintf(stderr, "chanalyze: %zu exports, %.1f MB, %llu frames, %llu blocks (%llu duplicate, %llu invalid), %llu samples\n",
+        analysis.files.size(), megabytes, (unsigned long long) analysis.totals.frames, (unsigned long long) analysis.totals.blocks,
+        (unsigned long long) duplicates, (unsigned long long) analysis.totals.badBlocks, (unsigned long long) samples);
+    fprintf(stderr, "chanalyze: %u threads, %llu steals, scan %.2f s, decode %.2f s, %.0f MB/s\n",
+        analysis.threads, (unsigned long long) analysis.steals, analysis.scanSeconds, analysis.decodeSeconds,
+        seconds > 0 ? megabytes / seconds : 0);
+}
+
+/* Each series of each export, then each series over every export */
+static void printRollups(const Analysis& analysis){
+    printf("export,series,samples,first,last,min,max,mean\n");
+    std::vector<Rollup> all(SERIES_COUNT);
+    for(size_t g = 0; g < analysis.groups.size(); g++){
+        const Rollup& rollup = analysis.groups[g].rollup;
+        all[g % SERIES_COUNT].merge(rollup);
+    }
+    for(size_t g = 0; g < analysis.groups.size() + SERIES_COUNT; g++){
+        bool total = g >= analysis.groups.size();
+        const Rollup& rollup = total ? all[g - analysis.groups.size()] : analysis.groups[g].rollup;
+        if(rollup.samples == 0){
+            continue;
+        }
+        char first[32], last[32];
+        formatTime(rollup.first, first, sizeof(first));
+        formatTime(rollup.last, last, sizeof(last));
+        printf("%s,%s,%llu,%s,%s,%d,%d,%.2f\n", total ? "all" : analysis.files[g / SERIES_COUNT].path,
+            SERIES_NAMES[g % SERIES_COUNT], (unsigned long long) rollup.samples, first, last,
+            rollup.min, rollup.max, (double) rollup.sum / rollup.samples);
+    }
+}
+
+static void printIntervals(const Analysis& analysis){
+    printf("export,series,intervals,mean_s,p50_s,p90_s,p99_s,max_s,out_of_order\n");
+    std::vector<IntervalHistogram> all(SERIES_COUNT);
+    std::vector<uint64_t> allBackwards(SERIES_COUNT, 0);
+    for(size_t g = 0; g < analysis.groups.size(); g++){
+        all[g % SERIES_COUNT].merge(analysis.groups[g].intervals);
+        allBackwards[g % SERIES_COUNT] += analysis.groups[g].backwards;
+    }
+    for(size_t g = 0; g < analysis.groups.size() + SERIES_COUNT; g++){
+        bool total = g >= analysis.groups.size();
+        const IntervalHistogram& intervals = total ? all[g - analysis.groups.size()] : analysis.groups[g].intervals;
+        uint64_t backwards = total ? allBackwards[g - analysis.groups.size()] : analysis.groups[g].backwards;
+        if(intervals.count == 0){
+            continue;
+        }
+        printf("%s,%s,%llu,%.2f,%u,%u,%u,%u,%llu\n", total ? "all" : analysis.files[g / SERIES_COUNT].path,
+            SERIES_NAMES[g % SERIES_COUNT], (unsigned long long) intervals.count, (double) intervals.sum / intervals.count,
+            intervals.percentile(0.5), intervals.percentile(0.9), intervals.percentile(0.99), intervals.max,
+            (unsigned long long) backwards);
+    }
+}
+
+static void printGaps(const Analysis& analysis){
+    printf("export,series,from,to,seconds\n");
+    for(size_t g = 0; g < analysis.groups.size(); g++){
+        for(const Gap& gap : analysis.groups[g].gaps){
+            char from[32], to[32];
+            formatTime(gap.from, from, sizeof(from));
+            formatTime(gap.to, to, sizeof(to));
+            printf("%s,%s,%s,%s,%u\n", analysis.files[g / SERIES_COUNT].path, SERIES_NAMES[g % SERIES_COUNT],
+                from, to, gap.to - gap.from);
+        }
+    }
+}
+
+/* Time the whole analysis at 1, 2, 4... threads up to the machine's */
+static void runBench(Analysis& analysis){
+    unsigned maxThreads = analysis.threads;
+    double megabytes = totalBytes(analysis) / 1e6;
+    //once untimed, so every run finds the exports in the page cache
+    analysis.threads = 1;
+    analyse(analysis);
+    printf("threads,seconds,mb_per_s,speedup,efficiency\n");
+    double single = 0;
+    for(unsigned threads = 1; ; threads = std::min(threads * 2, maxThreads)){
+        analysis.threads = threads;
+        analyse(analysis);
+        double seconds = analysis.scanSeconds + analysis.decodeSeconds;
+        if(threads == 1){
+            single = seconds;
+        }
+        printf("%u,%.3f,%.0f,%.2f,%.2f\n", threads, seconds, megabytes / seconds, single / seconds, single / seconds / threads);
+        fflush(stdout);
+        if(threads == maxThreads){
+            break;
+        }
+    }
+}
+
+/* A made up export: every series sampled at its usual rate, with log lines mixed in, the odd
+   outage, and the odd block exported twice. For trying the analysis on more data than a
+   real clusterhead holds */
+static int runSynth(const char* path, double megabytes, uint32_t seed){
+    FILE* out = fopen(path, "wb");
+    if(out == NULL){
+        fprintf(stderr, "chanalyze: can't create %s\n", path);
+        return 1;
+    }
+    //seconds between samples, and how far each step can move
+    static const uint32_t PERIOD[SERIES_COUNT] = { 30, 30, 5, 1, 30, 5, 1, 2, 10 };
+    static const int32_t STEP[SERIES_COUNT] = { 1, 2, 20, 5, 1, 20, 100, 1, 10 };
+    static const int32_t RANGE[SERIES_COUNT] = { 40, 100, 2000, 255, 40, 2000, 4095, 1, 100 };
+    //matches SERIES_BLOCK_SIZE in clusterhead/src/SeriesStore.h
+    static const size_t BLOCK_SIZE = 128;
+
+    std::mt19937 rng(seed);
+    uint8_t blocks[SERIES_COUNT][BLOCK_SIZE];
+    TimeSeriesEncoder encoders[SERIES_COUNT];
+    int32_t values[SERIES_COUNT];
+    uint32_t nextSample[SERIES_COUNT];
+    uint32_t now = 1600000000;
+    for(int s = 0; s < SERIES_COUNT; s++){
+        encoders[s].begin(blocks[s], BLOCK_SIZE);
+        values[s] = RANGE[s] / 2;
+        nextSample[s] = now;
+    }
+    uint8_t payload[QP_MAX_PAYLOAD];
+    uint8_t frame[QP_HEADER_SIZE + QP_MAX_PAYLOAD + QP_CRC_SIZE];
+    std::vector<uint8_t> lastFrame;
+    uint64_t written = 0;
+    uint64_t target = (uint64_t) (megabytes * 1e6);
+    uint32_t sequence = 0;
+    while(written < target){
+        //an outage now and then, a little under one a week
+        if(rng() % 500000 == 0){
+            now += 3600 + rng() % (6 * 3600);
+            for(int s = 0; s < SERIES_COUNT; s++){
+                nextSample[s] = now;
+            }
+        }
+        for(int s = 0; s < SERIES_COUNT; s++){
+            if(now < nextSample[s]){
+                continue;
+            }
+            nextSample[s] = now + PERIOD[s] + (rng() % 3 == 0 ? rng() % (PERIOD[s] + 1) : 0);
+            int32_t step = (int32_t) (rng() % (2 * STEP[s] + 1)) - STEP[s];
+            values[s] = std::max(0, std::min(RANGE[s], values[s] + step));
+            if(encoders[s].append(now, values[s])){
+                continue;
+            }
+            size_t length = encoders[s].finish();
+            payload[0] = s;
+            qpPut32(payload + 1, sequence++);
+            memcpy(payload + BLOCK_PREFIX, blocks[s], length);
+            size_t frameLength = qpEncodeFrame(QP_RESP_BLOCK, payload, BLOCK_PREFIX + length, frame);
+            fwrite(frame, 1, frameLength, out);
+            written += frameLength;
+            //the clusterhead's log shares the serial port
+            if(rng() % 40 == 0){
+                written += fprintf(out, "%010u [app] INFO: Sensor 1 - Light: %d Lux\r\n", now, values[2]);
+            }
+            //the same block again, as overlapping dumps give
+            if(rng() % 1000 == 0){
+                fwrite(frame, 1, frameLength, out);
+                written += frameLength;
+            }
+            encoders[s].begin(blocks[s], BLOCK_SIZE);
+            encoders[s].append(now, values[s]);
+        }
+        now++;
+    }
+    fclose(out);
+    fprintf(stderr, "chanalyze: wrote %llu bytes, %u blocks\n", (unsigned long long) written, sequence);
+    return 0;
+}
+
+int main(int argc, char** argv){
+    Analysis analysis;
+    analysis.threads = std::max(1u, std::thread::hardware_concurrency());
+    analysis.gapSeconds = DEFAULT_GAP;
+    int arg = 1;
+    while(arg + 1 < argc && argv[arg][0] == '-'){
+        if(strcmp(argv[arg], "-j") == 0 && atoi(argv[arg + 1]) > 0){
+            analysis.threads = atoi(argv[arg + 1]);
+        }
+        else if(strcmp(argv[arg], "-g") == 0 && atoi(argv[arg + 1]) > 0){
+            analysis.gapSeconds = atoi(argv[arg + 1]);
+        }
+        else{
+            usage();
+            return 2;
+        }
+        arg += 2;
+    }
+    if(arg >= argc){
+        usage();
+        return 2;
+    }
+    const char* command = argv[arg++];
+    if(strcmp(command, "synth") == 0){
+        if(argc - arg < 2 || atof(argv[arg + 1]) <= 0){
+            usage();
+            return 2;
+        }
+        return runSynth(argv[arg], atof(argv[arg + 1]), argc - arg > 2 ? strtoul(argv[arg + 2], NULL, 0) : 1);
+    }
+    if(strcmp(command, "rollup") != 0 && strcmp(command, "intervals") != 0
+        && strcmp(command, "gaps") != 0 && strcmp(command, "bench") != 0){
+        usage();
+        return 2;
+    }
+    if(arg >= argc){
+        usage();
+        return 2;
+    }
+    for(; arg < argc; arg++){
+        ExportFile file;
+        if(!mapFile(argv[arg], file)){
+            return 1;
+        }
+        analysis.files.push_back(file);
+    }
+
+    if(strcmp(command, "bench") == 0){
+        runBench(analysis);
+        return 0;
+    }
+    analyse(analysis);
+    if(strcmp(command, "rollup") == 0){
+        printRollups(analysis);
+    }
+    else if(strcmp(command, "intervals") == 0){
+        printIntervals(analysis);
+    }
+    else{
+        printGaps(analysis);
+    }
+    printSummary(analysis);
+    return 0;
+}
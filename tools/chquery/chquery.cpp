@@ -0,0 +1,315 @@
+/*
+ * chquery.cpp
+ * Description: host command line client for the clusterhead's serial query protocol.
+ *              Shares QueryProtocol and TimeSeriesCodec with the firmware, see README.md
+ * Author: Tom Schwenke
+ * Date: 19/10/2026
+ */
+#include "QueryProtocol.h"
+#include "TimeSeriesCodec.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+//must match the SeriesId order in clusterhead/src/SeriesStore.h
+static const char* SERIES_NAMES[] = {
+    "temperature1", "humidity", "light1", "distance",
+    "temperature2", "light2", "sound", "humanDetector",
+    "occupancy"
+};
+static const int SERIES_COUNT = sizeof(SERIES_NAMES) / sizeof(SERIES_NAMES[0]);
+
+//how long to wait for the clusterhead to answer before giving up
+static const int RESPONSE_TIMEOUT_MS = 5000;
+
+static void usage(){
+    fprintf(stderr,
+        "usage: chquery <port> latest\n"
+        "       chquery <port> stats\n"
+        "       chquery <port> range <series> [from] [to]\n"
+        "       chquery <port> subscribe <series>[,<series>...]|all\n"
+        "       chquery <port> export [from] > <file>\n"
+        "series: ");
+    for(int i = 0; i < SERIES_COUNT; i++){
+        fprintf(stderr, "%s%s", SERIES_NAMES[i], i + 1 < SERIES_COUNT ? ", " : "\n");
+    }
+}
+
+static int seriesByName(const char* name){
+    for(int i = 0; i < SERIES_COUNT; i++){
+        if(strcmp(name, SERIES_NAMES[i]) == 0){
+            return i;
+        }
+    }
+    return -1;
+}
+
+static const char* seriesName(uint8_t series){
+    return series < SERIES_COUNT ? SERIES_NAMES[series] : "unknown";
+}
+
+/* Opens the port raw, so binary frames arrive untouched */
+static int openPort(const char* path){
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if(fd < 0){
+        fprintf(stderr, "chquery: can't open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    struct termios tio;
+    if(tcgetattr(fd, &tio) == 0){
+        cfmakeraw(&tio);
+        cfsetspeed(&tio, B115200);//ignored by USB CDC, but some ptys insist on one
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+static bool sendRequest(int fd, uint8_t type, const uint8_t* payload, uint16_t length){
+    uint8_t frame[QP_HEADER_SIZE + QP_MAX_PAYLOAD + QP_CRC_SIZE];
+    size_t frameLength = qpEncodeFrame(type, payload, length, frame);
+    return write(fd, frame, frameLength) == (ssize_t) frameLength;
+}
+
+/* Reads until the parser has a frame. timeoutMs < 0 waits forever.
+   Bytes read past the end of a frame are kept for the next call */
+static bool readFrame(int fd, QueryFrameParser& parser, int timeoutMs){
+    static uint8_t buffer[256];
+    static size_t pending = 0, offset = 0;
+    for(;;){
+        while(offset < pending){
+            if(parser.feed(buffer[offset++])){
+                return true;
+            }
+        }
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        if(poll(&pfd, 1, timeoutMs) <= 0){
+            return false;
+        }
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if(n <= 0){
+            return false;
+        }
+        pending = n;
+        offset = 0;
+    }
+}
+
+static void printTime(uint32_t timestamp){
+    time_t t = timestamp;
+    char text[32];
+    strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", gmtime(&t));
+    printf("%s", text);
+}
+
+static bool printError(const QueryFrameParser& parser){
+    if(parser.type() != QP_RESP_ERROR || parser.length() < 2){
+        return false;
+    }
+    fprintf(stderr, "chquery: request 0x%02x failed with error %u\n", parser.payload()[0], parser.payload()[1]);
+    return true;
+}
+
+static int runLatest(int fd){
+    QueryFrameParser parser;
+    sendRequest(fd, QP_REQ_LATEST, NULL, 0);
+    while(readFrame(fd, parser, RESPONSE_TIMEOUT_MS)){
+        if(printError(parser)){
+            return 1;
+        }
+        if(parser.type() != QP_RESP_LATEST){
+            continue;
+        }
+        for(uint16_t i = 0; i + QP_LATEST_ENTRY_SIZE <= parser.length(); i += QP_LATEST_ENTRY_SIZE){
+            const uint8_t* entry = parser.payload() + i;
+            printf("%-14s ", seriesName(entry[0]));
+            printTime(qpGet32(entry + 1));
+            printf("  %d\n", (int32_t) qpGet32(entry + 5));
+        }
+        return 0;
+    }
+    fprintf(stderr, "chquery: no response\n");
+    return 1;
+}
+
+static int runStats(int fd){
+    QueryFrameParser parser;
+    sendRequest(fd, QP_REQ_STATS, NULL, 0);
+    while(readFrame(fd, parser, RESPONSE_TIMEOUT_MS)){
+        if(printError(parser)){
+            return 1;
+        }
+        if(parser.type() != QP_RESP_STATS){
+            continue;
+        }
+        printf("%-14s %10s %8s %8s %10s\n", "series", "count", "min", "max", "mean");
+        for(uint16_t i = 0; i + QP_STATS_ENTRY_SIZE <= parser.length(); i += QP_STATS_ENTRY_SIZE){
+            const uint8_t* entry = parser.payload() + i;
+            uint32_t count = qpGet32(entry + 1);
+            int64_t sum = (int64_t) ((uint64_t) qpGet32(entry + 13) | ((uint64_t) qpGet32(entry + 17) << 32));
+            printf("%-14s %10u %8d %8d %10.2f\n", seriesName(entry[0]), count,
+                (int32_t) qpGet32(entry + 5), (int32_t) qpGet32(entry + 9),
+                count > 0 ? (double) sum / count : 0.0);
+        }
+        return 0;
+    }
+    fprintf(stderr, "chquery: no response\n");
+    return 1;
+}
+
+static int runRange(int fd, uint8_t series, uint32_t from, uint32_t to){
+    uint8_t request[9];
+    request[0] = series;
+    qpPut32(request + 1, from);
+    qpPut32(request + 5, to);
+    sendRequest(fd, QP_REQ_RANGE, request, sizeof(request));
+
+    QueryFrameParser parser;
+    uint32_t samples = 0;
+    size_t compressedBytes = 0;
+    while(readFrame(fd, parser, RESPONSE_TIMEOUT_MS)){
+        if(printError(parser)){
+            return 1;
+        }
+        if(parser.type() == QP_RESP_END && parser.length() >= 3 && parser.payload()[0] == QP_REQ_RANGE){
+            fprintf(stderr, "chquery: %u samples from %u chunks (%zu compressed bytes)\n",
+                samples, qpGet16(parser.payload() + 1), compressedBytes);
+            return 0;
+        }
+        if(parser.type() != QP_RESP_BLOCK || parser.length() < 5){
+            continue;
+        }
+        //the server sends whole blocks that overlap the range, trim them here
+        TimeSeriesDecoder decoder;
+        uint32_t timestamp;
+        int32_t value;
+        compressedBytes += parser.length() - 5;
+        decoder.begin(parser.payload() + 5, parser.length() - 5);
+        while(decoder.next(timestamp, value)){
+            if(timestamp >= from && timestamp <= to){
+                printTime(timestamp);
+                printf("  %d\n", value);
+                samples++;
+            }
+        }
+    }
+    fprintf(stderr, "chquery: response timed out\n");
+    return 1;
+}
+
+static int runSubscribe(int fd, uint16_t mask){
+    uint8_t request[2];
+    qpPut16(request, mask);
+    sendRequest(fd, QP_REQ_SUBSCRIBE, request, sizeof(request));
+
+    QueryFrameParser parser;
+    while(readFrame(fd, parser, -1)){
+        if(printError(parser)){
+            return 1;
+        }
+        if(parser.type() != QP_RESP_SAMPLE || parser.length() != QP_SAMPLE_SIZE){
+            continue;
+        }
+        const uint8_t* sample = parser.payload();
+        printTime(qpGet32(sample + 1));
+        printf("  %-14s %d\n", seriesName(sample[0]), (int32_t) qpGet32(sample + 5));
+        fflush(stdout);
+    }
+    return 0;
+}
+
+/* Every series' blocks from a unix time onwards, written to stdout as the frames they came in,
+   for tools/chanalyze. Nothing is decoded, so the export is exactly what the clusterhead stored */
+static int runExport(int fd, uint32_t from){
+    uint8_t frame[QP_HEADER_SIZE + QP_MAX_PAYLOAD + QP_CRC_SIZE];
+    size_t exportedBytes = 0;
+    for(int series = 0; series < SERIES_COUNT; series++){
+        uint8_t request[9];
+        request[0] = series;
+        qpPut32(request + 1, from);
+        qpPut32(request + 5, UINT32_MAX);
+        sendRequest(fd, QP_REQ_RANGE, request, sizeof(request));
+
+        QueryFrameParser parser;
+        bool ended = false;
+        while(!ended && readFrame(fd, parser, RESPONSE_TIMEOUT_MS)){
+            if(printError(parser)){
+                return 1;
+            }
+            if(parser.type() == QP_RESP_END && parser.length() >= 3 && parser.payload()[0] == QP_REQ_RANGE){
+                fprintf(stderr, "chquery: %s, %u blocks\n", SERIES_NAMES[series], qpGet16(parser.payload() + 1));
+                ended = true;
+            }
+            else if(parser.type() == QP_RESP_BLOCK){
+                size_t length = qpEncodeFrame(parser.type(), parser.payload(), parser.length(), frame);
+                fwrite(frame, 1, length, stdout);
+                exportedBytes += length;
+            }
+        }
+        if(!ended){
+            fprintf(stderr, "chquery: response timed out\n");
+            return 1;
+        }
+    }
+    fflush(stdout);
+    fprintf(stderr, "chquery: exported %zu bytes\n", exportedBytes);
+    return 0;
+}
+
+int main(int argc, char** argv){
+    if(argc < 3){
+        usage();
+        return 2;
+    }
+    int fd = openPort(argv[1]);
+    if(fd < 0){
+        return 1;
+    }
+    const char* command = argv[2];
+
+    if(strcmp(command, "latest") == 0){
+        return runLatest(fd);
+    }
+    if(strcmp(command, "stats") == 0){
+        return runStats(fd);
+    }
+    if(strcmp(command, "range") == 0 && argc >= 4){
+        int series = seriesByName(argv[3]);
+        if(series < 0){
+            usage();
+            return 2;
+        }
+        uint32_t from = argc >= 5 ? strtoul(argv[4], NULL, 0) : 0;
+        uint32_t to = argc >= 6 ? strtoul(argv[5], NULL, 0) : UINT32_MAX;
+        return runRange(fd, series, from, to);
+    }
+    if(strcmp(command, "export") == 0){
+        return runExport(fd, argc >= 4 ? strtoul(argv[3], NULL, 0) : 0);
+    }
+    if(strcmp(command, "subscribe") == 0 && argc >= 4){
+        uint16_t mask = 0;
+        if(strcmp(argv[3], "all") == 0){
+            mask = (1 << SERIES_COUNT) - 1;
+        }
+        else{
+            char* names = argv[3];
+            for(char* name = strtok(names, ","); name != NULL; name = strtok(NULL, ",")){
+                int series = seriesByName(name);
+                if(series < 0){
+                    usage();
+                    return 2;
+                }
+                mask |= 1 << series;
+            }
+        }
+        return runSubscribe(fd, mask);
+    }
+    usage();
+    return 2;
+}
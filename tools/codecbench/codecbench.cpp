@@ -0,0 +1,247 @@
+/*
+ * codecbench.cpp
+ * Description: runs recorded (or synthetic) sensor traces through the clusterhead's
+ *              TimeSeriesCodec in blocks the size SeriesStore seals, checks every sample
+ *              comes back, and prints the compression ratio and encode/decode throughput
+ *              of each. See README.md
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#include "TimeSeriesCodec.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+//SERIES_BLOCK_SIZE in SeriesStore.h, which needs Particle.h so isn't included here
+static const size_t DEFAULT_BLOCK_SIZE = 128;
+//each timing runs the whole trace until at least this long has passed
+static const double MIN_TIMING_S = 0.2;
+
+struct Sample {
+    uint32_t timestamp;
+    int32_t value;
+};
+
+struct Trace {
+    std::string name;
+    std::vector<Sample> samples;
+};
+
+struct Result {
+    size_t blocks;
+    size_t encodedBytes;
+    double encodeSamplesPerS;
+    double decodeSamplesPerS;
+};
+
+static double secondsSince(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/* Encode the whole trace into blocks as SeriesStore does: append until a block is full,
+   then seal it and start the next with the sample that didn't fit */
+static void encodeTrace(const Trace& trace, size_t blockSize, std::vector<std::vector<uint8_t> >& blocks){
+    blocks.clear();
+    std::vector<uint8_t> buffer(blockSize);
+    TimeSeriesEncoder encoder;
+    encoder.begin(buffer.data(), blockSize);
+    for(size_t i = 0; i < trace.samples.size(); i++){
+        const Sample& sample = trace.samples[i];
+        if(!encoder.append(sample.timestamp, sample.value)){
+            size_t length = encoder.finish();
+            blocks.push_back(std::vector<uint8_t>(buffer.begin(), buffer.begin() + length));
+            encoder.begin(buffer.data(), blockSize);
+            encoder.append(sample.timestamp, sample.value);
+        }
+    }
+    if(encoder.count() > 0){
+        size_t length = encoder.finish();
+        blocks.push_back(std::vector<uint8_t>(buffer.begin(), buffer.begin() + length));
+    }
+}
+
+/* Decode every block and compare against the trace. Returns false on the first difference */
+static bool checkTrace(const Trace& trace, const std::vector<std::vector<uint8_t> >& blocks){
+    size_t next = 0;
+    for(size_t b = 0; b < blocks.size(); b++){
+        TimeSeriesDecoder decoder;
+        uint32_t timestamp;
+        int32_t value;
+        if(!decoder.begin(blocks[b].data(), blocks[b].size())){
+            fprintf(stderr, "codecbench: %s block %zu has no header\n", trace.name.c_str(), b);
+            return false;
+        }
+        while(decoder.next(timestamp, value)){
+            if(next >= trace.samples.size() || trace.samples[next].timestamp != timestamp
+                || trace.samples[next].value != value){
+                fprintf(stderr, "codecbench: %s sample %zu came back as %lu %ld\n", trace.name.c_str(), next,
+                    (unsigned long) timestamp, (long) value);
+                return false;
+            }
+            next++;
+        }
+    }
+    if(next != trace.samples.size()){
+        fprintf(stderr, "codecbench: %s only %zu of %zu samples came back\n", trace.name.c_str(), next, trace.samples.size());
+        return false;
+    }
+    return true;
+}
+
+static bool bench(const Trace& trace, size_t blockSize, Result& result){
+    std::vector<std::vector<uint8_t> > blocks;
+    encodeTrace(trace, blockSize, blocks);
+    if(!checkTrace(trace, blocks)){
+        return false;
+    }
+    result.blocks = blocks.size();
+    result.encodedBytes = 0;
+    for(size_t b = 0; b < blocks.size(); b++){
+        result.encodedBytes += blocks[b].size();
+    }
+
+    std::vector<std::vector<uint8_t> > scratch;
+    size_t runs = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double elapsed;
+    do{
+        encodeTrace(trace, blockSize, scratch);
+        runs++;
+    } while((elapsed = secondsSince(start)) < MIN_TIMING_S);
+    result.encodeSamplesPerS = runs * trace.samples.size() / elapsed;
+
+    //sum what comes out, so the decode can't be optimised away
+    int64_t sum = 0;
+    runs = 0;
+    start = std::chrono::steady_clock::now();
+    do{
+        for(size_t b = 0; b < blocks.size(); b++){
+            TimeSeriesDecoder decoder;
+            uint32_t timestamp;
+            int32_t value;
+            decoder.begin(blocks[b].data(), blocks[b].size());
+            while(decoder.next(timestamp, value)){
+                sum += value;
+            }
+        }
+        runs++;
+    } while((elapsed = secondsSince(start)) < MIN_TIMING_S);
+    result.decodeSamplesPerS = runs * trace.samples.size() / elapsed;
+    if(sum == 0x7FFFFFFFFFFFFFFFLL){
+        fprintf(stderr, "codecbench: unlikely sum\n");
+    }
+    return true;
+}
+
+/* A trace as "<unix time s> <value>" per line, in time order, e.g. chquery range output
+   with the series name cut off */
+static bool loadTrace(const char* path, Trace& trace){
+    FILE* file = fopen(path, "r");
+    if(file == NULL){
+        fprintf(stderr, "codecbench: can't open %s\n", path);
+        return false;
+    }
+    trace.name = path;
+    unsigned long timestamp;
+    long value;
+    while(fscanf(file, "%lu %ld", &timestamp, &value) == 2){
+        Sample sample = { (uint32_t) timestamp, (int32_t) value };
+        trace.samples.push_back(sample);
+    }
+    fclose(file);
+    if(trace.samples.empty()){
+        fprintf(stderr, "codecbench: no samples in %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+/* A day of each series at the rates the nodes read them when nothing is happening, with a
+   daily cycle, sensor noise and the odd late reading. Stands in when there is no recording */
+static void synthTraces(std::vector<Trace>& traces){
+    const uint32_t start = 1603065600;
+    const uint32_t day = 86400;
+    srand(1);
+    struct Series {
+        const char* name;
+        uint32_t interval;
+        double mean;
+        double swing;   //half the daily cycle
+        double noise;   //uniform, plus or minus
+    } series[] = {
+        { "synth_temperature", 30, 22, 3, 0.5 },
+        { "synth_humidity", 30, 55, 10, 1 },
+        { "synth_light", 5, 900, 900, 4 },
+        { "synth_sound", 1, 300, 40, 25 },
+        { "synth_distance", 1, 200, 0, 1 },
+    };
+    for(size_t s = 0; s < sizeof(series) / sizeof(series[0]); s++){
+        Trace trace;
+        trace.name = series[s].name;
+        uint32_t t = start;
+        while(t < start + day){
+            double phase = 2 * M_PI * (t - start) / day;
+            double value = series[s].mean + series[s].swing * sin(phase)
+                + series[s].noise * (2.0 * rand() / RAND_MAX - 1);
+            //someone walks past the rangefinder now and then
+            if(strcmp(series[s].name, "synth_distance") == 0 && rand() % 600 == 0){
+                value = 40 + rand() % 80;
+            }
+            Sample sample = { t, (int32_t) lround(value < 0 ? 0 : value) };
+            trace.samples.push_back(sample);
+            t += series[s].interval + (rand() % 20 == 0 ? 1 : 0);
+        }
+        traces.push_back(trace);
+    }
+}
+
+int main(int argc, char** argv){
+    size_t blockSize = DEFAULT_BLOCK_SIZE;
+    int arg = 1;
+    if(arg + 1 < argc && strcmp(argv[arg], "-b") == 0){
+        blockSize = strtoul(argv[arg + 1], NULL, 0);
+        arg += 2;
+    }
+    if(arg >= argc || blockSize < TSC_HEADER_SIZE + (TSC_MAX_SAMPLE_BITS + 7) / 8 || blockSize > 8192){
+        fprintf(stderr, "usage: codecbench [-b block bytes] synth | <trace>...\n"
+                        "trace: one \"<unix time s> <value>\" pair per line, in time order\n");
+        return 2;
+    }
+
+    std::vector<Trace> traces;
+    if(strcmp(argv[arg], "synth") == 0){
+        synthTraces(traces);
+    }
+    else{
+        for(; arg < argc; arg++){
+            Trace trace;
+            if(!loadTrace(argv[arg], trace)){
+                return 1;
+            }
+            traces.push_back(trace);
+        }
+    }
+
+    fprintf(stderr, "codecbench: %zu byte blocks, encoder state %zu bytes per series\n",
+        blockSize, sizeof(TimeSeriesEncoder));
+    printf("trace,samples,blocks,raw_bytes,encoded_bytes,ratio,bits_per_sample,encode_msamples_per_s,decode_msamples_per_s\n");
+    int failed = 0;
+    for(size_t i = 0; i < traces.size(); i++){
+        const Trace& trace = traces[i];
+        Result r;
+        if(!bench(trace, blockSize, r)){
+            failed++;
+            continue;
+        }
+        size_t raw = trace.samples.size() * TSC_RAW_SAMPLE_SIZE;
+        printf("%s,%zu,%zu,%zu,%zu,%.2f,%.2f,%.2f,%.2f\n", trace.name.c_str(), trace.samples.size(), r.blocks,
+            raw, r.encodedBytes, (double) raw / r.encodedBytes, 8.0 * r.encodedBytes / trace.samples.size(),
+            r.encodeSamplesPerS / 1e6, r.decodeSamplesPerS / 1e6);
+    }
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,160 @@
+/*
+ * cryptobench.cpp
+ * Description: checks FrameCipher against the RFC 8439 ChaCha20-Poly1305 test vector and
+ *              its own tamper and replay handling, then times sealing and opening each kind
+ *              of frame the nodes send, and what the 12 bytes of framing cost in airtime per
+ *              reading. See README.md
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#include "FrameCipher.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+/* Link model, as in tools/linksim: a notification costs its payload plus link layer, L2CAP
+   and ATT headers, an inter frame space and the empty packet acknowledging it */
+const int PACKET_OVERHEAD = 10 + 4 + 3;
+const int EMPTY_PACKET = 10;
+const double BYTE_US = 8;               //1M PHY
+const double IFS_US = 150;
+const int STREAM_RECORD_SIZE = 7;
+
+//RFC 8439 section 2.8.2
+static const char* RFC_PLAINTEXT = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, sunscreen would be it.";
+static const uint8_t RFC_AAD[] = { 0x50, 0x51, 0x52, 0x53, 0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7 };
+static const uint8_t RFC_NONCE[] = { 0x07, 0x00, 0x00, 0x00, 0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47 };
+static const uint8_t RFC_CIPHERTEXT[] = {
+    0xd3, 0x1a, 0x8d, 0x34, 0x64, 0x8e, 0x60, 0xdb, 0x7b, 0x86, 0xaf, 0xbc, 0x53, 0xef, 0x7e, 0xc2,
+    0xa4, 0xad, 0xed, 0x51, 0x29, 0x6e, 0x08, 0xfe, 0xa9, 0xe2, 0xb5, 0xa7, 0x36, 0xee, 0x62, 0xd6,
+    0x3d, 0xbe, 0xa4, 0x5e, 0x8c, 0xa9, 0x67, 0x12, 0x82, 0xfa, 0xfb, 0x69, 0xda, 0x92, 0x72, 0x8b,
+    0x1a, 0x71, 0xde, 0x0a, 0x9e, 0x06, 0x0b, 0x29, 0x05, 0xd6, 0xa5, 0xb6, 0x7e, 0xcd, 0x3b, 0x36,
+    0x92, 0xdd, 0xbd, 0x7f, 0x2d, 0x77, 0x8b, 0x8c, 0x98, 0x03, 0xae, 0xe3, 0x28, 0x09, 0x1b, 0x58,
+    0xfa, 0xb3, 0x24, 0xe4, 0xfa, 0xd6, 0x75, 0x94, 0x55, 0x85, 0x80, 0x8b, 0x48, 0x31, 0xd7, 0xbc,
+    0x3f, 0xf4, 0xde, 0xf0, 0x8e, 0x4b, 0x7a, 0x9d, 0xe5, 0x76, 0xd2, 0x65, 0x86, 0xce, 0xc6, 0x4b,
+    0x61, 0x16
+};
+static const uint8_t RFC_TAG[] = { 0x1a, 0xe1, 0x0b, 0x59, 0x4f, 0x09, 0xe2, 0x6a, 0x7e, 0x90, 0x2e, 0xcb, 0xd0, 0x60, 0x06, 0x91 };
+
+static bool checkRfcVector(){
+    uint8_t key[FRAME_KEY_SIZE];
+    for(size_t i = 0; i < FRAME_KEY_SIZE; i++){
+        key[i] = 0x80 + i;
+    }
+    size_t len = strlen(RFC_PLAINTEXT);
+    uint8_t out[256];
+    uint8_t tag[16];
+    FrameCipher::aeadEncrypt(key, RFC_NONCE, RFC_AAD, sizeof(RFC_AAD), (const uint8_t*) RFC_PLAINTEXT, len, out, tag);
+    return len == sizeof(RFC_CIPHERTEXT) && memcmp(out, RFC_CIPHERTEXT, len) == 0 && memcmp(tag, RFC_TAG, 16) == 0;
+}
+
+/* Every bit flipped in a sealed frame must make it fail to open, and the wrong channel too */
+static bool checkTamper(const FrameCipher& cipher){
+    uint8_t plain[64], sealed[64 + FRAME_OVERHEAD], opened[64];
+    for(size_t i = 0; i < sizeof(plain); i++){
+        plain[i] = i * 7;
+    }
+    size_t len = cipher.seal(FRAME_CHANNEL_STREAM, 42, plain, sizeof(plain), sealed);
+    uint32_t sequence;
+    if(!cipher.open(FRAME_CHANNEL_STREAM, sealed, len, opened, sequence) || sequence != 42 || memcmp(opened, plain, sizeof(plain)) != 0){
+        return false;
+    }
+    if(cipher.open(FRAME_CHANNEL_DIAGNOSTICS, sealed, len, opened, sequence)){
+        return false;
+    }
+    for(size_t bit = 0; bit < len * 8; bit++){
+        sealed[bit / 8] ^= 1 << (bit % 8);
+        bool opens = cipher.open(FRAME_CHANNEL_STREAM, sealed, len, opened, sequence);
+        sealed[bit / 8] ^= 1 << (bit % 8);
+        if(opens){
+            return false;
+        }
+    }
+    return !cipher.open(FRAME_CHANNEL_STREAM, sealed, len - 1, opened, sequence);
+}
+
+static bool checkReplay(){
+    ReplayWindow window;
+    bool ok = window.accept(10) && window.accept(12) && !window.accept(12) && window.accept(11)
+        && !window.accept(10) && window.accept(100) && !window.accept(60) && window.accept(90);
+    window.reset(500);
+    return ok && !window.accept(500) && !window.accept(480) && window.accept(501);
+}
+
+static double airtimeUs(size_t payload){
+    return (PACKET_OVERHEAD + payload + EMPTY_PACKET) * BYTE_US + 2 * IFS_US;
+}
+
+struct FrameKind {
+    const char* name;
+    size_t payload;
+};
+
+//the plain payload of each kind of frame, from the firmware
+static const FrameKind FRAMES[] = {
+    { "control rate hint", 10 },
+    { "stream, 1 record", 1 + 1 * STREAM_RECORD_SIZE },
+    { "stream, 4 records", 1 + 4 * STREAM_RECORD_SIZE },
+    { "stream, 16 records", 1 + 16 * STREAM_RECORD_SIZE },
+    { "diagnostics energy", 85 },
+    { "event window", 139 },
+    { "largest notification", FRAME_MAX_SIZE - FRAME_OVERHEAD },
+};
+
+int main(int argc, char** argv){
+    if(argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)){
+        fprintf(stderr, "usage: cryptobench [iterations]\n");
+        return 0;
+    }
+    long iterations = argc > 1 ? atol(argv[1]) : 200000;
+    if(iterations <= 0){
+        fprintf(stderr, "usage: cryptobench [iterations]\n");
+        return 1;
+    }
+
+    FrameCipher cipher;
+    uint8_t key[FRAME_KEY_SIZE];
+    FrameCipher::parseKey("000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f", key);
+    cipher.setKey(key);
+    bool rfc = checkRfcVector();
+    bool tamper = checkTamper(cipher);
+    bool replay = checkReplay();
+    printf("check,result\nrfc8439 vector,%s\ntamper,%s\nreplay,%s\n\n", rfc ? "pass" : "FAIL",
+        tamper ? "pass" : "FAIL", replay ? "pass" : "FAIL");
+    if(!rfc || !tamper || !replay){
+        return 1;
+    }
+
+    printf("frame,plain_bytes,sealed_bytes,seal_ns,open_ns,airtime_plain_us,airtime_sealed_us,airtime_increase_pct\n");
+    for(const FrameKind& frame : FRAMES){
+        uint8_t plain[256], sealed[256 + FRAME_OVERHEAD], opened[256];
+        for(size_t i = 0; i < frame.payload; i++){
+            plain[i] = rand();
+        }
+        size_t len = 0;
+        auto start = std::chrono::steady_clock::now();
+        for(long i = 0; i < iterations; i++){
+            len = cipher.seal(FRAME_CHANNEL_STREAM, (uint32_t) i, plain, frame.payload, sealed);
+            plain[0] ^= sealed[len - 1];    //keep each iteration dependent on the last
+        }
+        double sealNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+        uint32_t sequence = 0;
+        long opens = 0;
+        start = std::chrono::steady_clock::now();
+        for(long i = 0; i < iterations; i++){
+            opens += cipher.open(FRAME_CHANNEL_STREAM, sealed, len, opened, sequence);
+        }
+        double openNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+        if(opens != iterations){
+            fprintf(stderr, "%s: sealed frame failed to open\n", frame.name);
+            return 1;
+        }
+        double plainAir = airtimeUs(frame.payload);
+        double sealedAir = airtimeUs(len);
+        printf("%s,%zu,%zu,%.0f,%.0f,%.0f,%.0f,%.1f\n", frame.name, frame.payload, len, sealNs, openNs,
+            plainAir, sealedAir, 100 * (sealedAir - plainAir) / plainAir);
+    }
+    return 0;
+}
@@ -0,0 +1,940 @@
+/*
+ * decodefuzz.cpp
+ * Description: fuzzes every decoder that takes bytes off the air or the serial port, and
+ *              compares what they make of a fixed corpus against a recorded golden trace,
+ *              so a change in how any of them reads a frame shows up in review. See README.md
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#include "EnergyMeter.h"
+#include "EventDetector.h"
+#include "FrameCipher.h"
+#include "HealthMonitor.h"
+#include "NodeConfig.h"
+#include "QueryProtocol.h"
+#include "RelayRouter.h"
+#include "StreamFrame.h"
+#include "TimeSeriesCodec.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+typedef std::vector<uint8_t> Bytes;
+
+/* Small deterministic generator, so the golden corpus is the same on every host */
+class Rng {
+public:
+    explicit Rng(uint64_t seed) : state(seed ? seed : 0x9E3779B97F4A7C15ull) {}
+
+    uint32_t next(){
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return (uint32_t) (state >> 32);
+    }
+
+    uint32_t below(uint32_t bound){ return bound ? next() % bound : 0; }
+
+private:
+    uint64_t state;
+};
+
+static std::string format(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+static std::string format(const char* fmt, ...){
+    char line[512];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    return line;
+}
+
+static std::string hex(const Bytes& data){
+    std::string out;
+    char digits[3];
+    for(uint8_t byte : data){
+        snprintf(digits, sizeof(digits), "%02x", byte);
+        out += digits;
+    }
+    return out.empty() ? "-" : out;
+}
+
+static uint8_t fuzzKey[FRAME_KEY_SIZE];
+static FrameCipher fuzzCipher;
+
+/* A decoder under test. describe() decodes an input and says what came out, in one line that
+   only depends on the input. check() decodes it again and returns a broken invariant, or NULL */
+struct Decoder {
+    const char* name;
+    void (*seeds)(std::vector<Bytes>& out);
+    std::string (*describe)(const Bytes& input);
+    const char* (*check)(const Bytes& input);
+};
+
+//----------------------------------------------------------------- health reports
+
+static void healthSeeds(std::vector<Bytes>& out){
+    HealthMonitor monitor;
+    uint32_t now = 0;
+    for(int i = 0; i < 50; i++){
+        monitor.beginLoop(now);
+        monitor.enter((HealthSection) (1 + i % (HEALTH_SECTION_COUNT - 1)), now + 100);
+        monitor.leave(now + 100 + i * 4000);
+        now += 100 + i * 4000 + 500;
+        monitor.endLoop(now);
+    }
+    monitor.setQueueDepth(3, 12);
+    monitor.sampleHeap(41000);
+    HealthReport report;
+    Bytes encoded(HEALTH_REPORT_SIZE);
+    for(int reset = 0; reset < 3; reset++){
+        monitor.setResetReason(reset == 0 ? 0 : HEALTH_RESET_REASON_USER,
+            reset == 0 ? 0 : HEALTH_WATCHDOG_RESET_DATA | (reset == 1 ? HEALTH_SECTION_DHT : 0x7E));
+        monitor.report(report, 3600 + reset);
+        HealthMonitor::encode(report, encoded.data());
+        out.push_back(encoded);
+    }
+}
+
+static std::string healthDescribe(const Bytes& input){
+    HealthReport report;
+    if(!HealthMonitor::decode(input.data(), input.size(), report)){
+        return "reject";
+    }
+    char summary[400], sections[300];
+    HealthMonitor::formatSummary(report, summary, sizeof(summary));
+    HealthMonitor::formatSections(report, sections, sizeof(sections));
+    return std::string(summary) + " |" + sections;
+}
+
+static const char* healthCheck(const Bytes& input){
+    HealthReport report;
+    if(!HealthMonitor::decode(input.data(), input.size(), report)){
+        return input.size() >= HEALTH_REPORT_SIZE ? "rejected a full length report" : NULL;
+    }
+    Bytes encoded(HEALTH_REPORT_SIZE);
+    HealthMonitor::encode(report, encoded.data());
+    if(memcmp(encoded.data(), input.data(), HEALTH_REPORT_SIZE) != 0){
+        return "does not encode back to its input";
+    }
+    char line[400];
+    int written = HealthMonitor::formatSummary(report, line, sizeof(line));
+    return written < 0 || strlen(line) >= sizeof(line) ? "summary overran" : NULL;
+}
+
+//----------------------------------------------------------------- energy reports
+
+static void energySeeds(std::vector<Bytes>& out){
+    EnergyMeter meter;
+    meter.setBattery(1200, 3700);
+    meter.add(ENERGY_CPU_ACTIVE, 250000);
+    meter.add(ENERGY_CPU_IDLE, 9750000);
+    meter.addNotification(113);
+    meter.addLinkTime(10000, true);
+    meter.add(ENERGY_DHT, 40000);
+    meter.addReading();
+    meter.addReading();
+    EnergyReport report;
+    meter.report(report);
+    Bytes encoded(ENERGY_REPORT_SIZE);
+    EnergyMeter::encode(report, encoded.data());
+    out.push_back(encoded);
+    memset(&report, 0, sizeof(report));
+    EnergyMeter::encode(report, encoded.data());
+    out.push_back(encoded);
+}
+
+static std::string energyDescribe(const Bytes& input){
+    EnergyReport report;
+    if(!EnergyMeter::decode(input.data(), input.size(), report)){
+        return "reject";
+    }
+    char line[400];
+    EnergyMeter::formatSummary(report, line, sizeof(line));
+    std::string out = line;
+    for(int i = 0; i < ENERGY_STATE_COUNT; i++){
+        out += format(" %llu", (unsigned long long) report.charge[i]);
+    }
+    return out;
+}
+
+static const char* energyCheck(const Bytes& input){
+    EnergyReport report;
+    if(!EnergyMeter::decode(input.data(), input.size(), report)){
+        return input.size() >= ENERGY_REPORT_SIZE ? "rejected a full length report" : NULL;
+    }
+    Bytes encoded(ENERGY_REPORT_SIZE);
+    EnergyMeter::encode(report, encoded.data());
+    if(memcmp(encoded.data(), input.data(), ENERGY_REPORT_SIZE) != 0){
+        return "does not encode back to its input";
+    }
+    char line[400];
+    for(int i = 0; i < ENERGY_STATE_COUNT; i++){
+        int written = EnergyMeter::formatState(report, (EnergyState) i, line, sizeof(line));
+        if(written < 0 || strlen(line) >= sizeof(line)){
+            return "state line overran";
+        }
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------- event windows
+
+static void eventSeeds(std::vector<Bytes>& out){
+    EventWindow window;
+    window.triggerTime = 1790000000;
+    window.periodMs = 50;
+    window.preSamples = 48;
+    window.count = EVENT_WINDOW_SAMPLES;
+    window.zScore10 = -73;
+    for(int i = 0; i < EVENT_WINDOW_SAMPLES; i++){
+        window.samples[i] = i < 48 ? 2000 + i % 5 : 3100 - i;
+    }
+    Bytes encoded(EVENT_WINDOW_MAX_SIZE);
+    encoded.resize(EventDetector::encode(window, encoded.data()));
+    out.push_back(encoded);
+    window.count = 1;
+    window.preSamples = 0;
+    encoded.resize(EVENT_WINDOW_MAX_SIZE);
+    encoded.resize(EventDetector::encode(window, encoded.data()));
+    out.push_back(encoded);
+}
+
+static std::string eventDescribe(const Bytes& input){
+    EventWindow window;
+    if(!EventDetector::decode(input.data(), input.size(), window)){
+        return "reject";
+    }
+    std::string out = format("at %lu, %u ms apart, %u before of %u, z %d:", (unsigned long) window.triggerTime,
+        window.periodMs, window.preSamples, window.count, window.zScore10);
+    for(int i = 0; i < window.count; i++){
+        out += format(" %u", window.samples[i]);
+    }
+    return out;
+}
+
+static const char* eventCheck(const Bytes& input){
+    EventWindow window;
+    if(!EventDetector::decode(input.data(), input.size(), window)){
+        return NULL;
+    }
+    if(window.count > EVENT_WINDOW_SAMPLES || window.preSamples >= window.count){
+        return "accepted a window it can't hold";
+    }
+    Bytes encoded(EVENT_WINDOW_MAX_SIZE);
+    size_t length = EventDetector::encode(window, encoded.data());
+    if(length > input.size() || memcmp(encoded.data(), input.data(), length) != 0){
+        return "does not encode back to its input";
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------- node frames, once opened
+
+static void putRecord(Bytes& frame, uint8_t sensor, uint16_t value, uint32_t timestamp){
+    uint8_t record[STREAM_RECORD_SIZE] = { sensor, (uint8_t) value, (uint8_t) (value >> 8), (uint8_t) timestamp,
+        (uint8_t) (timestamp >> 8), (uint8_t) (timestamp >> 16), (uint8_t) (timestamp >> 24) };
+    frame.insert(frame.end(), record, record + STREAM_RECORD_SIZE);
+}
+
+static void streamSeeds(std::vector<Bytes>& out){
+    Bytes frame(1, 6);
+    for(uint8_t i = 0; i < 5; i++){
+        putRecord(frame, i % STREAM_SENSORS, i == 0 ? 0xFFE9 : 300 + i * 211, 1790000000 + i);
+    }
+    putRecord(frame, 0x09, 42, 1790000005);//from a sensor this clusterhead doesn't know, skipped
+    out.push_back(frame);
+    frame.assign(1, 0);
+    out.push_back(frame);
+}
+
+static std::string streamDescribe(const Bytes& input){
+    StreamFrameReader reader;
+    StreamRecord record;
+    if(!reader.begin(input.data(), input.size())){
+        return "reject";
+    }
+    std::string out = format("claims %u%s:", reader.claimedCount(), reader.truncated() ? ", truncated" : "");
+    while(reader.next(record)){
+        out += format(" [%u %u at %lu]", record.sensor, record.value, (unsigned long) record.timestamp);
+    }
+    return out + format(", %u skipped", reader.skipped());
+}
+
+static const char* streamCheck(const Bytes& input){
+    StreamFrameReader reader;
+    StreamRecord record;
+    if(!reader.begin(input.data(), input.size())){
+        return input.empty() ? NULL : "rejected a frame with a count";
+    }
+    size_t present = (input.size() - 1) / STREAM_RECORD_SIZE;
+    if(reader.truncated() != (input[0] > present)){
+        return "wrong about being truncated";
+    }
+    //every record returned has to be the next one in the frame for a sensor in range
+    size_t position = 0;
+    while(reader.next(record)){
+        while(position < present && input[1 + position * STREAM_RECORD_SIZE] >= STREAM_SENSORS){
+            position++;
+        }
+        if(position >= present || position >= input[0]){
+            return "returned a record past the end";
+        }
+        Bytes encoded;
+        putRecord(encoded, record.sensor, record.value, record.timestamp);
+        if(memcmp(encoded.data(), &input[1 + position * STREAM_RECORD_SIZE], STREAM_RECORD_SIZE) != 0){
+            return "does not encode back to its input";
+        }
+        position++;
+    }
+    return NULL;
+}
+
+static void diagnosticsSeeds(std::vector<Bytes>& out){
+    std::vector<Bytes> reports;
+    energySeeds(reports);
+    Bytes frame(1, DIAGNOSTICS_ENERGY);
+    frame.insert(frame.end(), reports[0].begin(), reports[0].end());
+    out.push_back(frame);
+    reports.clear();
+    healthSeeds(reports);
+    frame.assign(1, DIAGNOSTICS_HEALTH);
+    frame.insert(frame.end(), reports[1].begin(), reports[1].end());
+    out.push_back(frame);
+    ConfigStatusReport config = { 7, CONFIG_STATUS_TRIAL, 6 };
+    frame.assign(1 + CONFIG_STATUS_SIZE, DIAGNOSTICS_CONFIG);
+    configStatusEncode(config, &frame[1]);
+    out.push_back(frame);
+}
+
+static std::string diagnosticsDescribe(const Bytes& input){
+    DiagnosticsFrame frame;
+    if(!streamDecodeDiagnostics(input.data(), input.size(), frame)){
+        return "reject";
+    }
+    Bytes payload(input.begin() + 1, input.end());
+    switch(frame.type){
+        case DIAGNOSTICS_ENERGY: return "energy " + energyDescribe(payload);
+        case DIAGNOSTICS_HEALTH: return "health " + healthDescribe(payload);
+        default: return format("config version %u %s, using %u", frame.config.version,
+            configStatusName(frame.config.status), frame.config.inUse);
+    }
+}
+
+static const char* diagnosticsCheck(const Bytes& input){
+    DiagnosticsFrame frame;
+    bool accepted = streamDecodeDiagnostics(input.data(), input.size(), frame);
+    if(input.empty()){
+        return accepted ? "accepted an empty frame" : NULL;
+    }
+    if(frame.type != input[0]){
+        return "did not say which type it was";
+    }
+    size_t full = frame.type == DIAGNOSTICS_ENERGY ? ENERGY_REPORT_SIZE
+        : frame.type == DIAGNOSTICS_HEALTH ? HEALTH_REPORT_SIZE
+        : frame.type == DIAGNOSTICS_CONFIG ? CONFIG_STATUS_SIZE : 0;
+    if(full == 0){
+        return accepted ? "accepted an unknown type" : NULL;
+    }
+    if(!accepted){
+        return input.size() - 1 >= full ? "rejected a full length report" : NULL;
+    }
+    if(input.size() - 1 < full){
+        return "accepted a short report";
+    }
+    Bytes encoded(full);
+    if(frame.type == DIAGNOSTICS_ENERGY){
+        EnergyMeter::encode(frame.energy, encoded.data());
+    }
+    else if(frame.type == DIAGNOSTICS_HEALTH){
+        HealthMonitor::encode(frame.health, encoded.data());
+    }
+    else{
+        configStatusEncode(frame.config, encoded.data());
+    }
+    return memcmp(encoded.data(), &input[1], full) != 0 ? "does not encode back to its input" : NULL;
+}
+
+static void eventFrameSeeds(std::vector<Bytes>& out){
+    std::vector<Bytes> windows;
+    eventSeeds(windows);
+    for(uint8_t i = 0; i < windows.size(); i++){
+        Bytes frame(1, i == 0 ? 3 : 0);
+        frame.insert(frame.end(), windows[i].begin(), windows[i].end());
+        out.push_back(frame);
+    }
+}
+
+static std::string eventFrameDescribe(const Bytes& input){
+    uint8_t sensor;
+    EventWindow window;
+    if(!streamDecodeEvent(input.data(), input.size(), sensor, window)){
+        return "reject";
+    }
+    return format("sensor %u ", sensor) + eventDescribe(Bytes(input.begin() + 1, input.end()));
+}
+
+static const char* eventFrameCheck(const Bytes& input){
+    uint8_t sensor;
+    EventWindow window;
+    if(!streamDecodeEvent(input.data(), input.size(), sensor, window)){
+        return NULL;
+    }
+    if(sensor >= STREAM_SENSORS || sensor != input[0]){
+        return "accepted a sensor out of range";
+    }
+    return eventCheck(Bytes(input.begin() + 1, input.end()));
+}
+
+//----------------------------------------------------------------- relay beacons and batches
+
+static void beaconSeeds(std::vector<Bytes>& out){
+    RelayBeacon beacon;
+    beacon.clusterId = 0x1A2B3C4D;
+    beacon.hops = 2;
+    beacon.parentId = 0x0BADF00D;
+    beacon.openSlots = 3;
+    Bytes encoded(RELAY_BEACON_SIZE);
+    relayEncodeBeacon(beacon, encoded.data());
+    out.push_back(encoded);
+    beacon.hops = RELAY_NO_ROUTE;
+    beacon.parentId = 0;
+    beacon.openSlots = RELAY_MAX_CHILDREN;
+    relayEncodeBeacon(beacon, encoded.data());
+    out.push_back(encoded);
+}
+
+static std::string beaconDescribe(const Bytes& input){
+    RelayBeacon beacon;
+    if(!relayDecodeBeacon(input.data(), input.size(), beacon)){
+        return "reject";
+    }
+    return format("cluster %08lx, %u hops, parent %08lx, %u child slots free", (unsigned long) beacon.clusterId, beacon.hops,
+        (unsigned long) beacon.parentId, beacon.openSlots);
+}
+
+static const char* beaconCheck(const Bytes& input){
+    RelayBeacon beacon;
+    if(!relayDecodeBeacon(input.data(), input.size(), beacon)){
+        return NULL;
+    }
+    Bytes encoded(RELAY_BEACON_SIZE);
+    size_t length = relayEncodeBeacon(beacon, encoded.data());
+    if(length > input.size() || memcmp(encoded.data(), input.data(), length) != 0){
+        return "does not encode back to its input";
+    }
+    return NULL;
+}
+
+static void attachSeeds(std::vector<Bytes>& out){
+    RelayAttach attach = { 0x0BADF00D, 12 };
+    Bytes encoded(RELAY_ATTACH_SIZE);
+    relayEncodeAttach(attach, encoded.data());
+    out.push_back(encoded);
+    attach.grant = 0;
+    relayEncodeAttach(attach, encoded.data());
+    out.push_back(encoded);
+}
+
+static std::string attachDescribe(const Bytes& input){
+    RelayAttach attach;
+    if(!relayDecodeAttach(input.data(), input.size(), attach)){
+        return "reject";
+    }
+    return format("parent %08lx, room for %u blocks", (unsigned long) attach.parentId, attach.grant);
+}
+
+static const char* attachCheck(const Bytes& input){
+    RelayAttach attach;
+    if(!relayDecodeAttach(input.data(), input.size(), attach)){
+        return NULL;
+    }
+    if(attach.parentId == 0){
+        return "accepted a grant from no parent";
+    }
+    Bytes encoded(RELAY_ATTACH_SIZE);
+    size_t length = relayEncodeAttach(attach, encoded.data());
+    if(length > input.size() || memcmp(encoded.data(), input.data(), length) != 0){
+        return "does not encode back to its input";
+    }
+    return NULL;
+}
+
+static void batchSeeds(std::vector<Bytes>& out){
+    Bytes batch(FRAME_MAX_SIZE - FRAME_OVERHEAD);
+    uint8_t block[96];
+    for(size_t i = 0; i < sizeof(block); i++){
+        block[i] = i * 37 + 11;
+    }
+    RelayBatchWriter writer;
+    writer.begin(batch.data(), batch.size());
+    writer.add(0x1A2B3C4D, 0x3C01, 7, 0, block, 40);
+    writer.add(0x1A2B3C4D, 0x3C01, 8, 3, block + 40, 24);
+    writer.add(0x55AA55AA, 0x0002, 1, 5, block, 96);
+    batch.resize(writer.length());
+    out.push_back(batch);
+    batch.assign(1, 0);
+    out.push_back(batch);
+}
+
+static std::string batchDescribe(const Bytes& input){
+    RelayBatchReader reader;
+    RelayEntry entry;
+    reader.begin(input.data(), input.size());
+    std::string out = "entries";
+    int entries = 0;
+    while(reader.next(entry)){
+        out += format(" [%08lx/%04x #%lu series %u, %u bytes crc %04x]", (unsigned long) entry.origin,
+            entry.epoch, (unsigned long) entry.sequence, entry.series, entry.length, qpCrc16(entry.block, entry.length));
+        entries++;
+    }
+    return entries > 0 ? out : "reject";
+}
+
+static const char* batchCheck(const Bytes& input){
+    RelayBatchReader reader;
+    RelayEntry entry;
+    reader.begin(input.data(), input.size());
+    int entries = 0;
+    while(reader.next(entry)){
+        if(entry.block < input.data() || entry.block + entry.length > input.data() + input.size()){
+            return "entry points outside the batch";
+        }
+        if(++entries > 255){
+            return "more entries than the count allows";
+        }
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------- config blobs
+
+static NodeSettings configDefaults(){
+    NodeSettings defaults;
+    memset(&defaults, 0, sizeof(defaults));
+    for(int i = 0; i < CONFIG_SENSOR_COUNT; i++){
+        defaults.sensors[i].minDelay = 1000;
+        defaults.sensors[i].maxDelay = 10000;
+        defaults.sensors[i].threshold = 5;
+        defaults.sensors[i].pin = i;
+        defaults.sensors[i].scale = 1;
+    }
+    defaults.recordsPerNotification = 8;
+    defaults.notificationsPerLoop = 4;
+    defaults.loopDelay = 100;
+    defaults.diagnosticsInterval = 60000;
+    return defaults;
+}
+
+static void configSeeds(std::vector<Bytes>& out){
+    Bytes blob(CONFIG_MAX_SIZE);
+    ConfigWriter writer;
+    writer.begin(blob.data(), blob.size(), 12);
+    writer.addText("light.min=2000,light.max=30000,distance.threshold=3,sound.scale=0.5,sound.offset=-2,"
+        "records=12,notifications=6,loop=250,diagnostics=300000");
+    blob.resize(writer.length());
+    out.push_back(blob);
+    blob.resize(CONFIG_MAX_SIZE);
+    writer.begin(blob.data(), blob.size(), 13);
+    writer.pin(CONFIG_SENSOR_TEMPERATURE, 4);
+    writer.calibration(CONFIG_SENSOR_HUMIDITY, 1.25f, 0);
+    blob.resize(writer.length());
+    out.push_back(blob);
+}
+
+static std::string configDescribe(const Bytes& input){
+    NodeSettings settings;
+    if(!configParse(input.data(), input.size(), configDefaults(), settings)){
+        return "reject";
+    }
+    std::string out = format("version %u, records %u, notifications %u, loop %u, diagnostics %lu", settings.version,
+        settings.recordsPerNotification, settings.notificationsPerLoop, settings.loopDelay,
+        (unsigned long) settings.diagnosticsInterval);
+    for(int i = 0; i < CONFIG_SENSOR_COUNT; i++){
+        const SensorSettings& sensor = settings.sensors[i];
+        out += format(" | %s %lu-%lu th %ld pin %u x%g %+g", CONFIG_SENSOR_NAMES[i], (unsigned long) sensor.minDelay,
+            (unsigned long) sensor.maxDelay, (long) sensor.threshold, sensor.pin, sensor.scale, sensor.offset);
+    }
+    return out;
+}
+
+static const char* configCheck(const Bytes& input){
+    NodeSettings settings;
+    if(!configParse(input.data(), input.size(), configDefaults(), settings)){
+        return NULL;
+    }
+    if(settings.version != configVersion(input.data(), input.size())){
+        return "parsed a different version to configVersion";
+    }
+    if(settings.recordsPerNotification == 0 || settings.recordsPerNotification > CONFIG_MAX_RECORDS_PER_NOTIFICATION
+        || settings.notificationsPerLoop == 0 || settings.notificationsPerLoop > CONFIG_MAX_NOTIFICATIONS_PER_LOOP
+        || settings.loopDelay < CONFIG_MIN_LOOP_DELAY || settings.loopDelay > CONFIG_MAX_LOOP_DELAY
+        || settings.diagnosticsInterval < CONFIG_MIN_DIAGNOSTICS_INTERVAL){
+        return "accepted a setting out of range";
+    }
+    for(int i = 0; i < CONFIG_SENSOR_COUNT; i++){
+        if(settings.sensors[i].minDelay > settings.sensors[i].maxDelay){
+            return "accepted a minimum delay above the maximum";
+        }
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------- sealed frames
+
+static void cipherSeeds(std::vector<Bytes>& out){
+    uint8_t plain[113];
+    for(size_t i = 0; i < sizeof(plain); i++){
+        plain[i] = i ^ 0x5C;
+    }
+    Bytes sealed(sizeof(plain) + FRAME_OVERHEAD);
+    fuzzCipher.seal(FRAME_CHANNEL_STREAM, 4100, plain, sizeof(plain), sealed.data());
+    out.push_back(sealed);
+    sealed.resize(3 + FRAME_OVERHEAD);
+    fuzzCipher.seal(FRAME_CHANNEL_STREAM, 0, plain, 3, sealed.data());
+    out.push_back(sealed);
+    sealed.resize(FRAME_OVERHEAD);
+    fuzzCipher.seal(FRAME_CHANNEL_STREAM, 0xFFFFFFFE, plain, 0, sealed.data());
+    out.push_back(sealed);
+}
+
+static std::string cipherDescribe(const Bytes& input){
+    uint8_t plain[FRAME_MAX_SIZE];
+    uint32_t sequence;
+    if(input.size() > FRAME_MAX_SIZE || !fuzzCipher.open(FRAME_CHANNEL_STREAM, input.data(), input.size(), plain, sequence)){
+        return "reject";
+    }
+    size_t length = input.size() - FRAME_OVERHEAD;
+    return format("sequence %lu, %u bytes crc %04x", (unsigned long) sequence, (unsigned) length, qpCrc16(plain, length));
+}
+
+static const char* cipherCheck(const Bytes& input){
+    uint8_t plain[FRAME_MAX_SIZE];
+    uint32_t sequence;
+    if(input.size() > FRAME_MAX_SIZE || !fuzzCipher.open(FRAME_CHANNEL_STREAM, input.data(), input.size(), plain, sequence)){
+        return NULL;
+    }
+    //whatever opens has to be exactly what sealing it again gives
+    Bytes sealed(input.size());
+    fuzzCipher.seal(FRAME_CHANNEL_STREAM, sequence, plain, input.size() - FRAME_OVERHEAD, sealed.data());
+    if(sealed != input){
+        return "opened a frame that was not sealed under the key";
+    }
+    if(fuzzCipher.open(FRAME_CHANNEL_CONTROL, input.data(), input.size(), plain, sequence)){
+        return "opened on another channel";
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------- query frames and blocks
+
+static Bytes queryFrame(uint8_t type, const Bytes& payload){
+    Bytes frame(QP_HEADER_SIZE + payload.size() + QP_CRC_SIZE);
+    frame.resize(qpEncodeFrame(type, payload.data(), payload.size(), frame.data()));
+    return frame;
+}
+
+static Bytes seriesBlock(uint32_t start, int samples){
+    Bytes block(QP_MAX_PAYLOAD - 5);
+    TimeSeriesEncoder encoder;
+    encoder.begin(block.data(), block.size());
+    for(int i = 0; i < samples; i++){
+        if(!encoder.append(start + i * 10 + (i % 7 == 3), 2150 + (i * 13) % 40 - (i % 11) * 3)){
+            break;
+        }
+    }
+    block.resize(encoder.finish());
+    return block;
+}
+
+static void querySeeds(std::vector<Bytes>& out){
+    Bytes range(9);
+    range[0] = 2;
+    qpPut32(&range[1], 1790000000);
+    qpPut32(&range[5], 1790003600);
+    Bytes stream = queryFrame(QP_REQ_RANGE, range);
+    out.push_back(stream);
+    //log text around a frame, and a frame with an empty payload
+    const char* text = "0000012345 [app] INFO: ";
+    stream.assign(text, text + strlen(text));
+    Bytes block = seriesBlock(1790000000, 60);
+    Bytes payload(5);
+    payload[0] = 1;
+    qpPut32(&payload[1], 42);
+    payload.insert(payload.end(), block.begin(), block.end());
+    Bytes frame = queryFrame(QP_RESP_BLOCK, payload);
+    stream.insert(stream.end(), frame.begin(), frame.end());
+    frame = queryFrame(QP_REQ_LATEST, Bytes());
+    stream.insert(stream.end(), frame.begin(), frame.end());
+    out.push_back(stream);
+}
+
+static std::string queryDescribe(const Bytes& input){
+    QueryFrameParser parser;
+    std::string out;
+    for(uint8_t byte : input){
+        if(!parser.feed(byte)){
+            continue;
+        }
+        out += format("[type %02x, %u bytes", parser.type(), parser.length());
+        //a block response carries a codec block after its series and sequence
+        TimeSeriesDecoder decoder;
+        if(parser.type() == QP_RESP_BLOCK && parser.length() > 5 && decoder.begin(parser.payload() + 5, parser.length() - 5)){
+            uint32_t timestamp;
+            int32_t value;
+            int samples = 0;
+            uint16_t crc = 0xFFFF;
+            while(decoder.next(timestamp, value)){
+                uint8_t sample[8];
+                qpPut32(sample, timestamp);
+                qpPut32(sample + 4, value);
+                crc = qpCrc16(sample, sizeof(sample), crc);
+                samples++;
+            }
+            out += format(", block of %u, %d decoded crc %04x", decoder.count(), samples, crc);
+        }
+        out += "]";
+    }
+    return format("%s, crc errors %lu", out.empty() ? "reject" : out.c_str(), (unsigned long) parser.crcErrors());
+}
+
+static const char* queryCheck(const Bytes& input){
+    QueryFrameParser parser;
+    for(uint8_t byte : input){
+        if(!parser.feed(byte)){
+            continue;
+        }
+        if(parser.length() > QP_MAX_PAYLOAD){
+            return "accepted a payload longer than the maximum";
+        }
+        //every accepted frame has to be the one its own fields encode to
+        Bytes payload(parser.payload(), parser.payload() + parser.length());
+        Bytes frame = queryFrame(parser.type(), payload);
+        if(input.size() < frame.size() || std::search(input.begin(), input.end(), frame.begin(), frame.end()) == input.end()){
+            return "accepted a frame that is not in the input";
+        }
+    }
+    //the codec reads whatever a block response carries, so give it the raw input too
+    TimeSeriesDecoder decoder;
+    if(decoder.begin(input.data(), input.size())){
+        uint32_t timestamp;
+        int32_t value;
+        int samples = 0;
+        while(decoder.next(timestamp, value)){
+            if(++samples > decoder.count()){
+                return "decoded more samples than the block holds";
+            }
+        }
+    }
+    return NULL;
+}
+
+//-----------------------------------------------------------------
+
+static const Decoder DECODERS[] = {
+    { "health", healthSeeds, healthDescribe, healthCheck },
+    { "energy", energySeeds, energyDescribe, energyCheck },
+    { "event", eventSeeds, eventDescribe, eventCheck },
+    { "stream", streamSeeds, streamDescribe, streamCheck },
+    { "diag", diagnosticsSeeds, diagnosticsDescribe, diagnosticsCheck },
+    { "evframe", eventFrameSeeds, eventFrameDescribe, eventFrameCheck },
+    { "beacon", beaconSeeds, beaconDescribe, beaconCheck },
+    { "attach", attachSeeds, attachDescribe, attachCheck },
+    { "relay", batchSeeds, batchDescribe, batchCheck },
+    { "config", configSeeds, configDescribe, configCheck },
+    { "cipher", cipherSeeds, cipherDescribe, cipherCheck },
+    { "query", querySeeds, queryDescribe, queryCheck },
+};
+const int DECODER_COUNT = sizeof(DECODERS) / sizeof(DECODERS[0]);
+
+/* Change an input the ways a bad link or a bad actor would: flip bits, set bytes to the
+   values that end up as lengths and counts, cut it short, or run on past its end */
+static Bytes mutate(const Bytes& seed, Rng& rng){
+    Bytes out = seed;
+    int edits = 1 + rng.below(4);
+    for(int i = 0; i < edits; i++){
+        switch(rng.below(6)){
+            case 0:
+                if(!out.empty()){
+                    out[rng.below(out.size())] ^= 1 << rng.below(8);
+                }
+                break;
+            case 1: {
+                static const uint8_t INTERESTING[] = { 0x00, 0x01, 0x7F, 0x80, 0xFE, 0xFF, 0x40, 0x10 };
+                if(!out.empty()){
+                    out[rng.below(out.size())] = INTERESTING[rng.below(sizeof(INTERESTING))];
+                }
+                break;
+            }
+            case 2:
+                out.resize(rng.below(out.size() + 1));
+                break;
+            case 3:
+                for(int extra = 1 + rng.below(16); extra > 0; extra--){
+                    out.push_back(rng.next());
+                }
+                break;
+            case 4:
+                if(!out.empty()){
+                    out[rng.below(out.size())] = rng.next();
+                }
+                break;
+            default: {
+                //repeat a stretch, as a retransmission spliced into a frame would
+                if(out.size() > 1){
+                    size_t from = rng.below(out.size());
+                    size_t length = 1 + rng.below(out.size() - from);
+                    Bytes stretch(out.begin() + from, out.begin() + from + length);
+                    out.insert(out.begin() + rng.below(out.size()), stretch.begin(), stretch.end());
+                }
+                break;
+            }
+        }
+    }
+    return out;
+}
+
+/* The corpus the golden trace records: each seed, every length it can be cut to, and a fixed
+   set of mutations of it */
+static void goldenCorpus(const Decoder& decoder, std::vector<Bytes>& out){
+    std::vector<Bytes> seeds;
+    decoder.seeds(seeds);
+    Rng rng(0xDEC0DE00 + seeds.size());
+    for(const Bytes& seed : seeds){
+        out.push_back(seed);
+        for(size_t length = 0; length < seed.size(); length += 1 + seed.size() / 16){
+            out.push_back(Bytes(seed.begin(), seed.begin() + length));
+        }
+        for(int i = 0; i < 24; i++){
+            out.push_back(mutate(seed, rng));
+        }
+    }
+}
+
+static void goldenTrace(std::vector<std::string>& lines){
+    for(int d = 0; d < DECODER_COUNT; d++){
+        std::vector<Bytes> corpus;
+        goldenCorpus(DECODERS[d], corpus);
+        for(const Bytes& input : corpus){
+            lines.push_back(std::string(DECODERS[d].name) + " " + hex(input) + " : " + DECODERS[d].describe(input));
+        }
+    }
+}
+
+static int runGolden(const char* path, bool write){
+    std::vector<std::string> lines;
+    goldenTrace(lines);
+    if(write){
+        FILE* file = fopen(path, "w");
+        if(file == NULL){
+            perror(path);
+            return 1;
+        }
+        for(const std::string& line : lines){
+            fprintf(file, "%s\n", line.c_str());
+        }
+        fclose(file);
+        printf("Wrote %u lines to %s\n", (unsigned) lines.size(), path);
+        return 0;
+    }
+    FILE* file = fopen(path, "r");
+    if(file == NULL){
+        perror(path);
+        return 1;
+    }
+    std::vector<std::string> expected;
+    std::string line;
+    int c;
+    while((c = fgetc(file)) != EOF){
+        if(c == '\n'){
+            expected.push_back(line);
+            line.clear();
+        }
+        else{
+            line += (char) c;
+        }
+    }
+    fclose(file);
+    int differences = 0;
+    size_t count = lines.size() > expected.size() ? lines.size() : expected.size();
+    for(size_t i = 0; i < count; i++){
+        const std::string& want = i < expected.size() ? expected[i] : "(nothing)";
+        const std::string& got = i < lines.size() ? lines[i] : "(nothing)";
+        if(want != got){
+            if(differences < 10){
+                printf("line %u differs\n  golden: %s\n  now:    %s\n", (unsigned) i + 1, want.c_str(), got.c_str());
+            }
+            differences++;
+        }
+    }
+    printf("%u lines, %d differ from %s\n", (unsigned) lines.size(), differences, path);
+    return differences > 0 ? 1 : 0;
+}
+
+static int runFuzz(uint32_t iterations, uint64_t seed){
+    Rng rng(seed);
+    int failures = 0;
+    for(int d = 0; d < DECODER_COUNT; d++){
+        const Decoder& decoder = DECODERS[d];
+        std::vector<Bytes> seeds;
+        decoder.seeds(seeds);
+        uint32_t accepted = 0;
+        for(uint32_t i = 0; i < iterations; i++){
+            Bytes input;
+            if(i % 8 == 0){
+                //pure noise, as well as mutations of what the decoder expects
+                input.resize(rng.below(FRAME_MAX_SIZE + 16));
+                for(uint8_t& byte : input){
+                    byte = rng.next();
+                }
+            }
+            else{
+                input = mutate(seeds[rng.below(seeds.size())], rng);
+            }
+            const char* broken = decoder.check(input);
+            if(decoder.describe(input).compare(0, 6, "reject") != 0){
+                accepted++;
+            }
+            if(broken != NULL){
+                if(failures < 10){
+                    printf("%s: %s, input %s\n", decoder.name, broken, hex(input).c_str());
+                }
+                failures++;
+            }
+        }
+        printf("%-8s %u inputs, %u accepted\n", decoder.name, iterations, accepted);
+    }
+    printf("%d failures\n", failures);
+    return failures > 0 ? 1 : 0;
+}
+
+static void usage(){
+    fprintf(stderr, "usage: decodefuzz fuzz [iterations] [seed]\n"
+                    "       decodefuzz golden <file>\n"
+                    "       decodefuzz golden --write <file>\n");
+}
+
+int main(int argc, char** argv){
+    for(size_t i = 0; i < FRAME_KEY_SIZE; i++){
+        fuzzKey[i] = 0xA0 + i;
+    }
+    fuzzCipher.setKey(fuzzKey);
+    if(argc >= 2 && strcmp(argv[1], "fuzz") == 0){
+        uint32_t iterations = argc >= 3 ? strtoul(argv[2], NULL, 10) : 200000;
+        uint64_t seed = argc >= 4 ? strtoull(argv[3], NULL, 0) : 1;
+        return runFuzz(iterations, seed);
+    }
+    if(argc == 3 && strcmp(argv[1], "golden") == 0){
+        return runGolden(argv[2], false);
+    }
+    if(argc == 4 && strcmp(argv[1], "golden") == 0 && strcmp(argv[2], "--write") == 0){
+        return runGolden(argv[3], true);
+    }
+    usage();
+    return 2;
+}
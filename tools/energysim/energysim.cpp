@@ -0,0 +1,157 @@
+/*
+ * energysim.cpp
+ * Description: runs sensor node 1's loop on the host against a synthetic day of signals,
+ *              through the firmware's AdaptiveSampler and EnergyMeter, and prints the same
+ *              energy report the node sends the clusterhead, for each scheduling and
+ *              batching policy. See README.md
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#include "AdaptiveSampler.h"
+#include "EnergyMeter.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+
+//matches sensorNode1.ino
+static const uint32_t LOOP_DELAY = 100;
+static const uint32_t RECORDS_PER_NOTIFICATION = 16;
+static const uint32_t RECORD_SIZE = 7;
+
+/* How long the firmware spends on each part of a loop, in micros */
+static const uint32_t LOOP_OVERHEAD_US = 300;       //sampler checks, connection state
+static const uint32_t READING_OVERHEAD_US = 2000;   //logging and queueing a reading
+static const uint32_t DHT_READ_US = 25000;          //start signal plus 40 bit transfer
+static const uint32_t ADC_READ_US = 40;
+static const uint32_t RANGEFINDER_BASE_US = 500;    //trigger pulse and echo set up
+static const uint32_t RANGEFINDER_US_PER_CM = 58;   //round trip of the echo
+
+struct SensorConfig {
+    const char* name;
+    uint32_t minDelay;
+    uint32_t maxDelay;
+    int32_t threshold;
+    int valueSize;
+};
+
+//node 1's sensors in samplers array order: temperature, humidity, light, distance
+static const SensorConfig SENSORS[4] = {
+    { "temperature", 10000, 120000, 1, 1 },
+    { "humidity", 10000, 120000, 2, 1 },
+    { "light", 1000, 40000, 20, 2 },
+    { "distance", 200, 6400, 5, 1 },
+};
+
+enum Schedule { SCHEDULE_FASTEST, SCHEDULE_ADAPTIVE, SCHEDULE_SLOWEST };
+static const char* SCHEDULE_NAMES[] = { "fixed fastest", "adaptive", "fixed slowest" };
+
+/* A synthetic day: temperature and humidity drift, light follows the sun with clouds,
+   distance sits at the far wall with someone walking past every few minutes */
+struct Signals {
+    std::mt19937 rng;
+    double temperature = 22, humidity = 50;
+    uint32_t walkUntil = 0;
+
+    explicit Signals(unsigned seed) : rng(seed) {}
+
+    void read(uint32_t now, int32_t* values){
+        std::normal_distribution<double> drift(0, 0.002);
+        temperature += drift(rng);
+        humidity += drift(rng) * 2;
+        double hour = (now / 3600000.0);
+        double sun = hour > 6 && hour < 18 ? 400 * sin((hour - 6) / 12 * 3.14159) : 0;
+        std::uniform_int_distribution<int> cloud(-15, 15);
+        if(walkUntil < now && rng() % 2400 == 0){
+            walkUntil = now + 8000;
+        }
+        values[0] = (int32_t) temperature;
+        values[1] = (int32_t) humidity;
+        values[2] = (int32_t) sun + 30 + cloud(rng);
+        values[3] = now < walkUntil ? 60 + (int32_t) ((walkUntil - now) / 100) : 250;
+    }
+};
+
+static void run(Schedule schedule, bool batched, uint32_t durationMs, unsigned seed){
+    EnergyMeter meter;
+    Signals signals(seed);
+    AdaptiveSampler* samplers[4];
+    for(int i = 0; i < 4; i++){
+        const SensorConfig& sensor = SENSORS[i];
+        uint32_t minDelay = schedule == SCHEDULE_SLOWEST ? sensor.maxDelay : sensor.minDelay;
+        uint32_t maxDelay = schedule == SCHEDULE_FASTEST ? sensor.minDelay : sensor.maxDelay;
+        samplers[i] = new AdaptiveSampler(minDelay, maxDelay, sensor.threshold);
+    }
+
+    //like the firmware, a loop takes its busy time plus the delay
+    for(uint64_t nowUs = 0; nowUs < (uint64_t) durationMs * 1000; ){
+        uint32_t now = nowUs / 1000;
+        int32_t values[4];
+        signals.read(now, values);
+        uint32_t busy = LOOP_OVERHEAD_US;
+        uint32_t queued = 0;
+        for(int i = 0; i < 4; i++){
+            if(!samplers[i]->due(now)){
+                continue;
+            }
+            samplers[i]->update(now, values[i]);
+            uint32_t conversion = i < 2 ? DHT_READ_US : i == 2 ? ADC_READ_US
+                : RANGEFINDER_BASE_US + RANGEFINDER_US_PER_CM * values[3];
+            meter.add(i < 2 ? ENERGY_DHT : i == 2 ? ENERGY_ADC : ENERGY_RANGEFINDER, conversion);
+            meter.addReading();
+            busy += conversion + READING_OVERHEAD_US;
+            if(batched){
+                queued++;
+            }
+            else{
+                //one notification per reading, [value][send time u64]
+                meter.addNotification(SENSORS[i].valueSize + 8);
+            }
+        }
+        while(queued > 0){
+            uint32_t records = queued < RECORDS_PER_NOTIFICATION ? queued : RECORDS_PER_NOTIFICATION;
+            meter.addNotification(1 + records * RECORD_SIZE);
+            queued -= records;
+        }
+        meter.add(ENERGY_CPU_ACTIVE, busy);
+        meter.add(ENERGY_CPU_IDLE, LOOP_DELAY * 1000);
+        meter.addLinkTime(busy / 1000 + LOOP_DELAY, true);
+        nowUs += busy + LOOP_DELAY * 1000;
+    }
+
+    EnergyReport report;
+    meter.report(report);
+    char line[160];
+    printf("%s, %s:\n", SCHEDULE_NAMES[schedule], batched ? "batched" : "one notification per reading");
+    EnergyMeter::formatSummary(report, line, sizeof(line));
+    printf("%s\n", line);
+    for(int state = 0; state < ENERGY_STATE_COUNT; state++){
+        EnergyMeter::formatState(report, (EnergyState) state, line, sizeof(line));
+        printf("%s\n", line);
+    }
+    printf("\n");
+    for(int i = 0; i < 4; i++){
+        delete samplers[i];
+    }
+}
+
+int main(int argc, char** argv){
+    if(argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)){
+        fprintf(stderr, "usage: energysim [duration hours] [seed]\n");
+        return 0;
+    }
+    double hours = argc > 1 ? atof(argv[1]) : 24;
+    unsigned seed = argc > 2 ? atoi(argv[2]) : 1;
+    if(hours <= 0 || hours > 1000){
+        fprintf(stderr, "usage: energysim [duration hours] [seed]\n");
+        return 1;
+    }
+    for(int schedule = SCHEDULE_FASTEST; schedule <= SCHEDULE_SLOWEST; schedule++){
+        for(int batched = 0; batched <= 1; batched++){
+            run((Schedule) schedule, batched, (uint32_t) (hours * 3600000), seed);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,80 @@
+/*
+ * FaultInjector.cpp
+ * Description: implementation of the seeded fault scenarios
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#include "FaultInjector.h"
+#include <math.h>
+
+const FaultScenario FAULT_SCENARIOS[] = {
+    //name              loss  spike  spike ms     storms/h storm ms down ms      up ms         dht   range
+    { "ideal",          0,    0,     0, 0,        0, 0,    0, 0,       0, 0,     0,    0 },
+    { "packetLoss",     0.05, 0,     0, 0,        0, 0,    0, 0,       0, 0,     0,    0 },
+    { "latencySpikes",  0,    0.02,  500, 3000,   0, 0,    0, 0,       0, 0,     0,    0 },
+    { "disconnectStorm",0,    0,     0, 0,        6, 60000, 1000, 8000, 2000, 10000, 0, 0 },
+    { "sensorFailures", 0,    0,     0, 0,        0, 0,    0, 0,       0, 0,     0.1,  0.15 },
+    { "combined",       0.05, 0.02,  500, 3000,   6, 60000, 1000, 8000, 2000, 10000, 0.1, 0.15 },
+};
+const size_t FAULT_SCENARIO_COUNT = sizeof(FAULT_SCENARIOS) / sizeof(FAULT_SCENARIOS[0]);
+
+FaultInjector::FaultInjector(const FaultScenario& scenario, uint32_t seed)
+    : faults(scenario), rng(seed), nextStorm(UINT32_MAX), stormEnd(0), nextToggle(UINT32_MAX), up(true) {
+    if(faults.stormsPerHour > 0){
+        //storms arrive as a Poisson process
+        nextStorm = (uint32_t) (-log(1 - chance()) * 3600000 / faults.stormsPerHour);
+    }
+}
+
+double FaultInjector::chance(){
+    return rng() / 4294967296.0;
+}
+
+uint32_t FaultInjector::between(uint32_t low, uint32_t high){
+    if(high <= low){
+        return low;
+    }
+    return low + rng() % (high - low + 1);
+}
+
+bool FaultInjector::linkUp(uint32_t now){
+    if(faults.stormsPerHour <= 0){
+        return true;
+    }
+    if(now >= nextStorm){
+        //a new storm starts with a drop
+        stormEnd = now + faults.stormMs;
+        nextStorm = stormEnd + (uint32_t) (-log(1 - chance()) * 3600000 / faults.stormsPerHour);
+        up = false;
+        nextToggle = now + between(faults.stormDownMinMs, faults.stormDownMaxMs);
+    }
+    while(now >= nextToggle){
+        if(up){
+            up = false;
+            nextToggle += between(faults.stormDownMinMs, faults.stormDownMaxMs);
+        }
+        else{
+            //once the storm is over the link stays up after its last drop
+            up = true;
+            nextToggle = nextToggle >= stormEnd ? UINT32_MAX
+                : nextToggle + between(faults.stormUpMinMs, faults.stormUpMaxMs);
+        }
+    }
+    return up;
+}
+
+bool FaultInjector::loseNotification(){
+    return faults.notificationLoss > 0 && chance() < faults.notificationLoss;
+}
+
+uint32_t FaultInjector::notificationDelay(){
+    if(faults.latencySpikeChance > 0 && chance() < faults.latencySpikeChance){
+        return between(faults.latencySpikeMinMs, faults.latencySpikeMaxMs);
+    }
+    return 0;
+}
+
+bool FaultInjector::sensorFails(FaultSensor sensor){
+    double probability = sensor == FAULT_SENSOR_DHT ? faults.dhtFailure : faults.rangefinderFailure;
+    return probability > 0 && chance() < probability;
+}
@@ -0,0 +1,68 @@
+/*
+ * FaultInjector.h
+ * Description: seeded, reproducible faults for host models of the node to clusterhead link:
+ *              notifications lost in flight, latency spikes, disconnect storms and sensor
+ *              reads that fail (DHT NAN, HC-SR04 NO_SIGNAL). The same scenario and seed always
+ *              give the same faults, so a change to batching, retry or reconnect logic can be
+ *              compared against the run before it.
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <random>
+
+struct FaultScenario {
+    const char* name;
+    double notificationLoss;        //chance a sent notification never arrives
+    double latencySpikeChance;      //chance a notification is held up, along with everything behind it
+    uint32_t latencySpikeMinMs;
+    uint32_t latencySpikeMaxMs;
+    double stormsPerHour;           //how often the link starts flapping
+    uint32_t stormMs;               //how long a storm lasts
+    uint32_t stormDownMinMs;        //each drop within a storm
+    uint32_t stormDownMaxMs;
+    uint32_t stormUpMinMs;          //and each recovery between drops
+    uint32_t stormUpMaxMs;
+    double dhtFailure;              //chance a DHT read returns NAN
+    double rangefinderFailure;      //chance an HC-SR04 read returns NO_SIGNAL
+};
+
+/* The standard scenarios: ideal, each fault on its own, then all of them together */
+extern const FaultScenario FAULT_SCENARIOS[];
+extern const size_t FAULT_SCENARIO_COUNT;
+
+enum FaultSensor { FAULT_SENSOR_DHT, FAULT_SENSOR_RANGEFINDER };
+
+class FaultInjector {
+public:
+    FaultInjector(const FaultScenario& scenario, uint32_t seed);
+
+    // Whether the radio link is up at time now. Calls must not go back in time
+    bool linkUp(uint32_t now);
+
+    // For each notification sent: whether it is lost, and if not the extra delay on top of
+    // the connection interval before it arrives
+    bool loseNotification();
+    uint32_t notificationDelay();
+
+    // Whether a read of this sensor fails
+    bool sensorFails(FaultSensor sensor);
+
+    const FaultScenario& scenario() const { return faults; }
+
+private:
+    //std::mt19937 is the same everywhere, the std distributions are not, so draws are done here
+    double chance();
+    uint32_t between(uint32_t low, uint32_t high);
+
+    FaultScenario faults;
+    std::mt19937 rng;
+
+    uint32_t nextStorm;     //start of the next storm
+    uint32_t stormEnd;
+    uint32_t nextToggle;    //next drop or recovery within the storm
+    bool up;
+};
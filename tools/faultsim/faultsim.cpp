@@ -0,0 +1,265 @@
+/*
+ * faultsim.cpp
+ * Description: runs sensor node 1's loop on the host, through the firmware's AdaptiveSampler,
+ *              over a model of the stream link to the clusterhead, under each FaultInjector
+ *              scenario. Prints how throughput, delivery latency and data completeness hold up.
+ *              See README.md
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#include "AdaptiveSampler.h"
+#include "FaultInjector.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+//matches sensorNode1.ino and FrameBacklog.h
+static const uint32_t LOOP_DELAY = 100;
+static const size_t RECORDS_PER_NOTIFICATION = 16;
+static const size_t NOTIFICATIONS_PER_LOOP = 8;
+static const size_t BACKLOG_RAM_FRAMES = 256;
+static const size_t BACKLOG_EEPROM_FRAMES = (4096 - 1024 - 8) / 7;
+
+/* Link model. A notification arrives a connection interval after it is sent, later if held up
+   behind a delayed one, and is lost if the link drops first. Once the link is back the
+   clusterhead's reconnectCachedNodes() retries every 2 s, then connects and subscribes */
+static const uint32_t CONNECTION_INTERVAL_MS = 30;
+static const uint32_t RECONNECT_PERIOD_MS = 2000;
+static const uint32_t RECONNECT_SETUP_MS = 300;
+
+struct SensorConfig {
+    const char* name;
+    uint32_t minDelay;
+    uint32_t maxDelay;
+    int32_t threshold;
+    bool dht;
+    bool rangefinder;
+};
+
+//node 1's sensors in samplers array order
+static const SensorConfig SENSORS[4] = {
+    { "temperature", 10000, 120000, 1, true, false },
+    { "humidity", 10000, 120000, 2, true, false },
+    { "light", 1000, 40000, 20, false, false },
+    { "distance", 200, 6400, 5, false, true },
+};
+
+/* Slowly drifting signals, with someone walking past the rangefinder every few minutes.
+   Drawn from their own generator so every scenario sees the same readings */
+struct Signals {
+    std::mt19937 rng;
+    double temperature = 22, humidity = 50, light = 300;
+    uint32_t walkUntil = 0;
+
+    explicit Signals(uint32_t seed) : rng(seed) {}
+
+    double noise(){
+        return rng() / 4294967296.0 - 0.5;
+    }
+
+    void read(uint32_t now, int32_t* values){
+        temperature += noise() * 0.004;
+        humidity += noise() * 0.008;
+        light += noise() * 4;
+        if(walkUntil < now && rng() % 2400 == 0){
+            walkUntil = now + 8000;
+        }
+        values[0] = (int32_t) temperature;
+        values[1] = (int32_t) humidity;
+        values[2] = (int32_t) light;
+        values[3] = now < walkUntil ? 60 + (int32_t) ((walkUntil - now) / 100) : 250;
+    }
+};
+
+struct Record {
+    uint32_t takenAt;
+};
+
+struct InFlight {
+    uint32_t arrivesAt;
+    std::vector<Record> records;
+};
+
+struct Result {
+    long attempts;          //reads attempted
+    long failedReads;       //reads that returned NAN or NO_SIGNAL, retried by the sampler
+    long readings;          //good readings queued for the clusterhead
+    long delivered;
+    long lostInFlight;      //sent, then lost to a bad packet or a dropped link
+    long backlogDropped;    //pushed out of a full backlog
+    long notifications;
+    long pending;           //still in the backlog or in flight at the end of the run
+    uint32_t disconnectedMs;
+    std::vector<uint32_t> latencies;
+};
+
+static Result run(const FaultScenario& scenario, uint32_t durationMs, uint32_t seed){
+    Result result = {};
+    FaultInjector faults(scenario, seed);
+    Signals signals(seed);
+    AdaptiveSampler* samplers[4];
+    for(int i = 0; i < 4; i++){
+        samplers[i] = new AdaptiveSampler(SENSORS[i].minDelay, SENSORS[i].maxDelay, SENSORS[i].threshold);
+    }
+    std::deque<Record> backlog;
+    std::deque<InFlight> inFlight;
+    bool connected = true;
+    uint32_t reconnectAt = 0;
+    uint32_t lastArrival = 0;
+
+    for(uint32_t now = 0; now < durationMs; now += LOOP_DELAY){
+        //link state, and the clusterhead reconnecting once it is back
+        bool up = faults.linkUp(now);
+        if(!up){
+            connected = false;
+            reconnectAt = 0;
+        }
+        else if(!connected){
+            if(reconnectAt == 0){
+                reconnectAt = (now / RECONNECT_PERIOD_MS + 1) * RECONNECT_PERIOD_MS + RECONNECT_SETUP_MS;
+            }
+            connected = now >= reconnectAt;
+        }
+        if(!connected){
+            result.disconnectedMs += LOOP_DELAY;
+        }
+
+        //notifications arriving, or lost with the link
+        while(!inFlight.empty() && (inFlight.front().arrivesAt <= now || !up)){
+            InFlight& notification = inFlight.front();
+            if(up){
+                for(const Record& record : notification.records){
+                    result.latencies.push_back(notification.arrivesAt - record.takenAt);
+                }
+                result.delivered += notification.records.size();
+            }
+            else{
+                result.lostInFlight += notification.records.size();
+            }
+            inFlight.pop_front();
+        }
+
+        //the node's loop: sample whatever is due, queue good readings
+        int32_t values[4];
+        signals.read(now, values);
+        for(int i = 0; i < 4; i++){
+            if(!samplers[i]->due(now)){
+                continue;
+            }
+            result.attempts++;
+            bool failed = (SENSORS[i].dht && faults.sensorFails(FAULT_SENSOR_DHT))
+                || (SENSORS[i].rangefinder && faults.sensorFails(FAULT_SENSOR_RANGEFINDER));
+            if(failed){
+                samplers[i]->skip(now);
+                result.failedReads++;
+                continue;
+            }
+            samplers[i]->update(now, values[i]);
+            result.readings++;
+            if(backlog.size() >= BACKLOG_RAM_FRAMES + BACKLOG_EEPROM_FRAMES){
+                backlog.pop_front();
+                result.backlogDropped++;
+            }
+            backlog.push_back({ now });
+        }
+
+        //drainBacklog(): setValue() fails while disconnected, so nothing leaves the backlog,
+        //but once a notification is handed to the stack it is gone from the node
+        if(!connected){
+            continue;
+        }
+        for(size_t n = 0; n < NOTIFICATIONS_PER_LOOP && !backlog.empty(); n++){
+            size_t count = std::min(backlog.size(), RECORDS_PER_NOTIFICATION);
+            InFlight notification;
+            notification.records.assign(backlog.begin(), backlog.begin() + count);
+            backlog.erase(backlog.begin(), backlog.begin() + count);
+            result.notifications++;
+            //notifications are delivered in order, so a delayed one holds up the rest
+            uint32_t arrivesAt = now + CONNECTION_INTERVAL_MS * (n + 1) + faults.notificationDelay();
+            lastArrival = std::max(lastArrival, arrivesAt);
+            if(faults.loseNotification()){
+                result.lostInFlight += count;
+                continue;
+            }
+            notification.arrivesAt = lastArrival;
+            inFlight.push_back(notification);
+        }
+    }
+    result.pending = backlog.size();
+    for(const InFlight& notification : inFlight){
+        result.pending += notification.records.size();
+    }
+    for(int i = 0; i < 4; i++){
+        delete samplers[i];
+    }
+    return result;
+}
+
+static void print(const FaultScenario& scenario, Result& result, uint32_t durationMs){
+    double mean = 0, p99 = 0, worst = 0;
+    if(!result.latencies.empty()){
+        std::sort(result.latencies.begin(), result.latencies.end());
+        double total = 0;
+        for(uint32_t latency : result.latencies){
+            total += latency;
+        }
+        mean = total / result.latencies.size();
+        p99 = result.latencies[(result.latencies.size() - 1) * 99 / 100];
+        worst = result.latencies.back();
+    }
+    //readings still on their way when the run stops aren't held against it
+    long settled = result.readings - result.pending;
+    double completeness = settled > 0 ? 100.0 * result.delivered / settled : 0;
+    double perMinute = result.delivered / (durationMs / 60000.0);
+    printf("%s,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%.1f,%.1f,%.1f,%.0f,%.0f,%.1f\n", scenario.name, result.attempts,
+        result.failedReads, result.readings, result.delivered, result.lostInFlight, result.backlogDropped,
+        result.notifications, result.pending, 100.0 * result.disconnectedMs / durationMs, completeness, perMinute, mean, p99, worst / 1000);
+}
+
+static void usage(){
+    fprintf(stderr, "usage: faultsim [duration hours] [seed] [scenario]\nscenarios:");
+    for(size_t i = 0; i < FAULT_SCENARIO_COUNT; i++){
+        fprintf(stderr, " %s", FAULT_SCENARIOS[i].name);
+    }
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char** argv){
+    if(argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)){
+        usage();
+        return 0;
+    }
+    double hours = argc > 1 ? atof(argv[1]) : 6;
+    uint32_t seed = argc > 2 ? strtoul(argv[2], NULL, 10) : 1;
+    const char* only = argc > 3 ? argv[3] : NULL;
+    if(hours <= 0 || hours > 1000){
+        usage();
+        return 1;
+    }
+    uint32_t durationMs = (uint32_t) (hours * 3600000);
+
+    bool found = only == NULL;
+    for(size_t i = 0; i < FAULT_SCENARIO_COUNT; i++){
+        found = found || strcmp(only, FAULT_SCENARIOS[i].name) == 0;
+    }
+    if(!found){
+        usage();
+        return 1;
+    }
+
+    printf("scenario,attempts,failed_reads,readings,delivered,lost_in_flight,backlog_dropped,notifications,pending,"
+        "disconnected_pct,completeness_pct,delivered_per_min,latency_mean_ms,latency_p99_ms,latency_max_s\n");
+    for(size_t i = 0; i < FAULT_SCENARIO_COUNT; i++){
+        if(only != NULL && strcmp(only, FAULT_SCENARIOS[i].name) != 0){
+            continue;
+        }
+        Result result = run(FAULT_SCENARIOS[i], durationMs, seed);
+        print(FAULT_SCENARIOS[i], result, durationMs);
+    }
+    return 0;
+}
@@ -0,0 +1,75 @@
+/*
+ * Particle.h
+ * Description: the little of Device OS the clusterhead's ingest path and a node's link
+ *              security use, for building them on a host. Each device gets its own EEPROM,
+ *              picked with useEeprom(), the clock only moves when the replay moves it, and the
+ *              log goes to logLine() so it can be compared line by line. See README.md
+ * Author: Tom Schwenke
+ * Date: 19/10/2026
+ */
+#pragma once
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+class EEPROMClass {
+public:
+    EEPROMClass(){ memset(mem, 0xFF, sizeof(mem)); }
+
+    uint8_t read(int address){ return mem[address]; }
+    void write(int address, uint8_t value){ mem[address] = value; }
+    template<class T> T& get(int address, T& out){ memcpy(&out, mem + address, sizeof(T)); return out; }
+    template<class T> const T& put(int address, const T& value){ memcpy(mem + address, &value, sizeof(T)); return value; }
+    size_t length(){ return sizeof(mem); }
+
+private:
+    uint8_t mem[4096];  //the Argon's emulated EEPROM, erased
+};
+
+//the EEPROM of whichever device the code running now belongs to
+extern EEPROMClass* currentEeprom;
+inline void useEeprom(EEPROMClass& eeprom){ currentEeprom = &eeprom; }
+#define EEPROM (*currentEeprom)
+
+//moved by the replay, to the time each frame was received
+extern unsigned long simulatedMillis;
+inline unsigned long millis(){ return simulatedMillis; }
+inline unsigned long micros(){ return simulatedMillis * 1000; }
+
+/* Nothing on the other end, responses to queries go nowhere */
+class USBSerial {
+public:
+    int available(){ return 0; }
+    int read(){ return -1; }
+    size_t write(const uint8_t* /*data*/, size_t length){ return length; }
+    void lock(){}
+    void unlock(){}
+};
+
+#define WITH_LOCK(port) for(bool locked = ((port).lock(), true); locked; (port).unlock(), locked = false)
+
+//only declared, for NodeLinkCache.h
+class BleAddress;
+
+//gets each line of the log, without a timestamp so runs compare
+void logLine(const char* level, const char* text);
+
+/* trace is left out, as in querysim: it is only block sealing, which the summaries cover */
+class Logger {
+public:
+    void info(const char* format, ...){ va_list args; va_start(args, format); line("INFO", format, args); va_end(args); }
+    void warn(const char* format, ...){ va_list args; va_start(args, format); line("WARN", format, args); va_end(args); }
+    void error(const char* format, ...){ va_list args; va_start(args, format); line("ERROR", format, args); va_end(args); }
+    void trace(const char* /*format*/, ...){}
+
+private:
+    void line(const char* level, const char* format, va_list args){
+        char text[256];
+        vsnprintf(text, sizeof(text), format, args);
+        logLine(level, text);
+    }
+};
+
+extern Logger Log;
@@ -0,0 +1,556 @@
+/*
+ * ingestreplay.cpp
+ * Description: records frames the way the sensor nodes build and seal them, and replays
+ *              them through the clusterhead's ingest path, printing what it makes of them,
+ *              so a change in how the clusterhead handles node frames shows up against a
+ *              recorded golden run. See README.md
+ * Author: Tom Schwenke
+ * Date: 19/10/2026
+ */
+#include "Particle.h"
+#include "EnergyMeter.h"
+#include "EventDetector.h"
+#include "FrameBacklog.h"
+#include "HealthMonitor.h"
+#include "IngestQueue.h"
+#include "LinkSecurity.h"
+#include "MemoryPool.h"
+#include "NodeConfig.h"
+#include "NodeIngest.h"
+#include "NodeKeyring.h"
+#include "PresenceFusion.h"
+#include "QueryServer.h"
+#include "SeriesStore.h"
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+EEPROMClass* currentEeprom = NULL;
+unsigned long simulatedMillis = 0;
+Logger Log;
+
+typedef std::vector<uint8_t> Bytes;
+
+//recorded runs start here, 2026-09-21 in unix time (s)
+const uint32_t RECORD_START = 1790000000;
+//each node's link key, given to the node when recording and to the clusterhead by "key" lines
+static uint8_t nodeKey(uint8_t node, size_t i){ return (uint8_t) (node * 0x31 + i * 7); }
+
+static const char* SERIES_NAMES[SERIES_COUNT] = {
+    "temperature1", "humidity", "light1", "distance", "temperature2", "light2", "sound", "human", "occupancy"
+};
+
+//output lines of the replay, or of the log while recording
+static std::vector<std::string> output;
+
+void logLine(const char* level, const char* text){
+    output.push_back(std::string("  ") + level + ": " + text);
+}
+
+static std::string format(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+static std::string format(const char* fmt, ...){
+    char line[512];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    return line;
+}
+
+static std::string hex(const uint8_t* data, size_t length){
+    std::string out;
+    for(size_t i = 0; i < length; i++){
+        out += format("%02x", data[i]);
+    }
+    return out.empty() ? "-" : out;
+}
+
+static bool unhex(const char* text, Bytes& out){
+    out.clear();
+    if(strcmp(text, "-") == 0){
+        return true;
+    }
+    for(; text[0] != '\0' && text[1] != '\0'; text += 2){
+        char digits[3] = { text[0], text[1], '\0' };
+        char* end;
+        out.push_back((uint8_t) strtoul(digits, &end, 16));
+        if(*end != '\0'){
+            return false;
+        }
+    }
+    return text[0] == '\0';
+}
+
+//----------------------------------------------------------------- recording
+
+/* One simulated sensor node: its own EEPROM and link security, sealing frames as its .ino does */
+struct RecordedNode {
+    EEPROMClass eeprom;
+    LinkSecurity security;
+};
+
+/* Writes a run to a frames file, one line per thing that happens to the clusterhead:
+   "<unix time> frame <ingest tag> <bytes as received>", "<unix time> connect <node>",
+   "<unix time> key <node>" or "<unix time> reset", with "# " lines saying what comes next */
+class Recorder {
+public:
+    explicit Recorder(FILE* file) : file(file), now(RECORD_START) {
+        for(uint8_t node = 1; node <= NODE_CACHE_NODES; node++){
+            uint8_t key[FRAME_KEY_SIZE];
+            for(size_t i = 0; i < FRAME_KEY_SIZE; i++){
+                key[i] = nodeKey(node, i);
+            }
+            useEeprom(nodes[node - 1].eeprom);
+            nodes[node - 1].security.begin();
+            nodes[node - 1].security.provision(key);
+        }
+    }
+
+    void note(const char* text){ fprintf(file, "# %s\n", text); }
+    void wait(uint32_t seconds){ now += seconds; }
+    uint32_t time() const { return now; }
+
+    void connect(uint8_t node){
+        useEeprom(nodes[node - 1].eeprom);
+        nodes[node - 1].security.onConnected();
+        fprintf(file, "%lu connect %u\n", (unsigned long) now, node);
+    }
+
+    void key(uint8_t node){ fprintf(file, "%lu key %u\n", (unsigned long) now, node); }
+    void reset(){ fprintf(file, "%lu reset\n", (unsigned long) now); }
+
+    void raw(uint8_t tag, const Bytes& frame){
+        fprintf(file, "%lu frame %02x %s\n", (unsigned long) now, tag, hex(frame.data(), frame.size()).c_str());
+    }
+
+    // Seal a payload on the node's channel, as it would go out on the air, and record it
+    Bytes send(uint8_t node, uint8_t channel, const Bytes& payload){
+        Bytes sealed(payload.size() + FRAME_OVERHEAD);
+        useEeprom(nodes[node - 1].eeprom);
+        sealed.resize(nodes[node - 1].security.seal(channel, payload.data(), payload.size(), sealed.data()));
+        uint8_t tag = channel == FRAME_CHANNEL_STREAM ? (node == 1 ? INGEST_STREAM_1 : INGEST_STREAM_2)
+            : channel == FRAME_CHANNEL_DIAGNOSTICS ? (node == 1 ? INGEST_DIAGNOSTICS_1 : INGEST_DIAGNOSTICS_2)
+            : (node == 1 ? INGEST_EVENT_1 : INGEST_EVENT_2);
+        raw(tag, sealed);
+        return sealed;
+    }
+
+    // A stream notification of readings, [count u8][records...], claiming claimed records
+    Bytes stream(uint8_t node, const std::vector<BacklogFrame>& readings, int claimed = -1){
+        Bytes payload(1 + readings.size() * BACKLOG_RECORD_SIZE);
+        payload[0] = claimed < 0 ? readings.size() : claimed;
+        for(size_t i = 0; i < readings.size(); i++){
+            FrameBacklog::encode(readings[i], &payload[1 + i * BACKLOG_RECORD_SIZE]);
+        }
+        return send(node, FRAME_CHANNEL_STREAM, payload);
+    }
+
+    Bytes diagnostics(uint8_t node, uint8_t type, const uint8_t* report, size_t length){
+        Bytes payload(1, type);
+        payload.insert(payload.end(), report, report + length);
+        return send(node, FRAME_CHANNEL_DIAGNOSTICS, payload);
+    }
+
+private:
+    FILE* file;
+    uint32_t now;
+    RecordedNode nodes[NODE_CACHE_NODES];
+};
+
+static BacklogFrame reading(uint8_t sensor, uint16_t value, uint32_t timestamp){
+    BacklogFrame frame = { sensor, value, timestamp };
+    return frame;
+}
+
+/* Node 1's sensors are temperature, humidity, light and distance, node 2's temperature,
+   light, sound and the human detector, see STREAM_SERIES_ in NodeIngest.cpp */
+static void recordRun(Recorder& run){
+    run.note("both nodes connect, the clusterhead only has node 1's key so far");
+    run.connect(1);
+    run.connect(2);
+    run.key(1);
+    run.stream(2, { reading(0, 21, run.time()) });
+    run.key(2);
+
+    run.note("live readings from both, someone walks in");
+    for(int i = 0; i < 6; i++){
+        run.wait(2);
+        run.stream(1, { reading(0, (uint16_t) (int8_t) (22 - i / 3), run.time()), reading(1, 48, run.time()),
+            reading(3, i < 2 ? 255 : 90 - i * 5, run.time()) });
+        if(i == 2){
+            run.stream(2, { reading(3, 1, run.time()), reading(2, 61, run.time()) });
+        }
+    }
+    run.note("below freezing outside, signed temperatures");
+    run.stream(2, { reading(0, (uint16_t) (int8_t) -4, run.time()), reading(1, 320, run.time()) });
+
+    run.note("node 1 catches up on readings taken while it was away, with one live one ahead of them");
+    std::vector<BacklogFrame> backlog = { reading(3, 70, run.time()) };
+    const uint16_t BACKLOG_VALUES[3] = { 19, 52, 400 };
+    for(uint32_t i = 0; i < 8; i++){
+        backlog.push_back(reading(i % 3, BACKLOG_VALUES[i % 3] + i / 3, RECORD_START - 600 + i * 60));
+    }
+    run.stream(1, backlog);
+
+    run.note("an empty notification, one claiming more records than it holds, and one with a sensor out of range");
+    run.stream(1, {});
+    run.wait(1);
+    run.stream(1, { reading(2, 512, run.time()), reading(1, 47, run.time()) }, 5);
+    run.stream(2, { reading(7, 9, run.time()), reading(2, 64, run.time()) });
+
+    run.note("a replayed frame, a forged one and one cut short, in a row, then the connection is dropped");
+    run.wait(2);
+    Bytes sealed = run.stream(1, { reading(3, 75, run.time()) });
+    run.raw(INGEST_STREAM_1, sealed);
+    Bytes forged = sealed;
+    forged[forged.size() / 2] ^= 0x40;
+    run.raw(INGEST_STREAM_1, forged);
+    run.raw(INGEST_STREAM_1, Bytes(sealed.begin(), sealed.end() - 3));
+    run.wait(3);
+    run.connect(1);
+    run.stream(1, { reading(3, 72, run.time()) });
+
+    run.note("the clusterhead resets, frames it accepted before are still rejected");
+    run.wait(20);
+    run.reset();
+    run.raw(INGEST_STREAM_1, sealed);
+    run.connect(1);
+    run.connect(2);
+    run.stream(1, { reading(3, 74, run.time()) });
+
+    run.note("diagnostics: energy, health after a watchdog reset, then a longer stall, and config status");
+    EnergyMeter meter;
+    meter.setBattery(1200, 3700);
+    meter.add(ENERGY_CPU_ACTIVE, 250000);
+    meter.add(ENERGY_CPU_IDLE, 9750000);
+    meter.addNotification(113);
+    meter.addLinkTime(10000, true);
+    meter.addReading();
+    EnergyReport energy;
+    meter.report(energy);
+    uint8_t encoded[HEALTH_REPORT_SIZE > ENERGY_REPORT_SIZE ? HEALTH_REPORT_SIZE : ENERGY_REPORT_SIZE];
+    EnergyMeter::encode(energy, encoded);
+    run.diagnostics(1, DIAGNOSTICS_ENERGY, encoded, ENERGY_REPORT_SIZE);
+    run.diagnostics(2, DIAGNOSTICS_ENERGY, encoded, ENERGY_REPORT_SIZE - 4);
+
+    HealthMonitor monitor;
+    monitor.setResetReason(HEALTH_RESET_REASON_USER, HEALTH_WATCHDOG_RESET_DATA | HEALTH_SECTION_DHT);
+    uint32_t clock = 0;
+    for(int i = 0; i < 20; i++){
+        monitor.beginLoop(clock);
+        monitor.enter(HEALTH_SECTION_DHT, clock + 100);
+        monitor.leave(clock + 100 + i * 300);
+        clock += 100 + i * 300 + 500;
+        monitor.endLoop(clock);
+    }
+    HealthReport health;
+    monitor.report(health, 40);
+    HealthMonitor::encode(health, encoded);
+    run.diagnostics(1, DIAGNOSTICS_HEALTH, encoded, HEALTH_REPORT_SIZE);
+    run.wait(60);
+    monitor.beginLoop(clock);
+    monitor.enter(HEALTH_SECTION_BLE_CONNECT, clock);
+    monitor.leave(clock + 9000);
+    monitor.endLoop(clock + 9100);
+    monitor.report(health, 100);
+    HealthMonitor::encode(health, encoded);
+    run.diagnostics(1, DIAGNOSTICS_HEALTH, encoded, HEALTH_REPORT_SIZE);
+
+    ConfigStatusReport config = { 4, CONFIG_STATUS_TRIAL, 4 };
+    configStatusEncode(config, encoded);
+    run.diagnostics(2, DIAGNOSTICS_CONFIG, encoded, CONFIG_STATUS_SIZE);
+    run.diagnostics(2, DIAGNOSTICS_CONFIG, encoded, CONFIG_STATUS_SIZE - 1);
+    run.diagnostics(2, 0x7E, encoded, 3);
+    run.wait(30);
+    config.status = CONFIG_STATUS_CONFIRMED;
+    configStatusEncode(config, encoded);
+    run.diagnostics(2, DIAGNOSTICS_CONFIG, encoded, CONFIG_STATUS_SIZE);
+
+    run.note("an event window from node 1's distance sensor, and one for a sensor it doesn't have");
+    EventWindow window;
+    window.triggerTime = run.time();
+    window.periodMs = 50;
+    window.preSamples = 8;
+    window.count = 24;
+    window.zScore10 = -73;
+    for(int i = 0; i < window.count; i++){
+        window.samples[i] = i < 8 ? 240 + i % 3 : 60 + i;
+    }
+    Bytes payload(1 + EVENT_WINDOW_MAX_SIZE, 3);
+    payload.resize(1 + EventDetector::encode(window, &payload[1]));
+    run.send(1, FRAME_CHANNEL_EVENT, payload);
+    payload[0] = 5;
+    run.send(1, FRAME_CHANNEL_EVENT, payload);
+
+    run.note("they leave, the room empties over a few minutes");
+    for(int i = 0; i < 12; i++){
+        run.wait(15);
+        run.stream(1, { reading(3, 255, run.time()) });
+        if(i == 0){
+            run.stream(2, { reading(3, 0, run.time()) });
+        }
+    }
+}
+
+static int runRecord(const char* path){
+    FILE* file = fopen(path, "w");
+    if(file == NULL){
+        perror(path);
+        return 1;
+    }
+    fprintf(file, "# recorded by ingestreplay record, see README.md\n");
+    Recorder run(file);
+    recordRun(run);
+    fclose(file);
+    //the nodes' own log, e.g. about sequence reservations, isn't part of the run
+    output.clear();
+    printf("Recorded to %s\n", path);
+    return 0;
+}
+
+//----------------------------------------------------------------- replaying
+
+static const char* KIND_NAMES[] = { "dropped", "stream", "energy", "config", "health", "event", "untrusted" };
+
+/* The clusterhead: everything onNodeFrame() in clusterhead.ino hands frames to, with what it
+   does itself only printed */
+class Clusterhead {
+public:
+    Clusterhead() : queries(store, port), ingest(NULL), keyring(NULL) {
+        useEeprom(eeprom);
+        boot();
+    }
+
+    ~Clusterhead(){
+        delete ingest;
+        delete keyring;
+    }
+
+    // A reset: the keyring reloads from EEPROM, and what NodeIngest held in RAM is gone
+    void boot(){
+        delete ingest;
+        delete keyring;
+        keyring = new NodeKeyring();
+        keyring->begin();
+        ingest = new NodeIngest(*keyring, store, queries, presence);
+    }
+
+    void provision(uint8_t node){
+        uint8_t key[FRAME_KEY_SIZE];
+        for(size_t i = 0; i < FRAME_KEY_SIZE; i++){
+            key[i] = nodeKey(node, i);
+        }
+        keyring->provision(node, key);
+    }
+
+    void connect(uint8_t node){
+        ingest->onConnected(node);
+        keyring->onConnected(node);
+    }
+
+    // As onFrameReceived() on the BLE thread, then handleReceivedFrames() in loop()
+    void receive(uint8_t tag, const Bytes& data, uint32_t now){
+        IngestFrame* frame = pool.allocate();
+        frame->tag = tag;
+        frame->length = data.size() < INGEST_FRAME_DATA ? data.size() : INGEST_FRAME_DATA;
+        frame->receivedAt = millis();
+        memcpy(frame->data, data.data(), frame->length);
+        queue.push(frame);
+        while((frame = queue.pop()) != NULL){
+            NodeFrameKind kind = ingest->handle(*frame, now);
+            output.push_back(std::string("  -> ") + KIND_NAMES[kind]);
+            if(kind == NODE_FRAME_EVENT){
+                const EventWindow& window = ingest->event();
+                output.push_back(format("  publish rawWindow %u,%lu,%u,%u,%d,%u samples", ingest->eventSeries(),
+                    (unsigned long) window.triggerTime, window.periodMs, window.preSamples, window.zScore10, window.count));
+            }
+            pool.release(frame);
+        }
+    }
+
+    // As checkPresence()
+    void checkPresence(uint32_t now){
+        presence.update(now);
+        PresenceTransition transition;
+        while(presence.takeTransition(transition)){
+            output.push_back(format("  presence %s, confidence %u%%, confirmed after %lu s", transition.occupied ? "occupied" : "vacant",
+                transition.confidence, (unsigned long) transition.latency));
+            ingest->record(SERIES_OCCUPANCY, transition.timestamp, transition.occupied ? transition.confidence : 0);
+        }
+    }
+
+    void summarise(){
+        output.push_back("summary");
+        for(uint8_t series = 0; series < SERIES_COUNT; series++){
+            SeriesStats stats;
+            if(store.copyStats(series, stats)){
+                output.push_back(format("  %s: %lu readings, %ld to %ld, last %ld at %lu", SERIES_NAMES[series],
+                    (unsigned long) stats.count, (long) stats.min, (long) stats.max, (long) stats.lastValue,
+                    (unsigned long) stats.lastTimestamp));
+            }
+        }
+        char line[400];
+        for(uint8_t node = 1; node <= NODE_CACHE_NODES; node++){
+            if(ingest->energy(node) != NULL){
+                EnergyMeter::formatSummary(*ingest->energy(node), line, sizeof(line));
+                output.push_back(format("  node %u energy: %s", node, line));
+            }
+            if(ingest->health(node) != NULL){
+                HealthMonitor::formatSummary(*ingest->health(node), line, sizeof(line));
+                output.push_back(format("  node %u health: %s", node, line));
+            }
+            output.push_back(format("  node %u: %lu frames rejected since reset", node, (unsigned long) keyring->rejected(node)));
+        }
+        output.push_back(format("  presence: %s, %lu changes suppressed", presence.occupied() ? "occupied" : "vacant",
+            (unsigned long) presence.suppressed()));
+        output.push_back(format("  ingest queue: %u deep at most", queue.maxDepth()));
+    }
+
+private:
+    EEPROMClass eeprom;
+    USBSerial port;
+    SeriesStore store;
+    QueryServer queries;
+    PresenceFusion presence;
+    MemoryPool<IngestFrame, 4> pool;
+    IngestQueue queue;
+    NodeIngest* ingest;
+    NodeKeyring* keyring;
+};
+
+static bool readLines(const char* path, std::vector<std::string>& lines){
+    FILE* file = fopen(path, "r");
+    if(file == NULL){
+        perror(path);
+        return false;
+    }
+    std::string line;
+    int c;
+    while((c = fgetc(file)) != EOF){
+        if(c == '\n'){
+            lines.push_back(line);
+            line.clear();
+        }
+        else{
+            line += (char) c;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+static bool replay(const char* path){
+    std::vector<std::string> lines;
+    if(!readLines(path, lines)){
+        return false;
+    }
+    Clusterhead clusterhead;
+    uint32_t start = 0;
+    for(size_t i = 0; i < lines.size(); i++){
+        const std::string& line = lines[i];
+        if(line.empty() || (line[0] == '#' && i == 0)){
+            continue;
+        }
+        output.push_back(line.size() > 80 ? line.substr(0, 77) + "..." : line);
+        if(line[0] == '#'){
+            continue;
+        }
+        //the tag of a frame, in hex, or the node a key or connection is for
+        char verb[16], argument[1024];
+        unsigned long now;
+        unsigned number;
+        int fields = sscanf(line.c_str(), "%lu %15s %x %1023s", &now, verb, &number, argument);
+        if(fields < 2){
+            fprintf(stderr, "%s:%u: can't read \"%s\"\n", path, (unsigned) i + 1, line.c_str());
+            return false;
+        }
+        if(start == 0){
+            start = now;
+        }
+        simulatedMillis = (now - start) * 1000;
+        Bytes data;
+        if(fields == 4 && strcmp(verb, "frame") == 0 && unhex(argument, data)){
+            clusterhead.receive(number, data, now);
+        }
+        else if(fields == 3 && strcmp(verb, "key") == 0){
+            clusterhead.provision(number);
+        }
+        else if(fields == 3 && strcmp(verb, "connect") == 0){
+            clusterhead.connect(number);
+        }
+        else if(fields == 2 && strcmp(verb, "reset") == 0){
+            clusterhead.boot();
+        }
+        else{
+            fprintf(stderr, "%s:%u: can't read \"%s\"\n", path, (unsigned) i + 1, line.c_str());
+            return false;
+        }
+        clusterhead.checkPresence(now);
+    }
+    clusterhead.summarise();
+    return true;
+}
+
+static int runReplay(const char* path, const char* goldenPath, bool write){
+    if(!replay(path)){
+        return 1;
+    }
+    if(goldenPath == NULL){
+        for(const std::string& line : output){
+            printf("%s\n", line.c_str());
+        }
+        return 0;
+    }
+    if(write){
+        FILE* file = fopen(goldenPath, "w");
+        if(file == NULL){
+            perror(goldenPath);
+            return 1;
+        }
+        for(const std::string& line : output){
+            fprintf(file, "%s\n", line.c_str());
+        }
+        fclose(file);
+        printf("Wrote %u lines to %s\n", (unsigned) output.size(), goldenPath);
+        return 0;
+    }
+    std::vector<std::string> expected;
+    if(!readLines(goldenPath, expected)){
+        return 1;
+    }
+    int differences = 0;
+    size_t count = output.size() > expected.size() ? output.size() : expected.size();
+    for(size_t i = 0; i < count; i++){
+        const std::string& want = i < expected.size() ? expected[i] : "(nothing)";
+        const std::string& got = i < output.size() ? output[i] : "(nothing)";
+        if(want != got){
+            if(differences < 10){
+                printf("line %u differs\n  golden: %s\n  now:    %s\n", (unsigned) i + 1, want.c_str(), got.c_str());
+            }
+            differences++;
+        }
+    }
+    printf("%u lines, %d differ from %s\n", (unsigned) output.size(), differences, goldenPath);
+    return differences > 0 ? 1 : 0;
+}
+
+static void usage(){
+    fprintf(stderr, "usage: ingestreplay record <frames>\n"
+                    "       ingestreplay replay <frames> [golden]\n"
+                    "       ingestreplay replay --write <frames> <golden>\n");
+}
+
+int main(int argc, char** argv){
+    if(argc == 3 && strcmp(argv[1], "record") == 0){
+        return runRecord(argv[2]);
+    }
+    if(argc >= 3 && argc <= 4 && strcmp(argv[1], "replay") == 0 && strcmp(argv[2], "--write") != 0){
+        return runReplay(argv[2], argc == 4 ? argv[3] : NULL, false);
+    }
+    if(argc == 5 && strcmp(argv[1], "replay") == 0 && strcmp(argv[2], "--write") == 0){
+        return runReplay(argv[3], argv[4], true);
+    }
+    usage();
+    return 2;
+}
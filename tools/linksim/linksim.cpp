@@ -0,0 +1,148 @@
+/*
+ * linksim.cpp
+ * Description: host model of the node to clusterhead BLE link, comparing the old protocol
+ *              (one NOTIFY characteristic per sensor, [value][send time u64] per reading,
+ *              found by scanning on every reconnect) with the stream protocol (one stream
+ *              and one control characteristic, 7 byte records batched per node loop, cached
+ *              node addresses). Prints reconnect-to-first-data time and per-reading overhead
+ *              for each node's sensors sampled at their fastest and slowest read delays.
+ * Author: Tom Schwenke
+ * Date: 19/10/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Link model. Every ATT request during discovery and subscription takes one connection
+   interval to be answered. A notification costs its payload plus link layer, L2CAP and
+   ATT headers, an inter frame space and the empty packet acknowledging it */
+const double CONNECTION_INTERVAL_MS = 30;
+const double SCAN_MS = 5000;            //BLE.scan() runs for its whole timeout before returning
+const double CONNECT_MS = 2 * CONNECTION_INTERVAL_MS;
+const double NODE_LOOP_MS = 100;        //the delay at the end of each node loop
+const int PACKET_OVERHEAD = 10 + 4 + 3; //link layer (preamble, access address, header, CRC), L2CAP, ATT
+const int EMPTY_PACKET = 10;
+const double BYTE_US = 8;               //1M PHY
+const double IFS_US = 150;
+
+struct Sensor {
+    const char* name;
+    int valueSize;
+    double minDelayMs;
+    double maxDelayMs;
+};
+
+struct Node {
+    const char* name;
+    Sensor sensors[4];
+};
+
+//read delays and value sizes from the node firmware
+const Node NODES[] = {
+    { "node1", { { "temperature", 1, 10000, 120000 }, { "humidity", 1, 10000, 120000 },
+                 { "light", 2, 1000, 40000 }, { "distance", 1, 200, 6400 } } },
+    { "node2", { { "temperature", 1, 10000, 120000 }, { "light", 2, 1000, 40000 },
+                 { "sound", 2, 500, 16000 }, { "humanDetector", 1, 500, 4000 } } },
+};
+
+/* GATT requests Device OS makes discovering a service with this many characteristics, of which
+   notifying are NOTIFY, and then subscribing to them: services, characteristics (a few per
+   response, plus the request that finds no more), descriptors of each NOTIFY characteristic,
+   and a CCCD write for each */
+int discoveryRequests(int characteristics, int notifying){
+    int serviceRequests = 2;
+    int characteristicRequests = (characteristics + 2) / 3 + 1;
+    return serviceRequests + characteristicRequests + notifying * 2;
+}
+
+double airtimeUs(int payload){
+    return (PACKET_OVERHEAD + payload + EMPTY_PACKET) * BYTE_US + 2 * IFS_US;
+}
+
+struct Traffic {
+    long readings;
+    long notifications;
+    long bytes;         //on air, including all overhead
+    double airtimeUs;
+};
+
+/* Run one node for durationMs with every sensor read at its fastest or slowest read delay */
+Traffic simulate(const Node& node, bool slow, bool stream, double durationMs){
+    Traffic traffic = { 0, 0, 0, 0 };
+    double nextRead[4] = { 0, 0, 0, 0 };
+    for(double now = 0; now < durationMs; now += NODE_LOOP_MS){
+        int recordsThisLoop = 0;
+        for(int i = 0; i < 4; i++){
+            const Sensor& sensor = node.sensors[i];
+            if(now < nextRead[i]){
+                continue;
+            }
+            nextRead[i] = now + (slow ? sensor.maxDelayMs : sensor.minDelayMs);
+            traffic.readings++;
+            if(stream){
+                recordsThisLoop++;
+            }
+            else{
+                int payload = sensor.valueSize + 8;
+                traffic.notifications++;
+                traffic.bytes += PACKET_OVERHEAD + payload + EMPTY_PACKET;
+                traffic.airtimeUs += airtimeUs(payload);
+            }
+        }
+        //the stream protocol sends every reading taken this loop together, 16 to a notification
+        while(recordsThisLoop > 0){
+            int records = recordsThisLoop < 16 ? recordsThisLoop : 16;
+            int payload = 1 + 7 * records;
+            traffic.notifications++;
+            traffic.bytes += PACKET_OVERHEAD + payload + EMPTY_PACKET;
+            traffic.airtimeUs += airtimeUs(payload);
+            recordsThisLoop -= records;
+        }
+    }
+    return traffic;
+}
+
+int main(int argc, char** argv){
+    if(argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)){
+        fprintf(stderr, "usage: linksim [duration s]\n");
+        return 0;
+    }
+    double durationMs = (argc > 1 ? atof(argv[1]) : 3600) * 1000;
+    if(durationMs <= 0){
+        fprintf(stderr, "usage: linksim [duration s]\n");
+        return 1;
+    }
+
+    /* Reconnect to first data. The old protocol scans, connects, discovers 6 characteristics
+       (4 sensors, rate hint and backlog, 5 of them NOTIFY) and waits for a reading to be due,
+       half the fastest read delay on average. The stream protocol connects straight to the
+       cached address, discovers 2 (1 NOTIFY) and gets the backlog at the end of the next node loop */
+    double oldDiscovery = discoveryRequests(6, 5) * CONNECTION_INTERVAL_MS;
+    double newDiscovery = discoveryRequests(2, 1) * CONNECTION_INTERVAL_MS;
+    printf("reconnect,protocol,scan_ms,connect_ms,discovery_ms,first_data_wait_ms,total_ms\n");
+    for(const Node& node : NODES){
+        double fastest = node.sensors[0].minDelayMs;
+        for(const Sensor& sensor : node.sensors){
+            if(sensor.minDelayMs < fastest){
+                fastest = sensor.minDelayMs;
+            }
+        }
+        printf("%s,old,%.0f,%.0f,%.0f,%.0f,%.0f\n", node.name, SCAN_MS, CONNECT_MS, oldDiscovery, fastest / 2,
+            SCAN_MS + CONNECT_MS + oldDiscovery + fastest / 2);
+        printf("%s,stream,0,%.0f,%.0f,%.0f,%.0f\n", node.name, CONNECT_MS, newDiscovery, NODE_LOOP_MS / 2,
+            CONNECT_MS + newDiscovery + NODE_LOOP_MS / 2);
+    }
+
+    printf("\ntraffic,rate,protocol,readings,notifications,bytes_per_reading,airtime_us_per_reading\n");
+    for(const Node& node : NODES){
+        for(int slow = 0; slow <= 1; slow++){
+            for(int stream = 0; stream <= 1; stream++){
+                Traffic traffic = simulate(node, slow, stream, durationMs);
+                printf("%s,%s,%s,%ld,%ld,%.1f,%.0f\n", node.name, slow ? "slowest" : "fastest", stream ? "stream" : "old",
+                    traffic.readings, traffic.notifications, (double) traffic.bytes / traffic.readings,
+                    traffic.airtimeUs / traffic.readings);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * poolsoak.cpp
+ * Description: soaks the clusterhead's MemoryPool with millions of random allocate/release
+ *              cycles and reports allocation latency and free capacity per window, to show
+ *              neither drifts the longer it runs. See README.md
+ * Author: Tom Schwenke
+ * Date: 19/10/2026
+ */
+#include "MemoryPool.h"
+#include "IngestQueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+//same shape as the clusterhead's ingest pool
+static const size_t POOL_SIZE = 32;
+static const uint32_t WINDOW = 1000000;
+
+int main(int argc, char** argv){
+    uint32_t windows = argc > 1 ? strtoul(argv[1], NULL, 0) : 10;
+    srand(argc > 2 ? strtoul(argv[2], NULL, 0) : 1);
+
+    MemoryPool<IngestFrame, POOL_SIZE> pool;
+    std::vector<IngestFrame*> held;
+    std::vector<uint32_t> latencies;
+    held.reserve(POOL_SIZE);
+    latencies.reserve(WINDOW);
+
+    printf("window,allocations,failed,high_water,free_after_drain,p50_ns,p99_ns,max_ns\n");
+    for(uint32_t w = 0; w < windows; w++){
+        latencies.clear();
+        MemoryPoolStats before = pool.getStats();
+        for(uint32_t i = 0; i < WINDOW; i++){
+            //bias towards allocating while mostly empty, releasing while mostly full
+            bool allocate = held.empty() || (held.size() < POOL_SIZE + 4 && (size_t) (rand() % (POOL_SIZE + 4)) >= held.size());
+            if(allocate){
+                auto start = std::chrono::steady_clock::now();
+                IngestFrame* frame = pool.allocate();
+                auto end = std::chrono::steady_clock::now();
+                latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+                if(frame != NULL){
+                    frame->length = i & 0xFF;
+                    held.push_back(frame);
+                }
+            }
+            else{
+                //release a random block rather than the newest, to mix up the free list order
+                size_t index = rand() % held.size();
+                pool.release(held[index]);
+                held[index] = held.back();
+                held.pop_back();
+            }
+        }
+
+        MemoryPoolStats after = pool.getStats();
+
+        //drain to check every block comes back, i.e. nothing has leaked or fragmented
+        for(IngestFrame* frame : held){
+            pool.release(frame);
+        }
+        held.clear();
+        size_t freeBlocks = 0;
+        while(IngestFrame* frame = pool.allocate()){
+            held.push_back(frame);
+            freeBlocks++;
+        }
+        for(IngestFrame* frame : held){
+            pool.release(frame);
+        }
+        held.clear();
+
+        std::sort(latencies.begin(), latencies.end());
+        printf("%u,%u,%u,%u,%zu,%u,%u,%u\n", w,
+            after.allocations - before.allocations,
+            after.failedAllocations - before.failedAllocations,
+            after.highWater, freeBlocks,
+            latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100], latencies.back());
+        if(freeBlocks != POOL_SIZE){
+            fprintf(stderr, "poolsoak: only %zu of %zu blocks free after draining\n", freeBlocks, POOL_SIZE);
+            return 1;
+        }
+    }
+    return 0;
+}
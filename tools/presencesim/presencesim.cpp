@@ -0,0 +1,328 @@
+/*
+ * presencesim.cpp
+ * Description: runs people coming and going past sensor node 1's rangefinder and sensor
+ *              node 2's PIR on the host, through the nodes' AdaptiveSampler and the
+ *              clusterhead's PresenceFusion, and prints how long occupancy takes to be
+ *              confirmed and cleared, what it misses and what it reports that wasn't there.
+ *              See README.md
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#include "AdaptiveSampler.h"
+#include "PresenceFusion.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+//matches the node and clusterhead firmware
+static const uint32_t LOOP_DELAY = 100;
+static const uint32_t DISTANCE_SAMPLE_PERIOD = 200;
+static const uint32_t DISTANCE_MIN_READ_DELAY = 200;
+static const uint32_t DISTANCE_MAX_READ_DELAY = 6400;
+static const int32_t DISTANCE_CHANGE_THRESHOLD = 5;
+static const uint32_t HUMAN_DETECTOR_MIN_READ_DELAY = 500;
+static const uint32_t HUMAN_DETECTOR_MAX_READ_DELAY = 4000;
+static const int32_t HUMAN_DETECTOR_CHANGE_THRESHOLD = 1;
+
+/* The room and the people in it */
+static const double MEAN_GAP_S = 240;           //vacant between visits
+static const double PASS_FRACTION = 0.3;        //visits that are someone walking straight past
+static const double STAY_MIN_S = 10;
+static const double STAY_MAX_S = 600;
+static const double PASS_MIN_S = 2;
+static const double PASS_MAX_S = 5;
+static const double MEAN_BEAM_DWELL_S = 8;      //someone staying moves in and out of the beam
+static const double IN_BEAM_CHANCE = 0.6;
+static const double WALL_CM = 300;              //past the 255 cm a reading is clamped to
+static const double ECHO_FAILURE_CHANCE = 0.03;
+static const double STILL_MOTION_PER_S = 0.4;   //how often someone staying moves enough for the PIR
+static const uint32_t PIR_HOLD = 2500;          //HC-SR501 output stays high this long after motion
+static const double PIR_FALSE_PER_HOUR = 3;     //triggers with nobody there, e.g. warm air
+
+/* Getting a reading to the clusterhead: the next loop's drain, then the BLE connection
+   interval, with the odd one held up by retries */
+static const uint32_t LINK_MIN_DELAY = 30;
+static const uint32_t LINK_MAX_DELAY = 250;
+static const double LINK_RETRY_CHANCE = 0.01;
+static const uint32_t LINK_RETRY_DELAY = 2000;
+
+static const uint32_t EPOCH = 1603065600;
+
+struct Visit {
+    uint32_t start;     //millis
+    uint32_t end;
+    bool pass;
+    double distanceCm;  //where they stand when in the beam
+};
+
+/* A reading on its way to the clusterhead */
+struct Frame {
+    uint32_t arrival;   //millis
+    uint32_t timestamp; //node time (s), as stamped by sendReading
+    bool distance;
+    uint8_t value;
+};
+
+struct FrameLater {
+    bool operator()(const Frame& a, const Frame& b) const { return a.arrival > b.arrival; }
+};
+
+static double percentile(std::vector<double> values, double p){
+    if(values.empty()){
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t) ceil(p / 100 * values.size());
+    return values[index > 0 ? index - 1 : 0];
+}
+
+static void printLatency(const char* name, const std::vector<double>& values){
+    double sum = 0;
+    for(size_t i = 0; i < values.size(); i++){
+        sum += values[i];
+    }
+    printf("%-28s n %5zu  mean %5.2f  p50 %5.2f  p90 %5.2f  p99 %5.2f  max %5.2f s\n", name, values.size(),
+        values.empty() ? 0 : sum / values.size(), percentile(values, 50), percentile(values, 90),
+        percentile(values, 99), percentile(values, 100));
+}
+
+int main(int argc, char** argv){
+    if(argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)){
+        fprintf(stderr, "usage: presencesim [duration hours] [seed]\n");
+        return 0;
+    }
+    double hours = argc > 1 ? atof(argv[1]) : 24;
+    unsigned seed = argc > 2 ? atoi(argv[2]) : 1;
+    if(hours <= 0 || hours > 1000){
+        fprintf(stderr, "usage: presencesim [duration hours] [seed]\n");
+        return 1;
+    }
+    uint32_t duration = (uint32_t) (hours * 3600000);
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> uniform(0, 1);
+
+    //who is there when. Stays are spread evenly on a log scale, most are short
+    std::vector<Visit> visits;
+    for(double t = 0; ; ){
+        t += -log(1 - uniform(rng)) * MEAN_GAP_S * 1000;
+        Visit visit;
+        visit.pass = uniform(rng) < PASS_FRACTION;
+        double length = visit.pass ? PASS_MIN_S + (PASS_MAX_S - PASS_MIN_S) * uniform(rng)
+            : STAY_MIN_S * pow(STAY_MAX_S / STAY_MIN_S, uniform(rng));
+        visit.start = (uint32_t) t;
+        visit.end = (uint32_t) (t + length * 1000);
+        visit.distanceCm = 50 + 60 * uniform(rng);
+        if(visit.end >= duration){
+            break;
+        }
+        visits.push_back(visit);
+        t = visit.end;
+    }
+
+    //the nodes' clocks are cloud synced, to within a fraction of a second of each other
+    int32_t distanceSkew = (int32_t) (uniform(rng) * 1000) - 500;
+    int32_t pirSkew = (int32_t) (uniform(rng) * 1000) - 500;
+
+    AdaptiveSampler distanceSampler(DISTANCE_MIN_READ_DELAY, DISTANCE_MAX_READ_DELAY, DISTANCE_CHANGE_THRESHOLD);
+    AdaptiveSampler humanDetectorSampler(HUMAN_DETECTOR_MIN_READ_DELAY, HUMAN_DETECTOR_MAX_READ_DELAY, HUMAN_DETECTOR_CHANGE_THRESHOLD);
+    PresenceFusion fusion;
+    std::vector<Frame> inFlight;
+
+    uint32_t lastDistanceSample = 0;
+    uint32_t distanceSum = 0;
+    uint32_t distanceCount = 0;
+    int lastHumanDetectorValue = 0;
+    bool inBeam = false;
+    uint32_t beamChange = 0;
+    uint32_t lastMotion = 0;
+    bool motionSeen = false;
+    uint32_t distanceReadings = 0;
+    uint32_t humanDetectorReadings = 0;
+
+    std::vector<uint8_t> truth(duration / LOOP_DELAY, 0);
+    std::vector<uint8_t> fused(duration / LOOP_DELAY, 0);
+    std::vector<uint32_t> occupiedAt;   //millis each occupied transition was taken
+    std::vector<double> reportedLatency;
+    size_t current = 0;
+
+    for(uint32_t now = 0; now / LOOP_DELAY < truth.size(); now += LOOP_DELAY){
+        while(current < visits.size() && visits[current].end <= now){
+            current++;
+        }
+        const Visit* visit = current < visits.size() && visits[current].start <= now ? &visits[current] : NULL;
+        truth[now / LOOP_DELAY] = visit != NULL;
+
+        //where the person is
+        if(visit == NULL){
+            inBeam = false;
+            beamChange = now;
+        }
+        else if(visit->pass){
+            //crosses the beam halfway along
+            uint32_t middle = visit->start + (visit->end - visit->start) / 2;
+            inBeam = now + 500 >= middle && now < middle + 500;
+        }
+        else if(now >= beamChange){
+            inBeam = uniform(rng) < IN_BEAM_CHANCE;
+            beamChange = now + (uint32_t) (-log(1 - uniform(rng)) * MEAN_BEAM_DWELL_S * 1000);
+        }
+        double motionChance = visit == NULL ? PIR_FALSE_PER_HOUR / 36000
+            : visit->pass ? 1 : STILL_MOTION_PER_S * LOOP_DELAY / 1000;
+        if(uniform(rng) < motionChance){
+            lastMotion = now;
+            motionSeen = true;
+        }
+        bool pirHigh = motionSeen && now - lastMotion < PIR_HOLD;
+
+        //sensor node 1, as in its loop(): raw samples into the mean, readings when the sampler says
+        uint32_t node1Time = (uint32_t) (((int64_t) EPOCH * 1000 + now + distanceSkew) / 1000);
+        if(now - lastDistanceSample >= DISTANCE_SAMPLE_PERIOD){
+            lastDistanceSample = now;
+            if(uniform(rng) >= ECHO_FAILURE_CHANCE){
+                double cm = (inBeam ? visit->distanceCm : WALL_CM) + 6 * uniform(rng) - 3;
+                distanceSum += cm > 255 ? 255 : (uint32_t) cm;
+                distanceCount++;
+            }
+        }
+        if(distanceSampler.due(now)){
+            if(distanceCount > 0){
+                uint8_t value = (uint8_t) ((distanceSum + distanceCount / 2) / distanceCount);
+                distanceSum = 0;
+                distanceCount = 0;
+                distanceSampler.update(now, value);
+                uint32_t delay = LINK_MIN_DELAY + (uint32_t) ((LINK_MAX_DELAY - LINK_MIN_DELAY) * uniform(rng))
+                    + (uniform(rng) < LINK_RETRY_CHANCE ? LINK_RETRY_DELAY : 0);
+                Frame frame = { now + LOOP_DELAY + delay, node1Time, true, value };
+                inFlight.push_back(frame);
+                std::push_heap(inFlight.begin(), inFlight.end(), FrameLater());
+                distanceReadings++;
+            }
+            else{
+                distanceSampler.skip(now);
+            }
+        }
+
+        //sensor node 2, the PIR is only sent when it changes
+        uint32_t node2Time = (uint32_t) (((int64_t) EPOCH * 1000 + now + pirSkew) / 1000);
+        if(humanDetectorSampler.due(now)){
+            int value = pirHigh ? 1 : 0;
+            humanDetectorSampler.update(now, value);
+            if(value != lastHumanDetectorValue){
+                uint32_t delay = LINK_MIN_DELAY + (uint32_t) ((LINK_MAX_DELAY - LINK_MIN_DELAY) * uniform(rng))
+                    + (uniform(rng) < LINK_RETRY_CHANCE ? LINK_RETRY_DELAY : 0);
+                Frame frame = { now + LOOP_DELAY + delay, node2Time, false, (uint8_t) value };
+                inFlight.push_back(frame);
+                std::push_heap(inFlight.begin(), inFlight.end(), FrameLater());
+                lastHumanDetectorValue = value;
+                humanDetectorReadings++;
+            }
+        }
+
+        //the clusterhead: readings as they arrive, then checkPresence()
+        while(!inFlight.empty() && inFlight.front().arrival <= now){
+            Frame frame = inFlight.front();
+            std::pop_heap(inFlight.begin(), inFlight.end(), FrameLater());
+            inFlight.pop_back();
+            if(frame.distance){
+                fusion.onDistance(frame.timestamp, frame.value);
+            }
+            else{
+                fusion.onHumanDetector(frame.timestamp, frame.value);
+            }
+        }
+        fusion.update(EPOCH + now / 1000);
+        PresenceTransition transition;
+        while(fusion.takeTransition(transition)){
+            if(transition.occupied){
+                occupiedAt.push_back(now);
+            }
+            reportedLatency.push_back(transition.latency);
+        }
+        fused[now / LOOP_DELAY] = fusion.occupied();
+    }
+
+    //score every visit against what the clusterhead reported
+    std::vector<double> enterLatency, exitLatency;
+    size_t stays = 0, passes = 0, missed = 0, carried = 0, merged = 0, passesReported = 0;
+    for(size_t v = 0; v < visits.size(); v++){
+        const Visit& visit = visits[v];
+        size_t first = visit.start / LOOP_DELAY;
+        size_t last = visit.end / LOOP_DELAY;
+        size_t next = v + 1 < visits.size() ? visits[v + 1].start / LOOP_DELAY : fused.size();
+        if(visit.pass){
+            //walking past is someone there too, but short enough that it's fine either way
+            passes++;
+            for(size_t k = first; k < last + (PRESENCE_ENTER_HOLD + 3) * 1000 / LOOP_DELAY && k < next; k++){
+                if(fused[k] && !fused[first]){
+                    passesReported++;
+                    break;
+                }
+            }
+            continue;
+        }
+        stays++;
+        if(fused[first]){
+            carried++;//still occupied from the visit before
+        }
+        else{
+            size_t k = first;
+            while(k < last && !fused[k]){
+                k++;
+            }
+            if(k == last){
+                missed++;
+                continue;
+            }
+            enterLatency.push_back((k - first) * LOOP_DELAY / 1000.0);
+        }
+        size_t k = last;
+        while(k < next && fused[k]){
+            k++;
+        }
+        if(k == next && next < fused.size()){
+            merged++;//still occupied when the next visit started
+        }
+        else if(k < fused.size()){
+            exitLatency.push_back((k - last) * LOOP_DELAY / 1000.0);
+        }
+    }
+
+    //occupied with nobody there, not counting the exit hold after someone leaves
+    size_t falseOccupied = 0;
+    for(size_t i = 0; i < occupiedAt.size(); i++){
+        size_t k = occupiedAt[i] / LOOP_DELAY;
+        size_t quiet = 0;
+        while(quiet < 5000 / LOOP_DELAY && quiet <= k && !truth[k - quiet]){
+            quiet++;
+        }
+        if(quiet == 5000 / LOOP_DELAY){
+            falseOccupied++;
+        }
+    }
+    size_t agree = 0, vacantTicks = 0, falseTicks = 0;
+    for(size_t k = 0; k < fused.size(); k++){
+        agree += fused[k] == truth[k];
+        if(!truth[k]){
+            vacantTicks++;
+            falseTicks += fused[k];
+        }
+    }
+
+    printf("%.1f hours, seed %u, node clocks %+d ms and %+d ms\n", hours, seed, (int) distanceSkew, (int) pirSkew);
+    printf("stays %zu: missed %zu, already occupied %zu, still occupied at the next %zu\n", stays, missed, carried, merged);
+    printf("passes %zu: reported occupied %zu\n", passes, passesReported);
+    printLatency("enter (from arriving)", enterLatency);
+    printLatency("exit (from leaving)", exitLatency);
+    printLatency("fusion's own latency field", reportedLatency);
+    printf("false occupied transitions %zu, occupied for %.1f%% of the vacant time\n", falseOccupied,
+        vacantTicks > 0 ? 100.0 * falseTicks / vacantTicks : 0);
+    printf("agreement with ground truth %.2f%%\n", 100.0 * agree / fused.size());
+    printf("uplink: %u distance and %u PIR readings in, %zu transitions out, %u candidates suppressed\n",
+        distanceReadings, humanDetectorReadings, reportedLatency.size(), fusion.suppressed());
+    return 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * Particle.h
+ * Description: the little of Device OS that QueryServer and SeriesStore use, for building
+ *              them on a host. USBSerial is a file descriptor, a pty in querysim, and the
+ *              log goes to the same port as it does on the clusterhead. See README.md
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#pragma once
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <chrono>
+#include <mutex>
+
+inline unsigned long micros(){
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return (unsigned long) std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline unsigned long millis(){
+    return micros() / 1000;
+}
+
+class USBSerial {
+public:
+    USBSerial() : fd(-1) {}
+
+    void attach(int fd){ this->fd = fd; }
+
+    int available(){
+        int pending = 0;
+        if(fd < 0 || ioctl(fd, FIONREAD, &pending) != 0){
+            return 0;
+        }
+        return pending;
+    }
+
+    int read(){
+        uint8_t byte;
+        return fd >= 0 && ::read(fd, &byte, 1) == 1 ? byte : -1;
+    }
+
+    size_t write(const uint8_t* data, size_t length){
+        size_t written = 0;
+        while(fd >= 0 && written < length){
+            ssize_t n = ::write(fd, data + written, length - written);
+            if(n < 0 && errno == EINTR){
+                continue;
+            }
+            if(n <= 0){
+                break;//non-blocking and nobody reading, dropped as a USB port with no host drops it
+            }
+            written += n;
+        }
+        return written;
+    }
+
+    void lock(){ mutex.lock(); }
+    void unlock(){ mutex.unlock(); }
+
+private:
+    int fd;
+    std::recursive_mutex mutex;
+};
+
+extern USBSerial Serial;
+
+#define WITH_LOCK(port) for(bool locked = ((port).lock(), true); locked; (port).unlock(), locked = false)
+
+/* Writes each line to Serial the way SerialLogHandler does, so the host side has to skip log
+   text between frames as it does against a real clusterhead. trace is left out, as at the
+   level the clusterhead logs at over a long run it would drown everything else */
+class Logger {
+public:
+    void info(const char* format, ...){ va_list args; va_start(args, format); line("INFO", format, args); va_end(args); }
+    void warn(const char* format, ...){ va_list args; va_start(args, format); line("WARN", format, args); va_end(args); }
+    void error(const char* format, ...){ va_list args; va_start(args, format); line("ERROR", format, args); va_end(args); }
+    void trace(const char* /*format*/, ...){}
+
+private:
+    void line(const char* level, const char* format, va_list args){
+        char text[256];
+        int length = snprintf(text, sizeof(text), "%010lu [app] %s: ", millis(), level);
+        length += vsnprintf(text + length, sizeof(text) - length - 2, format, args);
+        if(length > (int) sizeof(text) - 3){
+            length = sizeof(text) - 3;
+        }
+        text[length++] = '\r';
+        text[length++] = '\n';
+        WITH_LOCK(Serial){
+            Serial.write((const uint8_t*) text, length);
+        }
+    }
+};
+
+extern Logger Log;
@@ -0,0 +1,525 @@
+/*
+ * querysim.cpp
+ * Description: host simulation of the clusterhead's serial query protocol. Runs the
+ *              firmware's own SeriesStore and QueryServer behind a pty, fed by two simulated
+ *              nodes that drop out now and then and catch up live readings first, as the
+ *              real ones do. Serves chquery on the pty, or checks every response against
+ *              what the store holds. See README.md
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#include "Particle.h"
+#include "QueryProtocol.h"
+#include "QueryServer.h"
+#include "SeriesStore.h"
+#include "TimeSeriesCodec.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <random>
+#include <thread>
+#include <vector>
+
+USBSerial Serial;
+Logger Log;
+
+static const uint32_t START_TIME = 1603065600;
+//records a node gets through per second once reconnected, several notifications' worth
+static const size_t RECORDS_PER_SECOND = 40;
+static const int RESPONSE_TIMEOUT_MS = 5000;
+
+/* The series each node reads, at the rates they settle at when nothing is happening */
+struct SimSeries {
+    uint8_t series;
+    uint8_t node;
+    uint32_t interval;  //s
+    double mean;
+    double swing;       //half the daily cycle
+    double noise;       //uniform, plus or minus
+};
+static const SimSeries SIM_SERIES[] = {
+    { SERIES_TEMPERATURE_1, 1, 30, 22, 3, 0.5 },
+    { SERIES_HUMIDITY, 1, 30, 55, 10, 1 },
+    { SERIES_LIGHT_1, 1, 5, 900, 900, 4 },
+    { SERIES_DISTANCE, 1, 2, 200, 0, 1 },
+    { SERIES_TEMPERATURE_2, 2, 30, 21, 3, 0.5 },
+    { SERIES_LIGHT_2, 2, 5, 700, 700, 4 },
+    { SERIES_SOUND, 2, 2, 300, 40, 25 },
+    { SERIES_HUMAN_DETECTOR, 2, 10, 0, 0, 0 },
+};
+static const size_t SIM_SERIES_COUNT = sizeof(SIM_SERIES) / sizeof(SIM_SERIES[0]);
+
+struct Record {
+    uint8_t series;
+    uint32_t timestamp;
+    int32_t value;
+};
+
+/* A node's backlog, sent the way drainBacklog() sends it: readings queued while connected
+   go first, then the backlog oldest first */
+struct SimNode {
+    uint32_t outageEvery;   //s, a stretch out of range starts this often
+    uint32_t outageOffset;
+    uint32_t outageLength;
+    std::deque<Record> backlog;
+    size_t live;
+    int32_t lastHuman;
+
+    bool connected(uint32_t t) const {
+        return (t - START_TIME + outageEvery - outageOffset) % outageEvery >= outageLength;
+    }
+};
+
+class Simulation {
+public:
+    Simulation(SeriesStore& store, QueryServer& server, uint32_t seed) : store(store), server(server), rng(seed), now(START_TIME) {
+        SimNode first = { 3600, 1800, 600, std::deque<Record>(), 0, 0 };
+        SimNode second = { 3600, 2400, 300, std::deque<Record>(), 0, 0 };
+        nodes[0] = first;
+        nodes[1] = second;
+        memset(delivered, 0, sizeof(delivered));
+    }
+
+    // Advance one simulated second: read what's due on each node and send what the link allows
+    void step(){
+        for(size_t i = 0; i < SIM_SERIES_COUNT; i++){
+            const SimSeries& s = SIM_SERIES[i];
+            if((now - START_TIME) % s.interval != 0){
+                continue;
+            }
+            SimNode& node = nodes[s.node - 1];
+            int32_t value;
+            if(s.series == SERIES_HUMAN_DETECTOR){
+                //only sent when it changes
+                value = rng() % 12 == 0 ? !node.lastHuman : node.lastHuman;
+                if(value == node.lastHuman){
+                    continue;
+                }
+                node.lastHuman = value;
+            }
+            else{
+                std::uniform_real_distribution<double> noise(-s.noise, s.noise);
+                double phase = 2 * M_PI * (now - START_TIME) / 86400.0;
+                double raw = s.mean + s.swing * sin(phase) + noise(rng);
+                //someone walks past the rangefinder now and then
+                if(s.series == SERIES_DISTANCE && rng() % 300 == 0){
+                    raw = 40 + rng() % 80;
+                }
+                value = (int32_t) lround(raw < 0 ? 0 : raw);
+            }
+            Record record = { s.series, now, value };
+            node.backlog.push_back(record);
+            node.live = node.connected(now) ? node.live + 1 : 0;
+        }
+        for(int n = 0; n < 2; n++){
+            drain(nodes[n]);
+        }
+        now++;
+    }
+
+    uint32_t time() const { return now; }
+    uint32_t count(uint8_t series) const { return delivered[series]; }
+
+    // The newest reading delivered for a series. False if there has been none
+    bool newest(uint8_t series, Record& out) const {
+        if(delivered[series] == 0){
+            return false;
+        }
+        out = newestRecord[series];
+        return true;
+    }
+
+private:
+    void drain(SimNode& node){
+        if(!node.connected(now)){
+            return;
+        }
+        size_t budget = RECORDS_PER_SECOND;
+        if(node.live > node.backlog.size()){
+            node.live = node.backlog.size();
+        }
+        //live readings first, oldest first among them
+        size_t live = std::min(node.live, budget);
+        for(size_t i = node.backlog.size() - live; i < node.backlog.size(); i++){
+            deliver(node.backlog[i]);
+        }
+        node.backlog.erase(node.backlog.end() - live, node.backlog.end());
+        node.live -= live;
+        budget -= live;
+        while(budget > 0 && node.backlog.size() > node.live){
+            deliver(node.backlog.front());
+            node.backlog.pop_front();
+            budget--;
+        }
+    }
+
+    void deliver(const Record& record){
+        //recordReading() in the clusterhead
+        store.append(record.series, record.timestamp, record.value);
+        server.onSample(record.series, record.timestamp, record.value);
+        if(delivered[record.series] == 0 || record.timestamp >= newestRecord[record.series].timestamp){
+            newestRecord[record.series] = record;
+        }
+        delivered[record.series]++;
+    }
+
+    SeriesStore& store;
+    QueryServer& server;
+    std::mt19937 rng;
+    uint32_t now;
+    SimNode nodes[2];
+    uint32_t delivered[SERIES_COUNT];
+    Record newestRecord[SERIES_COUNT];
+};
+
+/* A pty with the server on the master side. Both ends are raw so frames pass untouched, and
+   the slave is held open so writes don't fail before a client has opened it */
+static int openPty(bool blocking, int& slave, char* path, size_t pathSize){
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if(master < 0 || grantpt(master) != 0 || unlockpt(master) != 0){
+        fprintf(stderr, "querysim: can't open a pty: %s\n", strerror(errno));
+        return -1;
+    }
+    snprintf(path, pathSize, "%s", ptsname(master));
+    slave = open(path, O_RDWR | O_NOCTTY);
+    struct termios tio;
+    int ends[2] = { master, slave };
+    for(int i = 0; i < 2; i++){
+        if(tcgetattr(ends[i], &tio) == 0){
+            cfmakeraw(&tio);
+            tcsetattr(ends[i], TCSANOW, &tio);
+        }
+    }
+    if(!blocking){
+        fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+    }
+    return master;
+}
+
+/* Client side, as chquery does it */
+static bool sendRequest(int fd, uint8_t type, const uint8_t* payload, uint16_t length){
+    uint8_t frame[QP_HEADER_SIZE + QP_MAX_PAYLOAD + QP_CRC_SIZE];
+    size_t frameLength = qpEncodeFrame(type, payload, length, frame);
+    return write(fd, frame, frameLength) == (ssize_t) frameLength;
+}
+
+static bool readFrame(int fd, QueryFrameParser& parser, int timeoutMs){
+    static uint8_t buffer[256];
+    static size_t pending = 0, offset = 0;
+    for(;;){
+        while(offset < pending){
+            if(parser.feed(buffer[offset++])){
+                return true;
+            }
+        }
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        if(poll(&pfd, 1, timeoutMs) <= 0){
+            return false;
+        }
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if(n <= 0){
+            return false;
+        }
+        pending = n;
+        offset = 0;
+    }
+}
+
+static bool sampleLess(const Record& a, const Record& b){
+    return a.timestamp != b.timestamp ? a.timestamp < b.timestamp : a.value < b.value;
+}
+
+/* Every held sample of a series within [from, to], straight from the store */
+static std::vector<Record> heldSamples(SeriesStore& store, uint8_t series, uint32_t from, uint32_t to){
+    std::vector<Record> out;
+    SealedBlock block;
+    uint32_t next = store.nextSequence();
+    for(uint32_t sequence = store.oldestSequence(); sequence <= next; sequence++){
+        bool found = sequence < next ? store.copySealed(sequence, block) && block.series == series : store.copyOpen(series, block);
+        TimeSeriesDecoder decoder;
+        Record record = { series, 0, 0 };
+        if(found && decoder.begin(block.data, block.length)){
+            while(decoder.next(record.timestamp, record.value)){
+                if(record.timestamp >= from && record.timestamp <= to){
+                    out.push_back(record);
+                }
+            }
+        }
+    }
+    std::sort(out.begin(), out.end(), sampleLess);
+    return out;
+}
+
+/* Run a range query and compare what comes back, trimmed as chquery trims it, with the store */
+static bool checkRange(int fd, SeriesStore& store, uint8_t series, uint32_t from, uint32_t to, size_t& samples){
+    uint8_t request[9];
+    request[0] = series;
+    qpPut32(request + 1, from);
+    qpPut32(request + 5, to);
+    sendRequest(fd, QP_REQ_RANGE, request, sizeof(request));
+
+    std::vector<Record> received;
+    QueryFrameParser parser;
+    uint16_t blocks = 0;
+    for(;;){
+        if(!readFrame(fd, parser, RESPONSE_TIMEOUT_MS)){
+            fprintf(stderr, "querysim: range %u %lu-%lu timed out\n", series, (unsigned long) from, (unsigned long) to);
+            return false;
+        }
+        if(parser.type() == QP_RESP_END && parser.length() >= 3 && parser.payload()[0] == QP_REQ_RANGE){
+            break;
+        }
+        if(parser.type() != QP_RESP_BLOCK || parser.length() < 5 || parser.payload()[0] != series){
+            continue;
+        }
+        blocks++;
+        TimeSeriesDecoder decoder;
+        Record record = { series, 0, 0 };
+        decoder.begin(parser.payload() + 5, parser.length() - 5);
+        while(decoder.next(record.timestamp, record.value)){
+            if(record.timestamp >= from && record.timestamp <= to){
+                received.push_back(record);
+            }
+        }
+    }
+    std::sort(received.begin(), received.end(), sampleLess);
+    std::vector<Record> expected = heldSamples(store, series, from, to);
+    samples += received.size();
+    if(received.size() != expected.size()){
+        fprintf(stderr, "querysim: range %u %lu-%lu returned %zu samples in %u blocks, the store holds %zu\n", series,
+            (unsigned long) from, (unsigned long) to, received.size(), blocks, expected.size());
+        return false;
+    }
+    for(size_t i = 0; i < expected.size(); i++){
+        if(received[i].timestamp != expected[i].timestamp || received[i].value != expected[i].value){
+            fprintf(stderr, "querysim: range %u %lu-%lu differs from the store at sample %zu\n", series,
+                (unsigned long) from, (unsigned long) to, i);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool checkLatest(int fd, const Simulation& sim){
+    sendRequest(fd, QP_REQ_LATEST, NULL, 0);
+    QueryFrameParser parser;
+    while(readFrame(fd, parser, RESPONSE_TIMEOUT_MS)){
+        if(parser.type() != QP_RESP_LATEST){
+            continue;
+        }
+        bool ok = true;
+        size_t entries = 0;
+        for(uint16_t i = 0; i + QP_LATEST_ENTRY_SIZE <= parser.length(); i += QP_LATEST_ENTRY_SIZE, entries++){
+            const uint8_t* entry = parser.payload() + i;
+            Record newest;
+            if(!sim.newest(entry[0], newest) || qpGet32(entry + 1) != newest.timestamp
+                || (int32_t) qpGet32(entry + 5) != newest.value){
+                fprintf(stderr, "querysim: latest for series %u is %lu %ld, not the newest reading\n", entry[0],
+                    (unsigned long) qpGet32(entry + 1), (long) (int32_t) qpGet32(entry + 5));
+                ok = false;
+            }
+        }
+        if(entries != SIM_SERIES_COUNT){
+            fprintf(stderr, "querysim: latest has %zu series, expected %zu\n", entries, SIM_SERIES_COUNT);
+            ok = false;
+        }
+        return ok;
+    }
+    fprintf(stderr, "querysim: latest timed out\n");
+    return false;
+}
+
+static bool checkStats(int fd, const Simulation& sim){
+    sendRequest(fd, QP_REQ_STATS, NULL, 0);
+    QueryFrameParser parser;
+    while(readFrame(fd, parser, RESPONSE_TIMEOUT_MS)){
+        if(parser.type() != QP_RESP_STATS){
+            continue;
+        }
+        bool ok = true;
+        for(uint16_t i = 0; i + QP_STATS_ENTRY_SIZE <= parser.length(); i += QP_STATS_ENTRY_SIZE){
+            const uint8_t* entry = parser.payload() + i;
+            if(entry[0] >= SERIES_COUNT || qpGet32(entry + 1) != sim.count(entry[0])){
+                fprintf(stderr, "querysim: stats count for series %u is %lu\n", entry[0], (unsigned long) qpGet32(entry + 1));
+                ok = false;
+            }
+        }
+        return ok;
+    }
+    fprintf(stderr, "querysim: stats timed out\n");
+    return false;
+}
+
+/* Subscribe to everything, feed a minute more and check each delivered reading is pushed */
+static bool checkSubscribe(int fd, Simulation& sim){
+    uint8_t request[2];
+    qpPut16(request, (1 << SERIES_COUNT) - 1);
+    sendRequest(fd, QP_REQ_SUBSCRIBE, request, sizeof(request));
+    QueryFrameParser parser;
+    if(!readFrame(fd, parser, RESPONSE_TIMEOUT_MS) || parser.type() != QP_RESP_END){
+        fprintf(stderr, "querysim: subscribe wasn't acknowledged\n");
+        return false;
+    }
+    uint32_t before = 0;
+    for(uint8_t s = 0; s < SERIES_COUNT; s++){
+        before += sim.count(s);
+    }
+    size_t pushed = 0;
+    for(int second = 0; second < 60; second++){
+        sim.step();
+        while(readFrame(fd, parser, 20)){
+            if(parser.type() == QP_RESP_SAMPLE){
+                pushed++;
+            }
+        }
+    }
+    while(readFrame(fd, parser, 200)){
+        if(parser.type() == QP_RESP_SAMPLE){
+            pushed++;
+        }
+    }
+    uint32_t after = 0;
+    for(uint8_t s = 0; s < SERIES_COUNT; s++){
+        after += sim.count(s);
+    }
+    qpPut16(request, 0);
+    sendRequest(fd, QP_REQ_SUBSCRIBE, request, sizeof(request));
+    //the server's queue holds QUERY_SAMPLE_QUEUE between polls, and drops beyond that
+    if(pushed != after - before){
+        fprintf(stderr, "querysim: %zu samples pushed to the subscriber, %lu delivered\n", pushed, (unsigned long) (after - before));
+        return false;
+    }
+    return true;
+}
+
+static void serveLoop(QueryServer& server, std::atomic<bool>& running){
+    while(running){
+        server.poll();
+        usleep(200);
+    }
+}
+
+static int runCheck(uint32_t hours, int queries, uint32_t seed){
+    int slave;
+    char path[64];
+    int master = openPty(true, slave, path, sizeof(path));
+    if(master < 0){
+        return 1;
+    }
+    Serial.attach(master);
+    SeriesStore store;
+    QueryServer server(store, Serial);
+    Simulation sim(store, server, seed);
+    //stop ten minutes after the first node last came back, so blocks holding its catch up
+    //are still in the store
+    while(sim.time() < START_TIME + hours * 3600 - 600){
+        sim.step();
+    }
+    size_t unordered = 0;
+    SealedBlock block;
+    for(uint32_t sequence = store.oldestSequence(); store.copySealed(sequence, block); sequence++){
+        TimeSeriesDecoder decoder;
+        uint32_t timestamp, last = 0;
+        int32_t value;
+        bool ordered = true;
+        decoder.begin(block.data, block.length);
+        while(decoder.next(timestamp, value)){
+            ordered = ordered && timestamp >= last;
+            last = timestamp;
+        }
+        unordered += ordered ? 0 : 1;
+    }
+
+    std::atomic<bool> running(true);
+    std::thread serverThread(serveLoop, std::ref(server), std::ref(running));
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    std::mt19937 rng(seed);
+    int failures = 0;
+    size_t samples = 0;
+    if(!checkLatest(fd, sim)){
+        failures++;
+    }
+    if(!checkStats(fd, sim)){
+        failures++;
+    }
+    //ranges over what the store still holds and a little either side, many across catch ups
+    uint32_t held = store.oldestSequence();
+    uint32_t earliest = START_TIME;
+    TimeSeriesDecoder decoder;
+    uint32_t timestamp;
+    int32_t value;
+    if(store.copySealed(held, block) && decoder.begin(block.data, block.length) && decoder.next(timestamp, value)){
+        earliest = timestamp - 1800;
+    }
+    for(int q = 0; q < queries; q++){
+        const SimSeries& s = SIM_SERIES[rng() % SIM_SERIES_COUNT];
+        uint32_t from = earliest + rng() % (sim.time() - earliest);
+        uint32_t to = from + rng() % 1800;
+        if(!checkRange(fd, store, s.series, from, to, samples)){
+            failures++;
+        }
+    }
+    if(!checkSubscribe(fd, sim)){
+        failures++;
+    }
+    running = false;
+    serverThread.join();
+    close(fd);
+    close(slave);
+    close(master);
+    printf("querysim: %lu s simulated, %zu held blocks out of time order, %d range queries returning %zu samples, %d failures\n",
+        (unsigned long) (sim.time() - START_TIME), unordered, queries, samples, failures);
+    return failures > 0 ? 1 : 0;
+}
+
+static int runServe(uint32_t speed, uint32_t seed){
+    int slave;
+    char path[64];
+    int master = openPty(false, slave, path, sizeof(path));
+    if(master < 0){
+        return 1;
+    }
+    Serial.attach(master);
+    SeriesStore store;
+    QueryServer server(store, Serial);
+    Simulation sim(store, server, seed);
+    printf("%s\n", path);
+    fflush(stdout);
+    fprintf(stderr, "querysim: serving on %s from unix time %lu, %lu simulated s per real s\n", path,
+        (unsigned long) START_TIME, (unsigned long) speed);
+    unsigned long start = millis();
+    uint64_t stepped = 0;
+    for(;;){
+        //catch the simulation up to real time, a simulated second at a time
+        uint64_t due = (uint64_t) (millis() - start) * speed / 1000;
+        while(stepped < due){
+            sim.step();
+            stepped++;
+        }
+        server.poll();
+        usleep(1000);
+    }
+}
+
+int main(int argc, char** argv){
+    if(argc >= 2 && strcmp(argv[1], "check") == 0){
+        uint32_t hours = argc >= 3 ? strtoul(argv[2], NULL, 0) : 6;
+        int queries = argc >= 4 ? atoi(argv[3]) : 500;
+        uint32_t seed = argc >= 5 ? strtoul(argv[4], NULL, 0) : 1;
+        return runCheck(hours > 0 ? hours : 1, queries, seed);
+    }
+    if(argc >= 2 && strcmp(argv[1], "serve") == 0){
+        uint32_t speed = argc >= 3 ? strtoul(argv[2], NULL, 0) : 60;
+        uint32_t seed = argc >= 4 ? strtoul(argv[3], NULL, 0) : 1;
+        return runServe(speed > 0 ? speed : 1, seed);
+    }
+    fprintf(stderr, "usage: querysim check [hours] [queries] [seed]\n"
+                    "       querysim serve [simulated s per s] [seed]\n");
+    return 2;
+}
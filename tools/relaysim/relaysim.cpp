@@ -0,0 +1,348 @@
+/*
+ * relaysim.cpp
+ * Description: host simulation of relay mode. Scatters clusterheads over a site, lets them
+ *              pick parents and take on children with the firmware's RelayRouter from
+ *              simulated beacons, then pushes compressed blocks up the tree through
+ *              RelayBatchWriter/Reader. Children take turns on their parent's spare link and
+ *              send no more than it grants them, as in the firmware. Prints end-to-end latency
+ *              and delivered throughput against tree depth as CSV.
+ * Author: Tom Schwenke
+ * Date: 19/10/2026
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#include <random>
+#include <vector>
+#include "RelayRouter.h"
+
+//matches the firmware
+const size_t BATCH_SIZE = 244;
+const size_t BLOCK_SIZE = 128;
+const size_t PENDING_BLOCKS = RELAY_MAX_CHILDREN * 12;   //RELAY_PENDING_BLOCKS
+const size_t OWN_BLOCKS = 24;                           //SERIES_LOG_BLOCKS, sealed blocks kept in RAM
+const int SCAN_INTERVAL = 30;                           //RELAY_SCAN_INTERVAL
+const int TURN = 5;                                     //RELAY_CHILD_TURN
+const int TURN_SENDING = 4;                             //less RELAY_TURN_GUARD, rounded down
+const size_t MIN_GRANT = 4;                             //RELAY_MIN_GRANT
+const int ATTACH_TIMEOUT = 60;                          //RELAY_ATTACH_TIMEOUT
+//seconds to connect to a child and find its characteristics at the start of a turn
+const int CONNECT_TIME = 1;
+
+struct Block {
+    uint32_t origin;
+    uint16_t epoch;
+    uint32_t sequence;
+    uint8_t series;
+    uint8_t length;
+    uint8_t depth;      //hops from the root of the cluster that sealed it, when it did
+    double createdAt;
+};
+
+/* The turn a parent is giving one of its children, as serveRelayChildren() does */
+struct Turn {
+    bool connected;
+    int slot;
+    uint32_t childId;
+    int startedAt;      //when the child can start sending, after connecting
+    size_t granted;
+    size_t received;
+    bool idle;          //the child sent nothing in the last second
+};
+
+struct Cluster {
+    double x, y;
+    RelayRouter router;
+    std::deque<Block> pending;  //received from children, oldest first
+    std::deque<Block> own;      //sealed here and not yet sent up
+    uint32_t nextSequence;
+    double nextSeal;
+    int nextScan;
+    Turn turn;
+    uint32_t attachedTo;        //who last gave us a turn, when, and how much is left of its grant
+    int attachedAt;
+    size_t grant;
+    uint32_t dropped;           //relayed blocks pushed out of a full pending queue
+    uint32_t lost;              //own blocks overwritten before they could be sent
+};
+
+struct DepthStats {
+    uint32_t clusters = 0;
+    uint32_t generated = 0;
+    uint32_t delivered = 0;
+    double latencySum = 0;
+    double latencyMax = 0;
+};
+
+static void usage(){
+    fprintf(stderr, "usage: relaysim [clusters] [site metres] [seal interval s] [batches per link per s] [duration s] [seed]\n");
+    fprintf(stderr, "defaults:  relaysim 40 200 60 4 3600 1\n");
+}
+
+int main(int argc, char** argv){
+    if(argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)){
+        usage();
+        return 0;
+    }
+    int clusterCount = argc > 1 ? atoi(argv[1]) : 40;
+    double site = argc > 2 ? atof(argv[2]) : 200;
+    double sealInterval = argc > 3 ? atof(argv[3]) : 60;
+    int linkRate = argc > 4 ? atoi(argv[4]) : 4;
+    int duration = argc > 5 ? atoi(argv[5]) : 3600;
+    unsigned seed = argc > 6 ? atoi(argv[6]) : 1;
+    if(clusterCount < 1 || site <= 0 || sealInterval <= 0 || linkRate < 1 || duration < 1){
+        usage();
+        return 1;
+    }
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> position(0, site);
+    std::normal_distribution<double> fading(0, 4);
+    //each of the firmware's series seals a block of roughly this size per interval
+    std::uniform_int_distribution<int> blockLength(40, BLOCK_SIZE);
+    const uint8_t seriesPerCluster = 9;
+
+    //cluster 0 is the cloud connected root, in the middle of the site
+    std::vector<Cluster> clusters(clusterCount);
+    for(int i = 0; i < clusterCount; i++){
+        Cluster& cluster = clusters[i];
+        cluster.x = i == 0 ? site / 2 : position(rng);
+        cluster.y = i == 0 ? site / 2 : position(rng);
+        cluster.router.begin(i + 1, rng() & 0xFFFF);
+        cluster.router.setRoot(i == 0);
+        cluster.nextSequence = 0;
+        cluster.nextSeal = sealInterval * (i + 1) / clusterCount;
+        cluster.nextScan = SCAN_INTERVAL * i / clusterCount;
+        cluster.turn = Turn();
+        cluster.turn.slot = -1;
+        cluster.attachedTo = 0;
+        cluster.attachedAt = 0;
+        cluster.grant = 0;
+        cluster.dropped = 0;
+        cluster.lost = 0;
+    }
+
+    //log distance path loss, 1m reference of -45 dBm, exponent 2.5, plus per beacon fading
+    auto rssi = [&](const Cluster& a, const Cluster& b){
+        double distance = hypot(a.x - b.x, a.y - b.y);
+        double level = -45 - 25 * log10(distance < 1 ? 1 : distance) + fading(rng);
+        return (int8_t) (level < -127 ? -127 : level);
+    };
+    auto upstreamAttached = [&](const Cluster& cluster, int now){
+        return cluster.router.parent() != 0 && cluster.attachedTo == cluster.router.parent()
+            && now - cluster.attachedAt < ATTACH_TIMEOUT;
+    };
+    auto startTurn = [&](Cluster& parent, int startsAt){
+        Turn& turn = parent.turn;
+        Cluster& child = clusters[turn.childId - 1];
+        turn.startedAt = startsAt;
+        turn.granted = parent.router.isRoot() ? PENDING_BLOCKS : PENDING_BLOCKS - parent.pending.size();
+        turn.received = 0;
+        turn.idle = false;
+        child.attachedTo = parent.router.self();
+        child.attachedAt = startsAt;
+        child.grant = turn.granted;
+    };
+
+    std::vector<DepthStats> depths(RELAY_MAX_HOPS + 1);
+    uint32_t duplicatesInjected = 0, turns = 0;
+    for(int now = 0; now < duration; now++){
+        //each clusterhead scans every SCAN_INTERVAL, hearing everyone's beacons
+        for(int i = 0; i < clusterCount; i++){
+            if(now < clusters[i].nextScan){
+                continue;
+            }
+            for(int j = 0; j < clusterCount; j++){
+                if(i != j){
+                    clusters[i].router.onBeacon(clusters[j].router.beacon(), rssi(clusters[i], clusters[j]), now);
+                }
+            }
+            clusters[i].nextScan += SCAN_INTERVAL;
+        }
+        for(Cluster& cluster : clusters){
+            cluster.router.setAttached(upstreamAttached(cluster, now));
+            cluster.router.update(now);
+        }
+
+        //seal local blocks. The oldest unsent are overwritten once the RAM log is full
+        for(Cluster& cluster : clusters){
+            while(cluster.nextSeal <= now){
+                uint8_t hops = cluster.router.hops();
+                for(uint8_t series = 0; series < seriesPerCluster; series++){
+                    Block block = { cluster.router.self(), cluster.router.epoch(), cluster.nextSequence++, series, (uint8_t) blockLength(rng), hops, cluster.nextSeal };
+                    if(cluster.router.isRoot()){
+                        continue;
+                    }
+                    if(hops <= RELAY_MAX_HOPS){
+                        depths[hops].generated++;
+                    }
+                    if(cluster.own.size() == OWN_BLOCKS){
+                        cluster.own.pop_front();
+                        cluster.lost++;
+                    }
+                    cluster.own.push_back(block);
+                }
+                cluster.nextSeal += sealInterval;
+            }
+        }
+
+        //each parent ends or renews its current turn, or connects to its next child
+        for(Cluster& parent : clusters){
+            Turn& turn = parent.turn;
+            size_t room = parent.router.isRoot() ? PENDING_BLOCKS : PENDING_BLOCKS - parent.pending.size();
+            if(turn.connected){
+                bool stillOurs = parent.router.childSlot(turn.childId) == turn.slot;
+                if(stillOurs && now < turn.startedAt + TURN && turn.received < turn.granted && !turn.idle){
+                    continue;
+                }
+                turn.connected = false;
+                if(stillOurs && parent.router.childCount() == 1){
+                    //an only child keeps the connection, and gets another grant
+                    if(room >= MIN_GRANT){
+                        startTurn(parent, now);
+                        turns++;
+                    }
+                    turn.connected = true;
+                    continue;
+                }
+            }
+            if(room < MIN_GRANT){
+                continue;
+            }
+            turn.slot = parent.router.nextChild(turn.slot);
+            if(turn.slot < 0){
+                continue;
+            }
+            turn.childId = parent.router.child(turn.slot);
+            turn.connected = true;
+            startTurn(parent, now + CONNECT_TIME);
+            turns++;
+        }
+
+        //children in their turn send up to linkRate batches, pending blocks before their own and
+        //no more than they were granted. Blocks are copied into real batches and read back out
+        //on the other side, as the firmware does
+        for(int i = 1; i < clusterCount; i++){
+            Cluster& cluster = clusters[i];
+            uint32_t parentId = cluster.router.parent();
+            if(parentId == 0){
+                continue;
+            }
+            Cluster& parent = clusters[parentId - 1];
+            Turn& turn = parent.turn;
+            if(!turn.connected || turn.childId != cluster.router.self() || now < turn.startedAt){
+                continue;
+            }
+            turn.idle = true;
+            if(!upstreamAttached(cluster, now) || now - cluster.attachedAt >= TURN_SENDING){
+                continue;
+            }
+            for(int sent = 0; sent < linkRate && cluster.grant > 0; sent++){
+                uint8_t batch[BATCH_SIZE];
+                uint8_t blockData[BLOCK_SIZE] = { 0 };
+                RelayBatchWriter writer;
+                writer.begin(batch, sizeof(batch));
+                std::vector<Block> taken;
+                size_t pendingTaken = 0, ownTaken = 0;
+                while(taken.size() < cluster.grant && pendingTaken < cluster.pending.size()){
+                    const Block& block = cluster.pending[pendingTaken];
+                    if(!writer.add(block.origin, block.epoch, block.sequence, block.series, blockData, block.length)){
+                        break;
+                    }
+                    taken.push_back(block);
+                    pendingTaken++;
+                }
+                while(taken.size() < cluster.grant && pendingTaken == cluster.pending.size() && ownTaken < cluster.own.size()){
+                    const Block& block = cluster.own[ownTaken];
+                    if(!writer.add(block.origin, block.epoch, block.sequence, block.series, blockData, block.length)){
+                        break;
+                    }
+                    taken.push_back(block);
+                    ownTaken++;
+                }
+                if(taken.empty()){
+                    break;
+                }
+                turn.idle = false;
+
+                //1 in 50 batches is sent twice, like a resend after the link dropped
+                int copies = rng() % 50 == 0 ? 2 : 1;
+                duplicatesInjected += copies - 1;
+                for(int copy = 0; copy < copies; copy++){
+                    RelayBatchReader reader;
+                    RelayEntry entry;
+                    reader.begin(batch, writer.length());
+                    size_t index = 0;
+                    while(reader.next(entry)){
+                        const Block& original = taken[index++];
+                        turn.received++;
+                        if(parent.router.seen(entry.origin, entry.epoch, entry.sequence)){
+                            continue;
+                        }
+                        if(parent.router.isRoot()){
+                            if(original.depth <= RELAY_MAX_HOPS){
+                                DepthStats& stats = depths[original.depth];
+                                double latency = now - original.createdAt;
+                                stats.delivered++;
+                                stats.latencySum += latency;
+                                if(latency > stats.latencyMax){
+                                    stats.latencyMax = latency;
+                                }
+                            }
+                            continue;
+                        }
+                        if(parent.pending.size() == PENDING_BLOCKS){
+                            parent.pending.pop_front();
+                            parent.dropped++;
+                        }
+                        parent.pending.push_back(original);
+                    }
+                }
+                cluster.pending.erase(cluster.pending.begin(), cluster.pending.begin() + pendingTaken);
+                cluster.own.erase(cluster.own.begin(), cluster.own.begin() + ownTaken);
+                cluster.grant -= taken.size();
+            }
+        }
+    }
+
+    uint32_t dropped = 0, lost = 0, unrouted = 0, unattached = 0, generated = 0, delivered = 0;
+    uint32_t duplicatesCaught = clusters[0].router.duplicates();
+    for(int i = 1; i < clusterCount; i++){
+        dropped += clusters[i].dropped;
+        lost += clusters[i].lost;
+        duplicatesCaught += clusters[i].router.duplicates();
+        uint8_t hops = clusters[i].router.hops();
+        if(hops > RELAY_MAX_HOPS){
+            unrouted++;
+        }
+        else if(!upstreamAttached(clusters[i], duration)){
+            unattached++;
+        }
+        else{
+            depths[hops].clusters++;
+        }
+    }
+    for(const DepthStats& stats : depths){
+        generated += stats.generated;
+        delivered += stats.delivered;
+    }
+    fprintf(stderr, "%d clusters, %u without a route at the end, %u waiting to be attached, %u turns\n",
+        clusterCount, unrouted, unattached, turns);
+    fprintf(stderr, "%u blocks sealed, %u delivered (%.1f%%), %u overwritten at their source before a turn, "
+        "%u dropped from full relay queues\n",
+        generated, delivered, generated > 0 ? 100.0 * delivered / generated : 0.0, lost, dropped);
+    fprintf(stderr, "%u batches sent twice, %u duplicate blocks caught\n", duplicatesInjected, duplicatesCaught);
+
+    printf("depth,clusters,blocks_generated,blocks_delivered,throughput_blocks_per_s,mean_latency_s,max_latency_s\n");
+    for(size_t depth = 1; depth <= RELAY_MAX_HOPS; depth++){
+        const DepthStats& stats = depths[depth];
+        if(stats.clusters == 0 && stats.generated == 0){
+            continue;
+        }
+        printf("%zu,%u,%u,%u,%.3f,%.1f,%.0f\n", depth, stats.clusters, stats.generated, stats.delivered,
+            (double) stats.delivered / duration, stats.delivered > 0 ? stats.latencySum / stats.delivered : 0.0, stats.latencyMax);
+    }
+    return 0;
+}
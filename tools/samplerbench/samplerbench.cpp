@@ -0,0 +1,100 @@
+/*
+ * samplerbench.cpp
+ * Description: replays a recorded sensor trace through the nodes' AdaptiveSampler and
+ *              prints the trade-off between readings taken and how closely they track
+ *              the signal, against fixed read delays. See README.md
+ * Author: Tom Schwenke, Edward Ingle
+ * Date: 19/10/2026
+ */
+#include "AdaptiveSampler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+//the nodes' loop() runs every ~100ms, so readings can only be taken on these ticks
+static const uint32_t LOOP_TICK_MS = 100;
+
+struct TracePoint {
+    uint32_t time;
+    int32_t value;
+};
+
+struct Result {
+    uint32_t samples;
+    double meanAbsError;       //of the last reading taken against the true signal
+    uint32_t outOfToleranceMs; //time the last reading was off by threshold or more
+};
+
+/* Steps through the trace one loop tick at a time. The "held" value is what the
+   clusterhead believes the reading is, i.e. the last one it was sent */
+static Result replay(const std::vector<TracePoint>& trace, AdaptiveSampler& sampler, int32_t threshold){
+    Result result = { 0, 0.0, 0 };
+    size_t next = 0;
+    int32_t trueValue = trace[0].value;
+    int32_t heldValue = 0;
+    uint64_t errorSum = 0;
+    uint32_t ticks = 0;
+    uint32_t start = trace[0].time;
+    uint32_t end = trace.back().time;
+
+    for(uint32_t t = start; t <= end; t += LOOP_TICK_MS){
+        while(next < trace.size() && trace[next].time <= t){
+            trueValue = trace[next++].value;
+        }
+        if(sampler.due(t - start)){
+            sampler.update(t - start, trueValue);
+            heldValue = trueValue;
+        }
+        int32_t error = abs(trueValue - heldValue);
+        errorSum += error;
+        if(error >= threshold){
+            result.outOfToleranceMs += LOOP_TICK_MS;
+        }
+        ticks++;
+    }
+    result.samples = sampler.samples();
+    result.meanAbsError = ticks > 0 ? (double) errorSum / ticks : 0.0;
+    return result;
+}
+
+int main(int argc, char** argv){
+    if(argc < 3){
+        fprintf(stderr, "usage: samplerbench <min delay ms> <change threshold> < trace\n"
+                        "trace: one \"<millis> <value>\" pair per line, in time order\n");
+        return 2;
+    }
+    uint32_t minDelay = strtoul(argv[1], NULL, 0);
+    int32_t threshold = strtol(argv[2], NULL, 0);
+    if(minDelay < LOOP_TICK_MS){
+        minDelay = LOOP_TICK_MS;
+    }
+
+    std::vector<TracePoint> trace;
+    unsigned long time;
+    long value;
+    while(scanf("%lu %ld", &time, &value) == 2){
+        trace.push_back({ (uint32_t) time, (int32_t) value });
+    }
+    if(trace.size() < 2){
+        fprintf(stderr, "samplerbench: trace needs at least two points\n");
+        return 1;
+    }
+    double hours = (trace.back().time - trace[0].time) / 3600000.0;
+
+    printf("policy,max_delay_ms,samples,samples_per_hour,mean_abs_error,out_of_tolerance_ms\n");
+    //fixed delays are the min == max case of the same controller
+    for(uint32_t delay = minDelay; delay <= minDelay * 128; delay *= 2){
+        AdaptiveSampler fixed(delay, delay, threshold);
+        Result r = replay(trace, fixed, threshold);
+        printf("fixed,%lu,%lu,%.1f,%.3f,%lu\n", (unsigned long) delay, (unsigned long) r.samples,
+            hours > 0 ? r.samples / hours : 0.0, r.meanAbsError, (unsigned long) r.outOfToleranceMs);
+    }
+    for(uint32_t maxDelay = minDelay * 2; maxDelay <= minDelay * 128; maxDelay *= 2){
+        AdaptiveSampler adaptive(minDelay, maxDelay, threshold);
+        Result r = replay(trace, adaptive, threshold);
+        printf("adaptive,%lu,%lu,%.1f,%.3f,%lu\n", (unsigned long) maxDelay, (unsigned long) r.samples,
+            hours > 0 ? r.samples / hours : 0.0, r.meanAbsError, (unsigned long) r.outOfToleranceMs);
+    }
+    return 0;
+}